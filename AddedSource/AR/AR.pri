@@ -2,6 +2,7 @@ CONFIG += c++11
 
 SOURCES += \
     $$PWD/Camera.cpp \
+    $$PWD/ImageBufferPool.cpp \
     $$PWD/ImageProcessing.cpp \
     $$PWD/CalibrationFrame.cpp \
     $$PWD/CameraCalibrator.cpp \
@@ -9,43 +10,58 @@ SOURCES += \
     $$PWD/faster_corner_10.cxx \
     $$PWD/OpticalFlow.cpp \
     $$PWD/OpticalFlowCalculator.cpp \
+    $$PWD/OpticalFlowBatch.cpp \
     $$PWD/FeatureDetector.cpp \
     $$PWD/KeyFrame.cpp \
+    $$PWD/KeyFramesIndex.cpp \
     $$PWD/MapPoint.cpp \
     $$PWD/Map.cpp \
     $$PWD/Feature.cpp \
     $$PWD/FastCorner.cpp \
     $$PWD/MapProjector.cpp \
+    $$PWD/WarpedPatchCache.cpp \
     $$PWD/ARSystem.cpp \
     $$PWD/Frame.cpp \
     $$PWD/PreviewFrame.cpp \
     $$PWD/MapInitializer.cpp \
+    $$PWD/Ransac.cpp \
     $$PWD/PerformanceMonitor.cpp \
     $$PWD/LocationOptimizer.cpp \
     $$PWD/Tracker.cpp \
+    $$PWD/ThreadPool.cpp \
     $$PWD/MapPointsDetector.cpp \
+    $$PWD/LocalBundleAdjustment.cpp \
     $$PWD/MapResourceObject.cpp \
     $$PWD/MapResourcesManager.cpp \
-    $$PWD/MapResourceLocker.cpp
+    $$PWD/MapResourceLocker.cpp \
+    $$PWD/MappedFile.cpp \
+    $$PWD/RelocalizationIndex.cpp \
+    $$PWD/PatchComparison.cpp \
+    $$PWD/PatchJacobian.cpp
 
 HEADERS += \
     $$PWD/Camera.h \
     $$PWD/Image.h \
+    $$PWD/ImageBufferPool.h \
     $$PWD/ImageProcessing.h \
     $$PWD/CalibrationFrame.h \
     $$PWD/CameraCalibrator.h \
     $$PWD/CalibrationCorner.h \
     $$PWD/OpticalFlow.h \
     $$PWD/OpticalFlowCalculator.h \
+    $$PWD/OpticalFlowBatch.h \
     $$PWD/FeatureDetector.h \
     $$PWD/Point2.h \
     $$PWD/Painter.h \
     $$PWD/KeyFrame.h \
+    $$PWD/KeyFramesIndex.h \
     $$PWD/MapPoint.h \
     $$PWD/Map.h \
+    $$PWD/SlabPool.h \
     $$PWD/Feature.h \
     $$PWD/FastCorner.h \
     $$PWD/MapProjector.h \
+    $$PWD/WarpedPatchCache.h \
     $$PWD/TukeyRobustCost.h \
     $$PWD/ARSystem.h \
     $$PWD/Frame.h \
@@ -55,13 +71,20 @@ HEADERS += \
     $$PWD/Camera.h \
     $$PWD/Image.h \
     $$PWD/MapInitializer.h \
-    $$PWD/ZMSSD.h \
+    $$PWD/Ransac.h \
+    $$PWD/PatchComparison.h \
+    $$PWD/PatchJacobian.h \
     $$PWD/PerformanceMonitor.h \
     $$PWD/LocationOptimizer.h \
     $$PWD/Tracker.h \
+    $$PWD/ThreadPool.h \
     $$PWD/Configurations.h \
     $$PWD/MapPointsDetector.h \
+    $$PWD/LocalBundleAdjustment.h \
     $$PWD/MapResourceObject.h \
     $$PWD/MapResourcesManager.h \
-    $$PWD/MapResourceLocker.h
+    $$PWD/MapResourceLocker.h \
+    $$PWD/SpscRingBuffer.h \
+    $$PWD/MappedFile.h \
+    $$PWD/RelocalizationIndex.h
 
@@ -3,7 +3,6 @@
 #include "MapResourceLocker.h"
 #include "ImageProcessing.h"
 #include "TMath/TTools.h"
-#include "ZMSSD.h"
 #include <algorithm>
 #include <iostream>
 
@@ -11,12 +10,14 @@ namespace AR {
 
 ARSystem::ARSystem():
     m_map(3, 32),
-    m_candidatesDetector(&m_map)
+    m_candidatesDetector(&m_map),
+    m_localBundleAdjustment(&m_map)
 {
     using namespace TMath;
 
     std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
 
+    m_map.addListener(&m_relocalizationIndex);
     m_mapProjector.setMap(&m_map);
     m_mapProjector.setMapResourceManager((&m_mapResourceManager));
     m_mapProjector.setMapPointsDetector(&m_candidatesDetector);
@@ -34,19 +35,38 @@ ARSystem::ARSystem():
     m_trackingState = TrackingState::Undefining;
     m_trackingQuality = TrackingQuality::Ugly;
     m_cameraParameters = Camera::defaultCameraParameters;
-    //m_candidatesDetector.startThread();
     m_currentImagePyramid.resize(m_map.countImageLevels());
     m_lastFrame = new PreviewFrame(m_camera, m_currentImagePyramid, TMatrixd::Identity(3), TVectord::create(0.0, 0.0, 0.0));
     m_performanceMonitor = std::shared_ptr<PerformanceMonitor>(new PerformanceMonitor());
+    m_stages.imagePyramid = m_performanceMonitor->registerStage("Creation of image pyramid");
+    m_stages.cameraMotion = m_performanceMonitor->registerStage("Calculating motion of camera");
+    m_stages.searchMapPoints = m_performanceMonitor->registerStage("Search of map points");
+    m_stages.cameraLocation = m_performanceMonitor->registerStage("Rectification of camera location");
+    m_stages.mapPointsPositions = m_performanceMonitor->registerStage("Rectification of positions of map points");
+    m_stages.trackingInitialization = m_performanceMonitor->registerStage("Tracking points and initialization");
+    m_stages.nearestImage = m_performanceMonitor->registerStage("Find nearest image");
+    m_candidatesDetector.setPerformanceMonitor(m_performanceMonitor.get());
+    m_localBundleAdjustment.setPerformanceMonitor(m_performanceMonitor.get());
+    m_mapProjector.setPerformanceMonitor(m_performanceMonitor.get());
+    m_trackingThread = nullptr;
+    m_trackingThreadIsRunning = false;
+    m_pipelineCountImageLevels = m_map.countImageLevels();
+    m_hasPendingFrame = false;
+    m_countDroppedFrames = 0;
+    _publishOutput(*m_lastFrame);
 }
 
 ARSystem::~ARSystem()
 {
+    setPipelinedProcessing(false);
     m_candidatesDetector.stopThread();
+    m_localBundleAdjustment.stopThread();
     {
         std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
         delete m_lastFrame;
     }
+    m_map.removeListener(&m_relocalizationIndex);
+    m_mapProjector.setMap(nullptr);
 }
 
 InitConfiguration ARSystem::initConfiguration() const
@@ -88,19 +108,33 @@ TrackingConfiguration ARSystem::trackingConfiguration() const
     configuration.preferredNumberTrackingPoints = m_preferredNumberTrackingPoints;
     configuration.maxCountKeyFrames = m_maxCountKeyFrames;
     configuration.featureMaxNumberIterations = m_mapProjector.maxNumberIterations();
+    configuration.warpedPatchMaxDrift = m_mapProjector.warpedPatchMaxDrift();
+    configuration.featureCountThreads = m_mapProjector.countThreads();
+    configuration.localBundleAdjustment = m_localBundleAdjustment.threadIsRunning();
+    configuration.localBundleAdjustment_countKeyFrames = m_localBundleAdjustment.countKeyFrames();
+    configuration.localBundleAdjustment_numberIterations = m_localBundleAdjustment.numberIterations();
     configuration.tracker_eps = m_trackerTransform.eps();
     configuration.tracker_numberIterations = m_trackerTransform.numberIterations();
     configuration.tracker_minImageLevel = m_trackerTransform.minLevel();
     configuration.tracker_maxImageLevel = m_trackerTransform.maxLevel();
     configuration.tracker_cursorSize = m_trackerTransform.cursorSize();
+    configuration.tracker_countThreads = m_trackerTransform.countThreads();
+    configuration.tracker_doublePrecision = m_trackerTransform.doublePrecision();
+    configuration.pipelinedProcessing = pipelinedProcessing();
 
     return configuration;
 }
 
 void ARSystem::setTrackingConfiguration(const TrackingConfiguration & configuration)
 {
+    setPipelinedProcessing(configuration.pipelinedProcessing);
+
     std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
 \
+    {
+        std::lock_guard<std::mutex> lockPipeline(m_pipelineMutex); (void)lockPipeline;
+        m_pipelineCountImageLevels = configuration.countImageLevels;
+    }
     m_currentImagePyramid.resize(configuration.countImageLevels);
     m_candidatesDetector.setCountImageLevels(configuration.countImageLevels);
     m_map.setCountImageLevels(&m_mapResourceManager, configuration.countImageLevels);
@@ -125,10 +159,20 @@ void ARSystem::setTrackingConfiguration(const TrackingConfiguration & configurat
     m_preferredNumberTrackingPoints = configuration.preferredNumberTrackingPoints;
     m_maxCountKeyFrames = configuration.maxCountKeyFrames;
     m_mapProjector.setMaxNumberIterations(configuration.featureMaxNumberIterations);
+    m_mapProjector.setWarpedPatchMaxDrift(configuration.warpedPatchMaxDrift);
+    m_mapProjector.setCountThreads(configuration.featureCountThreads);
+    m_localBundleAdjustment.setCountKeyFrames(configuration.localBundleAdjustment_countKeyFrames);
+    m_localBundleAdjustment.setNumberIterations(configuration.localBundleAdjustment_numberIterations);
+    if (configuration.localBundleAdjustment)
+        m_localBundleAdjustment.startThread();
+    else
+        m_localBundleAdjustment.stopThread();
     m_trackerTransform.setEps(configuration.tracker_eps);
     m_trackerTransform.setNumberIterations(configuration.tracker_numberIterations);
     m_trackerTransform.setMinMaxLevel(configuration.tracker_minImageLevel, configuration.tracker_maxImageLevel);
     m_trackerTransform.setCursorSize(configuration.tracker_cursorSize);
+    m_trackerTransform.setCountThreads(configuration.tracker_countThreads);
+    m_trackerTransform.setDoublePrecision(configuration.tracker_doublePrecision);
 }
 
 MapPointsDetectorConfiguration ARSystem::candidatesDetectorConfiguration() const
@@ -141,6 +185,15 @@ void ARSystem::setMapPointsDetectorConfiguration(const MapPointsDetectorConfigur
 {
     std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
     m_candidatesDetector.setConfiguration(configuration);
+    if (configuration.asynchronous)
+        m_candidatesDetector.startThread();
+    else
+        m_candidatesDetector.stopThread();
+}
+
+const MapPointsDetector * ARSystem::mapPointsDetector() const
+{
+    return &m_candidatesDetector;
 }
 
 ConstImage<uchar> ARSystem::lastImage() const
@@ -156,14 +209,14 @@ const std::vector<PreviewFrame::PreviewFeature> & ARSystem::currentFeatures() co
 
 TrackingState ARSystem::trackingState() const
 {
-    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
-    return m_trackingState;
+    std::lock_guard<std::mutex> lock(m_outputMutex); (void)lock;
+    return m_outputTrackingState;
 }
 
 TrackingQuality ARSystem::trackingQuality() const
 {
-    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
-    return m_trackingQuality;
+    std::lock_guard<std::mutex> lock(m_outputMutex); (void)lock;
+    return m_outputTrackingQuality;
 }
 
 TMath::TVectord ARSystem::cameraParameters() const
@@ -230,24 +283,24 @@ void ARSystem::setMaxCountKeyFrames(int count)
 
 TMath::TMatrixd ARSystem::currentRotation() const
 {
-    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
-    return m_lastFrame->rotation();
+    std::lock_guard<std::mutex> lock(m_outputMutex); (void)lock;
+    return m_outputRotation;
 }
 
 TMath::TVectord ARSystem::currentTranslation() const
 {
-    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
-    return m_lastFrame->translation();
+    std::lock_guard<std::mutex> lock(m_outputMutex); (void)lock;
+    return m_outputTranslation;
 }
 
 TMath::TMatrixd ARSystem::currentTransform() const
 {
-    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    std::lock_guard<std::mutex> lock(m_outputMutex); (void)lock;
 
     TMath::TMatrixd result(4, 4);
     result.setToIdentity();
-    result.fill(0, 0, m_lastFrame->rotation());
-    result.setColumn(3, m_lastFrame->translation());
+    result.fill(0, 0, m_outputRotation);
+    result.setColumn(3, m_outputTranslation);
     return result;
 }
 
@@ -265,11 +318,41 @@ void ARSystem::_reset()
     m_trackingQuality = TrackingQuality::Ugly;
 }
 
+bool ARSystem::saveMap(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    m_map.lock();
+    bool result = m_map.save(&m_mapResourceManager, path);
+    m_map.unlock();
+    return result;
+}
+
+bool ARSystem::loadMap(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    m_map.lock();
+    bool result = m_map.load(&m_mapResourceManager, path);
+    m_map.unlock();
+    if (!result)
+        return false;
+    m_initializer.reset();
+    if (m_map.countKeyFrames() > 0) {
+        m_trackingState = TrackingState::LostTracking;
+        m_trackingQuality = TrackingQuality::Ugly;
+    } else {
+        m_trackingState = TrackingState::Undefining;
+        m_trackingQuality = TrackingQuality::Ugly;
+    }
+    _publishOutput(*m_lastFrame);
+    return true;
+}
+
 void ARSystem::reset()
 {
     std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
 
     _reset();
+    _publishOutput(*m_lastFrame);
 }
 
 void ARSystem::nextTrackingState()
@@ -282,7 +365,7 @@ void ARSystem::nextTrackingState()
     case TrackingState::CaptureFirstFrame:
         break;
     case TrackingState::CaptureSecondFrame: {
-        m_initializer.setSecondFrame(m_camera, m_blackWhiteFrame);
+        m_initializer.setSecondFrame(m_camera, m_currentImagePyramid[0]);
         MapInitializer::InitializationResult initializationResult = m_initializer.compute(&m_map, &m_mapResourceManager, true);
         switch (initializationResult) {
             case MapInitializer::InitializationResult::Success:
@@ -304,53 +387,152 @@ void ARSystem::nextTrackingState()
         _reset();
         break;
     }
+    _publishOutput(*m_lastFrame);
 }
 
 void ARSystem::process(const ImageRef<Rgba> & frame)
 {
+    {
+        std::unique_lock<std::mutex> lockPipeline(m_pipelineMutex);
+        if (m_trackingThreadIsRunning) {
+            // m_preparedImagePyramid is used only by the thread that calls process()
+            m_preparedImagePyramid.resize(m_pipelineCountImageLevels);
+            lockPipeline.unlock();
+            ImageProcessing::buildImagePyramid(m_preparedImagePyramid, frame);
+            lockPipeline.lock();
+            if (m_hasPendingFrame)
+                ++m_countDroppedFrames;
+            std::swap(m_preparedImagePyramid, m_pendingImagePyramid);
+            m_hasPendingFrame = true;
+            m_pipeline_condition.notify_one();
+            return;
+        }
+    }
+
     std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
 
     m_performanceMonitor->start();
 
+    m_performanceMonitor->startTimer(m_stages.imagePyramid);
+    ImageProcessing::buildImagePyramid(m_currentImagePyramid, frame);
+    m_performanceMonitor->endTimer(m_stages.imagePyramid);
+
+    _processCurrentFrame();
+
+    m_performanceMonitor->end();
+}
+
+bool ARSystem::pipelinedProcessing() const
+{
+    std::lock_guard<std::mutex> lockPipeline(m_pipelineMutex); (void)lockPipeline;
+    return m_trackingThreadIsRunning;
+}
+
+void ARSystem::setPipelinedProcessing(bool enabled)
+{
+    std::thread * trackingThread = nullptr;
+    {
+        std::lock_guard<std::mutex> lockPipeline(m_pipelineMutex); (void)lockPipeline;
+        if (m_trackingThreadIsRunning == enabled)
+            return;
+        m_trackingThreadIsRunning = enabled;
+        m_hasPendingFrame = false;
+        if (enabled) {
+            m_trackingThread = new std::thread(&ARSystem::_trackingLoop, this);
+            return;
+        }
+        trackingThread = m_trackingThread;
+        m_trackingThread = nullptr;
+    }
+    m_pipeline_condition.notify_one();
+    if (trackingThread != nullptr) {
+        trackingThread->join();
+        delete trackingThread;
+    }
+}
+
+std::size_t ARSystem::countDroppedFrames() const
+{
+    std::lock_guard<std::mutex> lockPipeline(m_pipelineMutex); (void)lockPipeline;
+    return m_countDroppedFrames;
+}
+
+void ARSystem::_trackingLoop()
+{
+    m_performanceMonitor->setThreadName("Tracking");
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lockPipeline(m_pipelineMutex);
+            while (!m_hasPendingFrame && m_trackingThreadIsRunning)
+                m_pipeline_condition.wait(lockPipeline);
+            if (!m_trackingThreadIsRunning)
+                break;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+        {
+            std::lock_guard<std::mutex> lockPipeline(m_pipelineMutex); (void)lockPipeline;
+            if (!m_hasPendingFrame)
+                continue;
+            std::swap(m_currentImagePyramid, m_pendingImagePyramid);
+            m_hasPendingFrame = false;
+        }
+        if ((int)m_currentImagePyramid.size() != m_map.countImageLevels()) {
+            // the configuration was changed after the creation of the image pyramid
+            m_currentImagePyramid.resize(m_map.countImageLevels());
+            continue;
+        }
+        m_performanceMonitor->start();
+        _processCurrentFrame();
+        m_performanceMonitor->end();
+    }
+}
+
+void ARSystem::_publishOutput(const Frame & frame)
+{
+    std::lock_guard<std::mutex> lock(m_outputMutex); (void)lock;
+    m_outputRotation = frame.rotation();
+    m_outputTranslation = frame.translation();
+    m_outputTrackingState = m_trackingState;
+    m_outputTrackingQuality = m_trackingQuality;
+}
+
+void ARSystem::_processCurrentFrame()
+{
     m_map.lock();
 
-    if (m_camera->imageSize() != frame.size().cast<double>()) {
+    Point2i frameSize = m_currentImagePyramid[0].size();
+    if (m_camera->imageSize() != frameSize.cast<double>()) {
         Camera * camera = new Camera();
-        camera->setImageSize(frame.size());
+        camera->setImageSize(frameSize);
         camera->setCameraParameters(m_cameraParameters);
         m_camera = std::shared_ptr<Camera>(camera);
     }
 
     bool needNewFrame = false;
 
-    m_performanceMonitor->startTimer("Creation of image pyramid");
-    _converToBlackWhiteFrame(frame);
-    _buildCurrentImagePyramid();
-    m_performanceMonitor->endTimer("Creation of image pyramid");
-
     PreviewFrame newFrame(m_camera, m_currentImagePyramid,
                           m_lastFrame->rotation(), m_lastFrame->translation());
 
     switch (m_trackingState) {
     case TrackingState::Tracking: {
 
-        m_performanceMonitor->startTimer("Calculating motion of camera");
+        m_performanceMonitor->startTimer(m_stages.cameraMotion);
         m_trackerTransform.setFirstFrame(*m_lastFrame);
         m_trackerTransform.setSecondFrame(newFrame);
         m_trackerTransform.tracking();
         newFrame.setRotation(m_trackerTransform.secondRotation());
         newFrame.setTranslation(m_trackerTransform.secondTranslation());
-        m_performanceMonitor->endTimer("Calculating motion of camera");
+        m_performanceMonitor->endTimer(m_stages.cameraMotion);
 
         needNewFrame = true;
 
-        m_performanceMonitor->startTimer("Search of map points");
+        m_performanceMonitor->startTimer(m_stages.searchMapPoints);
         m_mapProjector.projectMapPoints(newFrame, *m_lastFrame);
-        m_performanceMonitor->endTimer("Search of map points");
+        m_performanceMonitor->endTimer(m_stages.searchMapPoints);
 
-        m_performanceMonitor->startTimer("Rectification of camera location");
+        m_performanceMonitor->startTimer(m_stages.cameraLocation);
         m_locationOptimizer.optimize(newFrame);
-        m_performanceMonitor->endTimer("Rectification of camera location");
+        m_performanceMonitor->endTimer(m_stages.cameraLocation);
 
         if (m_mapProjector.existCloseKeyFrame(newFrame, m_toleranceOfCreatingFrames)) {
             needNewFrame = false;
@@ -370,38 +552,42 @@ void ARSystem::process(const ImageRef<Rgba> & frame)
         } else {
             m_trackingQuality = TrackingQuality::Good;
         }
+        _publishOutput(newFrame);
         {
-            m_performanceMonitor->startTimer("Rectification of positions of map points");
+            m_performanceMonitor->startTimer(m_stages.mapPointsPositions);
             m_mapProjector.deleteFaildedMapPoints();
             m_locationOptimizer.deleteFaildedMapPoints(&m_map);
             m_map.deleteNullMapPoints(&m_mapResourceManager);
-            _optimizeMapPoints(newFrame);
+            // map points are refined by local bundle adjustment off the tracking thread if it's running
+            if (!m_localBundleAdjustment.threadIsRunning())
+                _optimizeMapPoints(newFrame);
             m_mapProjector.createNewMapPointsFromCandidates(newFrame);
-            m_performanceMonitor->endTimer("Rectification of positions of map points");
+            m_performanceMonitor->endTimer(m_stages.mapPointsPositions);
 
             if (m_trackingQuality == TrackingQuality::Good) {
                 if (needNewFrame) {
                     if ((int)m_map.countKeyFrames() > m_maxCountKeyFrames) {
-                        m_map.deleteKeyFrame(m_map.getFurthestKeyFrame(&m_mapResourceManager, newFrame.worldPosition()));
+                        m_map.deleteKeyFrame(&m_mapResourceManager, m_map.getFurthestKeyFrame(&m_mapResourceManager, newFrame.worldPosition()));
                     }
                     std::shared_ptr<KeyFrame> newKeyFrame = _createNewKeyFrame(newFrame);
                     m_candidatesDetector.addKeyFrame(newKeyFrame);
+                    m_localBundleAdjustment.addKeyFrame(newKeyFrame);
                 }
             }
         }
     } break;
     case TrackingState::CaptureSecondFrame: {
-        m_performanceMonitor->startTimer("Tracking points and initialization");
-        m_initializer.setSecondFrame(m_camera, m_blackWhiteFrame);
+        m_performanceMonitor->startTimer(m_stages.trackingInitialization);
+        m_initializer.setSecondFrame(m_camera, m_currentImagePyramid[0]);
         MapInitializer::InitializationResult initializationResult = m_initializer.compute(&m_map, &m_mapResourceManager, false);
-        m_performanceMonitor->endTimer("Tracking points and initialization");
+        m_performanceMonitor->endTimer(m_stages.trackingInitialization);
 
         switch (initializationResult) {
         case MapInitializer::InitializationResult::Success: {
             m_trackingState = TrackingState::Tracking;
             m_trackingQuality = TrackingQuality::Good;
             std::shared_ptr<KeyFrame> keyFrame = m_map.keyFrame(m_map.countKeyFrames() - 1);
-            MapResourceLocker lockerR(&m_mapResourceManager, keyFrame.get()); (void)lockerR;
+            MapResourceLocker lockerR(&m_mapResourceManager, keyFrame.get(), MapResourceAccess::Shared); (void)lockerR;
             newFrame.copy(keyFrame);
             m_initializer.reset();
         } break;
@@ -413,34 +599,22 @@ void ARSystem::process(const ImageRef<Rgba> & frame)
         }
     } break;
     case TrackingState::CaptureFirstFrame:
-        m_initializer.setFirstFrame(m_camera, m_blackWhiteFrame.copy());
+        m_initializer.setFirstFrame(m_camera, m_currentImagePyramid[0].copy());
         m_trackingState = TrackingState::CaptureSecondFrame;
         break;
     case TrackingState::LostTracking: {
         bool foundNearestKeyFrame = false;
         {
-            std::weak_ptr<KeyFrame> nearestKeyFrame;
-            int bestScore = std::numeric_limits<int>::max(), score;
-            m_performanceMonitor->startTimer("Find nearest image");
+            m_performanceMonitor->startTimer(m_stages.nearestImage);
             Image<int> targetSmallImage = m_map.getSmallImage(newFrame);
-            for (std::size_t i = 0; i < m_map.countKeyFrames(); ++i) {
-                std::shared_ptr<KeyFrame> k = m_map.keyFrame(i);
-                if (!k)
-                    continue;
-                MapResourceLocker lockerR(&m_mapResourceManager, k.get()); (void)lockerR;
-                if (!k->isDeleted()) {
-                    ConstImage<int> smallImage = k->smallImage();
-                    score = ZMSSD::compare(smallImage, Point2i(0, 0),
-                                           targetSmallImage, Point2i(0, 0),
-                                           targetSmallImage.size());
-                    if (score < bestScore) {
-                        bestScore = score;
-                        nearestKeyFrame = k;
-                    }
-                }
+            std::vector<RelocalizationIndex::Candidate> candidates = m_relocalizationIndex.find(targetSmallImage, 1);
+            m_performanceMonitor->endTimer(m_stages.nearestImage);
+            std::shared_ptr<KeyFrame> keyFrame;
+            int bestScore = std::numeric_limits<int>::max();
+            if (!candidates.empty()) {
+                keyFrame = candidates[0].keyFrame;
+                bestScore = candidates[0].score;
             }
-            m_performanceMonitor->endTimer("Find nearest image");
-            std::shared_ptr<KeyFrame> keyFrame = nearestKeyFrame.lock();
             if (keyFrame) {
                 foundNearestKeyFrame = true;
                 if (bestScore > (int)(targetSmallImage.area() * ((255 * 0.18) * (255 * 0.18)))) {
@@ -448,16 +622,16 @@ void ARSystem::process(const ImageRef<Rgba> & frame)
                 }
             }
             if (keyFrame) {
-                MapResourceLocker lockerR(&m_mapResourceManager, keyFrame.get()); (void)lockerR;
+                MapResourceLocker lockerR(&m_mapResourceManager, keyFrame.get(), MapResourceAccess::Shared); (void)lockerR;
                 newFrame.setRotation(keyFrame->rotation());
                 newFrame.setTranslation(keyFrame->translation());
-                m_performanceMonitor->startTimer("Calculating motion of camera");
+                m_performanceMonitor->startTimer(m_stages.cameraMotion);
                 m_trackerTransform.setFirstFrame(keyFrame);
                 m_trackerTransform.setSecondFrame(newFrame);
                 m_trackerTransform.tracking();
                 newFrame.setRotation(m_trackerTransform.secondRotation());
                 newFrame.setTranslation(m_trackerTransform.secondTranslation());
-                m_performanceMonitor->endTimer("Calculating motion of camera");
+                m_performanceMonitor->endTimer(m_stages.cameraMotion);
 
                 if (m_trackerTransform.countTrackedFeatures() < m_minNumberTrackingPoints) {
                     newFrame.setRotation(m_lastFrame->rotation());
@@ -465,13 +639,13 @@ void ARSystem::process(const ImageRef<Rgba> & frame)
                     break;
                 }
 
-                m_performanceMonitor->startTimer("Search of map points");
+                m_performanceMonitor->startTimer(m_stages.searchMapPoints);
                 m_mapProjector.projectMapPoints(newFrame, *m_lastFrame);
-                m_performanceMonitor->endTimer("Search of map points");
+                m_performanceMonitor->endTimer(m_stages.searchMapPoints);
 
-                m_performanceMonitor->startTimer("Rectification of camera location");
+                m_performanceMonitor->startTimer(m_stages.cameraLocation);
                 m_locationOptimizer.optimize(newFrame);
-                m_performanceMonitor->endTimer("Rectification of camera location");
+                m_performanceMonitor->endTimer(m_stages.cameraLocation);
             }
         }
         {
@@ -503,12 +677,12 @@ void ARSystem::process(const ImageRef<Rgba> & frame)
     }
 
     m_lastFrame->copy(newFrame);
+    _publishOutput(*m_lastFrame);
     if (m_trackingQuality == TrackingQuality::Good) {
         if (!needNewFrame) {
             m_candidatesDetector.addFrame(std::move(newFrame));
         }
     }
-    m_performanceMonitor->end();
 
     m_map.unlock();
 }
@@ -558,29 +732,6 @@ std::vector<std::pair<Point2f, Point2f>> ARSystem::debugTrackedMatches() const
     return result;
 }
 
-void ARSystem::_converToBlackWhiteFrame(const ImageRef<Rgba> & frame)
-{
-    if (frame.size() != m_blackWhiteFrame.size())
-        m_blackWhiteFrame = Image<uchar>(frame.size());
-    const int area = m_blackWhiteFrame.area();
-    uchar * bwPtr = m_blackWhiteFrame.data();
-    const Rgba * rgbaPtr = frame.data();
-    for (int i = 0; i < area; ++i, ++bwPtr, ++rgbaPtr)
-        *bwPtr = (rgbaPtr->red + rgbaPtr->green + rgbaPtr->blue) / 3;
-}
-
-void ARSystem::_buildCurrentImagePyramid()
-{
-    m_currentImagePyramid[0] = m_blackWhiteFrame;
-    Point2i imageSize = m_blackWhiteFrame.size();
-    for (std::size_t i = 1; i < m_currentImagePyramid.size(); ++i) {
-        imageSize /= 2;
-        if (m_currentImagePyramid[i].size() != imageSize)
-            m_currentImagePyramid[i] = Image<uchar>(imageSize);
-        ImageProcessing::halfSample(m_currentImagePyramid[i], m_currentImagePyramid[i - 1]);
-    }
-}
-
 void ARSystem::_optimizeMapPoints(PreviewFrame & frame)
 {
     std::vector<PreviewFrame::PreviewFeature> & features = frame.previewFeatures();
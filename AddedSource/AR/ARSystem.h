@@ -11,13 +11,18 @@
 #include "LocationOptimizer.h"
 #include "PreviewFrame.h"
 #include "MapPointsDetector.h"
+#include "LocalBundleAdjustment.h"
+#include "RelocalizationIndex.h"
 #include "MapResourcesManager.h"
 #include "PerformanceMonitor.h"
 #include "Configurations.h"
 #include <memory>
 #include <vector>
 #include <utility>
+#include <string>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace AR {
 
@@ -49,6 +54,7 @@ public:
 
     MapPointsDetectorConfiguration candidatesDetectorConfiguration() const;
     void setMapPointsDetectorConfiguration(const MapPointsDetectorConfiguration & configuration);
+    const MapPointsDetector * mapPointsDetector() const;
 
     TMath::TVectord cameraParameters() const;
     void setCameraParameters(const TMath::TVectord& cameraParameters);
@@ -82,11 +88,22 @@ public:
 
     void process(const ImageRef<Rgba> & frame);
 
+    // In pipelined mode process() only builds the image pyramid and passes it to the tracking thread,
+    // the pose of the frame is published before optimization of structure and creation of key frames.
+    // If the tracking thread is busy, the previous unprocessed frame is dropped.
+    bool pipelinedProcessing() const;
+    void setPipelinedProcessing(bool enabled);
+    std::size_t countDroppedFrames() const;
+
     Map * map();
     const Map * map() const;
 
     MapResourcesManager * mapResourceManager();
 
+    bool saveMap(const std::string & path);
+    // After loading the system tries to relocalize in the loaded map.
+    bool loadMap(const std::string & path);
+
     BuilderTypePoint builderTypeMapPoint() const;
 
     std::vector<std::pair<Point2f, Point2f>> debugTrackedMatches() const;
@@ -97,6 +114,22 @@ public:
 private:
     mutable std::mutex m_mutex;
 
+    mutable std::mutex m_pipelineMutex;
+    std::condition_variable m_pipeline_condition;
+    std::thread * m_trackingThread;
+    bool m_trackingThreadIsRunning;
+    int m_pipelineCountImageLevels;
+    std::vector<Image<uchar>> m_preparedImagePyramid;
+    std::vector<Image<uchar>> m_pendingImagePyramid;
+    bool m_hasPendingFrame;
+    std::size_t m_countDroppedFrames;
+
+    mutable std::mutex m_outputMutex;
+    TMath::TMatrixd m_outputRotation;
+    TMath::TVectord m_outputTranslation;
+    TrackingState m_outputTrackingState;
+    TrackingQuality m_outputTrackingQuality;
+
     TMath::TVectord m_cameraParameters;
     int m_numberPointsForSructureOptimization;
     int m_numberIterationsForStructureOptimization;
@@ -113,19 +146,31 @@ private:
     PreviewFrame * m_lastFrame;
     std::vector<Image<uchar>> m_currentImagePyramid;
     Map m_map;
+    RelocalizationIndex m_relocalizationIndex;
     MapResourcesManager m_mapResourceManager;
     MapInitializer m_initializer;
     Tracker m_trackerTransform;
     MapProjector m_mapProjector;
     LocationOptimizer m_locationOptimizer;
-    Image<uchar> m_blackWhiteFrame;
 
     MapPointsDetector m_candidatesDetector;
+    LocalBundleAdjustment m_localBundleAdjustment;
 
     std::shared_ptr<PerformanceMonitor> m_performanceMonitor;
-
-    void _converToBlackWhiteFrame(const ImageRef<Rgba> & frame);
-    void _buildCurrentImagePyramid();
+    struct PerformanceStages
+    {
+        int imagePyramid;
+        int cameraMotion;
+        int searchMapPoints;
+        int cameraLocation;
+        int mapPointsPositions;
+        int trackingInitialization;
+        int nearestImage;
+    } m_stages;
+
+    void _processCurrentFrame();
+    void _publishOutput(const Frame & frame);
+    void _trackingLoop();
     void _optimizeMapPoints(PreviewFrame & frame);
     std::shared_ptr<KeyFrame> _createNewKeyFrame(PreviewFrame & previewFrame);
     void _incSuccessScore(PreviewFrame & frame);
@@ -2,22 +2,29 @@ CONFIG += c++11
 
 SOURCES += \
     $$PWD/Camera.cpp \
+    $$PWD/ImageBufferPool.cpp \
     $$PWD/ImageProcessing.cpp \
     $$PWD/faster_corner_10.cxx \
     $$PWD/OpticalFlow.cpp \
     $$PWD/OpticalFlowCalculator.cpp \
+    $$PWD/OpticalFlowBatch.cpp \
     $$PWD/FeatureDetector.cpp \
     $$PWD/FastCorner.cpp \
     $$PWD/Frame.cpp \
     $$PWD/PerformanceMonitor.cpp \
-    $$PWD/RotationTracker.cpp
+    $$PWD/RotationTracker.cpp \
+    $$PWD/PatchComparison.cpp \
+    $$PWD/PatchJacobian.cpp \
+    $$PWD/ThreadPool.cpp
 
 HEADERS += \
     $$PWD/Camera.h \
     $$PWD/Image.h \
+    $$PWD/ImageBufferPool.h \
     $$PWD/ImageProcessing.h \
     $$PWD/OpticalFlow.h \
     $$PWD/OpticalFlowCalculator.h \
+    $$PWD/OpticalFlowBatch.h \
     $$PWD/FeatureDetector.h \
     $$PWD/Point2.h \
     $$PWD/Painter.h \
@@ -27,7 +34,9 @@ HEADERS += \
     $$PWD/ImageProcessing.h \
     $$PWD/Camera.h \
     $$PWD/Image.h \
-    $$PWD/ZMSSD.h \
+    $$PWD/PatchComparison.h \
+    $$PWD/PatchJacobian.h \
     $$PWD/PerformanceMonitor.h \
+    $$PWD/ThreadPool.h \
     $$PWD/RotationTracker.h
 
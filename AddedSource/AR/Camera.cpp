@@ -1,9 +1,31 @@
 #include "Camera.h"
 #include <TMath/TMath.h>
 #include <vector>
+#include <algorithm>
 
 namespace AR {
 
+// Count of intervals of the radial table, error of linear interpolation is proportional to the square of interval.
+static const int countRadialIntervals = 4096;
+// Errors of the undistortion map are measured in centers of every this cell in both directions.
+static const int undistortionErrorStep = 4;
+
+struct Camera::RadialTable
+{
+    double maxRadius;                  // Radii not less than this are computed by the exact path
+    double invRadiusStep;
+    std::vector<double> distortedRadii; // Distorted radii on nodes i * maxRadius / countRadialIntervals
+    double maxError;                   // In pixels
+};
+
+struct Camera::UndistortionMap
+{
+    int width;
+    int height;
+    std::vector<Point2f> points; // Points on z=1 plane of pixels of image
+    double maxError;             // In pixels (z=1 error multiplied by focal length)
+};
+
 const TMath::TVectord Camera::defaultCameraParameters = TMath::TVectord::create(1.0, 1.33, 0.5, 0.5, 0.0);
 
 Camera::Camera()
@@ -91,6 +113,10 @@ void Camera::_refreshCameraParameters()
     // and the currently selected target image size.
     //
 
+    // Lookup tables are built again at the next batched call
+    m_radialTable.store(std::shared_ptr<const RadialTable>());
+    m_undistortionMap.store(std::shared_ptr<const UndistortionMap>());
+
     // First: Focal length and image center in pixel coordinates
     m_pixelFocal.x = m_imageSize.x * m_cameraParameters(0);
     m_pixelFocal.y = m_imageSize.y * m_cameraParameters(1);
@@ -258,6 +284,166 @@ Point2d Camera::unproject(const Point2i& imagePoint) const
     return unproject(imagePoint.cast<double>());
 }
 
+void Camera::projectMany(const Point2d* camPoints, Point2d* imagePoints, std::size_t count) const
+{
+    if (m_W == 0.0) {
+        for (std::size_t i = 0; i < count; ++i) {
+            imagePoints[i].set(m_pixelCenter.x + m_pixelFocal.x * camPoints[i].x,
+                               m_pixelCenter.y + m_pixelFocal.y * camPoints[i].y);
+        }
+        return;
+    }
+    std::shared_ptr<const RadialTable> table = _radialTable();
+    const double* distortedRadii = table->distortedRadii.data();
+    for (std::size_t i = 0; i < count; ++i) {
+        const Point2d& camPoint = camPoints[i];
+        double r = camPoint.length();
+        double factor;
+        if (r < 0.001) {
+            factor = 1.0;
+        } else if (r < table->maxRadius) {
+            double t = r * table->invRadiusStep;
+            int index = (int)t;
+            double distortedRadius = distortedRadii[index] +
+                    (distortedRadii[index + 1] - distortedRadii[index]) * (t - (double)index);
+            factor = distortedRadius / r;
+        } else {
+            factor = _rtrans_factor(r);
+        }
+        imagePoints[i].set(m_pixelCenter.x + m_pixelFocal.x * (camPoint.x * factor),
+                           m_pixelCenter.y + m_pixelFocal.y * (camPoint.y * factor));
+    }
+}
+
+template <typename PointType>
+void Camera::_unprojectMany(const PointType* imagePoints, Point2d* camPoints, std::size_t count) const
+{
+    if (m_W == 0.0) {
+        for (std::size_t i = 0; i < count; ++i) {
+            camPoints[i].set(((double)imagePoints[i].x - m_pixelCenter.x) * m_invPixelFocal.x,
+                             ((double)imagePoints[i].y - m_pixelCenter.y) * m_invPixelFocal.y);
+        }
+        return;
+    }
+    std::shared_ptr<const UndistortionMap> undistortionMap = _undistortionMap();
+    const Point2f* map = undistortionMap->points.data();
+    double maxX = (double)(undistortionMap->width - 1);
+    double maxY = (double)(undistortionMap->height - 1);
+    for (std::size_t i = 0; i < count; ++i) {
+        double x = (double)imagePoints[i].x, y = (double)imagePoints[i].y;
+        if ((x >= 0.0) && (y >= 0.0) && (x < maxX) && (y < maxY)) {
+            int ix = (int)x, iy = (int)y;
+            double dx = x - (double)ix, dy = y - (double)iy;
+            const Point2f* p = &map[iy * undistortionMap->width + ix];
+            const Point2f* p_next = p + undistortionMap->width;
+            double w00 = (1.0 - dx) * (1.0 - dy), w10 = dx * (1.0 - dy), w01 = (1.0 - dx) * dy, w11 = dx * dy;
+            camPoints[i].set(w00 * p[0].x + w10 * p[1].x + w01 * p_next[0].x + w11 * p_next[1].x,
+                             w00 * p[0].y + w10 * p[1].y + w01 * p_next[0].y + w11 * p_next[1].y);
+        } else {
+            camPoints[i] = unproject(Point2d(x, y));
+        }
+    }
+}
+
+void Camera::unprojectMany(const Point2d* imagePoints, Point2d* camPoints, std::size_t count) const
+{
+    _unprojectMany(imagePoints, camPoints, count);
+}
+
+void Camera::unprojectMany(const Point2f* imagePoints, Point2d* camPoints, std::size_t count) const
+{
+    _unprojectMany(imagePoints, camPoints, count);
+}
+
+Camera::LookupTablesErrors Camera::lookupTablesErrors() const
+{
+    if (m_W == 0.0)
+        return { 0.0, 0.0 };
+    return { _radialTable()->maxError, _undistortionMap()->maxError };
+}
+
+// Tables can be built by several threads at the same time, all of them are the same
+std::shared_ptr<const Camera::RadialTable> Camera::_radialTable() const
+{
+    std::shared_ptr<const RadialTable> table = m_radialTable.load();
+    if (!table) {
+        table = _buildRadialTable();
+        m_radialTable.store(table);
+    }
+    return table;
+}
+
+std::shared_ptr<const Camera::UndistortionMap> Camera::_undistortionMap() const
+{
+    std::shared_ptr<const UndistortionMap> undistortionMap = m_undistortionMap.load();
+    if (!undistortionMap) {
+        undistortionMap = _buildUndistortionMap();
+        m_undistortionMap.store(undistortionMap);
+    }
+    return undistortionMap;
+}
+
+std::shared_ptr<const Camera::RadialTable> Camera::_buildRadialTable() const
+{
+    std::shared_ptr<RadialTable> table = std::make_shared<RadialTable>();
+    double maxFocal = std::max(std::fabs(m_pixelFocal.x), std::fabs(m_pixelFocal.y));
+
+    table->maxRadius = m_maxRadius;
+    double radiusStep = m_maxRadius / (double)countRadialIntervals;
+    table->invRadiusStep = 1.0 / radiusStep;
+    table->distortedRadii.resize(countRadialIntervals + 1);
+    for (int i = 0; i <= countRadialIntervals; ++i) {
+        double r = i * radiusStep;
+        table->distortedRadii[i] = r * _rtrans_factor(r);
+    }
+    auto error = [&] (int i, double r) {
+        double t = r * table->invRadiusStep - (double)i;
+        double distortedRadius = table->distortedRadii[i] + (table->distortedRadii[i + 1] - table->distortedRadii[i]) * t;
+        return std::fabs(distortedRadius - r * _rtrans_factor(r));
+    };
+    double maxProjectionError = 0.0;
+    for (int i = 0; i < countRadialIntervals; ++i) {
+        // radii less than 0.001 aren't distorted by projectMany() as by the exact path
+        double r = (i + 0.5) * radiusStep;
+        if (r >= 0.001)
+            maxProjectionError = std::max(maxProjectionError, error(i, r));
+        // the factor of the exact path jumps at 0.001, so interpolation over it has the largest error at 0.001
+        if ((i * radiusStep < 0.001) && ((i + 1) * radiusStep > 0.001))
+            maxProjectionError = std::max(maxProjectionError, error(i, 0.001));
+    }
+    table->maxError = maxProjectionError * maxFocal;
+    return table;
+}
+
+std::shared_ptr<const Camera::UndistortionMap> Camera::_buildUndistortionMap() const
+{
+    std::shared_ptr<UndistortionMap> undistortionMap = std::make_shared<UndistortionMap>();
+    double maxFocal = std::max(std::fabs(m_pixelFocal.x), std::fabs(m_pixelFocal.y));
+
+    undistortionMap->width = std::max((int)m_imageSize.x, 0);
+    undistortionMap->height = std::max((int)m_imageSize.y, 0);
+    undistortionMap->points.resize(undistortionMap->width * undistortionMap->height);
+    Point2f* map = undistortionMap->points.data();
+    for (int y = 0; y < undistortionMap->height; ++y) {
+        for (int x = 0; x < undistortionMap->width; ++x, ++map)
+            *map = unproject(Point2d(x, y)).cast<float>();
+    }
+    double maxUnprojectionError = 0.0;
+    map = undistortionMap->points.data();
+    for (int y = 0; y < (undistortionMap->height - 1); y += undistortionErrorStep) {
+        for (int x = 0; x < (undistortionMap->width - 1); x += undistortionErrorStep) {
+            const Point2f* p = &map[y * undistortionMap->width + x];
+            const Point2f* p_next = p + undistortionMap->width;
+            Point2d interpolated(0.25 * ((double)p[0].x + p[1].x + p_next[0].x + p_next[1].x),
+                                 0.25 * ((double)p[0].y + p[1].y + p_next[0].y + p_next[1].y));
+            maxUnprojectionError = std::max(maxUnprojectionError,
+                                            (interpolated - unproject(Point2d(x + 0.5, y + 0.5))).length());
+        }
+    }
+    undistortionMap->maxError = maxUnprojectionError * maxFocal;
+    return undistortionMap;
+}
+
 Point2d Camera::distort(const Point2d& point) const
 {
     return point * _rtrans_factor(point.length());
@@ -6,6 +6,8 @@
 #include "TMath/TMatrix.h"
 
 #include <cmath>
+#include <memory>
+#include <cstddef>
 
 namespace AR {
 
@@ -15,6 +17,18 @@ namespace AR {
 // 2 - normalized x offset
 // 3 - normalized y offset
 // 4 - w (distortion parameter)
+//
+// projectMany() and unprojectMany() are batched versions of project() and unproject() on lookup tables:
+// the radial table of distorted radii (on [0, 1.5 * largest radius]) with linear interpolation and the undistortion
+// map of pixels of the current image size with bilinear interpolation. Tables are built at the first call of batched
+// functions after setCameraParameters()/setImageSize(), each table only by the function which uses it (the undistortion
+// map takes several megabytes and milliseconds), points outside of tables are computed by the exact path.
+// Errors of tables versus the exact path are measured when tables are built and are returned by lookupTablesErrors().
+// Errors of the radial table are measured in middles of intervals and at radius 0.001, where the exact path has a jump
+// of the distortion factor, so the bound includes errors of interpolation over the center (about 0.01 pixel).
+// Errors of the undistortion map are measured in centers of every 4th cell in both directions, so errors of other
+// cells (near the jump of the factor in the center of image) can be larger than the bound.
+// unprojectMany() isn't faster than unproject() at usual image sizes, so the tracker uses the exact path.
 
 class Camera
 {
@@ -29,6 +43,11 @@ public:
         bool invalid;
     };
 
+    struct LookupTablesErrors {
+        double projection;   // Max error of projectMany() in pixels
+        double unprojection; // Max error of unprojectMany() in pixels (z=1 error multiplied by focal length)
+    };
+
 public:
     Camera();
     Camera(const TMath::TVectord& cameraParameters, const Point2d& imageSize);
@@ -60,6 +79,12 @@ public:
     Point2d unproject(const Point2f& imagePoint, ProjectionInfo& projectionInfo) const;
     Point2d unproject(const Point2i& imagePoint, ProjectionInfo& projectionInfo) const;
 
+    // Batched projection functions on lookup tables, arrays must not overlap.
+    void projectMany(const Point2d* camPoints, Point2d* imagePoints, std::size_t count) const;
+    void unprojectMany(const Point2d* imagePoints, Point2d* camPoints, std::size_t count) const;
+    void unprojectMany(const Point2f* imagePoints, Point2d* camPoints, std::size_t count) const;
+    LookupTablesErrors lookupTablesErrors() const;
+
     Point2d distort(const Point2d& point) const;
     Point2d undistort(const Point2d& point) const;
 
@@ -106,7 +131,36 @@ private:
     Point2d m_implaneTopLeft;
     Point2d m_implaneBottomRight;
 
+    struct RadialTable;
+    struct UndistortionMap;
+
+    // Pointer to a table which is copied and changed atomically, tables are shared by copies of camera.
+    template <typename Table>
+    class TablePtr
+    {
+    public:
+        TablePtr() {}
+        TablePtr(const TablePtr& other): m_table(other.load()) {}
+        TablePtr& operator = (const TablePtr& other) { store(other.load()); return *this; }
+
+        std::shared_ptr<const Table> load() const { return std::atomic_load(&m_table); }
+        void store(const std::shared_ptr<const Table>& table) const { std::atomic_store(&m_table, table); }
+
+    private:
+        mutable std::shared_ptr<const Table> m_table;
+    };
+
+    // Tables of current parameters, they are built at the first use
+    TablePtr<RadialTable> m_radialTable;
+    TablePtr<UndistortionMap> m_undistortionMap;
+
     void _refreshCameraParameters();
+    std::shared_ptr<const RadialTable> _radialTable() const;
+    std::shared_ptr<const UndistortionMap> _undistortionMap() const;
+    std::shared_ptr<const RadialTable> _buildRadialTable() const;
+    std::shared_ptr<const UndistortionMap> _buildUndistortionMap() const;
+    template <typename PointType>
+    void _unprojectMany(const PointType* imagePoints, Point2d* camPoints, std::size_t count) const;
 
 protected:
 
@@ -24,6 +24,9 @@ struct InitConfiguration
     Point2i featureCursorSize;
     float pixelEps;
     int maxNumberIterationsForOpticalFlow;
+    int featureCountThreads;
+    double ransacConfidence;
+    int ransacCountThreads;
 
     InitConfiguration()
     {
@@ -44,6 +47,9 @@ struct InitConfiguration
         featureCursorSize = Point2i(10, 10);
         pixelEps = 1e-3f;
         maxNumberIterationsForOpticalFlow = 20;
+        featureCountThreads = 1;
+        ransacConfidence = 0.99;
+        ransacCountThreads = 1;
     }
 };
 
@@ -70,11 +76,25 @@ struct TrackingConfiguration
     int sizeOfSmallImage;
     int maxCountKeyFrames;
     int featureMaxNumberIterations;
+    // Max moving of corners of patches warped from key frames at which patches of previous frames are used again
+    // (in pixels of key frames), if it's negative then patches are warped on every frame.
+    float warpedPatchMaxDrift;
+    // Count of threads of matching of map points on cells of frameGridSize (0 - all hardware threads).
+    int featureCountThreads;
+    // Poses of key frames and positions of map points are refined by local bundle adjustment in own thread,
+    // per-frame optimization of map points in the tracking thread is skipped then.
+    bool localBundleAdjustment;
+    // Count of key frames of the window: the new key frame and the most covisible key frames.
+    int localBundleAdjustment_countKeyFrames;
+    int localBundleAdjustment_numberIterations;
     double tracker_eps;
     int tracker_numberIterations;
     int tracker_minImageLevel;
     int tracker_maxImageLevel;
     Point2i tracker_cursorSize;
+    int tracker_countThreads;
+    bool tracker_doublePrecision;
+    bool pipelinedProcessing;
 
     TrackingConfiguration()
     {
@@ -88,6 +108,11 @@ struct TrackingConfiguration
         frameGridSize = Point2i(7, 7);
         featureCursorSize = Point2i(2, 2);
         featureMaxNumberIterations = 4;
+        warpedPatchMaxDrift = 0.05f;
+        featureCountThreads = 1;
+        localBundleAdjustment = false;
+        localBundleAdjustment_countKeyFrames = 5;
+        localBundleAdjustment_numberIterations = 10;
         pixelEps = 1e-2f;
         locationEps = 3e-5;
         locationMaxPixelError = 4.0;
@@ -104,6 +129,9 @@ struct TrackingConfiguration
         tracker_minImageLevel = 1;
         tracker_maxImageLevel = -1;
         tracker_cursorSize = Point2i(2, 2);
+        tracker_countThreads = 1;
+        tracker_doublePrecision = false;
+        pipelinedProcessing = false;
     }
 };
 
@@ -122,6 +150,9 @@ struct MapPointsDetectorConfiguration
     float pixelEps;
     int maxNumberIterationsForOpticalFlow;
     int maxCountCandidatePoints;
+    bool asynchronous;
+    bool dropOldestFrames;
+    int countThreads; // threads of epipolar search of seeds, 0 - all hardware threads
 
     MapPointsDetectorConfiguration()
     {
@@ -138,6 +169,9 @@ struct MapPointsDetectorConfiguration
         pixelEps = 1e-2f;
         maxNumberIterationsForOpticalFlow = 20;
         maxCountCandidatePoints = 40;
+        asynchronous = false;
+        dropOldestFrames = true;
+        countThreads = 1;
     }
 };
 
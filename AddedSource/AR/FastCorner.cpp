@@ -1,9 +1,19 @@
 #include "FastCorner.h"
+#include "ImageProcessing.h"
 #include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AR_FASTCORNER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AR_FASTCORNER_NEON
+#include <arm_neon.h>
+#endif
 
 namespace AR {
 
-int FastCorner::_fast_pixel_ring[16];
+thread_local int FastCorner::_fast_pixel_ring[16];
 
 void FastCorner::_make_fast_pixel_offset(int row_stride)
 {
@@ -25,7 +35,15 @@ void FastCorner::_make_fast_pixel_offset(int row_stride)
     _fast_pixel_ring[15] = -1 + row_stride * 3;
 }
 
-float FastCorner::shiTomasiScore_10(const ImageRef<unsigned char>& im, const Point2i& pos)
+// Sums of Shi-Tomasi score are sums of integers, they are exact in float, so vectorized kernels sum them in int
+// and give the same scores as scalar code.
+static inline float shiTomasiScore(float Dxx, float Dxy, float Dyy)
+{
+    const float sum_Dxx_Dyy = Dxx + Dyy;
+    return 0.04f * 0.5f * (sum_Dxx_Dyy - std::sqrt(sum_Dxx_Dyy * sum_Dxx_Dyy - 4.0f * (Dxx * Dyy - Dxy * Dxy)));
+}
+
+static float shiTomasiScore_10_Scalar(const ImageRef<unsigned char>& im, const Point2i& pos)
 {
     const unsigned char* p3 = &(im.data())[(pos.y - 3) * im.width()];
     const unsigned char* p2 = &(im.data())[(pos.y - 2) * im.width()];
@@ -55,10 +73,367 @@ float FastCorner::shiTomasiScore_10(const ImageRef<unsigned char>& im, const Poi
         Dxx += dx * dx; Dyy += dy * dy; Dxy += dx * dy;
     }
 
-    const float sum_Dxx_Dyy = Dxx + Dyy;
+    return shiTomasiScore(Dxx, Dxy, Dyy);
+}
+
+// The score of the tree is the maximal barrier for which the pixel is a corner. Pixel is a corner with barrier b
+// if there are 10 contiguous pixels of the ring which are all brighter than center + b or all darker than center - b,
+// so the score is (max of minimal differences of arcs of 10 pixels) - 1, but not less than the barrier.
+// Differences are repeated after 16 values of the ring, so arcs are loaded without wrapping.
+static inline int fastScoreFromArcs(int maxArcMin, int barrier)
+{
+    return std::max(maxArcMin - 1, barrier);
+}
+
+#if defined(AR_FASTCORNER_SSE2)
+
+static inline __m128i loadRow_SSE2(const unsigned char* p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+static inline int horizontalSum_SSE2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// Columns of the window are in 7 of 8 lanes. Loads don't read outside of rows of the window and the next row,
+// except the last row which is loaded from the previous pixel.
+static float shiTomasiScore_10_SSE2(const ImageRef<unsigned char>& im, const Point2i& pos)
+{
+    const int stride = im.width();
+    const unsigned char* p = &(im.data())[(pos.y - 3) * stride + pos.x];
+    const __m128i mask = _mm_set_epi16(0, -1, -1, -1, -1, -1, -1, -1);
+    __m128i rows[7];
+    for (int i = 0; i < 6; ++i)
+        rows[i] = loadRow_SSE2(&p[i * stride - 3]);
+    rows[6] = _mm_srli_si128(loadRow_SSE2(&p[6 * stride - 4]), 2);
+    __m128i sumXX = _mm_setzero_si128(), sumYY = sumXX, sumXY = sumXX;
+    for (int i = 1; i < 6; ++i) {
+        __m128i dx = _mm_and_si128(_mm_sub_epi16(loadRow_SSE2(&p[i * stride - 2]),
+                                                 loadRow_SSE2(&p[i * stride - 4])), mask);
+        __m128i dy = _mm_and_si128(_mm_sub_epi16(rows[i + 1], rows[i - 1]), mask);
+        sumXX = _mm_add_epi32(sumXX, _mm_madd_epi16(dx, dx));
+        sumYY = _mm_add_epi32(sumYY, _mm_madd_epi16(dy, dy));
+        sumXY = _mm_add_epi32(sumXY, _mm_madd_epi16(dx, dy));
+    }
+    return shiTomasiScore((float)horizontalSum_SSE2(sumXX), (float)horizontalSum_SSE2(sumXY),
+                          (float)horizontalSum_SSE2(sumYY));
+}
 
-    float r = 0.04f * 0.5f * (sum_Dxx_Dyy - std::sqrt(sum_Dxx_Dyy * sum_Dxx_Dyy - 4.0f * (Dxx * Dyy - Dxy * Dxy)));
-    return r;
+// Pixels are processed by groups of 16 pixels, the last group overlaps the previous one and only new pixels
+// are added. row[x] is the pixel which is tested for the position x, endx - beginx must be at least 16.
+static void detectRow_SSE2(std::vector<FastCorner::Corner>& corners, const unsigned char* row, const int* ring,
+                           int y, int beginx, int endx, int barrier)
+{
+    const __m128i delta = _mm_set1_epi8((char)0x80);
+    const __m128i t = _mm_set1_epi8((char)barrier);
+    const __m128i minLength = _mm_set1_epi8(9);
+    FastCorner::Corner corner;
+    corner.pos.y = y;
+    corner.score = 0;
+    corner.level = 0;
+    for (int x = beginx, next = beginx; next < endx; next = x + 16) {
+        x = std::min(next, endx - 16);
+        const unsigned char* p = &row[x];
+        // pixels are compared as signed values after shifting by 0x80, saturated center +/- barrier
+        // can't be exceeded like int values out of [0, 255]
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i cb = _mm_xor_si128(_mm_adds_epu8(c, t), delta);
+        __m128i c_b = _mm_xor_si128(_mm_subs_epu8(c, t), delta);
+
+        // an arc of 10 pixels contains 2 neighboring pixels of 0, 4, 8 and 12
+        __m128i v0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p[ring[0]])), delta);
+        __m128i v4 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p[ring[4]])), delta);
+        __m128i v8 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p[ring[8]])), delta);
+        __m128i v12 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p[ring[12]])), delta);
+        __m128i b0 = _mm_cmpgt_epi8(v0, cb), b4 = _mm_cmpgt_epi8(v4, cb);
+        __m128i b8 = _mm_cmpgt_epi8(v8, cb), b12 = _mm_cmpgt_epi8(v12, cb);
+        __m128i d0 = _mm_cmplt_epi8(v0, c_b), d4 = _mm_cmplt_epi8(v4, c_b);
+        __m128i d8 = _mm_cmplt_epi8(v8, c_b), d12 = _mm_cmplt_epi8(v12, c_b);
+        __m128i candidates = _mm_or_si128(_mm_or_si128(_mm_and_si128(b0, b4), _mm_and_si128(b4, b8)),
+                                          _mm_or_si128(_mm_and_si128(b8, b12), _mm_and_si128(b12, b0)));
+        candidates = _mm_or_si128(candidates,
+                                  _mm_or_si128(_mm_or_si128(_mm_and_si128(d0, d4), _mm_and_si128(d4, d8)),
+                                               _mm_or_si128(_mm_and_si128(d8, d12), _mm_and_si128(d12, d0))));
+        if (_mm_movemask_epi8(candidates) == 0)
+            continue;
+
+        // lengths of runs of brighter and darker pixels, the ring is passed twice for arcs through the pixel 0
+        __m128i values[16];
+        for (int k = 0; k < 16; ++k)
+            values[k] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p[ring[k]])), delta);
+        __m128i countB = _mm_setzero_si128(), countD = countB, maxB = countB, maxD = countB;
+        for (int k = 0; k < 25; ++k) {
+            __m128i v = values[k & 15];
+            __m128i m = _mm_cmpgt_epi8(v, cb);
+            countB = _mm_and_si128(_mm_sub_epi8(countB, m), m);
+            maxB = _mm_max_epu8(maxB, countB);
+            m = _mm_cmplt_epi8(v, c_b);
+            countD = _mm_and_si128(_mm_sub_epi8(countD, m), m);
+            maxD = _mm_max_epu8(maxD, countD);
+        }
+        int isCorner = _mm_movemask_epi8(_mm_and_si128(candidates,
+                                                       _mm_cmpgt_epi8(_mm_max_epu8(maxB, maxD), minLength)));
+        isCorner >>= (next - x);
+        for (int i = next - x; isCorner != 0; ++i, isCorner >>= 1) {
+            if (isCorner & 1) {
+                corner.pos.x = x + i;
+                corners.push_back(corner);
+            }
+        }
+    }
+}
+
+// Differences must be repeated after 16 values, arcs of 10 pixels are min of octets and the pairs after them.
+static int maxArcMin_SSE2(const short* d)
+{
+    short pairs[32], quads[24];
+    for (int i = 0; i < 4; ++i)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&pairs[i * 8]),
+                         _mm_min_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&d[i * 8])),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(&d[i * 8 + 1]))));
+    for (int i = 0; i < 3; ++i)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&quads[i * 8]),
+                         _mm_min_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&pairs[i * 8])),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pairs[i * 8 + 2]))));
+    __m128i m = _mm_set1_epi16(-255);
+    for (int i = 0; i < 2; ++i) {
+        __m128i octets = _mm_min_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&quads[i * 8])),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(&quads[i * 8 + 4])));
+        m = _mm_max_epi16(m, _mm_min_epi16(octets,
+                                           _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pairs[i * 8 + 8]))));
+    }
+    m = _mm_max_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_max_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_max_epi16(m, _mm_shufflelo_epi16(m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (short)_mm_cvtsi128_si32(m);
+}
+
+static int fastScore_SSE2(const unsigned char* p, const int* ring, int barrier)
+{
+    short brighter[40], darker[40];
+    for (int k = 0; k < 40; ++k) {
+        brighter[k] = (short)(p[ring[k & 15]] - *p);
+        darker[k] = (short)(- brighter[k]);
+    }
+    return fastScoreFromArcs(std::max(maxArcMin_SSE2(brighter), maxArcMin_SSE2(darker)), barrier);
+}
+
+#endif
+
+#if defined(AR_FASTCORNER_NEON)
+
+static inline int16x8_t loadRow_NEON(const unsigned char* p)
+{
+    return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)));
+}
+
+static inline int horizontalSum_NEON(int32x4_t v)
+{
+    int32x2_t s = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+    return vget_lane_s32(vpadd_s32(s, s), 0);
+}
+
+static inline int32x4_t multiplyAdd_NEON(int32x4_t sum, int16x8_t a, int16x8_t b)
+{
+    sum = vmlal_s16(sum, vget_low_s16(a), vget_low_s16(b));
+    return vmlal_s16(sum, vget_high_s16(a), vget_high_s16(b));
+}
+
+static float shiTomasiScore_10_NEON(const ImageRef<unsigned char>& im, const Point2i& pos)
+{
+    const int stride = im.width();
+    const unsigned char* p = &(im.data())[(pos.y - 3) * stride + pos.x];
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16_t maskValues[8] = { -1, -1, -1, -1, -1, -1, -1, 0 };
+    const int16x8_t mask = vld1q_s16(maskValues);
+    int16x8_t rows[7];
+    for (int i = 0; i < 6; ++i)
+        rows[i] = loadRow_NEON(&p[i * stride - 3]);
+    rows[6] = vextq_s16(loadRow_NEON(&p[6 * stride - 4]), zero, 1);
+    int32x4_t sumXX = vdupq_n_s32(0), sumYY = sumXX, sumXY = sumXX;
+    for (int i = 1; i < 6; ++i) {
+        int16x8_t dx = vandq_s16(vsubq_s16(loadRow_NEON(&p[i * stride - 2]), loadRow_NEON(&p[i * stride - 4])), mask);
+        int16x8_t dy = vandq_s16(vsubq_s16(rows[i + 1], rows[i - 1]), mask);
+        sumXX = multiplyAdd_NEON(sumXX, dx, dx);
+        sumYY = multiplyAdd_NEON(sumYY, dy, dy);
+        sumXY = multiplyAdd_NEON(sumXY, dx, dy);
+    }
+    return shiTomasiScore((float)horizontalSum_NEON(sumXX), (float)horizontalSum_NEON(sumXY),
+                          (float)horizontalSum_NEON(sumYY));
+}
+
+static void detectRow_NEON(std::vector<FastCorner::Corner>& corners, const unsigned char* row, const int* ring,
+                           int y, int beginx, int endx, int barrier)
+{
+    const uint8x16_t t = vdupq_n_u8((uint8_t)barrier);
+    const uint8x16_t minLength = vdupq_n_u8(9);
+    FastCorner::Corner corner;
+    corner.pos.y = y;
+    corner.score = 0;
+    corner.level = 0;
+    uint8_t flags[16];
+    for (int x = beginx, next = beginx; next < endx; next = x + 16) {
+        x = std::min(next, endx - 16);
+        const unsigned char* p = &row[x];
+        uint8x16_t c = vld1q_u8(p);
+        uint8x16_t cb = vqaddq_u8(c, t);
+        uint8x16_t c_b = vqsubq_u8(c, t);
+
+        uint8x16_t v0 = vld1q_u8(&p[ring[0]]), v4 = vld1q_u8(&p[ring[4]]);
+        uint8x16_t v8 = vld1q_u8(&p[ring[8]]), v12 = vld1q_u8(&p[ring[12]]);
+        uint8x16_t b0 = vcgtq_u8(v0, cb), b4 = vcgtq_u8(v4, cb), b8 = vcgtq_u8(v8, cb), b12 = vcgtq_u8(v12, cb);
+        uint8x16_t d0 = vcltq_u8(v0, c_b), d4 = vcltq_u8(v4, c_b), d8 = vcltq_u8(v8, c_b), d12 = vcltq_u8(v12, c_b);
+        uint8x16_t candidates = vorrq_u8(vorrq_u8(vandq_u8(b0, b4), vandq_u8(b4, b8)),
+                                         vorrq_u8(vandq_u8(b8, b12), vandq_u8(b12, b0)));
+        candidates = vorrq_u8(candidates, vorrq_u8(vorrq_u8(vandq_u8(d0, d4), vandq_u8(d4, d8)),
+                                                   vorrq_u8(vandq_u8(d8, d12), vandq_u8(d12, d0))));
+        uint8x8_t any = vorr_u8(vget_low_u8(candidates), vget_high_u8(candidates));
+        if (vget_lane_u64(vreinterpret_u64_u8(any), 0) == 0)
+            continue;
+
+        uint8x16_t values[16];
+        for (int k = 0; k < 16; ++k)
+            values[k] = vld1q_u8(&p[ring[k]]);
+        uint8x16_t countB = vdupq_n_u8(0), countD = countB, maxB = countB, maxD = countB;
+        for (int k = 0; k < 25; ++k) {
+            uint8x16_t v = values[k & 15];
+            uint8x16_t m = vcgtq_u8(v, cb);
+            countB = vandq_u8(vsubq_u8(countB, m), m);
+            maxB = vmaxq_u8(maxB, countB);
+            m = vcltq_u8(v, c_b);
+            countD = vandq_u8(vsubq_u8(countD, m), m);
+            maxD = vmaxq_u8(maxD, countD);
+        }
+        vst1q_u8(flags, vandq_u8(candidates, vcgtq_u8(vmaxq_u8(maxB, maxD), minLength)));
+        for (int i = next - x; i < 16; ++i) {
+            if (flags[i] != 0) {
+                corner.pos.x = x + i;
+                corners.push_back(corner);
+            }
+        }
+    }
+}
+
+static int maxArcMin_NEON(const short* d)
+{
+    short pairs[32], quads[24];
+    for (int i = 0; i < 4; ++i)
+        vst1q_s16(&pairs[i * 8], vminq_s16(vld1q_s16(&d[i * 8]), vld1q_s16(&d[i * 8 + 1])));
+    for (int i = 0; i < 3; ++i)
+        vst1q_s16(&quads[i * 8], vminq_s16(vld1q_s16(&pairs[i * 8]), vld1q_s16(&pairs[i * 8 + 2])));
+    int16x8_t m = vdupq_n_s16(-255);
+    for (int i = 0; i < 2; ++i) {
+        int16x8_t octets = vminq_s16(vld1q_s16(&quads[i * 8]), vld1q_s16(&quads[i * 8 + 4]));
+        m = vmaxq_s16(m, vminq_s16(octets, vld1q_s16(&pairs[i * 8 + 8])));
+    }
+    int16x4_t h = vpmax_s16(vget_low_s16(m), vget_high_s16(m));
+    h = vpmax_s16(h, h);
+    h = vpmax_s16(h, h);
+    return vget_lane_s16(h, 0);
+}
+
+static int fastScore_NEON(const unsigned char* p, const int* ring, int barrier)
+{
+    short brighter[40], darker[40];
+    for (int k = 0; k < 40; ++k) {
+        brighter[k] = (short)(p[ring[k & 15]] - *p);
+        darker[k] = (short)(- brighter[k]);
+    }
+    return fastScoreFromArcs(std::max(maxArcMin_NEON(brighter), maxArcMin_NEON(darker)), barrier);
+}
+
+#endif
+
+typedef void (*DetectRowKernel)(std::vector<FastCorner::Corner>& corners, const unsigned char* row, const int* ring,
+                                int y, int beginx, int endx, int barrier);
+typedef int (*FastScoreKernel)(const unsigned char* p, const int* ring, int barrier);
+
+void FastCorner::fast_corner_detect_10(const ImageRef<unsigned char>& im,
+                                        const Point2i& begin, const Point2i& end,
+                                        std::vector<Corner>& corners, int barrier)
+{
+    DetectRowKernel detectRow = nullptr;
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_FASTCORNER_SSE2)
+    case ImageProcessing::InstructionSet::SSE2:
+    case ImageProcessing::InstructionSet::AVX2:
+        detectRow = detectRow_SSE2;
+        break;
+#endif
+#if defined(AR_FASTCORNER_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        detectRow = detectRow_NEON;
+        break;
+#endif
+    default:
+        break;
+    }
+    int beginx = std::max(begin.x, 3);
+    int beginy = std::max(begin.y, 3);
+    int endx = std::min(im.width() - 3, end.x + 1);
+    int endy = std::min(im.height() - 3, end.y + 1);
+
+    if ((detectRow == nullptr) || (barrier < 0) || ((endx - beginx) < 16)) {
+        _fast_corner_detect_10_tree(im, begin, end, corners, barrier);
+        return;
+    }
+
+    int stride = im.width();
+    _make_fast_pixel_offset(stride);
+    for (int y = beginy; y < endy; ++y) {
+        // the tree tests pixels from the beginning of the row, so positions of its corners are shifted by beginx,
+        // kernels test the same pixels to give the same corners
+        detectRow(corners, &im.data()[stride * y - beginx], _fast_pixel_ring, y, beginx, endx, std::min(barrier, 255));
+    }
+}
+
+void FastCorner::fast_corner_score_10(const ImageRef<unsigned char>& im, std::vector<Corner>& corners, int barrier)
+{
+    _make_fast_pixel_offset(im.width());
+    FastScoreKernel fastScore = nullptr;
+    if ((barrier >= 0) && (barrier < 255)) {
+        switch (ImageProcessing::instructionSet()) {
+#if defined(AR_FASTCORNER_SSE2)
+        case ImageProcessing::InstructionSet::SSE2:
+        case ImageProcessing::InstructionSet::AVX2:
+            fastScore = fastScore_SSE2;
+            break;
+#endif
+#if defined(AR_FASTCORNER_NEON)
+        case ImageProcessing::InstructionSet::NEON:
+            fastScore = fastScore_NEON;
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+    for (std::vector<Corner>::iterator it = corners.begin(); it != corners.end(); ++it) {
+        const unsigned char* p = &im.data()[it->pos.y * im.width() + it->pos.x];
+        it->score = (fastScore != nullptr) ? fastScore(p, _fast_pixel_ring, barrier) : fast_corner_score_10(p, barrier);
+    }
+}
+
+float FastCorner::shiTomasiScore_10(const ImageRef<unsigned char>& im, const Point2i& pos)
+{
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_FASTCORNER_SSE2)
+    case ImageProcessing::InstructionSet::SSE2:
+    case ImageProcessing::InstructionSet::AVX2:
+        return shiTomasiScore_10_SSE2(im, pos);
+#endif
+#if defined(AR_FASTCORNER_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        return shiTomasiScore_10_NEON(im, pos);
+#endif
+    default:
+        break;
+    }
+    return shiTomasiScore_10_Scalar(im, pos);
 }
 
 void FastCorner::fastNonmaxSuppression(const std::vector<FastCorner::Corner>& corners,
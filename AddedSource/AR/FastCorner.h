@@ -16,7 +16,10 @@ public:
         int level;
     };
 
-    /// Perform tree based 10 point FAST feature detection
+    /// Perform 10 point FAST feature detection.
+    /// Vectorized kernels (selected by ImageProcessing::setInstructionSet()) test 16 pixels per step and reject
+    /// pixels by 4 points of the ring first, they give the same corners in the same order as the tree.
+    /// Scores of corners are zero.
     static void fast_corner_detect_10(const ImageRef<unsigned char>& im,
                                       const Point2i& begin, const Point2i& end,
                                       std::vector<Corner>& corners, int barrier);
@@ -28,13 +31,22 @@ public:
         return a.score > b.score;
     }
 
+    /// Tree based score, the ring must be prepared by fast_corner_detect_10() for the same image.
     static int fast_corner_score_10(const unsigned char* p, int barrier);
+    /// Sets scores of corners, they are equal to scores of the tree.
+    static void fast_corner_score_10(const ImageRef<unsigned char>& im, std::vector<Corner>& corners, int barrier);
     static float shiTomasiScore_10(const ImageRef<unsigned char>& im, const Point2i& pos);
 
 protected:
-    static int _fast_pixel_ring[16];
+    // Offsets of the ring are prepared per thread, so images can be processed in parallel.
+    static thread_local int _fast_pixel_ring[16];
 
     static void _make_fast_pixel_offset(int row_stride);
+
+    /// Tree based 10 point FAST feature detection, it's the scalar variant of fast_corner_detect_10().
+    static void _fast_corner_detect_10_tree(const ImageRef<unsigned char>& im,
+                                            const Point2i& begin, const Point2i& end,
+                                            std::vector<Corner>& corners, int barrier);
 };
 
 }
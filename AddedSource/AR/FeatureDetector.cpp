@@ -1,5 +1,6 @@
 #include "FeatureDetector.h"
 #include <cassert>
+#include <algorithm>
 
 namespace AR {
 
@@ -123,12 +124,11 @@ void FeatureDetector::setLevelForFeature(int minLevel, int maxLevel)
 
 void FeatureDetector::reset()
 {
-    m_candidates.clear();
-    m_finalCandidates.clear();
+    m_bands.clear();
     OpticalFlow::reset();
 }
 
-void FeatureDetector::detectFeaturesOnFirstImage(std::vector<FeatureCorner> & features)
+void FeatureDetector::_findBestCorners()
 {
     assert((m_gridSize.x > 0) && (m_gridSize.y > 0));
 
@@ -139,66 +139,105 @@ void FeatureDetector::detectFeaturesOnFirstImage(std::vector<FeatureCorner> & fe
     Point2f cellSize(imageSize.x / (float)(m_gridSize.x),
                      imageSize.y / (float)(m_gridSize.y));
 
-    m_finalCandidates.resize(0);
-    std::size_t prevSize = 0;
-
     int minLevel = (m_minLevelForFeature < 0) ? 0 : m_minLevelForFeature;
     int maxLevel = ((m_maxLevelForFeature < 0) || (m_maxLevelForFeature >= countLevels())) ?
                         (countLevels() - 1) :
                         m_maxLevelForFeature;
 
+    const int minBandHeight = 16;
+    Point2i cursorSize = m_opticalFlowCalculator.cursorSize();
+    int countBands = 0;
     for (int level = minLevel; level <= maxLevel; ++level) {
-        ConstImage<uchar> image = firstImageAtLevel(level);
-
-        m_candidates.resize(0);
-        FastCorner::fast_corner_detect_10(image,
-                                          m_opticalFlowCalculator.cursorSize(),
-                                          image.size() - (m_opticalFlowCalculator.cursorSize() + Point2i(1, 1)),
-                                          m_candidates,
-                                          m_barrier);
-        FastCorner::fastNonmaxSuppression(m_candidates, m_finalCandidates);
-        if (level > 0) {
-            int scale = (1 << level);
-            for (std::vector<FastCorner::Corner>::iterator it = m_finalCandidates.begin() + prevSize;
-                 it != m_finalCandidates.end();
-                 ++it) {
-                it->pos *= scale;
-                if ((it->pos.x < 0) || (it->pos.y < 0) || (it->pos.x >= imageSize.x) || (it->pos.y >= imageSize.y)) {
-                    assert(false);
-                }
-                it->level = level;
-            }
+        int beginY = cursorSize.y;
+        int endY = firstImageAtLevel(level).height() - cursorSize.y;
+        int countLevelBands = std::max(std::min(m_threadPool.countThreads(), (endY - beginY) / minBandHeight), 1);
+        if ((int)m_bands.size() < countBands + countLevelBands)
+            m_bands.resize(countBands + countLevelBands);
+        for (int i = 0; i < countLevelBands; ++i) {
+            Band & band = m_bands[countBands + i];
+            band.level = level;
+            band.beginY = beginY + ((endY - beginY) * i) / countLevelBands;
+            band.endY = beginY + ((endY - beginY) * (i + 1)) / countLevelBands;
+        }
+        countBands += countLevelBands;
+        // only the first level after the zero level is used
+        if (level > 0)
             break;
-        } else {
-            for (std::vector<FastCorner::Corner>::iterator it = m_finalCandidates.begin() + prevSize;
-                 it != m_finalCandidates.end();
-                 ++it) {
-                it->level = 0;
+    }
+
+    m_threadPool.run(countBands, [this, &cellSize] (int index) {
+        _processBand(m_bands[index], cellSize);
+    });
+
+    // bands are merged in order of rows, so cells get the first of the best corners like in a serial pass
+    for (int i = 0; i < countBands; ++i) {
+        const std::vector<Cell> & bandCells = m_bands[i].cells;
+        for (std::size_t k = 0; k < m_cells.size(); ++k) {
+            if (bandCells[k].score > m_cells[k].score) {
+                m_cells[k].score = bandCells[k].score;
+                m_cells[k].pos = bandCells[k].pos;
+                m_cells[k].level = bandCells[k].level;
             }
         }
-        prevSize = m_finalCandidates.size();
     }
+}
 
-    for (std::vector<Cell>::iterator it = m_cells.begin(); it != m_cells.end(); ++it) {
-        it->score = 0.0f;
-    }
+void FeatureDetector::_processBand(Band & band, const Point2f & cellSize)
+{
+    ConstImage<uchar> image = firstImageAtLevel(band.level);
+    Point2i imageSize = m_level0_first.size();
+    Point2i begin = m_opticalFlowCalculator.cursorSize();
+    Point2i end = image.size() - (m_opticalFlowCalculator.cursorSize() + Point2i(1, 1));
+
+    band.candidates.resize(0);
+    FastCorner::fast_corner_detect_10(image,
+                                      Point2i(begin.x, std::max(band.beginY - 1, begin.y)),
+                                      Point2i(end.x, std::min(band.endY, end.y)),
+                                      band.candidates,
+                                      m_barrier);
+    band.finalCandidates.resize(0);
+    FastCorner::fastNonmaxSuppression(band.candidates, band.finalCandidates);
+
+    Cell emptyCell;
+    emptyCell.pos.setZero();
+    emptyCell.score = 0.0f;
+    emptyCell.level = 0;
+    emptyCell.lock = false;
+    band.cells.assign(m_cells.size(), emptyCell);
 
     ConstImage<uchar> firstImage = this->firstImage();
+    int scale = (1 << band.level);
     int k;
     float score;
-    for (std::vector<FastCorner::Corner>::iterator it = m_finalCandidates.begin();
-            it != m_finalCandidates.end();
+    for (std::vector<FastCorner::Corner>::const_iterator it = band.finalCandidates.begin();
+            it != band.finalCandidates.end();
             ++it) {
-        k = (int)(std::floor(it->pos.y / cellSize.y) * m_gridSize.y + std::floor(it->pos.x / cellSize.x));
+        if ((it->pos.y < band.beginY) || (it->pos.y >= band.endY))
+            continue;
+        Point2i pos = it->pos * scale;
+        if ((pos.x < 0) || (pos.y < 0) || (pos.x >= imageSize.x) || (pos.y >= imageSize.y)) {
+            assert(false);
+        }
+        k = (int)(std::floor(pos.y / cellSize.y) * m_gridSize.y + std::floor(pos.x / cellSize.x));
         if (m_cells[k].lock)
             continue;
-        score = FastCorner::shiTomasiScore_10(firstImage, it->pos);
-        if (score > m_cells[k].score) {
-            m_cells[k].score = score;
-            m_cells[k].pos = it->pos;
-            m_cells[k].level = it->level;
+        score = FastCorner::shiTomasiScore_10(firstImage, pos);
+        Cell & cell = band.cells[k];
+        if (score > cell.score) {
+            cell.score = score;
+            cell.pos = pos;
+            cell.level = band.level;
         }
     }
+}
+
+void FeatureDetector::detectFeaturesOnFirstImage(std::vector<FeatureCorner> & features)
+{
+    for (std::vector<Cell>::iterator it = m_cells.begin(); it != m_cells.end(); ++it) {
+        it->score = 0.0f;
+    }
+
+    _findBestCorners();
 
     std::vector<int> cellOrders;
     cellOrders.resize(m_cells.size());
@@ -210,7 +249,7 @@ void FeatureDetector::detectFeaturesOnFirstImage(std::vector<FeatureCorner> & fe
     for (std::vector<int>::iterator it = cellOrders.begin(); it != cellOrders.end(); ++it) {
         const Cell& cell = m_cells[*it];
         if (cell.score > m_detectionThreshold) {
-            features.push_back(FeatureCorner(cell.pos, cell.level));
+            features.push_back(FeatureCorner(cell.pos, cell.level, cell.score));
             if ((int)features.size() > m_maxCountFeatures)
                 return;
         }
@@ -219,55 +258,6 @@ void FeatureDetector::detectFeaturesOnFirstImage(std::vector<FeatureCorner> & fe
 
 void FeatureDetector::fillFeaturesOnFirstImage(std::vector<FeatureCorner> & features)
 {
-    assert((m_gridSize.x > 0) && (m_gridSize.y > 0));
-
-    Point2i imageSize = m_level0_first.size();
-
-    assert((imageSize.x != 0) && (imageSize.y != 0));
-
-    Point2f cellSize(imageSize.x / (float)(m_gridSize.x),
-                     imageSize.y / (float)(m_gridSize.y));
-
-    m_finalCandidates.resize(0);
-    std::size_t prevSize = 0;
-
-    int minLevel = (m_minLevelForFeature < 0) ? 0 : m_minLevelForFeature;
-    int maxLevel = ((m_maxLevelForFeature < 0) || (m_maxLevelForFeature >= countLevels())) ?
-                        (countLevels() - 1) :
-                        m_maxLevelForFeature;
-
-    for (int level = minLevel; level <= maxLevel; ++level) {
-        ConstImage<uchar> image = firstImageAtLevel(level);
-
-        m_candidates.resize(0);
-        FastCorner::fast_corner_detect_10(image,
-                                          m_opticalFlowCalculator.cursorSize(),
-                                          image.size() - (m_opticalFlowCalculator.cursorSize() + Point2i(1, 1)),
-                                          m_candidates,
-                                          m_barrier);
-        FastCorner::fastNonmaxSuppression(m_candidates, m_finalCandidates);
-        if (level > 0) {
-            int scale = (1 << level);
-            for (std::vector<FastCorner::Corner>::iterator it = m_finalCandidates.begin() + prevSize;
-                 it != m_finalCandidates.end();
-                 ++it) {
-                it->pos *= scale;
-                if ((it->pos.x < 0) || (it->pos.y < 0) || (it->pos.x >= imageSize.x) || (it->pos.y >= imageSize.y)) {
-                    assert(false);
-                }
-                it->level = level;
-            }
-            break;
-        } else {
-            for (std::vector<FastCorner::Corner>::iterator it = m_finalCandidates.begin() + prevSize;
-                 it != m_finalCandidates.end();
-                 ++it) {
-                it->level = 0;
-            }
-        }
-        prevSize = m_finalCandidates.size();
-    }
-
     int k = 0;
     for (std::vector<Cell>::iterator it = m_cells.begin(); it != m_cells.end(); ++it) {
         it->score = 0.0f;
@@ -276,21 +266,7 @@ void FeatureDetector::fillFeaturesOnFirstImage(std::vector<FeatureCorner> & feat
                     (int)(k / m_gridSize.x + 0.5f) * m_cellSize.y);
     }
 
-    ConstImage<uchar> firstImage = this->firstImage();
-    float score;
-    for (std::vector<FastCorner::Corner>::iterator it = m_finalCandidates.begin();
-            it != m_finalCandidates.end();
-            ++it) {
-        k = (int)(std::floor(it->pos.y / cellSize.y) * m_gridSize.y + std::floor(it->pos.x / cellSize.x));
-        if (m_cells[k].lock)
-            continue;
-        score = FastCorner::shiTomasiScore_10(firstImage, it->pos);
-        if (score > m_cells[k].score) {
-            m_cells[k].score = score;
-            m_cells[k].pos = it->pos;
-            m_cells[k].level = it->level;
-        }
-    }
+    _findBestCorners();
 
     std::vector<int> cellOrders;
     cellOrders.resize(m_cells.size());
@@ -302,7 +278,7 @@ void FeatureDetector::fillFeaturesOnFirstImage(std::vector<FeatureCorner> & feat
     for (std::vector<int>::iterator it = cellOrders.begin(); it != cellOrders.end(); ++it) {
         const Cell& cell = m_cells[*it];
         //if (cell.score > m_detectionThreshold) {
-            features.push_back(FeatureCorner(cell.pos, cell.level));
+            features.push_back(FeatureCorner(cell.pos, cell.level, cell.score));
             if ((int)features.size() > m_maxCountFeatures)
                 return;
         //}
@@ -311,4 +287,3 @@ void FeatureDetector::fillFeaturesOnFirstImage(std::vector<FeatureCorner> & feat
 
 
 }
-
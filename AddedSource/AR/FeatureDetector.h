@@ -14,12 +14,14 @@ public:
     struct FeatureCorner {
         Point2i pos;
         int level;
+        float score;
 
         FeatureCorner() {}
-        FeatureCorner(const Point2i& pos, int level)
+        FeatureCorner(const Point2i& pos, int level, float score = 0.0f)
         {
             this->pos = pos;
             this->level = level;
+            this->score = score;
         }
     };
 
@@ -41,6 +43,8 @@ public:
     void setFirstImage(const ImageRef<uchar>& image) override;
     void setFirstImage(const Frame& frame) override;
 
+    // Levels are split into horizontal bands, which are detected and scored by threads of OpticalFlow.
+    // Features don't depend on count of threads.
     void detectFeaturesOnFirstImage(std::vector<FeatureCorner>& features);
     void fillFeaturesOnFirstImage(std::vector<FeatureCorner>& features);
 
@@ -70,11 +74,25 @@ protected:
     int m_maxLevelForFeature;
     int m_maxCountFeatures;
 
-    std::vector<FastCorner::Corner> m_candidates;
-    std::vector<FastCorner::Corner> m_finalCandidates;
+    // Rows [beginY, endY) of a level. Corners are detected with one row above and below for non-max suppression,
+    // the best corners of cells are found only among corners of own rows.
+    struct Band {
+        int level;
+        int beginY;
+        int endY;
+        std::vector<FastCorner::Corner> candidates;
+        std::vector<FastCorner::Corner> finalCandidates;
+        std::vector<Cell> cells;
+    };
+
     Point2i m_gridSize;
     Point2f m_cellSize;
     std::vector<Cell> m_cells;
+
+    std::vector<Band> m_bands;
+
+    void _findBestCorners();
+    void _processBand(Band & band, const Point2f & cellSize);
 };
 
 }
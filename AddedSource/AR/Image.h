@@ -7,8 +7,12 @@
 #include <functional>
 #include <cmath>
 #include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <type_traits>
 
 #include "Point2.h"
+#include "ImageBufferPool.h"
 
 typedef unsigned char uchar;
 
@@ -76,8 +80,8 @@ public:
 public:
     inline bool equals(const ImageRef<T>& image) const
     {
-        if (m_count_copies != nullptr)
-            return (m_count_copies == image.m_count_copies);
+        if (m_buffer != nullptr)
+            return (m_buffer == image.m_buffer);
         return (m_data == image.m_data) && (m_size == image.m_size);
     }
 
@@ -92,7 +96,7 @@ public:
     inline Point2i size() const { return m_size; }
     inline int width() const { return m_size.x; }
     inline int height() const { return m_size.y; }
-    inline bool autoDeleting() { return (m_count_copies != nullptr); }
+    inline bool autoDeleting() { return (m_buffer != nullptr); }
     inline Image<T> copy() const;
 
     template<typename ConvertType>
@@ -113,7 +117,7 @@ public:
     {
         std::swap(imageA.m_data, imageB.m_data);
         std::swap(imageA.m_size, imageB.m_size);
-        std::swap(imageA.m_count_copies, imageB.m_count_copies);
+        std::swap(imageA.m_buffer, imageB.m_buffer);
     }
 
 protected:
@@ -121,7 +125,9 @@ protected:
     friend class Image<T>;
 
     T* m_data;
-    int* m_count_copies;
+    // Shared header of data with atomic counter of copies, images are shared between threads
+    // (key frames are used by tracking and mapping). Data of images from ImageBufferPool follows the header.
+    ImageBuffer* m_buffer;
     Point2i m_size;
 
     ImageRef() {}
@@ -131,44 +137,36 @@ protected:
     inline void _remove()
     {
         //m_size.set(0, 0);
-        if (m_count_copies == nullptr) {
+        if (m_buffer == nullptr) {
             //m_data = nullptr;
             return;
         }
-        if (*m_count_copies <= 1) {
-/*#if defined(_WIN32)
-            _aligned_free(m_data);
-#elif defined(__ANDROID__)
-            free(m_data);
-#endif*/
-            delete[] m_data;
-            delete m_count_copies;
-        } else {
-            --(*m_count_copies);
-        }
+        if (m_buffer->countCopies.fetch_sub(1) <= 1)
+            ImageBufferPool::release(m_buffer);
         m_data = nullptr;
-        m_count_copies = nullptr;
+        m_buffer = nullptr;
     }
     inline void _allocData()
     {
         //assert(m_size.x >= 0 && m_size.y >= 0);
-/*#if defined(_WIN32)
-        m_data = static_cast<T*>(_aligned_malloc(countBytes(), 16));
-#elif defined(__ANDROID__)
-        m_data = static_cast<T*>(memalign(16, countBytes());
-#endif
-        m_data = new (_data)T[area()];*/
-        m_data = new T[area()];
+        // data of pool isn't constructed and isn't destructed, as data of new T[] of trivial types
+        static_assert(std::is_trivially_destructible<T>::value, "Type of pixels must be trivially destructible");
+        m_buffer = ImageBufferPool::acquire(countBytes());
+        m_data = static_cast<T*>(ImageBufferPool::data(m_buffer));
+    }
+    static void _deleteUserData(void* data)
+    {
+        delete[] static_cast<T*>(data);
     }
     inline void _copyRef(const ImageRef<T>& image)
     {
         m_data = image.m_data;
         m_size = image.m_size;
-        if (image.m_count_copies != nullptr) {
-            ++(*image.m_count_copies);
-            m_count_copies = image.m_count_copies;
+        if (image.m_buffer != nullptr) {
+            ++image.m_buffer->countCopies;
+            m_buffer = image.m_buffer;
         } else {
-            m_count_copies = nullptr;
+            m_buffer = nullptr;
         }
     }
     inline void _moveRef(ImageRef<T>&& image)
@@ -177,8 +175,8 @@ protected:
         image.m_data = nullptr;
         m_size = image.m_size;
         image.m_size.set(0, 0);
-        m_count_copies = image.m_count_copies;
-        image.m_count_copies = nullptr;
+        m_buffer = image.m_buffer;
+        image.m_buffer = nullptr;
     }
 };
 
@@ -192,7 +190,7 @@ public:
     ConstImage()
     {
         this->m_data = nullptr;
-        this->m_count_copies = nullptr;
+        this->m_buffer = nullptr;
         this->m_size.setZero();
     }
     ConstImage(const ImageRef<T>& image)
@@ -223,7 +221,15 @@ public:
     {
         this->m_size = size;
         this->m_data = const_cast<T*>(data);
-        this->m_count_copies = (autoDeleting) ? new int(1) : nullptr;
+        this->m_buffer = (autoDeleting) ?
+                    ImageBufferPool::userData(const_cast<T*>(data), &ImageRef<T>::_deleteUserData) : nullptr;
+    }
+    // Data belongs to owner, owner is kept while there are copies of the image.
+    ConstImage(const Point2i& size, const T* data, const std::shared_ptr<void>& owner)
+    {
+        this->m_size = size;
+        this->m_data = const_cast<T*>(data);
+        this->m_buffer = ImageBufferPool::sharedData(const_cast<T*>(data), owner);
     }
     ~ConstImage()
     {
@@ -274,7 +280,7 @@ public:
     Image()
     {
         this->m_data = nullptr;
-        this->m_count_copies = nullptr;
+        this->m_buffer = nullptr;
         this->m_size.setZero();
     }
     Image(const Image<T>& image)
@@ -289,13 +295,20 @@ public:
     {
         this->m_size = size;
         this->_allocData();
-        this->m_count_copies = new int(1);
     }
     Image(const Point2i& size, T* data, bool autoDeleting = true)
     {
         this->m_size = size;
         this->m_data = const_cast<T*>(data);
-        this->m_count_copies = (autoDeleting) ? new int(1) : nullptr;
+        this->m_buffer = (autoDeleting) ?
+                    ImageBufferPool::userData(const_cast<T*>(data), &ImageRef<T>::_deleteUserData) : nullptr;
+    }
+    // Data belongs to owner, owner is kept while there are copies of the image.
+    Image(const Point2i& size, T* data, const std::shared_ptr<void>& owner)
+    {
+        this->m_size = size;
+        this->m_data = data;
+        this->m_buffer = ImageBufferPool::sharedData(data, owner);
     }
     ~Image()
     {
@@ -0,0 +1,248 @@
+#include "ImageBufferPool.h"
+#include <cstdint>
+#include <algorithm>
+#include <new>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+namespace AR {
+
+namespace {
+
+struct CommonFreeList
+{
+    std::mutex mutex;
+    std::unordered_map<std::size_t, ImageBuffer*> buffers; // lists of buffers by capacities
+    std::size_t freeBytes;
+    std::size_t maxFreeBytes;
+
+    std::atomic<std::uint64_t> countHeapAllocations;
+    std::atomic<std::uint64_t> countReuses;
+    std::atomic<std::uint64_t> countHeapFrees;
+
+    CommonFreeList():
+        freeBytes(0),
+        maxFreeBytes(64 * 1024 * 1024),
+        countHeapAllocations(0),
+        countReuses(0),
+        countHeapFrees(0)
+    {
+    }
+};
+
+// Images can be released by destructors of static objects, so the common list is never destroyed.
+CommonFreeList & commonFreeList()
+{
+    static CommonFreeList * freeList = new CommonFreeList();
+    return *freeList;
+}
+
+enum class ThreadFreeListState: int {
+    NotCreated,
+    Alive,
+    Destroyed
+};
+
+// The list of thread is destroyed at exit of thread, buffers released after that go to the common list.
+thread_local ThreadFreeListState threadFreeListState = ThreadFreeListState::NotCreated;
+
+struct ThreadFreeList
+{
+    std::vector<ImageBuffer*> buffers; // the last released buffers are at the end
+    std::size_t freeBytes;
+
+    ThreadFreeList():
+        freeBytes(0)
+    {
+        threadFreeListState = ThreadFreeListState::Alive;
+    }
+
+    ~ThreadFreeList()
+    {
+        threadFreeListState = ThreadFreeListState::Destroyed;
+        for (ImageBuffer * buffer : buffers)
+            ImageBufferPool::release(buffer);
+    }
+};
+
+ThreadFreeList * currentThreadFreeList()
+{
+    if (threadFreeListState == ThreadFreeListState::Destroyed)
+        return nullptr;
+    static thread_local ThreadFreeList threadFreeList;
+    return &threadFreeList;
+}
+
+// Returns true if buffer is kept in the common list.
+bool pushToCommonFreeList(CommonFreeList & freeList, ImageBuffer * buffer)
+{
+    std::lock_guard<std::mutex> lock(freeList.mutex); (void)lock;
+    if ((freeList.freeBytes + buffer->capacity) > freeList.maxFreeBytes)
+        return false;
+    ImageBuffer * & head = freeList.buffers[buffer->capacity];
+    buffer->next = head;
+    head = buffer;
+    freeList.freeBytes += buffer->capacity;
+    return true;
+}
+
+} // anonymous namespace
+
+ImageBuffer * ImageBufferPool::acquire(std::size_t countBytes)
+{
+    std::size_t capacity = std::max(((countBytes + alignment - 1) / alignment) * alignment, alignment);
+    CommonFreeList & freeList = commonFreeList();
+    ImageBuffer * buffer = nullptr;
+    ThreadFreeList * localList = currentThreadFreeList();
+    if (localList != nullptr) {
+        for (std::size_t i = localList->buffers.size(); i > 0; --i) {
+            if (localList->buffers[i - 1]->capacity == capacity) {
+                buffer = localList->buffers[i - 1];
+                localList->buffers.erase(localList->buffers.begin() + (i - 1));
+                localList->freeBytes -= capacity;
+                break;
+            }
+        }
+    }
+    if (buffer == nullptr) {
+        std::lock_guard<std::mutex> lock(freeList.mutex); (void)lock;
+        auto it = freeList.buffers.find(capacity);
+        if ((it != freeList.buffers.end()) && (it->second != nullptr)) {
+            buffer = it->second;
+            it->second = buffer->next;
+            freeList.freeBytes -= capacity;
+        }
+    }
+    if (buffer == nullptr) {
+        buffer = _allocate(capacity);
+        ++freeList.countHeapAllocations;
+    } else {
+        ++freeList.countReuses;
+    }
+    buffer->countCopies = 1;
+    buffer->next = nullptr;
+    return buffer;
+}
+
+ImageBuffer * ImageBufferPool::userData(void * data, void (*deleteUserData)(void * data))
+{
+    ImageBuffer * buffer = new ImageBuffer();
+    buffer->countCopies = 1;
+    buffer->capacity = 0;
+    buffer->memory = data;
+    buffer->deleteUserData = deleteUserData;
+    buffer->next = nullptr;
+    return buffer;
+}
+
+ImageBuffer * ImageBufferPool::sharedData(void * data, const std::shared_ptr<void> & owner)
+{
+    ImageBuffer * buffer = new ImageBuffer();
+    buffer->countCopies = 1;
+    buffer->capacity = 0;
+    buffer->memory = data;
+    buffer->deleteUserData = nullptr;
+    buffer->owner = owner;
+    buffer->next = nullptr;
+    return buffer;
+}
+
+void ImageBufferPool::release(ImageBuffer * buffer)
+{
+    if (buffer->capacity == 0) {
+        if (buffer->deleteUserData != nullptr)
+            buffer->deleteUserData(buffer->memory);
+        delete buffer;
+        return;
+    }
+    ThreadFreeList * localList = currentThreadFreeList();
+    if (localList == nullptr) {
+        if (!pushToCommonFreeList(commonFreeList(), buffer))
+            _free(buffer);
+        return;
+    }
+    localList->buffers.push_back(buffer);
+    localList->freeBytes += buffer->capacity;
+    if (localList->freeBytes <= maxThreadFreeBytes)
+        return;
+    // the oldest buffers are moved to the common list
+    CommonFreeList & freeList = commonFreeList();
+    std::size_t countMoved = 0;
+    while ((localList->freeBytes > maxThreadFreeBytes) && (countMoved < localList->buffers.size())) {
+        ImageBuffer * oldBuffer = localList->buffers[countMoved];
+        ++countMoved;
+        localList->freeBytes -= oldBuffer->capacity;
+        if (!pushToCommonFreeList(freeList, oldBuffer))
+            _free(oldBuffer);
+    }
+    localList->buffers.erase(localList->buffers.begin(), localList->buffers.begin() + countMoved);
+}
+
+ImageBufferPool::Statistics ImageBufferPool::statistics()
+{
+    CommonFreeList & freeList = commonFreeList();
+    Statistics statistics;
+    statistics.countHeapAllocations = freeList.countHeapAllocations.load();
+    statistics.countReuses = freeList.countReuses.load();
+    statistics.countHeapFrees = freeList.countHeapFrees.load();
+    return statistics;
+}
+
+std::size_t ImageBufferPool::maxFreeBytes()
+{
+    CommonFreeList & freeList = commonFreeList();
+    std::lock_guard<std::mutex> lock(freeList.mutex); (void)lock;
+    return freeList.maxFreeBytes;
+}
+
+void ImageBufferPool::setMaxFreeBytes(std::size_t maxFreeBytes)
+{
+    CommonFreeList & freeList = commonFreeList();
+    std::lock_guard<std::mutex> lock(freeList.mutex); (void)lock;
+    freeList.maxFreeBytes = maxFreeBytes;
+}
+
+void ImageBufferPool::trim()
+{
+    std::vector<ImageBuffer*> buffers;
+    ThreadFreeList * localList = currentThreadFreeList();
+    if (localList != nullptr) {
+        buffers.swap(localList->buffers);
+        localList->freeBytes = 0;
+    }
+    CommonFreeList & freeList = commonFreeList();
+    {
+        std::lock_guard<std::mutex> lock(freeList.mutex); (void)lock;
+        for (auto & it : freeList.buffers) {
+            for (ImageBuffer * buffer = it.second; buffer != nullptr; buffer = buffer->next)
+                buffers.push_back(buffer);
+        }
+        freeList.buffers.clear();
+        freeList.freeBytes = 0;
+    }
+    for (ImageBuffer * buffer : buffers)
+        _free(buffer);
+}
+
+ImageBuffer * ImageBufferPool::_allocate(std::size_t capacity)
+{
+    void * memory = ::operator new(headerSize + capacity + alignment - 1);
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(memory);
+    address = ((address + alignment - 1) / alignment) * alignment;
+    ImageBuffer * buffer = new (reinterpret_cast<void*>(address)) ImageBuffer();
+    buffer->capacity = capacity;
+    buffer->memory = memory;
+    buffer->deleteUserData = nullptr;
+    return buffer;
+}
+
+void ImageBufferPool::_free(ImageBuffer * buffer)
+{
+    void * memory = buffer->memory;
+    buffer->~ImageBuffer();
+    ::operator delete(memory);
+    ++commonFreeList().countHeapFrees;
+}
+
+} // namespace AR
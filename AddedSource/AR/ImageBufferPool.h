@@ -0,0 +1,71 @@
+#ifndef AR_IMAGEBUFFERPOOL_H
+#define AR_IMAGEBUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+
+namespace AR {
+
+// Header of data of image, it's shared by all copies of image.
+struct ImageBuffer
+{
+    std::atomic<int> countCopies;
+    std::size_t capacity; // count of bytes of data from ImageBufferPool, 0 - data is given by user
+    void * memory; // allocated memory with header and data or data given by user
+    void (*deleteUserData)(void * data);
+    std::shared_ptr<void> owner; // owner of data given by user (a mapped file), it's kept while the image exists
+    ImageBuffer * next; // in free lists of pool
+};
+
+// Pool of data of images. Data is aligned by ImageBufferPool::alignment and has inline header ImageBuffer.
+// Freed buffers are kept in free lists of threads and are reused by images with the same count of bytes
+// (images with the same size and type), so steady-state processing of frames doesn't use the heap for images.
+// Free lists of threads are limited by maxThreadFreeBytes, excess buffers are moved to the common free list,
+// which is limited by maxFreeBytes() - buffers over this limit are returned to the heap.
+// Buffers can be acquired and released in any threads.
+class ImageBufferPool
+{
+public:
+    static const std::size_t alignment = 64;
+    static const std::size_t maxThreadFreeBytes = 16 * 1024 * 1024;
+
+    struct Statistics
+    {
+        std::uint64_t countHeapAllocations; // buffers allocated from the heap
+        std::uint64_t countReuses; // buffers taken from free lists
+        std::uint64_t countHeapFrees; // buffers returned to the heap
+    };
+
+    static ImageBuffer * acquire(std::size_t countBytes);
+    // Header for data which was allocated by user, data is deleted by deleteUserData at release.
+    static ImageBuffer * userData(void * data, void (*deleteUserData)(void * data));
+    // Header for data which belongs to owner, data isn't deleted at release, only the reference to owner is dropped.
+    static ImageBuffer * sharedData(void * data, const std::shared_ptr<void> & owner);
+    static void release(ImageBuffer * buffer);
+
+    static inline void * data(ImageBuffer * buffer)
+    {
+        return reinterpret_cast<char*>(buffer) + headerSize;
+    }
+
+    static Statistics statistics();
+
+    static std::size_t maxFreeBytes();
+    static void setMaxFreeBytes(std::size_t maxFreeBytes);
+    // Returns buffers of the common free list and of the free list of the calling thread to the heap.
+    static void trim();
+
+private:
+    static const std::size_t headerSize = ((sizeof(ImageBuffer) + alignment - 1) / alignment) * alignment;
+
+    ImageBufferPool() = delete;
+
+    static ImageBuffer * _allocate(std::size_t capacity);
+    static void _free(ImageBuffer * buffer);
+};
+
+} // namespace AR
+
+#endif // AR_IMAGEBUFFERPOOL_H
@@ -1,10 +1,354 @@
 #include "ImageProcessing.h"
 #include <cmath>
 #include <cassert>
+#include <atomic>
 #include "TMath/TTools.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AR_IMAGEPROCESSING_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AR_IMAGEPROCESSING_AVX2
+#define AR_IMAGEPROCESSING_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define AR_IMAGEPROCESSING_AVX2
+#define AR_IMAGEPROCESSING_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AR_IMAGEPROCESSING_NEON
+#include <arm_neon.h>
+#endif
+
 namespace AR {
 
+// Row kernels return the count of processed output pixels, the rest of row is processed by scalar code.
+// The gray value is (r + g + b) / 3, the division is replaced by (sum * 21846) >> 16,
+// that gives the same result for all sums up to 765.
+
+static int convertRowToBW_Scalar(uchar * out, const Rgba * in, int count, int begin)
+{
+    for (int i = begin; i < count; ++i)
+        out[i] = static_cast<uchar>((in[i].red + in[i].green + in[i].blue) / 3);
+    return count;
+}
+
+static int halfSampleRow_Scalar(uchar * out, const uchar * inA, const uchar * inB, int count, int begin)
+{
+    for (int i = begin; i < count; ++i) {
+        const int j = i * 2;
+        out[i] = static_cast<uchar>((inA[j] + inA[j + 1] + inB[j] + inB[j + 1]) / 4);
+    }
+    return count;
+}
+
+#if defined(AR_IMAGEPROCESSING_SSE2)
+
+static inline __m128i sumRgb_SSE2(const Rgba * in)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    __m128i sum = _mm_and_si128(v, mask);
+    sum = _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(v, 8), mask));
+    return _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(v, 16), mask));
+}
+
+static int convertRowToBW_SSE2(uchar * out, const Rgba * in, int count, int)
+{
+    const __m128i k = _mm_set1_epi16(21846);
+    const int end = count - (count % 16);
+    for (int i = 0; i < end; i += 16) {
+        __m128i a = _mm_packs_epi32(sumRgb_SSE2(&in[i]), sumRgb_SSE2(&in[i + 4]));
+        __m128i b = _mm_packs_epi32(sumRgb_SSE2(&in[i + 8]), sumRgb_SSE2(&in[i + 12]));
+        a = _mm_mulhi_epu16(a, k);
+        b = _mm_mulhi_epu16(b, k);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]), _mm_packus_epi16(a, b));
+    }
+    return end;
+}
+
+static inline __m128i sumPairs_SSE2(const uchar * inA, const uchar * inB)
+{
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inA));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inB));
+    __m128i sum = _mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+    sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8)));
+    return _mm_srli_epi16(sum, 2);
+}
+
+static int halfSampleRow_SSE2(uchar * out, const uchar * inA, const uchar * inB, int count, int)
+{
+    const int end = count - (count % 16);
+    for (int i = 0; i < end; i += 16) {
+        const int j = i * 2;
+        __m128i a = sumPairs_SSE2(&inA[j], &inB[j]);
+        __m128i b = sumPairs_SSE2(&inA[j + 16], &inB[j + 16]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]), _mm_packus_epi16(a, b));
+    }
+    return end;
+}
+
+#endif
+
+#if defined(AR_IMAGEPROCESSING_AVX2)
+
+AR_IMAGEPROCESSING_TARGET_AVX2
+static inline __m256i sumRgb_AVX2(const Rgba * in)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    __m256i sum = _mm256_and_si256(v, mask);
+    sum = _mm256_add_epi32(sum, _mm256_and_si256(_mm256_srli_epi32(v, 8), mask));
+    return _mm256_add_epi32(sum, _mm256_and_si256(_mm256_srli_epi32(v, 16), mask));
+}
+
+AR_IMAGEPROCESSING_TARGET_AVX2
+static int convertRowToBW_AVX2(uchar * out, const Rgba * in, int count, int)
+{
+    const __m256i k = _mm256_set1_epi16(21846);
+    // packing works inside of 128-bit lanes, so the order of 32-bit groups is restored at the end
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const int end = count - (count % 32);
+    for (int i = 0; i < end; i += 32) {
+        __m256i a = _mm256_packs_epi32(sumRgb_AVX2(&in[i]), sumRgb_AVX2(&in[i + 8]));
+        __m256i b = _mm256_packs_epi32(sumRgb_AVX2(&in[i + 16]), sumRgb_AVX2(&in[i + 24]));
+        a = _mm256_mulhi_epu16(a, k);
+        b = _mm256_mulhi_epu16(b, k);
+        __m256i result = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]), result);
+    }
+    return end;
+}
+
+AR_IMAGEPROCESSING_TARGET_AVX2
+static inline __m256i sumPairs_AVX2(const uchar * inA, const uchar * inB)
+{
+    const __m256i mask = _mm256_set1_epi16(0xFF);
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(inA));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(inB));
+    __m256i sum = _mm256_add_epi16(_mm256_and_si256(a, mask), _mm256_srli_epi16(a, 8));
+    sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_and_si256(b, mask), _mm256_srli_epi16(b, 8)));
+    return _mm256_srli_epi16(sum, 2);
+}
+
+AR_IMAGEPROCESSING_TARGET_AVX2
+static int halfSampleRow_AVX2(uchar * out, const uchar * inA, const uchar * inB, int count, int)
+{
+    const int end = count - (count % 32);
+    for (int i = 0; i < end; i += 32) {
+        const int j = i * 2;
+        __m256i a = sumPairs_AVX2(&inA[j], &inB[j]);
+        __m256i b = sumPairs_AVX2(&inA[j + 32], &inB[j + 32]);
+        __m256i result = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]), result);
+    }
+    return end;
+}
+
+static bool cpuSupportsAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // OSXSAVE and AVX, then the state of YMM registers must be saved by OS
+    if (((info[2] & (1 << 27)) == 0) || ((info[2] & (1 << 28)) == 0))
+        return false;
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return ((info[1] & (1 << 5)) != 0);
+#else
+    __builtin_cpu_init();
+    return (__builtin_cpu_supports("avx2") != 0);
+#endif
+}
+
+#endif
+
+#if defined(AR_IMAGEPROCESSING_NEON)
+
+static int convertRowToBW_NEON(uchar * out, const Rgba * in, int count, int)
+{
+    const uint16x4_t k = vdup_n_u16(21846);
+    const int end = count - (count % 16);
+    for (int i = 0; i < end; i += 16) {
+        uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uchar*>(&in[i]));
+        uint16x8_t sumLow = vaddw_u8(vaddl_u8(vget_low_u8(v.val[0]), vget_low_u8(v.val[1])),
+                                     vget_low_u8(v.val[2]));
+        uint16x8_t sumHigh = vaddw_u8(vaddl_u8(vget_high_u8(v.val[0]), vget_high_u8(v.val[1])),
+                                      vget_high_u8(v.val[2]));
+        uint16x8_t grayLow = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(sumLow), k), 16),
+                                          vshrn_n_u32(vmull_u16(vget_high_u16(sumLow), k), 16));
+        uint16x8_t grayHigh = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(sumHigh), k), 16),
+                                           vshrn_n_u32(vmull_u16(vget_high_u16(sumHigh), k), 16));
+        vst1q_u8(&out[i], vcombine_u8(vmovn_u16(grayLow), vmovn_u16(grayHigh)));
+    }
+    return end;
+}
+
+static int halfSampleRow_NEON(uchar * out, const uchar * inA, const uchar * inB, int count, int)
+{
+    const int end = count - (count % 8);
+    for (int i = 0; i < end; i += 8) {
+        const int j = i * 2;
+        uint16x8_t sum = vaddq_u16(vpaddlq_u8(vld1q_u8(&inA[j])), vpaddlq_u8(vld1q_u8(&inB[j])));
+        vst1_u8(&out[i], vshrn_n_u16(sum, 2));
+    }
+    return end;
+}
+
+#endif
+
+struct ImageProcessingKernels
+{
+    int (*convertRowToBW)(uchar * out, const Rgba * in, int count, int begin);
+    int (*halfSampleRow)(uchar * out, const uchar * inA, const uchar * inB, int count, int begin);
+};
+
+static ImageProcessing::InstructionSet bestInstructionSet()
+{
+#if defined(AR_IMAGEPROCESSING_AVX2)
+    if (cpuSupportsAVX2())
+        return ImageProcessing::InstructionSet::AVX2;
+#endif
+#if defined(AR_IMAGEPROCESSING_SSE2)
+    return ImageProcessing::InstructionSet::SSE2;
+#elif defined(AR_IMAGEPROCESSING_NEON)
+    return ImageProcessing::InstructionSet::NEON;
+#else
+    return ImageProcessing::InstructionSet::Scalar;
+#endif
+}
+
+static std::atomic<int> & currentInstructionSet()
+{
+    static std::atomic<int> instructionSet((int)bestInstructionSet());
+    return instructionSet;
+}
+
+static ImageProcessingKernels currentKernels()
+{
+    ImageProcessingKernels kernels = { convertRowToBW_Scalar, halfSampleRow_Scalar };
+    switch ((ImageProcessing::InstructionSet)currentInstructionSet().load(std::memory_order_relaxed)) {
+#if defined(AR_IMAGEPROCESSING_AVX2)
+    case ImageProcessing::InstructionSet::AVX2:
+        kernels.convertRowToBW = convertRowToBW_AVX2;
+        kernels.halfSampleRow = halfSampleRow_AVX2;
+        break;
+#endif
+#if defined(AR_IMAGEPROCESSING_SSE2)
+    case ImageProcessing::InstructionSet::SSE2:
+        kernels.convertRowToBW = convertRowToBW_SSE2;
+        kernels.halfSampleRow = halfSampleRow_SSE2;
+        break;
+#endif
+#if defined(AR_IMAGEPROCESSING_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        kernels.convertRowToBW = convertRowToBW_NEON;
+        kernels.halfSampleRow = halfSampleRow_NEON;
+        break;
+#endif
+    default:
+        break;
+    }
+    return kernels;
+}
+
+ImageProcessing::InstructionSet ImageProcessing::instructionSet()
+{
+    return (InstructionSet)currentInstructionSet().load(std::memory_order_relaxed);
+}
+
+bool ImageProcessing::setInstructionSet(InstructionSet instructionSet)
+{
+    bool supported = (instructionSet == InstructionSet::Scalar);
+    InstructionSet best = bestInstructionSet();
+    switch (instructionSet) {
+    case InstructionSet::SSE2:
+        supported = (best == InstructionSet::SSE2) || (best == InstructionSet::AVX2);
+        break;
+    case InstructionSet::AVX2:
+    case InstructionSet::NEON:
+        supported = (best == instructionSet);
+        break;
+    default:
+        break;
+    }
+    if (!supported)
+        return false;
+    currentInstructionSet().store((int)instructionSet, std::memory_order_relaxed);
+    return true;
+}
+
+void ImageProcessing::convertToBW(Image<uchar>& out, const ImageRef<Rgba>& in)
+{
+    if (out.size() != in.size())
+        out = Image<uchar>(in.size());
+    ImageProcessingKernels kernels = currentKernels();
+    // rows of images are continuous, so all image is processed as one row
+    const int area = in.area();
+    convertRowToBW_Scalar(out.data(), in.data(), area, kernels.convertRowToBW(out.data(), in.data(), area, 0));
+}
+
+void ImageProcessing::convertToBWAndHalfSample(Image<uchar>& out, Image<uchar>& outHalf, const ImageRef<Rgba>& in)
+{
+    if (out.size() != in.size())
+        out = Image<uchar>(in.size());
+    if (outHalf.size() != (in.size() / 2))
+        outHalf = Image<uchar>(in.size() / 2);
+    ImageProcessingKernels kernels = currentKernels();
+    const int width = in.width();
+    const int halfWidth = outHalf.width();
+    // two rows of level 0 are still in cache when they are half sampled
+    for (int y = 0; y < in.height(); ++y) {
+        uchar* outStr = &out.data()[width * y];
+        const Rgba* inStr = &in.data()[width * y];
+        convertRowToBW_Scalar(outStr, inStr, width, kernels.convertRowToBW(outStr, inStr, width, 0));
+        if (((y % 2) == 1) && ((y / 2) < outHalf.height())) {
+            uchar* outHalfStr = &outHalf.data()[halfWidth * (y / 2)];
+            const uchar* prevStr = &outStr[- width];
+            halfSampleRow_Scalar(outHalfStr, prevStr, outStr, halfWidth,
+                                 kernels.halfSampleRow(outHalfStr, prevStr, outStr, halfWidth, 0));
+        }
+    }
+}
+
+void ImageProcessing::halfSample(Image<uchar>& out, const ImageRef<uchar>& in)
+{
+    assert((in.size() / 2) == out.size());
+    ImageProcessingKernels kernels = currentKernels();
+    for (int y = 0; y < out.height(); ++y) {
+        uchar* outStr = &out.data()[out.width() * y];
+        const uchar* inStrA = &in.data()[in.width() * (y * 2)];
+        const uchar* inStrB = &inStrA[in.width()];
+        halfSampleRow_Scalar(outStr, inStrA, inStrB, out.width(),
+                             kernels.halfSampleRow(outStr, inStrA, inStrB, out.width(), 0));
+    }
+}
+
+void ImageProcessing::buildImagePyramid(std::vector<Image<uchar>>& imagePyramid, const ImageRef<Rgba>& frame)
+{
+    assert(!imagePyramid.empty());
+    if (imagePyramid.size() == 1) {
+        convertToBW(imagePyramid[0], frame);
+        return;
+    }
+    convertToBWAndHalfSample(imagePyramid[0], imagePyramid[1], frame);
+    Point2i imageSize = imagePyramid[1].size();
+    for (std::size_t i = 2; i < imagePyramid.size(); ++i) {
+        imageSize /= 2;
+        if (imagePyramid[i].size() != imageSize)
+            imagePyramid[i] = Image<uchar>(imageSize);
+        halfSample(imagePyramid[i], imagePyramid[i - 1]);
+    }
+}
+
 void ImageProcessing::sobel(Image<bool>& out, Image<int>& outIntegral, const ImageRef<uchar>& in, const uchar threshold)
 {
     assert((in.size() == out.size()) && (out.size() == outIntegral.size()));
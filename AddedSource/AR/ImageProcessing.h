@@ -6,6 +6,7 @@
 #include "TMath/TMatrix.h"
 #include <cmath>
 #include <cassert>
+#include <vector>
 
 #if QT_MULTIMEDIA_LIB
 #include <QImage>
@@ -17,12 +18,30 @@ namespace AR {
 class ImageProcessing
 {
 public:
+    // Instruction set of vectorized kernels, the best supported set is selected at runtime.
+    enum class InstructionSet
+    {
+        Scalar,
+        SSE2,
+        AVX2,
+        NEON
+    };
+
+    static InstructionSet instructionSet();
+    // Returns false if the instruction set isn't supported by this processor.
+    static bool setInstructionSet(InstructionSet instructionSet);
+
     static void sobel(Image<bool>& out, Image<int>& outIntegral, const ImageRef<uchar>& in, const uchar threshold);
     static void erode(Image<bool>& out, const ImageRef<int>& integral, int size, float k);
 #if QT_MULTIMEDIA_LIB
     static Image<Rgba> convertQImage(const QImage& image);
 #endif
     static Image<uchar> convertToBW(const ImageRef<Rgb>& image);
+    static void convertToBW(Image<uchar>& out, const ImageRef<Rgba>& in);
+    // Converts to black-white image and computes the next level of pyramid in one pass.
+    static void convertToBWAndHalfSample(Image<uchar>& out, Image<uchar>& outHalf, const ImageRef<Rgba>& in);
+    // Sizes of levels are set from frame, the count of levels is the size of imagePyramid.
+    static void buildImagePyramid(std::vector<Image<uchar>>& imagePyramid, const ImageRef<Rgba>& frame);
 
     static void gaussianBlurX(Image<uchar>& out, const ImageRef<uchar>& in, int halfSizeBlur, float sigma)
     {
@@ -39,10 +58,7 @@ public:
         gaussianBlur<float, uchar>(out, in, halfSizeBlur, sigma);
     }
 
-    static void halfSample(Image<uchar>& out, const ImageRef<uchar>& in)
-    {
-        halfSample<unsigned int, uchar>(out, in);
-    }
+    static void halfSample(Image<uchar>& out, const ImageRef<uchar>& in);
 
     template <typename RealSumType, typename Type>
     static void gaussianBlurX(Image<Type>& out, const ImageRef<Type>& in, int halfSizeBlur, float sigma)
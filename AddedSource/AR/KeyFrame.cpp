@@ -44,6 +44,20 @@ KeyFrame::KeyFrame(Map * map, std::size_t index, const Frame & frame):
     m_smallImage = m_map->getSmallImage(*this);
 }
 
+KeyFrame::KeyFrame(Map * map, std::size_t index, const std::shared_ptr<const Camera> & camera,
+                   const std::vector<Image<uchar>> & imagePyramid,
+                   const TMath::TMatrixd & rotation,
+                   const TMath::TVectord & translation,
+                   const ConstImage<int> & smallImage):
+    Frame(camera, imagePyramid, rotation, translation),
+    MapResourceObject(map),
+    m_index(index),
+    m_smallImage(smallImage)
+{
+    TMath_assert((int)imagePyramid.size() == m_map->countImageLevels());
+    TMath_assert(smallImage.width() == m_map->sizeOfSmallImage());
+}
+
 KeyFrame::~KeyFrame()
 {
     _clearFeatures();
@@ -79,6 +93,30 @@ ConstImage<int> KeyFrame::smallImage() const
     return m_smallImage;
 }
 
+void KeyFrame::setRotation(const TMath::TMatrixd & rotation)
+{
+    Frame::setRotation(rotation);
+    _updateIndex();
+}
+
+void KeyFrame::setTranslation(const TMath::TVectord & translation)
+{
+    Frame::setTranslation(translation);
+    _updateIndex();
+}
+
+void KeyFrame::transform(const TMath::TMatrixd & rotation, const TMath::TVectord & translation)
+{
+    Frame::transform(rotation, translation);
+    _updateIndex();
+}
+
+void KeyFrame::_updateIndex()
+{
+    if (!isDeleted())
+        m_map->m_keyFramesIndex.update(m_index, *this);
+}
+
 void KeyFrame::_freeFeature(Feature * feature)
 {
     TMath_assert(feature->m_indexInKeyFrame >= 0);
@@ -124,7 +162,7 @@ void KeyFrame::getDepth(MapResourcesManager * manager, double & depthMean, doubl
         std::shared_ptr<const MapPoint> mapPoint = frame->feature(i)->mapPoint();
         if (!mapPoint)
             continue;
-        MapResourceLocker lockerR(manager, mapPoint.get()); (void)lockerR;
+        MapResourceLocker lockerR(manager, mapPoint.get(), MapResourceAccess::Shared); (void)lockerR;
         if (mapPoint->isDeleted())
             continue;
         TVectord localPos = rotation * mapPoint->position() + translation;
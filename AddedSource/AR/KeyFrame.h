@@ -32,6 +32,12 @@ public:
 
     ConstImage<int> smallImage() const;
 
+    // Pose of key frame must be changed only by these methods (not through Frame),
+    // they update cached world position of key frame in the map.
+    void setRotation(const TMath::TMatrixd & rotation);
+    void setTranslation(const TMath::TVectord & translation);
+    void transform(const TMath::TMatrixd & rotation, const TMath::TVectord & translation);
+
     static void getDepth(MapResourcesManager * manager, double & depthMean, double & depthMin,
                          const std::shared_ptr<const KeyFrame> & frame);
 
@@ -59,8 +65,16 @@ private:
 
     KeyFrame(Map * map, size_t index, const Frame & frame);
 
+    KeyFrame(Map * map, std::size_t index,
+             const std::shared_ptr<const Camera> & camera,
+             const std::vector<Image<uchar>> & imagePyramid,
+             const TMath::TMatrixd & rotation,
+             const TMath::TVectord & translation,
+             const ConstImage<int> & smallImage);
+
     void _freeFeature(Feature * feature);
     void _clearFeatures();
+    void _updateIndex();
 };
 
 }
@@ -0,0 +1,262 @@
+#include "KeyFramesIndex.h"
+#include "Frame.h"
+#include "TMath/TMath.h"
+#include <algorithm>
+#include <limits>
+
+namespace AR {
+
+KeyFramesIndex::KeyFramesIndex()
+{
+    m_treeIsValid = true;
+}
+
+void KeyFramesIndex::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    for (int i = 0; i < 3; ++i) {
+        m_positions[i].clear();
+        m_dirs[i].clear();
+    }
+    m_order.clear();
+    m_axes.clear();
+    m_boxes.clear();
+    m_treeIsValid = true;
+}
+
+std::size_t KeyFramesIndex::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    return m_positions[0].size();
+}
+
+void KeyFramesIndex::add(const Frame & frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    for (int i = 0; i < 3; ++i) {
+        m_positions[i].push_back(0.0);
+        m_dirs[i].push_back(0.0);
+    }
+    _set(m_positions[0].size() - 1, frame);
+}
+
+void KeyFramesIndex::update(std::size_t index, const Frame & frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    TMath_assert(index < m_positions[0].size());
+    _set(index, frame);
+}
+
+void KeyFramesIndex::remove(std::size_t index)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    TMath_assert(index < m_positions[0].size());
+    std::size_t lastIndex = m_positions[0].size() - 1;
+    for (int i = 0; i < 3; ++i) {
+        m_positions[i][index] = m_positions[i][lastIndex];
+        m_positions[i].resize(lastIndex);
+        m_dirs[i][index] = m_dirs[i][lastIndex];
+        m_dirs[i].resize(lastIndex);
+    }
+    m_treeIsValid = false;
+}
+
+TMath::TVectord KeyFramesIndex::worldPosition(std::size_t index) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    TMath_assert(index < m_positions[0].size());
+    return TMath::TVectord::create(m_positions[0][index], m_positions[1][index], m_positions[2][index]);
+}
+
+int KeyFramesIndex::findNearest(const TMath::TVectord & position, const TMath::TVectord & dir) const
+{
+    TMath_assert((position.size() == 3) && (dir.size() == 3));
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    _buildTree();
+    int bestIndex = -1;
+    double bestDistanceSquared = std::numeric_limits<double>::max();
+    _findNearest(0, (int)m_order.size(), position.data(), dir.data(), bestIndex, bestDistanceSquared);
+    return bestIndex;
+}
+
+int KeyFramesIndex::findFurthest(const TMath::TVectord & position) const
+{
+    TMath_assert(position.size() == 3);
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    _buildTree();
+    int bestIndex = -1;
+    double bestDistanceSquared = -1.0;
+    _findFurthest(0, (int)m_order.size(), position.data(), bestIndex, bestDistanceSquared);
+    return bestIndex;
+}
+
+void KeyFramesIndex::findNearest(std::vector<int> & indices, const TMath::TVectord & position,
+                                 std::size_t count) const
+{
+    TMath_assert(position.size() == 3);
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    indices.resize(0);
+    if (count == 0)
+        return;
+    _buildTree();
+    std::vector<std::pair<double, int>> best;
+    best.reserve(count + 1);
+    _findNearest(0, (int)m_order.size(), position.data(), best, count);
+    indices.reserve(best.size());
+    for (auto it = best.cbegin(); it != best.cend(); ++it)
+        indices.push_back(it->second);
+}
+
+void KeyFramesIndex::_set(std::size_t index, const Frame & frame)
+{
+    // rotation is orthonormal, so world position is - rotation^T * translation
+    // and view direction is the third row of rotation
+    TMath::TMatrixd rotation = frame.rotation();
+    TMath::TVectord translation = frame.translation();
+    for (int i = 0; i < 3; ++i) {
+        m_positions[i][index] = - (rotation(0, i) * translation(0) +
+                                   rotation(1, i) * translation(1) +
+                                   rotation(2, i) * translation(2));
+        m_dirs[i][index] = rotation(2, i);
+    }
+    m_treeIsValid = false;
+}
+
+void KeyFramesIndex::_buildTree() const
+{
+    if (m_treeIsValid)
+        return;
+    int size = (int)m_positions[0].size();
+    m_order.resize(size);
+    for (int i = 0; i < size; ++i)
+        m_order[i] = i;
+    m_axes.resize(size);
+    m_boxes.resize(size);
+    _buildNode(0, size);
+    m_treeIsValid = true;
+}
+
+void KeyFramesIndex::_buildNode(int begin, int end) const
+{
+    if (begin >= end)
+        return;
+    Box box;
+    for (int i = 0; i < 3; ++i) {
+        const std::vector<double> & coordinates = m_positions[i];
+        box.min[i] = box.max[i] = coordinates[m_order[begin]];
+        for (int j = begin + 1; j < end; ++j) {
+            double c = coordinates[m_order[j]];
+            if (c < box.min[i])
+                box.min[i] = c;
+            else if (c > box.max[i])
+                box.max[i] = c;
+        }
+    }
+    int axis = 0;
+    for (int i = 1; i < 3; ++i) {
+        if ((box.max[i] - box.min[i]) > (box.max[axis] - box.min[axis]))
+            axis = i;
+    }
+    int middle = (begin + end) / 2;
+    const std::vector<double> & coordinates = m_positions[axis];
+    std::nth_element(m_order.begin() + begin, m_order.begin() + middle, m_order.begin() + end,
+                     [&coordinates] (int a, int b) { return (coordinates[a] < coordinates[b]); });
+    m_axes[middle] = axis;
+    m_boxes[middle] = box;
+    _buildNode(begin, middle);
+    _buildNode(middle + 1, end);
+}
+
+double KeyFramesIndex::_distanceSquared(int index, const double * position) const
+{
+    double dx = m_positions[0][index] - position[0];
+    double dy = m_positions[1][index] - position[1];
+    double dz = m_positions[2][index] - position[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+void KeyFramesIndex::_findNearest(int begin, int end, const double * position, const double * dir,
+                                  int & bestIndex, double & bestDistanceSquared) const
+{
+    if (begin >= end)
+        return;
+    int middle = (begin + end) / 2;
+    int index = m_order[middle];
+    if ((m_dirs[0][index] * dir[0] + m_dirs[1][index] * dir[1] + m_dirs[2][index] * dir[2]) > 0.0) {
+        double d = _distanceSquared(index, position);
+        if (d < bestDistanceSquared) {
+            bestDistanceSquared = d;
+            bestIndex = index;
+        }
+    }
+    int axis = m_axes[middle];
+    double delta = position[axis] - m_positions[axis][index];
+    if (delta < 0.0) {
+        _findNearest(begin, middle, position, dir, bestIndex, bestDistanceSquared);
+        if ((delta * delta) < bestDistanceSquared)
+            _findNearest(middle + 1, end, position, dir, bestIndex, bestDistanceSquared);
+    } else {
+        _findNearest(middle + 1, end, position, dir, bestIndex, bestDistanceSquared);
+        if ((delta * delta) < bestDistanceSquared)
+            _findNearest(begin, middle, position, dir, bestIndex, bestDistanceSquared);
+    }
+}
+
+void KeyFramesIndex::_findFurthest(int begin, int end, const double * position,
+                                   int & bestIndex, double & bestDistanceSquared) const
+{
+    if (begin >= end)
+        return;
+    int middle = (begin + end) / 2;
+    const Box & box = m_boxes[middle];
+    double maxDistanceSquared = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        double d = std::max(std::fabs(position[i] - box.min[i]), std::fabs(position[i] - box.max[i]));
+        maxDistanceSquared += d * d;
+    }
+    if (maxDistanceSquared <= bestDistanceSquared)
+        return;
+    int index = m_order[middle];
+    double d = _distanceSquared(index, position);
+    if (d > bestDistanceSquared) {
+        bestDistanceSquared = d;
+        bestIndex = index;
+    }
+    // the far side of the split plane is checked first, it's more likely to have the furthest entry
+    int axis = m_axes[middle];
+    if (position[axis] < m_positions[axis][index]) {
+        _findFurthest(middle + 1, end, position, bestIndex, bestDistanceSquared);
+        _findFurthest(begin, middle, position, bestIndex, bestDistanceSquared);
+    } else {
+        _findFurthest(begin, middle, position, bestIndex, bestDistanceSquared);
+        _findFurthest(middle + 1, end, position, bestIndex, bestDistanceSquared);
+    }
+}
+
+void KeyFramesIndex::_findNearest(int begin, int end, const double * position,
+                                  std::vector<std::pair<double, int>> & best, std::size_t count) const
+{
+    if (begin >= end)
+        return;
+    int middle = (begin + end) / 2;
+    int index = m_order[middle];
+    std::pair<double, int> item(_distanceSquared(index, position), index);
+    if ((best.size() < count) || (item < best.back())) {
+        best.insert(std::upper_bound(best.begin(), best.end(), item), item);
+        if (best.size() > count)
+            best.pop_back();
+    }
+    int axis = m_axes[middle];
+    double delta = position[axis] - m_positions[axis][index];
+    int nearBegin = begin, nearEnd = middle, farBegin = middle + 1, farEnd = end;
+    if (delta >= 0.0) {
+        std::swap(nearBegin, farBegin);
+        std::swap(nearEnd, farEnd);
+    }
+    _findNearest(nearBegin, nearEnd, position, best, count);
+    // equal distances are included, so the order of entries with equal distances doesn't depend on the tree
+    if ((best.size() < count) || ((delta * delta) <= best.back().first))
+        _findNearest(farBegin, farEnd, position, best, count);
+}
+
+} // namespace AR
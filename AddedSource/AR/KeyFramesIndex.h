@@ -0,0 +1,73 @@
+#ifndef AR_KEYFRAMESINDEX_H
+#define AR_KEYFRAMESINDEX_H
+
+#include <vector>
+#include <mutex>
+#include <utility>
+#include "TMath/TVector.h"
+
+namespace AR {
+
+class Frame;
+
+// Cache of world positions and view directions of key frames for spatial queries.
+// Entries have the same indices as key frames of the map, they are stored as separate arrays of coordinates.
+// Positions are placed into a k-d tree, the tree is rebuilt on the next query after any change,
+// so queries don't compute world positions of key frames and don't lock key frames.
+class KeyFramesIndex
+{
+public:
+    KeyFramesIndex();
+
+    void clear();
+    std::size_t size() const;
+
+    void add(const Frame & frame);
+    void update(std::size_t index, const Frame & frame);
+    // The last entry is moved on place of removed entry like in Map::deleteKeyFrame().
+    void remove(std::size_t index);
+
+    TMath::TVectord worldPosition(std::size_t index) const;
+
+    // Nearest entry which has view direction at an angle less than 90 degrees to dir, -1 if there is no such entry.
+    int findNearest(const TMath::TVectord & position, const TMath::TVectord & dir) const;
+    // Returns -1 if index is empty.
+    int findFurthest(const TMath::TVectord & position) const;
+    // Up to count nearest entries sorted by distance, entries with equal distances are sorted by index.
+    void findNearest(std::vector<int> & indices, const TMath::TVectord & position, std::size_t count) const;
+
+private:
+    struct Box
+    {
+        double min[3];
+        double max[3];
+    };
+
+    mutable std::mutex m_mutex;
+
+    std::vector<double> m_positions[3];
+    std::vector<double> m_dirs[3];
+
+    // Implicit k-d tree: node of range [begin, end) of m_order is in the middle of range.
+    mutable bool m_treeIsValid;
+    mutable std::vector<int> m_order;
+    mutable std::vector<int> m_axes;
+    mutable std::vector<Box> m_boxes;
+
+    void _set(std::size_t index, const Frame & frame);
+    void _buildTree() const;
+    void _buildNode(int begin, int end) const;
+
+    double _distanceSquared(int index, const double * position) const;
+
+    void _findNearest(int begin, int end, const double * position, const double * dir,
+                      int & bestIndex, double & bestDistanceSquared) const;
+    void _findFurthest(int begin, int end, const double * position,
+                       int & bestIndex, double & bestDistanceSquared) const;
+    void _findNearest(int begin, int end, const double * position,
+                      std::vector<std::pair<double, int>> & best, std::size_t count) const;
+};
+
+} // namespace AR
+
+#endif // AR_KEYFRAMESINDEX_H
@@ -0,0 +1,631 @@
+#include "LocalBundleAdjustment.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Feature.h"
+#include "Camera.h"
+#include "MapResourceLocker.h"
+#include "LocationOptimizer.h"
+#include "TukeyRobustCost.h"
+#include "TMath/TCholesky.h"
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <cmath>
+
+namespace AR {
+
+// Inverse of symmetric 3x3 matrix, returns false if the matrix is degenerate.
+static bool invert3x3(TMath::TMatrix3d & result, const TMath::TMatrix3d & m)
+{
+    double c00 = m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1);
+    double c01 = m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2);
+    double c02 = m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0);
+    double det = m(0, 0) * c00 + m(0, 1) * c01 + m(0, 2) * c02;
+    if (std::fabs(det) < std::numeric_limits<double>::epsilon()) {
+        result.setZero();
+        return false;
+    }
+    double invDet = 1.0 / det;
+    result(0, 0) = c00 * invDet;
+    result(1, 0) = c01 * invDet;
+    result(2, 0) = c02 * invDet;
+    result(0, 1) = (m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2)) * invDet;
+    result(1, 1) = (m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0)) * invDet;
+    result(2, 1) = (m(0, 1) * m(2, 0) - m(0, 0) * m(2, 1)) * invDet;
+    result(0, 2) = (m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1)) * invDet;
+    result(1, 2) = (m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2)) * invDet;
+    result(2, 2) = (m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0)) * invDet;
+    return true;
+}
+
+LocalBundleAdjustment::LocalBundleAdjustment(Map * map):
+    m_mapEpoch(0),
+    m_countAdjustments(0)
+{
+    TMath_assert(map != nullptr);
+    m_map = map;
+    m_countKeyFrames = 5;
+    m_numberIterations = 10;
+    m_thread_is_running = false;
+    m_thread = nullptr;
+    m_isNewKeyFrame = false;
+    m_performanceMonitor = nullptr;
+    m_stage_adjustment = -1;
+    m_counter_adjustments = m_counter_droppedAdjustments = -1;
+    m_countVariablePoses = 0;
+    m_minSquareSigma = 0.0;
+    m_map->addListener(this);
+}
+
+LocalBundleAdjustment::~LocalBundleAdjustment()
+{
+    stopThread();
+    m_map->removeListener(this);
+}
+
+int LocalBundleAdjustment::countKeyFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_config_mutex); (void)lock;
+    return m_countKeyFrames;
+}
+
+void LocalBundleAdjustment::setCountKeyFrames(int countKeyFrames)
+{
+    TMath_assert(countKeyFrames >= 2);
+    std::lock_guard<std::mutex> lock(m_config_mutex); (void)lock;
+    m_countKeyFrames = countKeyFrames;
+}
+
+int LocalBundleAdjustment::numberIterations() const
+{
+    std::lock_guard<std::mutex> lock(m_config_mutex); (void)lock;
+    return m_numberIterations;
+}
+
+void LocalBundleAdjustment::setNumberIterations(int numberIterations)
+{
+    std::lock_guard<std::mutex> lock(m_config_mutex); (void)lock;
+    m_numberIterations = numberIterations;
+}
+
+bool LocalBundleAdjustment::threadIsRunning() const
+{
+    std::lock_guard<std::mutex> lock(m_thread_mutex); (void)lock;
+    return m_thread_is_running;
+}
+
+void LocalBundleAdjustment::startThread()
+{
+    std::lock_guard<std::mutex> lock(m_thread_mutex); (void)lock;
+    if (m_thread_is_running)
+        return;
+    m_thread_is_running = true;
+    m_thread = new std::thread(&LocalBundleAdjustment::loop, this);
+}
+
+void LocalBundleAdjustment::stopThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_thread_mutex); (void)lock;
+        if (!m_thread_is_running)
+            return;
+        m_thread_is_running = false;
+    }
+    m_thread_condition.notify_one();
+    if (m_thread != nullptr) {
+        m_thread->join();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+}
+
+void LocalBundleAdjustment::setPerformanceMonitor(PerformanceMonitor * performanceMonitor)
+{
+    TMath_assert(!threadIsRunning());
+    m_performanceMonitor = performanceMonitor;
+    if (m_performanceMonitor != nullptr) {
+        m_stage_adjustment = m_performanceMonitor->registerStage("Local bundle adjustment");
+        m_counter_adjustments = m_performanceMonitor->registerCounter("Local bundle adjustments");
+        m_counter_droppedAdjustments = m_performanceMonitor->registerCounter("Dropped local bundle adjustments");
+    }
+}
+
+void LocalBundleAdjustment::addKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame)
+{
+    TMath_assert(keyFrame->map() == m_map);
+    {
+        std::lock_guard<std::mutex> lock(m_thread_mutex); (void)lock;
+        if (!m_thread_is_running)
+            return;
+        m_keyFrame = keyFrame;
+        m_isNewKeyFrame = true;
+    }
+    m_thread_condition.notify_one();
+}
+
+bool LocalBundleAdjustment::adjust(MapResourcesManager * manager, const std::shared_ptr<KeyFrame> & keyFrame)
+{
+    bool result = false;
+    if (_collect(manager, keyFrame)) {
+        _optimize(numberIterations());
+        _apply(manager);
+        ++m_countAdjustments;
+        result = true;
+    }
+    m_poses.clear();
+    m_points.clear();
+    return result;
+}
+
+std::size_t LocalBundleAdjustment::countAdjustments() const
+{
+    return m_countAdjustments.load();
+}
+
+void LocalBundleAdjustment::onTransformMap(const TMath::TMatrixd & rotation, const TMath::TVectord & translation)
+{
+    (void)rotation;
+    (void)translation;
+    ++m_mapEpoch;
+}
+
+void LocalBundleAdjustment::onScaleMap(double scale)
+{
+    (void)scale;
+    ++m_mapEpoch;
+}
+
+void LocalBundleAdjustment::onResetMap()
+{
+    ++m_mapEpoch;
+}
+
+void LocalBundleAdjustment::loop()
+{
+    if (m_performanceMonitor != nullptr)
+        m_performanceMonitor->setThreadName("Local bundle adjustment");
+    for (;;) {
+        std::shared_ptr<KeyFrame> keyFrame;
+        {
+            std::unique_lock<std::mutex> lock(m_thread_mutex);
+            m_thread_condition.wait(lock, [this] () { return (!m_thread_is_running || m_isNewKeyFrame); });
+            if (!m_thread_is_running)
+                break;
+            keyFrame = m_keyFrame.lock();
+            m_keyFrame.reset();
+            m_isNewKeyFrame = false;
+        }
+        if (!keyFrame)
+            continue;
+        if (m_performanceMonitor != nullptr) {
+            m_performanceMonitor->start();
+            m_performanceMonitor->startTimer(m_stage_adjustment);
+        }
+
+        // the map is locked only to copy the window and to apply results
+        m_map->lock();
+        std::uint64_t epoch = m_mapEpoch.load();
+        bool collected = _collect(&m_resourceManager, keyFrame);
+        m_map->unlock();
+        keyFrame.reset();
+
+        if (collected) {
+            _optimize(numberIterations());
+
+            m_map->lock();
+            if (m_mapEpoch.load() == epoch) {
+                _apply(&m_resourceManager);
+                ++m_countAdjustments;
+                if (m_performanceMonitor != nullptr)
+                    m_performanceMonitor->addToCounter(m_counter_adjustments, 1);
+            } else if (m_performanceMonitor != nullptr) {
+                m_performanceMonitor->addToCounter(m_counter_droppedAdjustments, 1);
+            }
+            m_map->unlock();
+        }
+        m_poses.clear();
+        m_points.clear();
+
+        if (m_performanceMonitor != nullptr) {
+            m_performanceMonitor->endTimer(m_stage_adjustment);
+            m_performanceMonitor->end();
+        }
+    }
+}
+
+bool LocalBundleAdjustment::_collect(MapResourcesManager * manager, const std::shared_ptr<KeyFrame> & keyFrame)
+{
+    using namespace TMath;
+
+    m_poses.clear();
+    m_points.clear();
+    m_positions.clear();
+    m_observations.clear();
+    m_countVariablePoses = 0;
+
+    int countKeyFrames = this->countKeyFrames();
+
+    // key frames covisible with the new key frame are found by common map points
+    std::vector<std::shared_ptr<MapPoint>> mapPoints;
+    std::unordered_map<const KeyFrame*, int> covisibility;
+    {
+        MapResourceLocker locker(manager, keyFrame.get(), MapResourceAccess::Shared); (void)locker;
+        if (keyFrame->isDeleted())
+            return false;
+        for (int i = 0; i < keyFrame->countFeatures(); ++i) {
+            std::shared_ptr<MapPoint> mapPoint = keyFrame->feature(i)->mapPoint();
+            if (mapPoint)
+                mapPoints.push_back(mapPoint);
+        }
+    }
+    std::vector<std::pair<std::shared_ptr<KeyFrame>, int>> covisibleKeyFrames;
+    for (auto it = mapPoints.cbegin(); it != mapPoints.cend(); ++it) {
+        MapResourceLocker locker(manager, it->get(), MapResourceAccess::Shared); (void)locker;
+        if ((*it)->isDeleted())
+            continue;
+        for (std::size_t i = 0; i < (*it)->countFeatures(); ++i) {
+            std::shared_ptr<KeyFrame> otherKeyFrame = (*it)->feature(i)->keyFrame();
+            if (!otherKeyFrame || (otherKeyFrame == keyFrame))
+                continue;
+            auto itCount = covisibility.find(otherKeyFrame.get());
+            if (itCount == covisibility.end()) {
+                covisibility.emplace(otherKeyFrame.get(), (int)covisibleKeyFrames.size());
+                covisibleKeyFrames.emplace_back(otherKeyFrame, 1);
+            } else {
+                ++covisibleKeyFrames[itCount->second].second;
+            }
+        }
+    }
+    // key frames added later are preferred at equal counts of common map points
+    std::sort(covisibleKeyFrames.begin(), covisibleKeyFrames.end(),
+              [] (const std::pair<std::shared_ptr<KeyFrame>, int> & a,
+                  const std::pair<std::shared_ptr<KeyFrame>, int> & b) {
+        if (a.second != b.second)
+            return (a.second > b.second);
+        return (a.first->index() > b.first->index());
+    });
+
+    std::unordered_map<const KeyFrame*, int> poseIndices;
+    auto addPose = [&] (const std::shared_ptr<KeyFrame> & poseKeyFrame, bool variable) {
+        Pose pose;
+        pose.keyFrame = poseKeyFrame;
+        pose.variable = variable ? m_countVariablePoses++ : -1;
+        poseIndices.emplace(poseKeyFrame.get(), (int)m_poses.size());
+        m_poses.push_back(pose);
+    };
+    addPose(keyFrame, true);
+    for (int i = 0; (i < (int)covisibleKeyFrames.size()) && ((int)m_poses.size() < countKeyFrames); ++i)
+        addPose(covisibleKeyFrames[i].first, true);
+    int countWindowPoses = (int)m_poses.size();
+    if (countWindowPoses < 2)
+        return false;
+
+    // map points of other key frames of the window
+    std::unordered_map<const MapPoint*, int> pointIndices;
+    for (auto it = mapPoints.cbegin(); it != mapPoints.cend(); ++it)
+        pointIndices.emplace(it->get(), 0);
+    for (int i = 1; i < countWindowPoses; ++i) {
+        const std::shared_ptr<KeyFrame> & windowKeyFrame = m_poses[i].keyFrame;
+        MapResourceLocker locker(manager, windowKeyFrame.get(), MapResourceAccess::Shared); (void)locker;
+        for (int j = 0; j < windowKeyFrame->countFeatures(); ++j) {
+            std::shared_ptr<MapPoint> mapPoint = windowKeyFrame->feature(j)->mapPoint();
+            if (mapPoint && pointIndices.emplace(mapPoint.get(), 0).second)
+                mapPoints.push_back(mapPoint);
+        }
+    }
+
+    // observations of map points, key frames out of the window are fixed
+    for (auto it = mapPoints.cbegin(); it != mapPoints.cend(); ++it) {
+        const std::shared_ptr<MapPoint> & mapPoint = *it;
+        MapResourceLocker locker(manager, mapPoint.get(), MapResourceAccess::Shared); (void)locker;
+        if (mapPoint->isDeleted() || (mapPoint->countFeatures() < 2))
+            continue;
+        Point point;
+        point.mapPoint = mapPoint;
+        point.firstObservation = (int)m_observations.size();
+        point.countObservations = 0;
+        for (std::size_t i = 0; i < mapPoint->countFeatures(); ++i) {
+            std::shared_ptr<Feature> feature = mapPoint->feature(i);
+            std::shared_ptr<KeyFrame> featureKeyFrame = feature->keyFrame();
+            if (!featureKeyFrame || featureKeyFrame->isDeleted())
+                continue;
+            auto itPose = poseIndices.find(featureKeyFrame.get());
+            if (itPose == poseIndices.end()) {
+                addPose(featureKeyFrame, false);
+                itPose = poseIndices.find(featureKeyFrame.get());
+            }
+            Observation observation;
+            observation.pose = itPose->second;
+            observation.localPoint = LocationOptimizer::project2d(feature->localDir());
+            double scale = (double)(1 << feature->imageLevel());
+            observation.invSquareScale = 1.0 / (scale * scale);
+            m_observations.push_back(observation);
+            ++point.countObservations;
+        }
+        if (point.countObservations < 2) {
+            m_observations.resize(point.firstObservation);
+            continue;
+        }
+        m_points.push_back(point);
+        m_positions.push_back(TVector3d(mapPoint->position()));
+    }
+    if (m_points.empty())
+        return false;
+
+    // the window has to be anchored, otherwise the most covisible key frame is fixed
+    if ((int)m_poses.size() == countWindowPoses) {
+        m_poses[1].variable = -1;
+        m_countVariablePoses = 0;
+        for (auto it = m_poses.begin(); it != m_poses.end(); ++it) {
+            if (it->variable >= 0)
+                it->variable = m_countVariablePoses++;
+        }
+    }
+
+    Point2d pixelFocal(1.0, 1.0);
+    for (auto it = m_poses.begin(); it != m_poses.end(); ++it) {
+        MapResourceLocker locker(manager, it->keyFrame.get(), MapResourceAccess::Shared); (void)locker;
+        it->rotation = TMatrix3d(it->keyFrame->rotation());
+        it->translation = TVector3d(it->keyFrame->translation());
+        if (it == m_poses.begin())
+            pixelFocal = it->keyFrame->camera()->pixelFocalLength();
+    }
+    // errors less than 2 pixels are never rejected
+    double minSigma = 2.0 / std::max(std::min(pixelFocal.x, pixelFocal.y), 1.0);
+    m_minSquareSigma = minSigma * minSigma;
+    return true;
+}
+
+void LocalBundleAdjustment::_optimize(int numberIterations)
+{
+    using namespace TMath;
+
+    // sigma of robust cost is fixed by initial errors, so costs of iterations are comparable
+    m_squareErrors.clear();
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        const Point & point = m_points[i];
+        for (int j = 0; j < point.countObservations; ++j) {
+            const Observation & observation = m_observations[point.firstObservation + j];
+            const Pose & pose = m_poses[observation.pose];
+            TVector3d v = pose.rotation * m_positions[i] + pose.translation;
+            if (v(2) < std::numeric_limits<float>::epsilon())
+                continue;
+            Point2d e = LocationOptimizer::project2d(v) - observation.localPoint;
+            m_squareErrors.push_back(e.lengthSquared() * observation.invSquareScale);
+        }
+    }
+    if (m_squareErrors.empty())
+        return;
+    double squareSigma = std::max(TukeyRobustCost::findSquareSigma(m_squareErrors), m_minSquareSigma);
+
+    double cost = _computeCost(m_poses, m_positions, squareSigma);
+    double lambda = 1e-3;
+    for (int iteration = 0; iteration < numberIterations; ) {
+        if (!_solve(lambda, squareSigma)) {
+            lambda *= 10.0;
+        } else {
+            double newCost = _computeCost(m_newPoses, m_newPositions, squareSigma);
+            if (newCost < cost) {
+                m_poses.swap(m_newPoses);
+                m_positions.swap(m_newPositions);
+                lambda *= 0.1;
+                ++iteration;
+                if ((cost - newCost) < (1e-6 * cost)) {
+                    cost = newCost;
+                    break;
+                }
+                cost = newCost;
+                continue;
+            }
+            lambda *= 10.0;
+        }
+        if (lambda > 1e6)
+            break;
+    }
+}
+
+double LocalBundleAdjustment::_computeCost(const std::vector<Pose> & poses,
+                                           const std::vector<TMath::TVector3d> & positions,
+                                           double squareSigma) const
+{
+    using namespace TMath;
+
+    double cost = 0.0;
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        const Point & point = m_points[i];
+        for (int j = 0; j < point.countObservations; ++j) {
+            const Observation & observation = m_observations[point.firstObservation + j];
+            const Pose & pose = poses[observation.pose];
+            TVector3d v = pose.rotation * positions[i] + pose.translation;
+            if (v(2) < std::numeric_limits<float>::epsilon()) {
+                // points behind the camera are outliers
+                cost += 1.0;
+                continue;
+            }
+            Point2d e = LocationOptimizer::project2d(v) - observation.localPoint;
+            cost += TukeyRobustCost::objectiveScore(e.lengthSquared() * observation.invSquareScale, squareSigma);
+        }
+    }
+    return cost;
+}
+
+bool LocalBundleAdjustment::_solve(double lambda, double squareSigma)
+{
+    using namespace TMath;
+
+    const int n = m_countVariablePoses;
+    m_H_pl.resize(m_observations.size());
+    m_H_ll.resize(m_points.size());
+    m_b_l.resize(m_points.size());
+    m_invH_ll.resize(m_points.size());
+    m_deltaPoints.resize(m_points.size());
+    m_H_pp.resize(n * n);
+    m_b_p.resize(n);
+    for (int i = 0; i < n * n; ++i)
+        m_H_pp[i].setZero();
+    for (int i = 0; i < n; ++i)
+        m_b_p[i].setZero();
+
+    // normal equations, blocks of poses with map points are kept by observations
+    TMatrixN<double, 2, 6> J_p;
+    TMatrixN<double, 2, 3> J_l;
+    TVectorN<double, 2> e;
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        const Point & point = m_points[i];
+        TMatrix3d & H_ll = m_H_ll[i];
+        TVector3d & b_l = m_b_l[i];
+        H_ll.setZero();
+        b_l.setZero();
+        for (int j = 0; j < point.countObservations; ++j) {
+            const int o = point.firstObservation + j;
+            const Observation & observation = m_observations[o];
+            const Pose & pose = m_poses[observation.pose];
+            TMatrixN<double, 6, 3> & H_pl = m_H_pl[o];
+            H_pl.setZero();
+
+            TVector3d v = pose.rotation * m_positions[i] + pose.translation;
+            if (v(2) < std::numeric_limits<float>::epsilon())
+                continue;
+            const double z_inv = 1.0 / v(2);
+            Point2d projection(v(0) * z_inv, v(1) * z_inv);
+            e(0) = projection.x - observation.localPoint.x;
+            e(1) = projection.y - observation.localPoint.y;
+            double squareError = (e(0) * e(0) + e(1) * e(1)) * observation.invSquareScale;
+            double weight = TukeyRobustCost::weight(squareError, squareSigma) * observation.invSquareScale;
+            if (weight <= 0.0)
+                continue;
+
+            // derivatives of projection by the point in the frame of camera
+            const double J_proj[2][3] = { { z_inv, 0.0, - projection.x * z_inv },
+                                          { 0.0, z_inv, - projection.y * z_inv } };
+            for (int r = 0; r < 2; ++r) {
+                // pose is updated as R' = exp(w) * R, t' = exp(w) * t + dt, so dv = dt + w x v
+                J_p(r, 0) = J_proj[r][0];
+                J_p(r, 1) = J_proj[r][1];
+                J_p(r, 2) = J_proj[r][2];
+                J_p(r, 3) = J_proj[r][1] * (- v(2)) + J_proj[r][2] * v(1);
+                J_p(r, 4) = J_proj[r][0] * v(2) + J_proj[r][2] * (- v(0));
+                J_p(r, 5) = J_proj[r][0] * (- v(1)) + J_proj[r][1] * v(0);
+                for (int c = 0; c < 3; ++c)
+                    J_l(r, c) = J_proj[r][0] * pose.rotation(0, c) +
+                                J_proj[r][1] * pose.rotation(1, c) +
+                                J_proj[r][2] * pose.rotation(2, c);
+            }
+
+            TMatrixN<double, 3, 2> J_lt_w = J_l.transposed() * weight;
+            H_ll += J_lt_w * J_l;
+            b_l -= J_lt_w * e;
+            if (pose.variable >= 0) {
+                TMatrixN<double, 6, 2> J_pt_w = J_p.transposed() * weight;
+                m_H_pp[pose.variable * n + pose.variable] += J_pt_w * J_p;
+                m_b_p[pose.variable] -= J_pt_w * e;
+                H_pl = J_pt_w * J_l;
+            }
+        }
+        for (int k = 0; k < 3; ++k)
+            H_ll(k, k) *= 1.0 + lambda;
+        invert3x3(m_invH_ll[i], H_ll);
+    }
+    for (int i = 0; i < n; ++i) {
+        TMatrix6d & H_pp = m_H_pp[i * n + i];
+        for (int k = 0; k < 6; ++k)
+            H_pp(k, k) *= 1.0 + lambda;
+    }
+
+    // map points are eliminated: S = H_pp - H_pl * inv(H_ll) * H_lp
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        const Point & point = m_points[i];
+        for (int a = 0; a < point.countObservations; ++a) {
+            const int o_a = point.firstObservation + a;
+            const int p_a = m_poses[m_observations[o_a].pose].variable;
+            if (p_a < 0)
+                continue;
+            TMatrixN<double, 6, 3> H_pl_invH_ll = m_H_pl[o_a] * m_invH_ll[i];
+            m_b_p[p_a] -= H_pl_invH_ll * m_b_l[i];
+            for (int b = 0; b < point.countObservations; ++b) {
+                const int o_b = point.firstObservation + b;
+                const int p_b = m_poses[m_observations[o_b].pose].variable;
+                if (p_b < 0)
+                    continue;
+                m_H_pp[p_a * n + p_b] -= H_pl_invH_ll * m_H_pl[o_b].transposed();
+            }
+        }
+    }
+
+    // the reduced system of poses is small, so it's solved as dense
+    TVectord deltaPoses(6 * n);
+    if (n > 0) {
+        TMatrixd S(6 * n, 6 * n);
+        TVectord b(6 * n);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                const TMatrix6d & block = m_H_pp[i * n + j];
+                for (int r = 0; r < 6; ++r)
+                    for (int c = 0; c < 6; ++c)
+                        S(i * 6 + r, j * 6 + c) = block(r, c);
+            }
+            for (int r = 0; r < 6; ++r)
+                b(i * 6 + r) = m_b_p[i](r);
+        }
+        TCholesky<double> cholesky(S);
+        if (cholesky.rank() < 6 * n)
+            return false;
+        deltaPoses = cholesky.backsub(b);
+        for (int i = 0; i < 6 * n; ++i) {
+            if (std::isnan(deltaPoses(i)))
+                return false;
+        }
+    }
+
+    m_newPoses = m_poses;
+    for (auto it = m_newPoses.begin(); it != m_newPoses.end(); ++it) {
+        if (it->variable < 0)
+            continue;
+        TVector6d mu;
+        for (int k = 0; k < 6; ++k)
+            mu(k) = deltaPoses(it->variable * 6 + k);
+        TMatrix3d dRotation;
+        TVector3d dTranslation;
+        TTools::exp_transform(dRotation, dTranslation, mu);
+        it->rotation = dRotation * it->rotation;
+        it->translation = dRotation * it->translation + dTranslation;
+    }
+
+    // back substitution: dX = inv(H_ll) * (b_l - H_lp * dx)
+    m_newPositions.resize(m_positions.size());
+    for (std::size_t i = 0; i < m_points.size(); ++i) {
+        const Point & point = m_points[i];
+        TVector3d b_l = m_b_l[i];
+        for (int j = 0; j < point.countObservations; ++j) {
+            const int o = point.firstObservation + j;
+            const int p = m_poses[m_observations[o].pose].variable;
+            if (p < 0)
+                continue;
+            TVector6d dx;
+            for (int k = 0; k < 6; ++k)
+                dx(k) = deltaPoses(p * 6 + k);
+            b_l -= m_H_pl[o].transposed() * dx;
+        }
+        m_deltaPoints[i] = m_invH_ll[i] * b_l;
+        m_newPositions[i] = m_positions[i] + m_deltaPoints[i];
+    }
+    return true;
+}
+
+void LocalBundleAdjustment::_apply(MapResourcesManager * manager)
+{
+    std::vector<Map::KeyFramePose> poses;
+    poses.reserve(m_countVariablePoses);
+    for (auto it = m_poses.cbegin(); it != m_poses.cend(); ++it) {
+        if (it->variable < 0)
+            continue;
+        poses.push_back({ it->keyFrame, it->rotation.toTMatrix(), it->translation.toTVector() });
+    }
+    std::vector<Map::MapPointPosition> positions;
+    positions.reserve(m_points.size());
+    for (std::size_t i = 0; i < m_points.size(); ++i)
+        positions.push_back({ m_points[i].mapPoint, m_positions[i].toTVector() });
+    m_map->adjust(manager, poses, positions);
+}
+
+} // namespace AR
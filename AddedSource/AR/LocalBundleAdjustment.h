@@ -0,0 +1,143 @@
+#ifndef AR_LOCALBUNDLEADJUSTMENT_H
+#define AR_LOCALBUNDLEADJUSTMENT_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include "TMath/TMath.h"
+#include "Point2.h"
+#include "Map.h"
+#include "MapResourcesManager.h"
+#include "PerformanceMonitor.h"
+
+namespace AR {
+
+class KeyFrame;
+class MapPoint;
+
+// Local bundle adjustment of a new key frame and key frames covisible with it.
+// The window is the new key frame and up to countKeyFrames() - 1 key frames with the most common map points,
+// poses of the window and positions of all their map points are refined together by Levenberg-Marquardt with
+// Tukey weights of errors. Other key frames which see these map points are fixed, if there are no such key frames
+// then the most covisible key frame of the window is fixed. Normal equations are solved by the Schur complement:
+// blocks of map points (3x3) are eliminated, the reduced system of poses (6x6 blocks) is solved by Cholesky
+// decomposition, then map points are found by back substitution.
+// With the thread adjustment is done off the tracking thread: the map is locked only to copy data of the window
+// and to apply results by Map::adjust(), results are dropped if the map was transformed, scaled or reset meanwhile.
+class LocalBundleAdjustment:
+        public Map::MapListener
+{
+public:
+    LocalBundleAdjustment(Map * map);
+    ~LocalBundleAdjustment();
+
+    int countKeyFrames() const;
+    void setCountKeyFrames(int countKeyFrames);
+
+    int numberIterations() const;
+    void setNumberIterations(int numberIterations);
+
+    bool threadIsRunning() const;
+    void startThread();
+    void stopThread();
+
+    // Adjustments are measured by performanceMonitor, it can be nullptr.
+    void setPerformanceMonitor(PerformanceMonitor * performanceMonitor);
+
+    // The window of the key frame is adjusted by the thread, only the last added key frame is kept.
+    void addKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame);
+
+    // Adjusts the window of key frame in the calling thread, the map must be locked by the caller.
+    // Returns false if there is nothing to adjust.
+    bool adjust(MapResourcesManager * manager, const std::shared_ptr<KeyFrame> & keyFrame);
+
+    std::size_t countAdjustments() const;
+
+    void onTransformMap(const TMath::TMatrixd & rotation, const TMath::TVectord & translation) override;
+    void onScaleMap(double scale) override;
+    void onResetMap() override;
+
+    void loop();
+
+private:
+    LocalBundleAdjustment(const LocalBundleAdjustment & ) = delete;
+    void operator = (const LocalBundleAdjustment & ) = delete;
+
+    struct Pose
+    {
+        std::shared_ptr<KeyFrame> keyFrame;
+        TMath::TMatrix3d rotation;
+        TMath::TVector3d translation;
+        int variable; // index of pose in the reduced system, -1 - pose is fixed
+    };
+
+    struct Point
+    {
+        std::shared_ptr<MapPoint> mapPoint;
+        int firstObservation; // observations of point are stored together
+        int countObservations;
+    };
+
+    struct Observation
+    {
+        int pose;
+        Point2d localPoint;    // on z=1 plane of key frame
+        double invSquareScale; // 1 / (2^imageLevel)^2
+    };
+
+    Map * m_map;
+    MapResourcesManager m_resourceManager;
+    mutable std::mutex m_config_mutex;
+    int m_countKeyFrames;
+    int m_numberIterations;
+
+    mutable std::mutex m_thread_mutex;
+    std::condition_variable m_thread_condition;
+    bool m_thread_is_running;
+    std::thread * m_thread;
+    std::weak_ptr<KeyFrame> m_keyFrame;
+    bool m_isNewKeyFrame;
+
+    // Changes of the whole map, data copied before a change is out of date.
+    std::atomic<std::uint64_t> m_mapEpoch;
+    std::atomic<std::size_t> m_countAdjustments;
+
+    PerformanceMonitor * m_performanceMonitor;
+    int m_stage_adjustment;
+    int m_counter_adjustments;
+    int m_counter_droppedAdjustments;
+
+    std::vector<Pose> m_poses;
+    std::vector<Point> m_points;
+    std::vector<TMath::TVector3d> m_positions; // by points
+    std::vector<Observation> m_observations;
+    int m_countVariablePoses;
+    double m_minSquareSigma;
+
+    // Buffers of solver.
+    std::vector<TMath::TMatrixN<double, 6, 3>> m_H_pl; // by observations
+    std::vector<TMath::TMatrix3d> m_H_ll;
+    std::vector<TMath::TVector3d> m_b_l;
+    std::vector<TMath::TMatrix3d> m_invH_ll;
+    std::vector<TMath::TVector3d> m_deltaPoints;
+    std::vector<TMath::TMatrix6d> m_H_pp; // blocks of the reduced system
+    std::vector<TMath::TVector6d> m_b_p;
+    std::vector<Pose> m_newPoses;
+    std::vector<TMath::TVector3d> m_newPositions;
+    std::vector<double> m_squareErrors;
+
+    bool _collect(MapResourcesManager * manager, const std::shared_ptr<KeyFrame> & keyFrame);
+    void _optimize(int numberIterations);
+    double _computeCost(const std::vector<Pose> & poses, const std::vector<TMath::TVector3d> & positions,
+                        double squareSigma) const;
+    bool _solve(double lambda, double squareSigma);
+    void _apply(MapResourcesManager * manager);
+};
+
+} // namespace AR
+
+#endif // AR_LOCALBUNDLEADJUSTMENT_H
@@ -87,21 +87,28 @@ void LocationOptimizer::optimize(PreviewFrame & previewFrame)
     squareErrors.resize(features.size());
     std::vector<Point2d> f_points;
     f_points.resize(features.size());
+    // points are projected by batches on lookup tables of camera, they are unprojected by the exact path,
+    // because the undistortion map of camera isn't faster
 
     Point2d e;
 
     std::shared_ptr<const Camera> camera = previewFrame.camera();
 
-    TMatrixd rotation = previewFrame.rotation();
-    TVectord translation = previewFrame.translation();
+    TMatrix3d rotation = previewFrame.rotation();
+    TVector3d translation = previewFrame.translation();
+
+    // positions of map points are locked and don't change while optimization
+    std::vector<TVector3d> positions;
+    positions.resize(features.size());
 
     std::size_t i = 0;
     for (auto it = features.begin(); it != features.end(); ++it, ++i) {
         std::shared_ptr<MapPoint> mapPoint = it->mapPoint;
         m_mapResourceManager->lock(mapPoint.get());
+        positions[i] = mapPoint->position();
         f_points[i] = camera->unproject(it->positionOnFrame);
         float scale = (float)(1 << it->imageLevel);
-        e = f_points[i] - project2d(rotation * mapPoint->position() + translation);
+        e = f_points[i] - project2d(rotation * positions[i] + translation);
         squareErrors[i] = (float)(e.lengthSquared() / (scale * scale));
     }
 
@@ -110,10 +117,11 @@ void LocationOptimizer::optimize(PreviewFrame & previewFrame)
 
     double squareSigma = (double)TukeyRobustCost::findSquareSigma(squareErrors);
 
-    TMatrixd dRotation(3, 3);
-    TVectord dTranslation(3);
+    TMatrix3d dRotation;
+    TVector3d dTranslation;
 
-    TVectord v_f(3), J_x(6), J_y(6);
+    TVector3d v_f;
+    TVector6d J_x, J_y;
 
     for (int iteration = 0; iteration < m_numberIterations; ++iteration) {
 
@@ -124,9 +132,7 @@ void LocationOptimizer::optimize(PreviewFrame & previewFrame)
 
         i = 0;
         for (auto it = features.begin(); it != features.end(); ++it, ++i) {
-            std::shared_ptr<MapPoint> mapPoint = it->mapPoint;
-
-            v_f = rotation * mapPoint->position() + translation;
+            v_f = rotation * positions[i] + translation;
             e = f_points[i] - project2d(v_f);
             double sqrt_cov = (double)(1 << it->imageLevel);
             sqrt_cov *= sqrt_cov;
@@ -141,7 +147,7 @@ void LocationOptimizer::optimize(PreviewFrame & previewFrame)
 
         wls.compute();
 
-        TVectord dT = - wls.X();
+        TVector6d dT = - TVector6d(wls.X());
         TTools::exp_transform(dRotation, dTranslation, dT);
 
         rotation = dRotation * rotation;
@@ -151,12 +157,19 @@ void LocationOptimizer::optimize(PreviewFrame & previewFrame)
             break;
     }
 
-    previewFrame.setRotation(rotation);
-    previewFrame.setTranslation(translation);
+    previewFrame.setRotation(rotation.toTMatrix());
+    previewFrame.setTranslation(translation.toTVector());
+
+    std::vector<Point2d> projections;
+    projections.resize(features.size());
+    for (i = 0; i < features.size(); ++i)
+        f_points[i] = project2d(rotation * positions[i] + translation);
+    camera->projectMany(f_points.data(), projections.data(), features.size());
 
-    for (auto it = features.begin(); it != features.end(); ) {
+    i = 0;
+    for (auto it = features.begin(); it != features.end(); ++i) {
         std::shared_ptr<MapPoint> mapPoint = it->mapPoint;
-        e = it->positionOnFrame.cast<double>() - camera->project(project2d(rotation * mapPoint->position() + translation));
+        e = it->positionOnFrame.cast<double>() - projections[i];
         float scale = (float)(1 << it->imageLevel);
         if (e.lengthSquared() / (scale * scale) > m_maxSquarePixelError) {
             mapPoint->statistic().incFailed();
@@ -4,6 +4,7 @@
 #include <vector>
 #include "TMath/TVector.h"
 #include "TMath/TMatrix.h"
+#include "TMath/TMatrixN.h"
 #include "MapPoint.h"
 #include "Map.h"
 #include "PreviewFrame.h"
@@ -67,6 +68,33 @@ public:
         J_y(5) = - x * z_inv;             // - x / z
     }
 
+    inline static Point2d project2d(const TMath::TVector3d & v)
+    {
+        return Point2d(v(0) / v(2), v(1) / v(2));
+    }
+
+    inline static void jacobian_xyz2uv(TMath::TVector6d & J_x, TMath::TVector6d & J_y, const TMath::TVector3d & v)
+    {
+        double x = v(0);
+        double y = v(1);
+        double z_inv = 1.0 / v(2);
+        double z_inv_squared = z_inv * z_inv;
+
+        J_x(0) = - z_inv;                 // - 1 / z
+        J_x(1) = 0.0;                     // 0
+        J_x(2) = x * z_inv_squared;       // x / z^2
+        J_x(3) = y * J_x(2);              // x * y / z^2
+        J_x(4) = - (1.0 + x * J_x(2));    // -(1.0 + x^2 / z^2)
+        J_x(5) = y * z_inv;               // y / z
+
+        J_y(0) = 0.0;                     // 0
+        J_y(1) = - z_inv;                 // - 1 / z
+        J_y(2) = y * z_inv_squared;       // y / z^2
+        J_y(3) = 1.0 + y * J_y(2);        // 1.0 + y^2 / z^2
+        J_y(4) = - J_x(3);                // -x * y / z^2
+        J_y(5) = - x * z_inv;             // - x / z
+    }
+
     inline static void jacobian_xyz2uv(float * J_x, float * J_y, const float * v)
     {
         float x = v[0];
@@ -98,9 +126,8 @@ private:
     MapResourcesManager * m_mapResourceManager;
     std::vector<std::shared_ptr<MapPoint>> m_failedMapPoints;
 
-    inline bool _needStop(const TMath::TVectord & dT) const
+    inline bool _needStop(const TMath::TVector6d & dT) const
     {
-        TMath_assert(dT.size() == 6);
         for (int i = 0; i < 6; ++i) {
             if (std::fabs(dT(i)) > m_eps)
                 return false;
@@ -11,9 +11,14 @@
 #include <limits>
 #include <climits>
 #include <cmath>
+#include <algorithm>
 #include "MapResourceObject.h"
 #include "MapResourcesManager.h"
 #include "MapResourceLocker.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 
 namespace AR {
 
@@ -23,7 +28,11 @@ Map::Map(int countImageLevels, int sizeOfSmallImage)
 {
     m_countImageLevels = countImageLevels;
     m_casheSmallImageH = Image<uchar>(Point2i(sizeOfSmallImage, sizeOfSmallImage));
+    m_casheSmallImageV = Image<uchar>(m_casheSmallImageH.size());
     m_listener = &_static_null_map_listener;
+    m_mapPointsPool = std::make_shared<SlabPool<MapPoint, MapPointsBlock>>();
+    m_keyFramesPool = std::make_shared<SlabPool<KeyFrame>>();
+    m_featuresPool = std::make_shared<SlabPool<Feature>>();
 }
 
 Map::~Map()
@@ -59,14 +68,33 @@ void Map::resetListener()
     m_listener = &_static_null_map_listener;
 }
 
+void Map::addListener(MapListener * listener)
+{
+    TMath_assert(listener != nullptr);
+    TMath_assert(std::find(m_listeners.begin(), m_listeners.end(), listener) == m_listeners.end());
+    m_listeners.push_back(listener);
+}
+
+void Map::removeListener(MapListener * listener)
+{
+    auto it = std::find(m_listeners.begin(), m_listeners.end(), listener);
+    if (it != m_listeners.end())
+        m_listeners.erase(it);
+}
+
 std::shared_ptr<MapPoint> Map::createMapPoint(const TMath::TVectord & position)
 {
-    std::shared_ptr<MapPoint> newMapPoint(new MapPoint(this, m_mapPoints.size(), position));
+    std::size_t slot;
+    void * memory = m_mapPointsPool->allocate(slot);
+    MapPointsBlock & block = m_mapPointsPool->block(slot);
+    std::shared_ptr<MapPoint> newMapPoint = m_mapPointsPool->makeShared(
+                new (memory) MapPoint(this, m_mapPoints.size(), m_mapPointsPool->handle(slot), &block, position), slot);
+    block.inMap[slot % countObjectsInSlab] = true;
     {
         //std::lock_guard<std::mutex> locker(m_mutex_mapPoints); (void)locker;
         m_mapPoints.push_back(newMapPoint);
     }
-    m_listener->onCreateMapPoint(newMapPoint);
+    _notify(&MapListener::onCreateMapPoint, newMapPoint);
     return newMapPoint;
 }
 
@@ -89,8 +117,9 @@ void Map::deleteMapPoint(const std::shared_ptr<MapPoint> & mapPoint)
         m_mapPoints.resize(lastIndex);
         mapPoint->_clearFeatures();
         mapPoint->m_index = std::numeric_limits<std::size_t>::max();
+        mapPoint->m_block->inMap[mapPoint->m_indexInBlock] = false;
     }
-    m_listener->onDeleteMapPoint(mapPoint);
+    _notify(&MapListener::onDeleteMapPoint, mapPoint);
 }
 
 std::size_t Map::countMapPoints() const
@@ -114,12 +143,13 @@ std::shared_ptr<const MapPoint> Map::mapPoint(std::size_t index) const
 std::shared_ptr<KeyFrame> Map::createKeyFrame(const std::shared_ptr<const Camera> & camera,
                                               const std::vector<Image<uchar>> & imagePyramid)
 {
-    std::shared_ptr<KeyFrame> newKeyFrame(new KeyFrame(this, m_keyFrames.size(), camera, imagePyramid));
+    std::shared_ptr<KeyFrame> newKeyFrame = _createInPool(*m_keyFramesPool, this, m_keyFrames.size(), camera, imagePyramid);
     {
         //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
         m_keyFrames.push_back(newKeyFrame);
+        m_keyFramesIndex.add(*newKeyFrame);
     }
-    m_listener->onCreateKeyFrame(newKeyFrame);
+    _notify(&MapListener::onCreateKeyFrame, newKeyFrame);
     return newKeyFrame;
 }
 
@@ -128,45 +158,50 @@ std::shared_ptr<KeyFrame> Map::createKeyFrame(const std::shared_ptr<const Camera
                                               const TMath::TMatrixd & rotation,
                                               const TMath::TVectord & translation)
 {
-    std::shared_ptr<KeyFrame> newKeyFrame(new KeyFrame(this, m_keyFrames.size(), camera, imagePyramid,
-                                                       rotation, translation));
+    std::shared_ptr<KeyFrame> newKeyFrame = _createInPool(*m_keyFramesPool, this, m_keyFrames.size(),
+                                                          camera, imagePyramid, rotation, translation);
     {
         //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
         m_keyFrames.push_back(newKeyFrame);
+        m_keyFramesIndex.add(*newKeyFrame);
     }
-    m_listener->onCreateKeyFrame(newKeyFrame);
+    _notify(&MapListener::onCreateKeyFrame, newKeyFrame);
     return newKeyFrame;
 }
 
 std::shared_ptr<KeyFrame> Map::createKeyFrame(const Frame & frame)
 {
-    std::shared_ptr<KeyFrame> newKeyFrame(new KeyFrame(this, m_keyFrames.size(), frame));
+    std::shared_ptr<KeyFrame> newKeyFrame = _createInPool(*m_keyFramesPool, this, m_keyFrames.size(), frame);
     {
         //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
         m_keyFrames.push_back(newKeyFrame);
+        m_keyFramesIndex.add(*newKeyFrame);
     }
-    m_listener->onCreateKeyFrame(newKeyFrame);
+    _notify(&MapListener::onCreateKeyFrame, newKeyFrame);
     return newKeyFrame;
 }
 
-void Map::deleteKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame)
+void Map::deleteKeyFrame(MapResourcesManager * manager, const std::shared_ptr<KeyFrame> & keyFrame)
 {
     {
         //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
         TMath_assert(keyFrame);
         TMath_assert(keyFrame->map() == this);
+        MapResourceLocker lockerR(manager, keyFrame.get()); (void)lockerR;
         TMath_assert(!keyFrame->isDeleted());
         keyFrame->_clearFeatures();
+        m_keyFramesIndex.remove(keyFrame->m_index);
         std::size_t lastIndex = m_keyFrames.size() - 1;
         if (keyFrame->m_index < lastIndex) {
             std::shared_ptr<KeyFrame> lastKeyFrame = m_keyFrames[lastIndex];
+            MapResourceLocker lockerLastR(manager, lastKeyFrame.get()); (void)lockerLastR;
             m_keyFrames[keyFrame->m_index] = lastKeyFrame;
             lastKeyFrame->m_index = keyFrame->m_index;
         }
         m_keyFrames.resize(lastIndex);
         keyFrame->m_index = std::numeric_limits<std::size_t>::max();
     }
-    m_listener->onDeleteKeyFrame(keyFrame);
+    _notify(&MapListener::onDeleteKeyFrame, keyFrame);
 }
 
 std::size_t Map::countKeyFrames() const
@@ -191,96 +226,62 @@ std::shared_ptr<KeyFrame> Map::getNearestKeyFrame(MapResourcesManager * manager,
                                                   const TMath::TVectord & position,
                                                   const TMath::TVectord & dir)
 {
-    TMath_assert(position.size() == 3);
-    std::shared_ptr<KeyFrame> result;
-    {
-        //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
-        double maxDistanceSquared = 0.0, d;
-        for (auto it = m_keyFrames.begin(); it != m_keyFrames.end(); ++it) {
-            MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
-            d = ((*it)->worldPosition() - position).lengthSquared();
-            d *= std::min(0.0, TMath::dot((*it)->rotation().getColumn(2), dir));
-            if (d > maxDistanceSquared) {
-                maxDistanceSquared = d;
-                result = *it;
-            }
-        }
-    }
-    return result;
+    (void)manager;
+    int index = m_keyFramesIndex.findNearest(position, dir);
+    return (index >= 0) ? m_keyFrames[index] : std::shared_ptr<KeyFrame>();
 }
 
 std::shared_ptr<const KeyFrame> Map::getNearestKeyFrame(MapResourcesManager * manager,
                                           const TMath::TVectord & position,
                                           const TMath::TVectord & dir) const
 {
-    TMath_assert(position.size() == 3);
-    std::shared_ptr<const KeyFrame> result;
-    {
-        //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
-        double maxDistanceSquared = 0.0, d;
-        for (auto it = m_keyFrames.cbegin(); it != m_keyFrames.cend(); ++it) {
-            MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
-            d = ((*it)->worldPosition() - position).lengthSquared();
-            d *= std::min(0.0, TMath::dot((*it)->rotation().getColumn(2), dir));
-            if (d > maxDistanceSquared) {
-                maxDistanceSquared = d;
-                result = *it;
-            }
-        }
-    }
-    return result;
+    (void)manager;
+    int index = m_keyFramesIndex.findNearest(position, dir);
+    return (index >= 0) ? m_keyFrames[index] : std::shared_ptr<const KeyFrame>();
 }
 
 std::shared_ptr<KeyFrame> Map::getFurthestKeyFrame(MapResourcesManager * manager,
                                                    const TMath::TVectord & position)
 {
-    TMath_assert(position.size() == 3);
-    std::shared_ptr<KeyFrame> result;
-    {
-        //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
-        double maxDistanceSquared = 0.0, d;
-        for (auto it = m_keyFrames.begin(); it != m_keyFrames.end(); ++it) {
-            MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
-            d = ((*it)->worldPosition() - position).lengthSquared();
-            if (d > maxDistanceSquared) {
-                maxDistanceSquared = d;
-                result = *it;
-            }
-        }
-    }
-    return result;
+    (void)manager;
+    int index = m_keyFramesIndex.findFurthest(position);
+    return (index >= 0) ? m_keyFrames[index] : std::shared_ptr<KeyFrame>();
 }
 
 std::shared_ptr<const KeyFrame> Map::getFurthestKeyFrame(MapResourcesManager * manager,
                                                          const TMath::TVectord & position) const
 {
-    TMath_assert(position.size() == 3);
-    std::shared_ptr<const KeyFrame> result;
-    {
-        //std::lock_guard<std::mutex> locker(m_mutex_keyFrames); (void)locker;
-        double maxDistanceSquared = 0.0, d;
-        for (auto it = m_keyFrames.cbegin(); it != m_keyFrames.cend(); ++it) {
-            MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
-            d = ((*it)->worldPosition() - position).lengthSquared();
-            if (d > maxDistanceSquared) {
-                maxDistanceSquared = d;
-                result = *it;
-            }
-        }
-    }
+    (void)manager;
+    int index = m_keyFramesIndex.findFurthest(position);
+    return (index >= 0) ? m_keyFrames[index] : std::shared_ptr<const KeyFrame>();
+}
+
+std::vector<std::shared_ptr<KeyFrame>> Map::getNearestKeyFrames(const TMath::TVectord & position,
+                                                                std::size_t count)
+{
+    std::vector<int> indices;
+    m_keyFramesIndex.findNearest(indices, position, count);
+    std::vector<std::shared_ptr<KeyFrame>> result(indices.size());
+    for (std::size_t i = 0; i < indices.size(); ++i)
+        result[i] = m_keyFrames[indices[i]];
     return result;
 }
 
+TMath::TVectord Map::keyFrameWorldPosition(std::size_t index) const
+{
+    return m_keyFramesIndex.worldPosition(index);
+}
+
 std::shared_ptr<Feature> Map::createFeature(const std::shared_ptr<KeyFrame> & keyFrame,
                                             const Point2f & positionOnFrame, int imageLevel,
                                             const std::shared_ptr<MapPoint> & mapPoint)
 {
-    std::shared_ptr<Feature> f(new Feature(keyFrame, positionOnFrame, imageLevel, mapPoint));
+    std::shared_ptr<Feature> f = _createInPool(*m_featuresPool, keyFrame, positionOnFrame, imageLevel, mapPoint);
     f->m_indexInKeyFrame = (int)keyFrame->m_features.size();
     keyFrame->m_features.push_back(f);
     f->m_indexInMapPoint = (int)mapPoint->m_features.size();
     mapPoint->m_features.push_back(f);
-    m_listener->onCreateFeature(f);
+    _notify(&MapListener::onCreateFeature, f);
     return f;
 }
 
@@ -288,7 +289,7 @@ void Map::deleteFeature(const std::shared_ptr<Feature> & feature)
 {
     feature->_releaseInKeyFrame();
     feature->_releaseInMapPoint();
-    m_listener->onDeleteFeature(feature);
+    _notify(&MapListener::onDeleteFeature, feature);
 }
 
 int Map::countImageLevels() const
@@ -373,6 +374,22 @@ Image<int> Map::getSmallImage(const Frame & frame) const
     return smallImage;
 }
 
+template <typename Function>
+void Map::_forEachMapPointInBlocks(MapResourcesManager * manager, Function function)
+{
+    SlabPool<MapPoint, MapPointsBlock> & pool = *m_mapPointsPool;
+    std::size_t countSlots = pool.countSlots();
+    for (std::size_t begin = 0; begin < countSlots; begin += countObjectsInSlab) {
+        MapPointsBlock & block = pool.block(begin);
+        for (std::size_t i = 0; i < countObjectsInSlab; ++i) {
+            if (!block.inMap[i])
+                continue;
+            MapResourceLocker lockerR(manager, pool.object(begin + i)); (void)lockerR;
+            function(block, i);
+        }
+    }
+}
+
 void Map::transform(MapResourcesManager * manager,
                     const TMath::TMatrixd & rotation,
                     const TMath::TVectord & translation)
@@ -380,10 +397,16 @@ void Map::transform(MapResourcesManager * manager,
     {
         //std::lock_guard<std::mutex> lockerKeyFrames(m_mutex_keyFrames); (void)lockerKeyFrames;
         //std::lock_guard<std::mutex> lockerMapPoints(m_mutex_mapPoints); (void)lockerMapPoints;
-        for (std::vector<std::shared_ptr<MapPoint>>::iterator it = m_mapPoints.begin(); it != m_mapPoints.end(); ++it) {
-            MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
-            (*it)->transform(rotation, translation);
-        }
+        TMath_assert((rotation.rows() == 3) && (rotation.cols() == 3));
+        TMath_assert(translation.size() == 3);
+        const double * R = rotation.data();
+        const double * t = translation.data();
+        _forEachMapPointInBlocks(manager, [R, t] (MapPointsBlock & block, std::size_t i) {
+            double x = block.x[i], y = block.y[i], z = block.z[i];
+            block.x[i] = R[0] * x + R[1] * y + R[2] * z + t[0];
+            block.y[i] = R[3] * x + R[4] * y + R[5] * z + t[1];
+            block.z[i] = R[6] * x + R[7] * y + R[8] * z + t[2];
+        });
         TMath::TMatrixd invRotation = TMath::TTools::matrix3x3Inverted(rotation);
         TMath::TVectord invTranslation = - (invRotation * translation);
         for (std::vector<std::shared_ptr<KeyFrame>>::iterator it = m_keyFrames.begin(); it != m_keyFrames.end(); ++it) {
@@ -391,7 +414,7 @@ void Map::transform(MapResourcesManager * manager,
             (*it)->transform(invRotation, invTranslation);
         }
     }
-    m_listener->onTransformMap(rotation, translation);
+    _notify(&MapListener::onTransformMap, rotation, translation);
 }
 
 void Map::scale(MapResourcesManager * manager, double scale)
@@ -399,17 +422,46 @@ void Map::scale(MapResourcesManager * manager, double scale)
     {
         std::lock_guard<std::mutex> lockerKeyFrames(m_mutex_keyFrames); (void)lockerKeyFrames;
         std::lock_guard<std::mutex> lockerMapPoints(m_mutex_mapPoints); (void)lockerMapPoints;
-        for (std::vector<std::shared_ptr<MapPoint>>::iterator it = m_mapPoints.begin(); it != m_mapPoints.end(); ++it) {
-            std::shared_ptr<MapPoint> mapPoint = *it;
-            MapResourceLocker lockerR(manager, mapPoint.get()); (void)lockerR;
-            mapPoint->setPosition(mapPoint->position() * scale);
-        }
+        _forEachMapPointInBlocks(manager, [scale] (MapPointsBlock & block, std::size_t i) {
+            block.x[i] *= scale;
+            block.y[i] *= scale;
+            block.z[i] *= scale;
+        });
         for (std::vector<std::shared_ptr<KeyFrame>>::iterator it = m_keyFrames.begin(); it != m_keyFrames.end(); ++it) {
             MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
             (*it)->setTranslation((*it)->translation() * scale);
         }
     }
-    m_listener->onScaleMap(scale);
+    _notify(&MapListener::onScaleMap, scale);
+}
+
+void Map::adjust(MapResourcesManager * manager,
+                 const std::vector<KeyFramePose> & poses,
+                 const std::vector<MapPointPosition> & positions)
+{
+    // objects are locked before changes, so other threads see all changes or none of them
+    if (manager != nullptr) {
+        for (auto it = poses.cbegin(); it != poses.cend(); ++it)
+            manager->lock(it->keyFrame.get());
+        for (auto it = positions.cbegin(); it != positions.cend(); ++it)
+            manager->lock(it->mapPoint.get());
+    }
+    for (auto it = poses.cbegin(); it != poses.cend(); ++it) {
+        if (!it->keyFrame->isDeleted()) {
+            it->keyFrame->setRotation(it->rotation);
+            it->keyFrame->setTranslation(it->translation);
+        }
+    }
+    for (auto it = positions.cbegin(); it != positions.cend(); ++it) {
+        if (!it->mapPoint->isDeleted())
+            it->mapPoint->setPosition(it->position);
+    }
+    if (manager != nullptr) {
+        for (auto it = positions.crbegin(); it != positions.crend(); ++it)
+            manager->unlock(it->mapPoint.get());
+        for (auto it = poses.crbegin(); it != poses.crend(); ++it)
+            manager->unlock(it->keyFrame.get());
+    }
 }
 
 void Map::resetMap(MapResourcesManager * manager)
@@ -420,31 +472,429 @@ void Map::resetMap(MapResourcesManager * manager)
         for (auto it = m_mapPoints.begin(); it != m_mapPoints.end(); ++it) {
             MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
             (*it)->m_index = std::numeric_limits<std::size_t>::max();
+            (*it)->m_block->inMap[(*it)->m_indexInBlock] = false;
         }
         m_mapPoints.clear();
         for (auto it = m_keyFrames.begin(); it != m_keyFrames.end(); ++it) {
             MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
+            // key frames can be destroyed in other threads (MapPointsDetector), so features are released here
+            (*it)->_clearFeatures();
             (*it)->m_index = std::numeric_limits<std::size_t>::max();
         }
         m_keyFrames.clear();
+        m_keyFramesIndex.clear();
     }
-    m_listener->onResetMap();
+    _notify(&MapListener::onResetMap);
 }
 
 void Map::deleteNullMapPoints(MapResourcesManager * manager)
 {
     {
         //std::lock_guard<std::mutex> lockerMapPoints(m_mutex_mapPoints); (void)lockerMapPoints;
-        for (auto it = m_mapPoints.begin(); it != m_mapPoints.end(); ) {
-            MapResourceLocker lockerR(manager, it->get()); (void)lockerR;
-            if ((*it)->countFeatures() == 0) {
-                deleteMapPoint(*it);
-                it = m_mapPoints.erase(it);
-            } else {
-                ++it;
-            }
+        // deleteMapPoint() moves the last map point on place of deleted map point, so map points are visited
+        // from the end, the moved map point is visited already
+        for (std::size_t i = m_mapPoints.size(); i > 0; --i) {
+            // the map point is owned here, so it lives until the locker is released
+            std::shared_ptr<MapPoint> mapPoint = m_mapPoints[i - 1];
+            MapResourceLocker lockerR(manager, mapPoint.get()); (void)lockerR;
+            if (mapPoint->countFeatures() == 0)
+                deleteMapPoint(mapPoint);
+        }
+    }
+}
+
+namespace {
+
+const char mapFileMagic[8] = { 'A', 'R', 'M', 'A', 'P', 0, 0, 0 };
+const std::uint32_t mapFileVersion = 1;
+const std::uint64_t mapFileAlignment = 64;
+const int mapFileMaxCountCameraParameters = 8;
+
+struct MapFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t headerSize;
+    std::int32_t countImageLevels;
+    std::int32_t sizeOfSmallImage;
+    std::uint64_t countCameras;
+    std::uint64_t countMapPoints;
+    std::uint64_t countKeyFrames;
+    std::uint64_t countFeatures;
+    std::uint64_t offsetCameras;            // MapFileCamera per camera
+    std::uint64_t offsetMapPointPositions;  // double[3] per map point
+    std::uint64_t offsetMapPointStatistics; // int32[2] (failed and success scores) per map point
+    std::uint64_t offsetKeyFramePoses;      // double[12] (rotation by rows and translation) per key frame
+    std::uint64_t offsetKeyFrames;          // MapFileKeyFrame per key frame
+    std::uint64_t offsetImageLevels;        // MapFileImageLevel per level of key frame
+    std::uint64_t offsetFeatures;           // MapFileFeature per feature, features are grouped by key frames
+    std::uint64_t fileSize;
+};
+
+struct MapFileCamera
+{
+    double imageSize[2];
+    std::int32_t countParameters;
+    std::int32_t reserved;
+    double parameters[mapFileMaxCountCameraParameters];
+};
+
+struct MapFileKeyFrame
+{
+    std::uint32_t cameraIndex;
+    std::uint32_t reserved;
+    std::uint64_t offsetSmallImage;         // int32[sizeOfSmallImage * sizeOfSmallImage]
+};
+
+struct MapFileImageLevel
+{
+    std::int32_t width;
+    std::int32_t height;
+    std::uint64_t offset;
+};
+
+struct MapFileFeature
+{
+    std::uint32_t keyFrameIndex;
+    std::uint32_t mapPointIndex;
+    std::int32_t imageLevel;
+    float x;
+    float y;
+};
+
+static_assert(sizeof(MapFileHeader) == 120, "Unexpected size of MapFileHeader");
+static_assert(sizeof(MapFileCamera) == 88, "Unexpected size of MapFileCamera");
+static_assert(sizeof(MapFileKeyFrame) == 16, "Unexpected size of MapFileKeyFrame");
+static_assert(sizeof(MapFileImageLevel) == 16, "Unexpected size of MapFileImageLevel");
+static_assert(sizeof(MapFileFeature) == 20, "Unexpected size of MapFileFeature");
+
+bool hostIsLittleEndian()
+{
+    const std::uint16_t value = 1;
+    unsigned char firstByte;
+    std::memcpy(&firstByte, &value, 1);
+    return (firstByte == 1);
+}
+
+std::uint64_t alignedOffset(std::uint64_t offset)
+{
+    return ((offset + mapFileAlignment - 1) / mapFileAlignment) * mapFileAlignment;
+}
+
+bool sectionInFile(std::uint64_t offset, std::uint64_t count, std::uint64_t elementSize, std::uint64_t fileSize)
+{
+    if ((offset % 8) != 0)
+        return false;
+    if (offset > fileSize)
+        return false;
+    if ((elementSize > 0) && (count > ((fileSize - offset) / elementSize)))
+        return false;
+    return true;
+}
+
+class MapFileWriter
+{
+public:
+    MapFileWriter(const std::string & path):
+        m_stream(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc),
+        m_position(0)
+    {
+    }
+
+    bool isGood() const
+    {
+        return m_stream.good();
+    }
+
+    void write(std::uint64_t offset, const void * data, std::uint64_t size)
+    {
+        TMath_assert(offset >= m_position);
+        static const char zeros[mapFileAlignment] = {};
+        while (m_position < offset) {
+            std::uint64_t sizePadding = std::min(offset - m_position, mapFileAlignment);
+            m_stream.write(zeros, (std::streamsize)sizePadding);
+            m_position += sizePadding;
+        }
+        m_stream.write(static_cast<const char*>(data), (std::streamsize)size);
+        m_position += size;
+    }
+
+private:
+    std::ofstream m_stream;
+    std::uint64_t m_position;
+};
+
+} // anonymous namespace
+
+bool Map::save(MapResourcesManager * manager, const std::string & path) const
+{
+    if (!hostIsLittleEndian())
+        return false;
+
+    MapFileHeader header;
+    std::memset(&header, 0, sizeof(MapFileHeader));
+    std::memcpy(header.magic, mapFileMagic, sizeof(header.magic));
+    header.version = mapFileVersion;
+    header.headerSize = sizeof(MapFileHeader);
+    header.countImageLevels = m_countImageLevels;
+    header.sizeOfSmallImage = m_casheSmallImageH.width();
+
+    std::vector<double> mapPointPositions(m_mapPoints.size() * 3);
+    std::vector<std::int32_t> mapPointStatistics(m_mapPoints.size() * 2);
+    for (std::size_t i = 0; i < m_mapPoints.size(); ++i) {
+        const std::shared_ptr<MapPoint> & mapPoint = m_mapPoints[i];
+        MapResourceLocker lockerR(manager, mapPoint.get()); (void)lockerR;
+        TMath_assert(mapPoint->m_index == i);
+        TMath::TVector3d position = mapPoint->_position3d();
+        for (int j = 0; j < 3; ++j)
+            mapPointPositions[i * 3 + j] = position(j);
+        mapPointStatistics[i * 2] = mapPoint->statistic().failedScore();
+        mapPointStatistics[i * 2 + 1] = mapPoint->statistic().successScore();
+    }
+
+    std::vector<std::shared_ptr<const Camera>> cameras;
+    std::vector<MapFileCamera> fileCameras;
+    std::vector<double> keyFramePoses(m_keyFrames.size() * 12);
+    std::vector<MapFileKeyFrame> fileKeyFrames(m_keyFrames.size());
+    std::vector<MapFileImageLevel> fileImageLevels(m_keyFrames.size() * m_countImageLevels);
+    std::vector<MapFileFeature> fileFeatures;
+    for (std::size_t i = 0; i < m_keyFrames.size(); ++i) {
+        const std::shared_ptr<KeyFrame> & keyFrame = m_keyFrames[i];
+        MapResourceLocker lockerR(manager, keyFrame.get()); (void)lockerR;
+        TMath_assert(keyFrame->m_index == i);
+        TMath_assert(keyFrame->countImageLevels() == m_countImageLevels);
+        std::size_t cameraIndex = 0;
+        for (; cameraIndex < cameras.size(); ++cameraIndex)
+            if (cameras[cameraIndex] == keyFrame->camera())
+                break;
+        if (cameraIndex == cameras.size()) {
+            std::shared_ptr<const Camera> camera = keyFrame->camera();
+            TMath::TVectord cameraParameters = camera->cameraParameters();
+            if (cameraParameters.size() > mapFileMaxCountCameraParameters)
+                return false;
+            MapFileCamera fileCamera;
+            std::memset(&fileCamera, 0, sizeof(MapFileCamera));
+            fileCamera.imageSize[0] = camera->imageSize().x;
+            fileCamera.imageSize[1] = camera->imageSize().y;
+            fileCamera.countParameters = cameraParameters.size();
+            for (int j = 0; j < cameraParameters.size(); ++j)
+                fileCamera.parameters[j] = cameraParameters(j);
+            cameras.push_back(camera);
+            fileCameras.push_back(fileCamera);
+        }
+        fileKeyFrames[i].cameraIndex = (std::uint32_t)cameraIndex;
+        fileKeyFrames[i].reserved = 0;
+        const TMath::TMatrixd & rotation = keyFrame->m_rotation;
+        const TMath::TVectord & translation = keyFrame->m_translation;
+        double * pose = &keyFramePoses[i * 12];
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 3; ++k)
+                pose[j * 3 + k] = rotation(j, k);
+            pose[9 + j] = translation(j);
+        }
+        for (int j = 0; j < keyFrame->countFeatures(); ++j) {
+            const std::shared_ptr<Feature> & feature = keyFrame->m_features[j];
+            std::shared_ptr<const MapPoint> mapPoint = feature->mapPoint();
+            if (!mapPoint)
+                continue;
+            MapResourceLocker lockerMapPointR(manager, mapPoint.get()); (void)lockerMapPointR;
+            if (mapPoint->isDeleted())
+                continue;
+            MapFileFeature fileFeature;
+            fileFeature.keyFrameIndex = (std::uint32_t)i;
+            fileFeature.mapPointIndex = (std::uint32_t)mapPoint->m_index;
+            fileFeature.imageLevel = feature->m_imageLevel;
+            fileFeature.x = feature->m_positionOnFrame.x;
+            fileFeature.y = feature->m_positionOnFrame.y;
+            fileFeatures.push_back(fileFeature);
         }
     }
+
+    header.countCameras = fileCameras.size();
+    header.countMapPoints = m_mapPoints.size();
+    header.countKeyFrames = m_keyFrames.size();
+    header.countFeatures = fileFeatures.size();
+    std::uint64_t offset = alignedOffset(sizeof(MapFileHeader));
+    header.offsetCameras = offset;
+    offset = alignedOffset(offset + fileCameras.size() * sizeof(MapFileCamera));
+    header.offsetMapPointPositions = offset;
+    offset = alignedOffset(offset + mapPointPositions.size() * sizeof(double));
+    header.offsetMapPointStatistics = offset;
+    offset = alignedOffset(offset + mapPointStatistics.size() * sizeof(std::int32_t));
+    header.offsetKeyFramePoses = offset;
+    offset = alignedOffset(offset + keyFramePoses.size() * sizeof(double));
+    header.offsetKeyFrames = offset;
+    offset = alignedOffset(offset + fileKeyFrames.size() * sizeof(MapFileKeyFrame));
+    header.offsetImageLevels = offset;
+    offset = alignedOffset(offset + fileImageLevels.size() * sizeof(MapFileImageLevel));
+    header.offsetFeatures = offset;
+    offset = alignedOffset(offset + fileFeatures.size() * sizeof(MapFileFeature));
+    const std::uint64_t sizeOfSmallImageData = (std::uint64_t)m_casheSmallImageH.area() * sizeof(std::int32_t);
+    for (std::size_t i = 0; i < m_keyFrames.size(); ++i) {
+        fileKeyFrames[i].offsetSmallImage = offset;
+        offset = alignedOffset(offset + sizeOfSmallImageData);
+        for (int j = 0; j < m_countImageLevels; ++j) {
+            MapFileImageLevel & fileImageLevel = fileImageLevels[i * m_countImageLevels + j];
+            Point2i size = m_keyFrames[i]->m_imagePyramid[j].size();
+            fileImageLevel.width = size.x;
+            fileImageLevel.height = size.y;
+            fileImageLevel.offset = offset;
+            offset = alignedOffset(offset + (std::uint64_t)size.x * size.y);
+        }
+    }
+    header.fileSize = offset;
+
+    MapFileWriter writer(path);
+    if (!writer.isGood())
+        return false;
+    writer.write(0, &header, sizeof(MapFileHeader));
+    writer.write(header.offsetCameras, fileCameras.data(), fileCameras.size() * sizeof(MapFileCamera));
+    writer.write(header.offsetMapPointPositions, mapPointPositions.data(), mapPointPositions.size() * sizeof(double));
+    writer.write(header.offsetMapPointStatistics, mapPointStatistics.data(),
+                 mapPointStatistics.size() * sizeof(std::int32_t));
+    writer.write(header.offsetKeyFramePoses, keyFramePoses.data(), keyFramePoses.size() * sizeof(double));
+    writer.write(header.offsetKeyFrames, fileKeyFrames.data(), fileKeyFrames.size() * sizeof(MapFileKeyFrame));
+    writer.write(header.offsetImageLevels, fileImageLevels.data(),
+                 fileImageLevels.size() * sizeof(MapFileImageLevel));
+    writer.write(header.offsetFeatures, fileFeatures.data(), fileFeatures.size() * sizeof(MapFileFeature));
+    for (std::size_t i = 0; i < m_keyFrames.size(); ++i) {
+        const std::shared_ptr<KeyFrame> & keyFrame = m_keyFrames[i];
+        MapResourceLocker lockerR(manager, keyFrame.get()); (void)lockerR;
+        writer.write(fileKeyFrames[i].offsetSmallImage, keyFrame->m_smallImage.data(), sizeOfSmallImageData);
+        for (int j = 0; j < m_countImageLevels; ++j) {
+            const MapFileImageLevel & fileImageLevel = fileImageLevels[i * m_countImageLevels + j];
+            writer.write(fileImageLevel.offset, keyFrame->m_imagePyramid[j].data(),
+                         (std::uint64_t)fileImageLevel.width * fileImageLevel.height);
+        }
+    }
+    writer.write(header.fileSize, nullptr, 0);
+    return writer.isGood();
+}
+
+bool Map::load(MapResourcesManager * manager, const std::string & path)
+{
+    if (!hostIsLittleEndian())
+        return false;
+
+    std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>();
+    if (!mappedFile->open(path))
+        return false;
+    const std::uint64_t fileSize = mappedFile->size();
+    unsigned char * data = mappedFile->data();
+    if (fileSize < sizeof(MapFileHeader))
+        return false;
+    MapFileHeader header;
+    std::memcpy(&header, data, sizeof(MapFileHeader));
+    if ((std::memcmp(header.magic, mapFileMagic, sizeof(header.magic)) != 0) ||
+            (header.version != mapFileVersion) ||
+            (header.headerSize != sizeof(MapFileHeader)) ||
+            (header.fileSize != fileSize))
+        return false;
+    if ((header.countImageLevels != m_countImageLevels) || (header.sizeOfSmallImage <= 0))
+        return false;
+    if ((header.countKeyFrames > 0) && (header.countCameras == 0))
+        return false;
+    if (!sectionInFile(header.offsetCameras, header.countCameras, sizeof(MapFileCamera), fileSize) ||
+            !sectionInFile(header.offsetMapPointPositions, header.countMapPoints, sizeof(double) * 3, fileSize) ||
+            !sectionInFile(header.offsetMapPointStatistics, header.countMapPoints,
+                           sizeof(std::int32_t) * 2, fileSize) ||
+            !sectionInFile(header.offsetKeyFramePoses, header.countKeyFrames, sizeof(double) * 12, fileSize) ||
+            !sectionInFile(header.offsetKeyFrames, header.countKeyFrames, sizeof(MapFileKeyFrame), fileSize) ||
+            !sectionInFile(header.offsetImageLevels, header.countKeyFrames,
+                           sizeof(MapFileImageLevel) * m_countImageLevels, fileSize) ||
+            !sectionInFile(header.offsetFeatures, header.countFeatures, sizeof(MapFileFeature), fileSize))
+        return false;
+
+    const MapFileCamera * fileCameras = reinterpret_cast<const MapFileCamera*>(data + header.offsetCameras);
+    const double * mapPointPositions = reinterpret_cast<const double*>(data + header.offsetMapPointPositions);
+    const std::int32_t * mapPointStatistics =
+            reinterpret_cast<const std::int32_t*>(data + header.offsetMapPointStatistics);
+    const double * keyFramePoses = reinterpret_cast<const double*>(data + header.offsetKeyFramePoses);
+    const MapFileKeyFrame * fileKeyFrames = reinterpret_cast<const MapFileKeyFrame*>(data + header.offsetKeyFrames);
+    const MapFileImageLevel * fileImageLevels =
+            reinterpret_cast<const MapFileImageLevel*>(data + header.offsetImageLevels);
+    const MapFileFeature * fileFeatures = reinterpret_cast<const MapFileFeature*>(data + header.offsetFeatures);
+
+    for (std::uint64_t i = 0; i < header.countCameras; ++i) {
+        if ((fileCameras[i].countParameters <= 0) ||
+                (fileCameras[i].countParameters > mapFileMaxCountCameraParameters))
+            return false;
+    }
+    const std::uint64_t sizeOfSmallImageData = (std::uint64_t)header.sizeOfSmallImage *
+            header.sizeOfSmallImage * sizeof(std::int32_t);
+    for (std::uint64_t i = 0; i < header.countKeyFrames; ++i) {
+        if (fileKeyFrames[i].cameraIndex >= header.countCameras)
+            return false;
+        if (!sectionInFile(fileKeyFrames[i].offsetSmallImage, sizeOfSmallImageData, 1, fileSize))
+            return false;
+        const MapFileImageLevel * levels = &fileImageLevels[i * m_countImageLevels];
+        Point2i size(levels[0].width, levels[0].height);
+        if ((size.x <= 0) || (size.y <= 0))
+            return false;
+        for (int j = 0; j < m_countImageLevels; ++j) {
+            if ((levels[j].width != size.x) || (levels[j].height != size.y))
+                return false;
+            if ((levels[j].offset > fileSize) || (((std::uint64_t)size.x * size.y) > (fileSize - levels[j].offset)))
+                return false;
+            size /= 2;
+        }
+    }
+    for (std::uint64_t i = 0; i < header.countFeatures; ++i) {
+        if ((fileFeatures[i].keyFrameIndex >= header.countKeyFrames) ||
+                (fileFeatures[i].mapPointIndex >= header.countMapPoints) ||
+                (fileFeatures[i].imageLevel < 0) || (fileFeatures[i].imageLevel >= m_countImageLevels))
+            return false;
+    }
+
+    resetMap(manager);
+
+    std::vector<std::shared_ptr<const Camera>> cameras(header.countCameras);
+    for (std::uint64_t i = 0; i < header.countCameras; ++i) {
+        TMath::TVectord cameraParameters(fileCameras[i].countParameters, fileCameras[i].parameters);
+        cameras[i] = std::make_shared<const Camera>(cameraParameters,
+                                                    Point2d(fileCameras[i].imageSize[0], fileCameras[i].imageSize[1]));
+    }
+    m_mapPoints.reserve(header.countMapPoints);
+    for (std::uint64_t i = 0; i < header.countMapPoints; ++i) {
+        std::shared_ptr<MapPoint> mapPoint = createMapPoint(TMath::TVectord(3, &mapPointPositions[i * 3]));
+        if (mapPointStatistics[i * 2] > 0)
+            mapPoint->statistic().incFailed(mapPointStatistics[i * 2]);
+        if (mapPointStatistics[i * 2 + 1] > 0)
+            mapPoint->statistic().incSuccess(mapPointStatistics[i * 2 + 1]);
+    }
+    const bool useSmallImages = (header.sizeOfSmallImage == m_casheSmallImageH.width());
+    m_keyFrames.reserve(header.countKeyFrames);
+    std::vector<Image<uchar>> imagePyramid(m_countImageLevels);
+    for (std::uint64_t i = 0; i < header.countKeyFrames; ++i) {
+        const MapFileImageLevel * levels = &fileImageLevels[i * m_countImageLevels];
+        for (int j = 0; j < m_countImageLevels; ++j) {
+            imagePyramid[j] = Image<uchar>(Point2i(levels[j].width, levels[j].height),
+                                           data + levels[j].offset, mappedFile);
+        }
+        const double * pose = &keyFramePoses[i * 12];
+        TMath::TMatrixd rotation(3, 3, pose);
+        TMath::TVectord translation(3, &pose[9]);
+        const std::shared_ptr<const Camera> & camera = cameras[fileKeyFrames[i].cameraIndex];
+        if (useSmallImages) {
+            ConstImage<int> smallImage(Point2i(header.sizeOfSmallImage, header.sizeOfSmallImage),
+                                       reinterpret_cast<const int*>(data + fileKeyFrames[i].offsetSmallImage),
+                                       mappedFile);
+            std::shared_ptr<KeyFrame> newKeyFrame = _createInPool(*m_keyFramesPool, this, m_keyFrames.size(),
+                                                                  camera, imagePyramid, rotation, translation,
+                                                                  smallImage);
+            m_keyFrames.push_back(newKeyFrame);
+            m_keyFramesIndex.add(*newKeyFrame);
+            _notify(&MapListener::onCreateKeyFrame, newKeyFrame);
+        } else {
+            createKeyFrame(camera, imagePyramid, rotation, translation);
+        }
+    }
+    for (std::uint64_t i = 0; i < header.countFeatures; ++i) {
+        const MapFileFeature & fileFeature = fileFeatures[i];
+        createFeature(m_keyFrames[fileFeature.keyFrameIndex], Point2f(fileFeature.x, fileFeature.y),
+                      fileFeature.imageLevel, m_mapPoints[fileFeature.mapPointIndex]);
+    }
+    return true;
 }
 
 }
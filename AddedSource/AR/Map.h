@@ -4,10 +4,13 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <string>
 #include "TMath/TVector.h"
 #include "TMath/TMatrix.h"
 #include "Image.h"
 #include "Camera.h"
+#include "KeyFramesIndex.h"
+#include "SlabPool.h"
 
 namespace AR {
 
@@ -15,6 +18,7 @@ class Frame;
 class KeyFrame;
 class MapPoint;
 class Feature;
+struct MapPointsBlock;
 class MapResourceObject;
 class MapResourcesManager;
 
@@ -42,6 +46,19 @@ public:
         virtual void onResetMap() {}
     };
 
+    struct KeyFramePose
+    {
+        std::shared_ptr<KeyFrame> keyFrame;
+        TMath::TMatrixd rotation;
+        TMath::TVectord translation;
+    };
+
+    struct MapPointPosition
+    {
+        std::shared_ptr<MapPoint> mapPoint;
+        TMath::TVectord position;
+    };
+
     Map(int countImageLevels, int sizeOfSmallImage);
     ~Map();
 
@@ -51,6 +68,9 @@ public:
     MapListener * listener();
     void setListener(MapListener * listener);
     void resetListener();
+    // Additional listeners are notified after the main listener, they aren't changed by setListener().
+    void addListener(MapListener * listener);
+    void removeListener(MapListener * listener);
 
     std::shared_ptr<MapPoint> createMapPoint(const TMath::TVectord & position);
     void deleteMapPoint(const std::shared_ptr<MapPoint> & mapPoint);
@@ -65,11 +85,14 @@ public:
                                              const TMath::TMatrixd & rotation,
                                              const TMath::TVectord & translation);
     std::shared_ptr<KeyFrame> createKeyFrame(const Frame & frame);
-    void deleteKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame);
+    // The key frame and the last key frame (it's moved on place of deleted key frame) are locked by manager.
+    void deleteKeyFrame(MapResourcesManager * manager, const std::shared_ptr<KeyFrame> & keyFrame);
     std::size_t countKeyFrames() const;
     std::shared_ptr<KeyFrame> keyFrame(std::size_t index);
     const std::shared_ptr<const KeyFrame> keyFrame(std::size_t index) const;
 
+    // Spatial queries use cached world positions of key frames, they don't lock key frames.
+    // Nearest key frame is searched among key frames which look in the same direction as dir.
     std::shared_ptr<KeyFrame> getNearestKeyFrame(MapResourcesManager * manager,
                                                  const TMath::TVectord & position,
                                                  const TMath::TVectord & dir);
@@ -80,6 +103,10 @@ public:
                                                   const TMath::TVectord & position);
     std::shared_ptr<const KeyFrame> getFurthestKeyFrame(MapResourcesManager * manager,
                                                   const TMath::TVectord & position) const;
+    // Up to count nearest key frames sorted by distance.
+    std::vector<std::shared_ptr<KeyFrame>> getNearestKeyFrames(const TMath::TVectord & position,
+                                                               std::size_t count);
+    TMath::TVectord keyFrameWorldPosition(std::size_t index) const;
 
     std::shared_ptr<Feature> createFeature(const std::shared_ptr<KeyFrame> & keyFrame,
                                            const Point2f& positionOnFrame, int imageLevel,
@@ -97,11 +124,25 @@ public:
                    const TMath::TMatrixd & rotation,
                    const TMath::TVectord & translation);
     void scale(MapResourcesManager * manager, double scale);
+    // Changes poses of key frames and positions of map points together (results of bundle adjustment),
+    // all of them are locked by manager before changes, deleted objects are skipped.
+    void adjust(MapResourcesManager * manager,
+                const std::vector<KeyFramePose> & poses,
+                const std::vector<MapPointPosition> & positions);
 
     void resetMap(MapResourcesManager * manager);
 
     void deleteNullMapPoints(MapResourcesManager * manager);
 
+    // Binary little-endian file with sections of map point positions, poses of key frames, features and
+    // levels of image pyramids of key frames. Every section is stored contiguously and aligned to 64 bytes.
+    bool save(MapResourcesManager * manager, const std::string & path) const;
+    // The file is mapped into memory and image levels of key frames are used without copying,
+    // every image holds a reference to the mapped file, so the file is unmapped when the last image of it is freed
+    // (also when key frames outlive the map). Count of image levels of the file must be equal
+    // to count of image levels of the map. If the file can't be loaded, the map isn't changed.
+    bool load(MapResourcesManager * manager, const std::string & path);
+
 private:
     friend class MapPoint;
     friend class KeyFrame;
@@ -117,12 +158,40 @@ private:
     mutable Image<uchar> m_casheSmallImageH;
     mutable Image<uchar> m_casheSmallImageV;
 
+    // Map points, key frames and features are stored in slabs of pools.
+    std::shared_ptr<SlabPool<MapPoint, MapPointsBlock>> m_mapPointsPool;
+    std::shared_ptr<SlabPool<KeyFrame>> m_keyFramesPool;
+    std::shared_ptr<SlabPool<Feature>> m_featuresPool;
+
     std::vector<std::shared_ptr<MapPoint>> m_mapPoints;
     std::vector<std::shared_ptr<KeyFrame>> m_keyFrames;
+    KeyFramesIndex m_keyFramesIndex;
 
     MapListener * m_listener;
+    std::vector<MapListener*> m_listeners;
 
     static MapListener _static_null_map_listener;
+
+    template <typename T, typename ... Args>
+    static std::shared_ptr<T> _createInPool(SlabPool<T> & pool, Args && ... args)
+    {
+        std::size_t slot;
+        void * memory = pool.allocate(slot);
+        return pool.makeShared(new (memory) T(std::forward<Args>(args) ...), slot);
+    }
+
+    // Calls function(block, index in block) for every map point of the map with lock of manager,
+    // map points are visited in order of slabs.
+    template <typename Function>
+    void _forEachMapPointInBlocks(MapResourcesManager * manager, Function function);
+
+    template <typename ... Args, typename ... Values>
+    void _notify(void (MapListener::*event)(Args ...), Values && ... values)
+    {
+        (m_listener->*event)(values ...);
+        for (MapListener * listener : m_listeners)
+            (listener->*event)(values ...);
+    }
 };
 
 }
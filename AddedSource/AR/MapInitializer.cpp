@@ -15,6 +15,120 @@
 
 namespace AR {
 
+// Estimators of models for Ransac, points are matches in order of m_matchesOrder.
+// Every thread of Ransac has own TSVD.
+struct MapInitializer::HomographyEstimator
+{
+    typedef TMath::TMatrixd Model;
+    static const int sampleSize = 4;
+    static const int maxCountModels = 1;
+
+    const MapInitializer & initializer;
+    std::vector<std::unique_ptr<TMath::TSVD<double>>> svds;
+
+    HomographyEstimator(const MapInitializer & initializer, int countThreads):
+        initializer(initializer)
+    {
+        for (int i = 0; i < countThreads; ++i)
+            svds.emplace_back(new TMath::TSVD<double>());
+    }
+
+    int computeModels(Model * models, const int * sample, int thread)
+    {
+        std::size_t indices[sampleSize];
+        for (int i = 0; i < sampleSize; ++i)
+            indices[i] = initializer.m_matchesOrder[sample[i]];
+        models[0] = initializer._findHomography(indices, sampleSize, *svds[thread]);
+        return 1;
+    }
+
+    double error(const Model & model, int point) const
+    {
+        return initializer._getHomographyError(model, initializer.m_matches[initializer.m_matchesOrder[point]]);
+    }
+};
+
+struct MapInitializer::EssentialEstimator
+{
+    typedef TMath::TMatrixd Model;
+    static const int sampleSize = 7;
+    static const int maxCountModels = 3;
+
+    const MapInitializer & initializer;
+    std::vector<std::unique_ptr<TMath::TSVD<double>>> svds;
+
+    EssentialEstimator(const MapInitializer & initializer, int countThreads):
+        initializer(initializer)
+    {
+        for (int i = 0; i < countThreads; ++i)
+            svds.emplace_back(new TMath::TSVD<double>());
+    }
+
+    int computeModels(Model * models, const int * sample, int thread)
+    {
+        std::size_t indices[sampleSize];
+        for (int i = 0; i < sampleSize; ++i)
+            indices[i] = initializer.m_matchesOrder[sample[i]];
+        return initializer._computeEssential_from7points(models, indices, *svds[thread]);
+    }
+
+    double error(const Model & model, int point) const
+    {
+        return initializer._getEssentialError(model, initializer.m_matches[initializer.m_matchesOrder[point]]);
+    }
+};
+
+// Points are 3d positions of matches of m_inlinerIndices, error is distance to plane.
+struct MapInitializer::PlaneEstimator
+{
+    struct Model
+    {
+        double point[3];
+        double normal[3];
+    };
+    static const int sampleSize = 3;
+    static const int maxCountModels = 1;
+
+    const MapInitializer & initializer;
+
+    PlaneEstimator(const MapInitializer & initializer):
+        initializer(initializer)
+    {
+    }
+
+    int computeModels(Model * models, const int * sample, int thread)
+    {
+        (void)thread;
+        const double * a = initializer.m_matches[initializer.m_inlinerIndices[sample[0]]].position3d.data();
+        const double * b = initializer.m_matches[initializer.m_inlinerIndices[sample[1]]].position3d.data();
+        const double * c = initializer.m_matches[initializer.m_inlinerIndices[sample[2]]].position3d.data();
+        double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        Model & model = models[0];
+        model.normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+        model.normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+        model.normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+        double length = std::sqrt(model.normal[0] * model.normal[0] +
+                                  model.normal[1] * model.normal[1] +
+                                  model.normal[2] * model.normal[2]);
+        if (length < std::numeric_limits<double>::epsilon())
+            return 0;
+        for (int i = 0; i < 3; ++i) {
+            model.normal[i] /= length;
+            model.point[i] = (a[i] + b[i] + c[i]) / 3.0;
+        }
+        return 1;
+    }
+
+    double error(const Model & model, int point) const
+    {
+        const double * p = initializer.m_matches[initializer.m_inlinerIndices[point]].position3d.data();
+        return std::fabs((p[0] - model.point[0]) * model.normal[0] +
+                         (p[1] - model.point[1]) * model.normal[1] +
+                         (p[2] - model.point[2]) * model.normal[2]);
+    }
+};
+
 MapInitializer::MapInitializer():
         m_bestHomography(3, 3),
         m_bestEssential(3, 3)
@@ -36,6 +150,8 @@ InitConfiguration MapInitializer::configuration() const
     configuration.maxPixelError = std::sqrt(m_maxSquarePixelError);
     configuration.epsDistanceForPlane = m_epsDistanceForPlane;
     configuration.countTimes = m_countTimes;
+    configuration.ransacConfidence = m_ransac.confidence();
+    configuration.ransacCountThreads = m_ransac.countThreads();
     configuration.mapScale = m_mapScale;
     configuration.minCountFeatures = m_minCountFeatures;
     configuration.minCountMapPoints = m_minCountMapPoints;
@@ -50,6 +166,7 @@ InitConfiguration MapInitializer::configuration() const
     configuration.featureCursorSize = m_featureDetector.cursorSize();
     configuration.pixelEps = m_featureDetector.pixelEps();
     configuration.maxNumberIterationsForOpticalFlow = m_featureDetector.maxNumberIterations();
+    configuration.featureCountThreads = m_featureDetector.countThreads();
 
     return configuration;
 }
@@ -59,6 +176,8 @@ void MapInitializer::setConfiguration(const InitConfiguration & configuration)
     setMaxPixelError(configuration.maxPixelError);
     m_epsDistanceForPlane = configuration.epsDistanceForPlane;
     m_countTimes = configuration.countTimes;
+    m_ransac.setConfidence(configuration.ransacConfidence);
+    m_ransac.setCountThreads(configuration.ransacCountThreads);
     m_mapScale = configuration.mapScale;
     m_minCountFeatures = configuration.minCountFeatures;
     m_minCountMapPoints = configuration.minCountMapPoints;
@@ -73,6 +192,7 @@ void MapInitializer::setConfiguration(const InitConfiguration & configuration)
     m_featureDetector.setCursorSize(configuration.featureCursorSize);
     m_featureDetector.setPixelEps(configuration.pixelEps);
     m_featureDetector.setMaxNumberIterations(configuration.maxNumberIterationsForOpticalFlow);
+    m_featureDetector.setCountThreads(configuration.featureCountThreads);
 }
 
 double MapInitializer::maxSquarePixelError() const
@@ -105,6 +225,26 @@ int MapInitializer::countTimes() const
     return m_countTimes;
 }
 
+double MapInitializer::ransacConfidence() const
+{
+    return m_ransac.confidence();
+}
+
+void MapInitializer::setRansacConfidence(double confidence)
+{
+    m_ransac.setConfidence(confidence);
+}
+
+int MapInitializer::ransacCountThreads() const
+{
+    return m_ransac.countThreads();
+}
+
+void MapInitializer::setRansacCountThreads(int countThreads)
+{
+    m_ransac.setCountThreads(countThreads);
+}
+
 double MapInitializer::mapScale() const
 {
     return m_mapScale;
@@ -190,12 +330,14 @@ void MapInitializer::setFirstFrame(const std::shared_ptr<const Camera> & camera,
     m_firstCameraErrorMultipler *= m_firstCameraErrorMultipler;
     m_firstFeatures.resize(0);
     m_featureImageLevel.resize(0);
+    m_featureScores.resize(0);
     if (m_featureDetector.firstImage().data() != nullptr) {
         std::vector<FeatureDetector::FeatureCorner> features;
         m_featureDetector.detectFeaturesOnFirstImage(features);
         for (std::vector<FeatureDetector::FeatureCorner>::iterator it = features.begin(); it != features.end(); ++it) {
             m_firstFeatures.push_back(Point2f((float)it->pos.x, (float)it->pos.y));
             m_featureImageLevel.push_back(it->level);
+            m_featureScores.push_back(it->score);
         }
     }
 }
@@ -240,6 +382,7 @@ MapInitializer::InitializationResult MapInitializer::compute(Map * map, MapResou
         d += Point2d((std::rand() % 100 - 50) * 0.04f, (std::rand() % 100 - 50) * 0.04f);
         m_secondFeatures.push_back(Point2f((float)d.x, (float)d.y));
         m_featureImageLevel.push_back(0);
+        m_featureScores.push_back(0.0f);
     }
     for (int i=0; i<7; ++i) {
         QVector3D v((std::rand() % 100 - 50) * 0.05f, (std::rand() % 100 - 50) * 0.05f, (std::rand() % 100 - 50) * 0.05f);
@@ -253,6 +396,7 @@ MapInitializer::InitializationResult MapInitializer::compute(Map * map, MapResou
         d += Point2d((std::rand() % 100 - 50) * 0.04f, (std::rand() % 100 - 50) * 0.04f);
         m_secondFeatures.push_back(Point2f((float)d.x, (float)d.y));
         m_featureImageLevel.push_back(0);
+        m_featureScores.push_back(0.0f);
     }
     _computeMatches();
     _computeTransformation();
@@ -312,6 +456,7 @@ MapInitializer::InitializationResult MapInitializer::compute(Map * map, MapResou
                 m_firstFeatures.erase(m_firstFeatures.begin() + j);
                 m_secondFeatures.erase(m_secondFeatures.begin() + j);
                 m_featureImageLevel.erase(m_featureImageLevel.begin() + j);
+                m_featureScores.erase(m_featureScores.begin() + j);
             }
         }
         if ((int)m_secondFeatures.size() >= m_minCountFeatures) {
@@ -482,61 +627,18 @@ bool MapInitializer::_findPlane()
     TMath_assert(m_inlinerIndices.size() >= 3);
     using namespace TMath;
 
-    double bestScore = std::numeric_limits<double>::max();
     m_outlinersIndices.clear();
-    std::size_t baseIndices[3];
-    std::size_t i, j;
-    TVectord va(3), vb(3), vc(3), d(3), nX(3), nY(3), nZ(3);
-    TVectord bestP, bestN;
-    double error;
-    TMath::Random_mt19937 rnd;
-    rnd.seed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
-                 std::chrono::system_clock::now().time_since_epoch()).count());
-    for (int iteration = 0; iteration < m_countTimes; ++iteration) {
-        if ((iteration % 200) == 0)
-            rnd.seed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
-                         std::chrono::system_clock::now().time_since_epoch()).count() + iteration * 7);
-        for (i = 0; i < 3; ++i) {
-            bool isUnique;
-            for(;;) {
-                isUnique = true;
-                baseIndices[i] = m_inlinerIndices[rnd() % m_inlinerIndices.size()];
-                for (j = 0; j < i; ++j) {
-                    if (baseIndices[j] == baseIndices[i]) {
-                        isUnique = false;
-                        break;
-                    }
-                }
-                if (isUnique)
-                    break;
-            }
-        }
-        va = m_matches[baseIndices[0]].position3d;
-        vb = m_matches[baseIndices[1]].position3d;
-        vc = m_matches[baseIndices[2]].position3d;
-        nX = (vb - va).normalized();
-        nZ = cross3(vb - va, vc - va).normalized();
-        //nY = cross3(nZ, nX);
-        /*int count = 0;
-        Point2d min(std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
-        Point2d max(std::numeric_limits<double>::min(), std::numeric_limits<double>::min());*/
-        Point2d p;
-        double score = 0.0;
-        for (i = 0; i < m_inlinerIndices.size(); ++i) {
-            d = m_matches[m_inlinerIndices[i]].position3d - va;
-            score += std::min(std::fabs(dot(d, nZ)), m_epsDistanceForPlane);
-        }
-        if (score < bestScore) {
-            bestP = (va + vb + vc) / 3.0;
-            bestN = nZ;
-        }
-    }
-    if ((bestP.size() != 3) || (bestN.size() != 3))
+    std::size_t i;
+    PlaneEstimator::Model bestPlane;
+    PlaneEstimator estimator(*this);
+    m_ransac.setMaxCountIterations(m_countTimes);
+    m_ransac.setSeed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch()).count());
+    if (!m_ransac.run(bestPlane, estimator, (int)m_inlinerIndices.size(), m_epsDistanceForPlane, false))
         return false;
     std::vector<std::size_t> newInliners;
     for (i = 0; i < m_inlinerIndices.size(); ++i) {
-        error = std::fabs(dot(m_matches[m_inlinerIndices[i]].position3d - bestP, bestN));
-        if (error < m_epsDistanceForPlane)
+        if (estimator.error(bestPlane, (int)i) < m_epsDistanceForPlane)
             newInliners.push_back(m_inlinerIndices[i]);
     }
     m_inlinerIndices = std::move(newInliners);
@@ -652,6 +754,7 @@ void MapInitializer::_computeMatches()
     for (std::size_t i = 0; i < m_matches.size(); ++i) {
         Match & match = m_matches[i];
         match.imageLevel = m_featureImageLevel[i];
+        match.score = m_featureScores[i];
         match.pixelFirst = m_firstFeatures[i];
         d = m_firstCamera->unproject(match.pixelFirst);
         match.camFirst = TMath::TVectord::create(d.x, d.y, 1.0);
@@ -661,23 +764,37 @@ void MapInitializer::_computeMatches()
 
         match.secondPixelProjDerivs = m_secondCamera->getProjectionDerivatives(projectionInfo);
     }
+    m_matchesOrder.resize(m_matches.size());
+    for (std::size_t i = 0; i < m_matchesOrder.size(); ++i)
+        m_matchesOrder[i] = i;
+    std::stable_sort(m_matchesOrder.begin(), m_matchesOrder.end(), [this] (std::size_t a, std::size_t b) {
+        return m_matches[a].score > m_matches[b].score;
+    });
 }
 
 double MapInitializer::_getHomographyError(const TMath::TMatrixd& homography, const Match& match) const
 {
-    TMath::TVectord v = homography * match.camFirst;
-    v(0) = v(0) / v(2) - match.camSecond(0);
-    v(1) = v(1) / v(2) - match.camSecond(1);
-    return (v(0) * v(0) + v(1) * v(1)) * m_secondCameraErrorMultipler;
+    const double * h = homography.data();
+    const double x = match.camFirst(0), y = match.camFirst(1);
+    const double z = h[6] * x + h[7] * y + h[8];
+    const double dx = (h[0] * x + h[1] * y + h[2]) / z - match.camSecond(0);
+    const double dy = (h[3] * x + h[4] * y + h[5]) / z - match.camSecond(1);
+    return (dx * dx + dy * dy) * m_secondCameraErrorMultipler;
 }
 
 TMath::TMatrixd MapInitializer::_findHomography()
 {
-    TMath_assert(m_inlinerIndices.size() >= 4);
-    TMath::TMatrixd M(std::max((int)(m_inlinerIndices.size() * 2), 9), 9);
+    return _findHomography(m_inlinerIndices.data(), m_inlinerIndices.size(), m_svd);
+}
+
+TMath::TMatrixd MapInitializer::_findHomography(const std::size_t * indices, std::size_t countIndices,
+                                                TMath::TSVD<double> & svd) const
+{
+    TMath_assert(countIndices >= 4);
+    TMath::TMatrixd M(std::max((int)(countIndices * 2), 9), 9);
     double* dataRow = M.firstDataRow();
-    for (std::size_t i = 0; i < m_inlinerIndices.size(); ++i) {
-        const Match & match = m_matches[m_inlinerIndices[i]];
+    for (std::size_t i = 0; i < countIndices; ++i) {
+        const Match & match = m_matches[indices[i]];
 
         dataRow[0] = match.camFirst(0);
         dataRow[1] = match.camFirst(1);
@@ -703,58 +820,27 @@ TMath::TMatrixd MapInitializer::_findHomography()
         dataRow = &dataRow[9];
     }
 
-    if (m_inlinerIndices.size() == 4) {
+    if (countIndices == 4) {
         for (int i=0; i<9; ++i)
             dataRow[i] = 0.0;
     }
 
-    m_svd.compute(M, false);
-    const double * constDataRow = m_svd.V_transposed().getDataRow(8);
+    svd.compute(M, false);
+    const double * constDataRow = svd.V_transposed().getDataRow(8);
     TMath::TMatrixd homography(3, 3, constDataRow);
     return homography;
 }
 
 bool MapInitializer::_findBestHomography()
 {
-    double bestScore = std::numeric_limits<double>::max();
     m_outlinersIndices.clear();
-    m_inlinerIndices.resize(4);
-    std::size_t i, j;
-    TMath::Random_mt19937 rnd;
-    rnd.seed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
-                 std::chrono::system_clock::now().time_since_epoch()).count());
-    for (int iteration = 0; iteration < m_countTimes; ++iteration) {
-        if ((iteration % 200) == 0)
-            rnd.seed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
-                         std::chrono::system_clock::now().time_since_epoch()).count() + iteration * 7);
-        for (i = 0; i < 4; ++i) {
-            bool isUnique;
-            for(;;) {
-                isUnique = true;
-                m_inlinerIndices[i] = rnd() % m_matches.size();
-                for (j = 0; j < i; ++j) {
-                    if (m_inlinerIndices[j] == m_inlinerIndices[i]) {
-                        isUnique = false;
-                        break;
-                    }
-                }
-                if (isUnique)
-                    break;
-            }
-        }
-        TMath::TMatrixd homography = _findHomography();
-        double score = 0.0, error;
-        for (i = 0; i < m_matches.size(); ++i) {
-            error = _getHomographyError(homography, m_matches[i]);
-            score += std::min(error, m_maxSquarePixelError);
-        }
-        if (score < bestScore) {
-            bestScore = score;
-            m_bestHomography = homography;
-        }
-    }
     m_inlinerIndices.clear();
-    if (m_bestHomography.rows() == 0)
+    std::size_t i;
+    HomographyEstimator estimator(*this, m_ransac.countThreads());
+    m_ransac.setMaxCountIterations(m_countTimes);
+    m_ransac.setSeed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch()).count());
+    if (!m_ransac.run(m_bestHomography, estimator, (int)m_matches.size(), m_maxSquarePixelError, true))
         return false;
     for (i = 0; i < m_matches.size(); ++i) {
         if (_getHomographyError(m_bestHomography, m_matches[i]) <= m_maxSquarePixelError)
@@ -951,13 +1037,21 @@ bool MapInitializer::_computeDecompositionsOfHomography()
 
 double MapInitializer::_getEssentialError(const TMath::TMatrixd& essential, const Match& match) const
 {
-    TMath::TVectord v = essential * match.camFirst;
-    double s2 = m_secondCameraErrorMultipler / (v(0) * v(0) + v(1) * v(1));
-    double d2 = match.camSecond(0) * v(0) + match.camSecond(1) * v(1) + v(2);
-
-    v = essential.refTransposed() * match.camSecond;
-    double s1 = m_firstCameraErrorMultipler / (v(0) * v(0) + v(1) * v(1));
-    double d1 = match.camFirst(0) * v(0) + match.camFirst(1) * v(1) + v(2);
+    const double * e = essential.data();
+    const double x1 = match.camFirst(0), y1 = match.camFirst(1);
+    const double x2 = match.camSecond(0), y2 = match.camSecond(1);
+
+    double a = e[0] * x1 + e[1] * y1 + e[2];
+    double b = e[3] * x1 + e[4] * y1 + e[5];
+    double c = e[6] * x1 + e[7] * y1 + e[8];
+    double s2 = m_secondCameraErrorMultipler / (a * a + b * b);
+    double d2 = x2 * a + y2 * b + c;
+
+    a = e[0] * x2 + e[3] * y2 + e[6];
+    b = e[1] * x2 + e[4] * y2 + e[7];
+    c = e[2] * x2 + e[5] * y2 + e[8];
+    double s1 = m_firstCameraErrorMultipler / (a * a + b * b);
+    double d1 = x1 * a + y1 * b + c;
 
     return std::max(d1 * d1 * s1, d2 * d2 * s2);
 }
@@ -978,10 +1072,16 @@ TMath::TMatrixd MapInitializer::_fixEssentialMatrix(const TMath::TMatrixd& essen
 int MapInitializer::_computeEssential_from7points(TMath::TMatrixd results[3])
 {
     TMath_assert(m_inlinerIndices.size() >= 7);
+    return _computeEssential_from7points(results, m_inlinerIndices.data(), m_svd);
+}
+
+int MapInitializer::_computeEssential_from7points(TMath::TMatrixd results[3], const std::size_t indices[7],
+                                                  TMath::TSVD<double> & svd) const
+{
     TMath::TMatrixd M(7, 9);
     double * dataRow = M.firstDataRow();
-    for (std::size_t i = 0; i < m_inlinerIndices.size(); ++i) {
-        const Match & match = m_matches[m_inlinerIndices[i]];
+    for (std::size_t i = 0; i < 7; ++i) {
+        const Match & match = m_matches[indices[i]];
 
         dataRow[0] = match.camFirst(0) * match.camSecond(0);
         dataRow[1] = match.camFirst(1) * match.camSecond(0);
@@ -996,9 +1096,9 @@ int MapInitializer::_computeEssential_from7points(TMath::TMatrixd results[3])
         dataRow = &dataRow[9];
     }
 
-    m_svd.compute(M, true);
-    TMath::TMatrixd F1(3, 3, m_svd.V_transposed().getDataRow(7));
-    TMath::TMatrixd F2(3, 3, m_svd.V_transposed().getDataRow(8));
+    svd.compute(M, true);
+    TMath::TMatrixd F1(3, 3, svd.V_transposed().getDataRow(7));
+    TMath::TMatrixd F2(3, 3, svd.V_transposed().getDataRow(8));
     return _computeEssentials(results, F1, F2);
 }
 
@@ -1047,54 +1147,14 @@ int MapInitializer::_computeEssentials(TMath::TMatrixd results[3],
 
 bool MapInitializer::_findBestEssential()
 {
-    using namespace TMath;
-
-    double bestScore = std::numeric_limits<double>::max();
     m_outlinersIndices.clear();
-    m_inlinerIndices.resize(7);
-    std::size_t i, j;
-    Random_mt19937 rnd;
-    rnd.seed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
-                 std::chrono::system_clock::now().time_since_epoch()).count());
-
-    TMatrixd essentials[3];
-    int countEssentials;
-
-    for (int iteration = 0; iteration < m_countTimes; ++iteration) {
-        if ((iteration % 200) == 0)
-            rnd.seed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
-                         std::chrono::system_clock::now().time_since_epoch()).count() + iteration * 7);
-        for (i = 0; i < 7; ++i) {
-            bool isUnique;
-            for(;;) {
-                isUnique = true;
-                m_inlinerIndices[i] = rnd() % m_matches.size();
-                for (j = 0; j < i; ++j) {
-                    if (m_inlinerIndices[j] == m_inlinerIndices[i]) {
-                        isUnique = false;
-                        break;
-                    }
-                }
-                if (isUnique)
-                    break;
-            }
-        }
-        countEssentials = _computeEssential_from7points(essentials);
-        for (int k = 0; k < countEssentials; ++k) {
-            const TMatrixd& essential = essentials[k];
-            double score = 0.0, error;
-            for (i = 0; i < m_matches.size(); ++i) {
-                error = _getEssentialError(essential, m_matches[i]);
-                score += std::min(error, m_maxSquarePixelError);
-            }
-            if (score < bestScore) {
-                bestScore = score;
-                m_bestEssential = essential;
-            }
-        }
-    }
     m_inlinerIndices.clear();
-    if (m_bestEssential.rows() == 0)
+    std::size_t i;
+    EssentialEstimator estimator(*this, m_ransac.countThreads());
+    m_ransac.setMaxCountIterations(m_countTimes);
+    m_ransac.setSeed((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch()).count());
+    if (!m_ransac.run(m_bestEssential, estimator, (int)m_matches.size(), m_maxSquarePixelError, true))
         return false;
     for (i = 0; i < m_matches.size(); ++i) {
         if (_getEssentialError(m_bestEssential, m_matches[i]) <= m_maxSquarePixelError)
@@ -11,6 +11,7 @@
 #include "Map.h"
 #include "MapResourcesManager.h"
 #include "Configurations.h"
+#include "Ransac.h"
 
 namespace AR {
 
@@ -34,6 +35,12 @@ public:
     int countTimes() const;
     void setCountTimes(int count);
 
+    double ransacConfidence() const;
+    void setRansacConfidence(double confidence);
+
+    int ransacCountThreads() const;
+    void setRansacCountThreads(int countThreads);
+
     double mapScale() const;
     void setMapScale(double scale);
 
@@ -75,6 +82,7 @@ private:
     struct Match
     {
         int imageLevel;
+        float score;
         Point2f pixelFirst;
         TMath::TVectord camFirst;
         Point2f pixelSecond;
@@ -94,6 +102,10 @@ private:
         TMath::TVectord n;
     };
 
+    struct HomographyEstimator;
+    struct EssentialEstimator;
+    struct PlaneEstimator;
+
     double m_maxSquarePixelError;
     int m_countTimes;
     double m_mapScale;
@@ -103,12 +115,15 @@ private:
     double m_epsDistanceForPlane;
 
     std::vector<Match> m_matches;
+    // indices of matches sorted by scores of features, the best first (for progressive sampling)
+    std::vector<std::size_t> m_matchesOrder;
     std::vector<std::size_t> m_inlinerIndices;
     std::vector<std::size_t> m_outlinersIndices;
     std::vector<HomographyDecomposition> m_decompositions;
     TMath::TMatrixd m_bestHomography;
     TMath::TMatrixd m_bestEssential;
     TMath::TSVD<double> m_svd;
+    Ransac m_ransac;
 
     FeatureDetector m_featureDetector;
     std::shared_ptr<const Camera> m_firstCamera;
@@ -116,6 +131,7 @@ private:
     std::shared_ptr<const Camera> m_secondCamera;
     double m_secondCameraErrorMultipler;
     std::vector<int> m_featureImageLevel;
+    std::vector<float> m_featureScores;
     std::vector<Point2f> m_firstFeatures;
     std::vector<Point2f> m_secondFeatures;
 
@@ -123,11 +139,15 @@ private:
     double _getHomographyError(const TMath::TMatrixd & homography, const Match & match) const;
     double _getEssentialError(const TMath::TMatrixd & essential, const Match & match) const;
     TMath::TMatrixd _findHomography();
+    TMath::TMatrixd _findHomography(const std::size_t * indices, std::size_t countIndices,
+                                    TMath::TSVD<double> & svd) const;
     bool _findBestHomography();
     void _refineHomography(TMath::TMatrixd & homography);
     bool _computeDecompositionsOfHomography();
     TMath::TMatrixd _fixEssentialMatrix(const TMath::TMatrixd & essential);
     int _computeEssential_from7points(TMath::TMatrixd results[3]);
+    int _computeEssential_from7points(TMath::TMatrixd results[3], const std::size_t indices[7],
+                                      TMath::TSVD<double> & svd) const;
     int _computeEssentials(TMath::TMatrixd results[3], const TMath::TMatrixd & F1, const TMath::TMatrixd & F2) const;
     bool _findBestEssential();
     int _getRealRoots(double * roots, double a, double b, double c, double d) const;
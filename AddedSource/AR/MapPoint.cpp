@@ -59,16 +59,23 @@ int MapPoint::Statistic::commonScore() const
     return (m_successScore - m_failedScore);
 }
 
-MapPoint::MapPoint(Map * map, std::size_t index, const TMath::TVectord & position):
+MapPoint::MapPoint(Map * map, std::size_t index, const SlabHandle & handle, MapPointsBlock * block,
+                   const TMath::TVectord & position):
     MapResourceObject(map),
     m_index(index),
-    m_position(position)
+    m_handle(handle),
+    m_block(block),
+    m_indexInBlock(handle.slot % countObjectsInSlab),
+    m_projectionEpoch(0)
 {
     TMath_assert(position.size() == 3);
+    _setPosition3d(TMath::TVector3d(position));
+    m_block->statistics[m_indexInBlock] = Statistic();
 }
 
 MapPoint::~MapPoint()
 {
+    // the slot of block is cleared by the map when the map point is removed from it
     _clearFeatures();
 }
 
@@ -82,22 +89,43 @@ std::size_t MapPoint::index() const
     return m_index;
 }
 
+SlabHandle MapPoint::handle() const
+{
+    return m_handle;
+}
+
 void MapPoint::setPosition(const TMath::TVectord & position)
 {
     TMath_assert(position.size() == 3);
-    m_position = position;
+    _setPosition3d(TMath::TVector3d(position));
 }
 
 void MapPoint::transform(const TMath::TMatrixd & rotation, const TMath::TVectord & translation)
 {
     TMath_assert((rotation.rows() == 3) && (rotation.cols() == 3));
     TMath_assert(translation.size() == 3);
-    m_position = rotation * m_position + translation;
+    _setPosition3d(TMath::TMatrix3d(rotation) * _position3d() + TMath::TVector3d(translation));
 }
 
 TMath::TVectord MapPoint::position() const
 {
-    return m_position;
+    return TMath::TVectord::create(m_block->x[m_indexInBlock], m_block->y[m_indexInBlock], m_block->z[m_indexInBlock]);
+}
+
+TMath::TVector3d MapPoint::_position3d() const
+{
+    TMath::TVector3d position;
+    position(0) = m_block->x[m_indexInBlock];
+    position(1) = m_block->y[m_indexInBlock];
+    position(2) = m_block->z[m_indexInBlock];
+    return position;
+}
+
+void MapPoint::_setPosition3d(const TMath::TVector3d & position)
+{
+    m_block->x[m_indexInBlock] = position(0);
+    m_block->y[m_indexInBlock] = position(1);
+    m_block->z[m_indexInBlock] = position(2);
 }
 
 std::size_t MapPoint::countFeatures() const
@@ -147,94 +175,59 @@ std::shared_ptr<const Feature> MapPoint::getBestCollinearFeature(const TMath::TV
 
 void MapPoint::optimize(MapResourcesManager * manager, int numberIterations)
 {
-    using namespace TMath;
-
-    TVectord oldPosition = m_position, v_f;
-    double chi2 = std::numeric_limits<double>::max();
-    TWLS<double> wls(3);
-    TVectord J_x(3), J_y(3);
-    Point2d e;
-
     for (auto it = m_features.cbegin(); it != m_features.cend(); ++it)
-        manager->lock((*it)->keyFrame().get());
-
-    for (int iteration = 0; iteration < numberIterations; ++iteration) {
-
-        wls.clear();
-
-        double new_chi2 = 0.0;
-
-        // compute residuals
-        auto it = m_features.cbegin();
-        while (it != m_features.cend()) {
-
-            std::shared_ptr<const KeyFrame> keyFrame = (*it)->keyFrame();
-
-            TMath_assert(keyFrame && !keyFrame->isDeleted());
-
-            TMatrixd rotation = keyFrame->rotation();
-
-            v_f = rotation * m_position + keyFrame->translation();
-
-            if (v_f(2) < std::numeric_limits<float>::epsilon()) {
-                ++it;
-                continue;
-            }
-
-            const double z_inv_squared = 1.0 / (v_f(2) * v_f(2));
-
-            J_x(0) = (rotation(0, 0) * v_f(2) - rotation(2, 0) * v_f(0)) * z_inv_squared;
-            J_x(1) = (rotation(0, 1) * v_f(2) - rotation(2, 1) * v_f(0)) * z_inv_squared;
-            J_x(2) = (rotation(0, 2) * v_f(2) - rotation(2, 2) * v_f(0)) * z_inv_squared;
-
-            J_y(0) = (rotation(1, 0) * v_f(2) - rotation(2, 0) * v_f(1)) * z_inv_squared;
-            J_y(1) = (rotation(1, 1) * v_f(2) - rotation(2, 1) * v_f(1)) * z_inv_squared;
-            J_y(2) = (rotation(1, 2) * v_f(2) - rotation(2, 2) * v_f(1)) * z_inv_squared;
-
-            e = LocationOptimizer::project2d((*it)->localDir()) - LocationOptimizer::project2d(v_f);
+        manager->lock((*it)->keyFrame().get(), MapResourceAccess::Shared);
 
-            wls.addMeasurement(e.x, J_x);
-            wls.addMeasurement(e.y, J_y);
+    std::vector<Observation> observations;
+    _addObservationsOfKeyFrames(observations);
+    _optimize(observations, numberIterations);
 
-            new_chi2 += e.lengthSquared();
-
-            ++it;
-        }
+    for (auto it = m_features.cbegin(); it != m_features.cend(); ++it)
+        manager->unlock((*it)->keyFrame().get(), MapResourceAccess::Shared);
+}
 
-        wls.compute();
+void MapPoint::optimize(MapResourcesManager * manager,
+                        int numberIterations, const Frame & frame, const Point2f & positionOnFrame)
+{
+    for (auto it = m_features.cbegin(); it != m_features.cend(); ++it)
+        manager->lock((*it)->keyFrame().get(), MapResourceAccess::Shared);
 
-        // check if error increased
-        if ((new_chi2 > chi2) || (std::isnan(wls.X()(0)))) {
-            m_position = oldPosition; // roll-back
-            break;
-        }
+    std::vector<Observation> observations(1);
+    observations[0].rotation = frame.rotation();
+    observations[0].translation = frame.translation();
+    observations[0].localPoint = frame.camera()->unproject(positionOnFrame);
+    _addObservationsOfKeyFrames(observations);
+    _optimize(observations, numberIterations);
 
-        oldPosition = m_position;
-        m_position += wls.X();
+    for (auto it = m_features.cbegin(); it != m_features.cend(); ++it)
+        manager->unlock((*it)->keyFrame().get(), MapResourceAccess::Shared);
+}
 
-        chi2 = new_chi2;
+void MapPoint::_addObservationsOfKeyFrames(std::vector<Observation> & observations) const
+{
+    observations.reserve(observations.size() + m_features.size());
+    for (auto it = m_features.cbegin(); it != m_features.cend(); ++it) {
+        std::shared_ptr<const KeyFrame> keyFrame = (*it)->keyFrame();
+        TMath_assert(keyFrame && !keyFrame->isDeleted());
+
+        Observation observation;
+        observation.rotation = keyFrame->rotation();
+        observation.translation = keyFrame->translation();
+        observation.localPoint = LocationOptimizer::project2d((*it)->localDir());
+        observations.push_back(observation);
     }
-
-    for (auto it = m_features.cbegin(); it != m_features.cend(); ++it)
-        manager->unlock((*it)->keyFrame().get());
 }
 
-void MapPoint::optimize(MapResourcesManager * manager,
-                        int numberIterations, const Frame & frame, const Point2f & positionOnFrame)
+void MapPoint::_optimize(const std::vector<Observation> & observations, int numberIterations)
 {
     using namespace TMath;
 
-    TVectord oldPosition = m_position, v_f;
+    // poses of key frames are locked, so they are copied once and iterations don't use heap
+    TVector3d position = _position3d(), oldPosition = position, v_f;
     double chi2 = std::numeric_limits<double>::max();
     TWLS<double> wls(3);
-    TVectord J_x(3), J_y(3);
+    TVector3d J_x, J_y;
     Point2d e;
-    TMatrixd rotation(3, 3);
-
-    for (auto it = m_features.cbegin(); it != m_features.cend(); ++it)
-        manager->lock((*it)->keyFrame().get());
-
-    Point2d localPoint = frame.camera()->unproject(positionOnFrame);
 
     for (int iteration = 0; iteration < numberIterations; ++iteration) {
 
@@ -243,44 +236,13 @@ void MapPoint::optimize(MapResourcesManager * manager,
         double new_chi2 = 0.0;
 
         // compute residuals
-        {
-            rotation = frame.rotation();
-
-            v_f = rotation * m_position + frame.translation();
-
-            if (v_f(2) > std::numeric_limits<float>::epsilon()) {
-                const double z_inv_squared = 1.0 / (v_f(2) * v_f(2));
+        for (auto it = observations.cbegin(); it != observations.cend(); ++it) {
+            const TMatrix3d & rotation = it->rotation;
 
-                J_x(0) = (rotation(0, 0) * v_f(2) - rotation(2, 0) * v_f(0)) * z_inv_squared;
-                J_x(1) = (rotation(0, 1) * v_f(2) - rotation(2, 1) * v_f(0)) * z_inv_squared;
-                J_x(2) = (rotation(0, 2) * v_f(2) - rotation(2, 2) * v_f(0)) * z_inv_squared;
+            v_f = rotation * position + it->translation;
 
-                J_y(0) = (rotation(1, 0) * v_f(2) - rotation(2, 0) * v_f(1)) * z_inv_squared;
-                J_y(1) = (rotation(1, 1) * v_f(2) - rotation(2, 1) * v_f(1)) * z_inv_squared;
-                J_y(2) = (rotation(1, 2) * v_f(2) - rotation(2, 2) * v_f(1)) * z_inv_squared;
-
-                e = localPoint - LocationOptimizer::project2d(v_f);
-
-                wls.addMeasurement(e.x, J_x);
-                wls.addMeasurement(e.y, J_y);
-
-                new_chi2 += e.lengthSquared();
-            }
-        }
-        auto it = m_features.cbegin();
-        while (it != m_features.cend()) {
-
-            std::shared_ptr<const KeyFrame> keyFrame = (*it)->keyFrame();
-            TMath_assert(keyFrame && !keyFrame->isDeleted());
-
-            rotation = keyFrame->rotation();
-
-            v_f = rotation * m_position + keyFrame->translation();
-
-            if (v_f(2) < std::numeric_limits<float>::epsilon()) {
-                ++it;
+            if (v_f(2) < std::numeric_limits<float>::epsilon())
                 continue;
-            }
 
             const double z_inv_squared = 1.0 / (v_f(2) * v_f(2));
 
@@ -292,37 +254,34 @@ void MapPoint::optimize(MapResourcesManager * manager,
             J_y(1) = (rotation(1, 1) * v_f(2) - rotation(2, 1) * v_f(1)) * z_inv_squared;
             J_y(2) = (rotation(1, 2) * v_f(2) - rotation(2, 2) * v_f(1)) * z_inv_squared;
 
-            e = LocationOptimizer::project2d((*it)->localDir()) - LocationOptimizer::project2d(v_f);
+            e = it->localPoint - LocationOptimizer::project2d(v_f);
 
             wls.addMeasurement(e.x, J_x);
             wls.addMeasurement(e.y, J_y);
 
             new_chi2 += e.lengthSquared();
-
-            ++it;
         }
 
         wls.compute();
 
         // check if error increased
         if ((new_chi2 > chi2) || (std::isnan(wls.X()(0)))) {
-            m_position = oldPosition; // roll-back
+            position = oldPosition; // roll-back
             break;
         }
 
-        oldPosition = m_position;
-        m_position += wls.X();
+        oldPosition = position;
+        position += TVector3d(wls.X());
 
         chi2 = new_chi2;
     }
 
-    for (auto it = m_features.cbegin(); it != m_features.cend(); ++it)
-        manager->unlock((*it)->keyFrame().get());
+    _setPosition3d(position);
 }
 
 MapPoint::Statistic & MapPoint::statistic() const
 {
-    return m_statistic;
+    return m_block->statistics[m_indexInBlock];
 }
 
 void MapPoint::_freeFeature(Feature * feature)
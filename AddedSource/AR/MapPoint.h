@@ -4,16 +4,20 @@
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <cstdint>
+#include <algorithm>
 #include "Point2.h"
 #include "TMath/TMath.h"
 #include "MapResourceObject.h"
 #include "MapResourcesManager.h"
+#include "SlabPool.h"
 
 namespace AR {
 
 class Feature;
 class Map;
 class Frame;
+struct MapPointsBlock;
 
 class MapPoint:
         public MapResourceObject
@@ -45,6 +49,9 @@ public:
 
     std::size_t index() const;
 
+    // Handle of map point in pool of the map.
+    SlabHandle handle() const;
+
     void setPosition(const TMath::TVectord & position);
     TMath::TVectord position() const;
 
@@ -65,19 +72,53 @@ public:
 private:
     friend class Map;
     friend class Feature;
+    friend class MapProjector;
 
     MapPoint(const MapPoint & ) = delete;
     void operator = (const MapPoint & ) = delete;
 
+    struct Observation
+    {
+        TMath::TMatrix3d rotation;
+        TMath::TVector3d translation;
+        Point2d localPoint;
+    };
+
     std::size_t m_index;
-    TMath::TVectord m_position;
+    SlabHandle m_handle;
+    MapPointsBlock * m_block;
+    std::size_t m_indexInBlock;
     std::vector<std::shared_ptr<Feature>> m_features;
-    mutable Statistic m_statistic;
+    // Number of the last projection of MapProjector in which the map point was projected.
+    std::uint64_t m_projectionEpoch;
+
+    MapPoint(Map * map, size_t index, const SlabHandle & handle, MapPointsBlock * block,
+             const TMath::TVectord & position);
 
-    MapPoint(Map * map, size_t index, const TMath::TVectord & position);
+    TMath::TVector3d _position3d() const;
+    void _setPosition3d(const TMath::TVector3d & position);
 
     void _freeFeature(Feature * feature);
     void _clearFeatures();
+
+    void _addObservationsOfKeyFrames(std::vector<Observation> & observations) const;
+    void _optimize(const std::vector<Observation> & observations, int numberIterations);
+};
+
+// Positions and statistics of map points of one slab, so loops over all map points of the map read memory linearly.
+struct MapPointsBlock
+{
+    double x[countObjectsInSlab];
+    double y[countObjectsInSlab];
+    double z[countObjectsInSlab];
+    MapPoint::Statistic statistics[countObjectsInSlab];
+    // Map point of slot is in the map (it's created and isn't deleted).
+    bool inMap[countObjectsInSlab];
+
+    MapPointsBlock()
+    {
+        std::fill(inMap, inMap + countObjectsInSlab, false);
+    }
 };
 
 enum class TypeMapPoint: int
@@ -3,7 +3,7 @@
 #include "MapProjector.h"
 #include "MapResourceLocker.h"
 #include "TMath/TMath.h"
-#include "ZMSSD.h"
+#include "PatchComparison.h"
 #include "KeyFrame.h"
 
 namespace AR {
@@ -126,15 +126,27 @@ CandidateMapPoint * CandidateMapPoint::prev()
     return m_prev;
 }
 
-MapPointsDetector::MapPointsDetector(Map * map)
+MapPointsDetector::MapPointsDetector(Map * map):
+    m_framesQueue(16),
+    m_countSeedUpdates(0),
+    m_countFailedMatches(0),
+    m_countConvergedSeeds(0),
+    m_countDivergedSeeds(0),
+    m_countRemovedSeeds(0),
+    m_countSeeds(0),
+    m_countSeedGroups(0)
 {
     TMath_assert(map != nullptr);
     m_map = map;
     m_thread_is_running = false;
     m_isNewKeyFrame = false;
-    m_needToStopSeedUpdating = false;
+    m_stopLoop = false;
     m_thread = nullptr;
+    m_countProcessedFrames.store(0);
+    m_performanceMonitor = nullptr;
+    m_stage_updateSeeds = m_stage_initializeSeed = -1;
     m_maxNumberOfUsedFrames = 3;
+    m_framesQueue.setLimit(m_maxNumberOfUsedFrames);
     m_maxNumberOfSearchSteps = 100;
     m_seedConvergenceSquaredSigmaThresh = 100.0f;
     m_sizeOfCommitMapPoints = 10;
@@ -143,6 +155,7 @@ MapPointsDetector::MapPointsDetector(Map * map)
     m_cellsLock = nullptr;
     m_preparedCandidates = new CandidateMapPointsList();
     m_finalCandidates = new CandidateMapPointsList();
+    setCountThreads(1);
 }
 
 MapPointsDetector::~MapPointsDetector()
@@ -165,14 +178,17 @@ MapPointsDetectorConfiguration MapPointsDetector::configuration() const
     configuration.seedConvergenceSquaredSigmaThresh = m_seedConvergenceSquaredSigmaThresh;
     configuration.sizeOfCommitMapPoints = m_sizeOfCommitMapPoints;
     configuration.maxCountCandidatePoints = m_maxCountCandidatePoints;
+    configuration.asynchronous = threadIsRunning();
+    configuration.dropOldestFrames = (m_framesQueue.policy() == SpscRingBuffer<Frame>::Policy::DropOldest);
     configuration.frameGridSize = m_featureDetector.gridSize();
     configuration.featureCornerBarier = m_featureDetector.barrier();
     configuration.featureDetectionThreshold = m_featureDetector.detectionThreshold();
     configuration.minImageLevelForFeature = m_featureDetector.minLevelForFeature();
     configuration.maxImageLevelForFeature = m_featureDetector.maxLevelForFeature();
-    configuration.featureCursorSize = m_matcher.cursorSize();
-    configuration.pixelEps = m_matcher.pixelEps();
-    configuration.maxNumberIterationsForOpticalFlow = m_matcher.numberIterations();
+    configuration.featureCursorSize = m_contexts[0]->matcher.cursorSize();
+    configuration.pixelEps = m_contexts[0]->matcher.pixelEps();
+    configuration.maxNumberIterationsForOpticalFlow = m_contexts[0]->matcher.numberIterations();
+    configuration.countThreads = m_threadPool.countThreads();
 
     return configuration;
 }
@@ -183,6 +199,9 @@ void MapPointsDetector::setConfiguration(const MapPointsDetectorConfiguration &
     std::lock_guard<std::mutex> lock_config(m_config_mutex); (void)lock_config;
 
     m_maxNumberOfUsedFrames = configuration.maxNumberOfUsedFrames;
+    m_framesQueue.setLimit(m_maxNumberOfUsedFrames);
+    m_framesQueue.setPolicy(configuration.dropOldestFrames ? SpscRingBuffer<Frame>::Policy::DropOldest :
+                                                             SpscRingBuffer<Frame>::Policy::DropNewest);
     m_maxNumberOfSearchSteps = configuration.maxNumberOfSearchSteps;
     m_seedConvergenceSquaredSigmaThresh = configuration.seedConvergenceSquaredSigmaThresh;
     m_sizeOfCommitMapPoints = configuration.sizeOfCommitMapPoints;
@@ -195,9 +214,13 @@ void MapPointsDetector::setConfiguration(const MapPointsDetectorConfiguration &
     m_featureDetector.setDetectionThreshold(configuration.featureDetectionThreshold);
     m_featureDetector.setLevelForFeature(configuration.minImageLevelForFeature,
                                          configuration.maxImageLevelForFeature);
-    m_matcher.setCursorSize(configuration.featureCursorSize);
-    m_matcher.setPixelEps(configuration.pixelEps);
-    m_matcher.setNumberIterations(configuration.maxNumberIterationsForOpticalFlow);
+    for (auto it = m_contexts.begin(); it != m_contexts.end(); ++it) {
+        OpticalFlowCalculator & matcher = (*it)->matcher;
+        matcher.setCursorSize(configuration.featureCursorSize);
+        matcher.setPixelEps(configuration.pixelEps);
+        matcher.setNumberIterations(configuration.maxNumberIterationsForOpticalFlow);
+    }
+    _setCountThreads(configuration.countThreads);
 }
 
 int MapPointsDetector::maxNumberOfUsedFrames() const
@@ -210,6 +233,53 @@ void MapPointsDetector::setMaxNumberOfUsedFrames(int maxNumberOfUsedFrames)
 {
     std::lock_guard<std::mutex> lock_frames(m_framesQueueMutex); (void)lock_frames;
     m_maxNumberOfUsedFrames = maxNumberOfUsedFrames;
+    m_framesQueue.setLimit(m_maxNumberOfUsedFrames);
+}
+
+bool MapPointsDetector::dropOldestFrames() const
+{
+    return (m_framesQueue.policy() == SpscRingBuffer<Frame>::Policy::DropOldest);
+}
+
+void MapPointsDetector::setDropOldestFrames(bool enabled)
+{
+    m_framesQueue.setPolicy(enabled ? SpscRingBuffer<Frame>::Policy::DropOldest :
+                                      SpscRingBuffer<Frame>::Policy::DropNewest);
+}
+
+int MapPointsDetector::countThreads() const
+{
+    std::lock_guard<std::mutex> lock_config(m_config_mutex); (void)lock_config;
+    return m_threadPool.countThreads();
+}
+
+void MapPointsDetector::setCountThreads(int countThreads)
+{
+    std::lock_guard<std::mutex> lock_config(m_config_mutex); (void)lock_config;
+    _setCountThreads(countThreads);
+}
+
+void MapPointsDetector::_setCountThreads(int countThreads)
+{
+    m_threadPool.setCountThreads(countThreads);
+    std::size_t countContexts = (std::size_t)m_threadPool.countThreads();
+    if (m_contexts.size() == countContexts)
+        return;
+    std::size_t oldCountContexts = m_contexts.size();
+    m_contexts.resize(countContexts);
+    for (std::size_t i = oldCountContexts; i < countContexts; ++i) {
+        m_contexts[i].reset(new SearchContext());
+        SearchContext & context = *m_contexts[i];
+        context.warpMatrix = TMath::TMatrixf(2, 2);
+        context.seedPoint = TMath::TVectord(3);
+        if (i > 0) {
+            // parameters of matching are the same in all contexts
+            const OpticalFlowCalculator & firstMatcher = m_contexts[0]->matcher;
+            context.matcher.setCursorSize(firstMatcher.cursorSize());
+            context.matcher.setPixelEps(firstMatcher.pixelEps());
+            context.matcher.setNumberIterations(firstMatcher.numberIterations());
+        }
+    }
 }
 
 int MapPointsDetector::maxNumberOfSearchSteps() const
@@ -284,6 +354,10 @@ void MapPointsDetector::startThread()
     if (m_thread_is_running)
         return;
     m_thread_is_running = true;
+    {
+        std::lock_guard<std::mutex> lockFrames(m_framesQueueMutex); (void)lockFrames;
+        m_stopLoop = false;
+    }
     m_thread = new std::thread(&MapPointsDetector::loop, this);
 }
 
@@ -295,7 +369,11 @@ void MapPointsDetector::stopThread()
             return;
         m_thread_is_running = false;
     }
-    m_frameQueue_condition.notify_one();
+    {
+        std::lock_guard<std::mutex> lockFrames(m_framesQueueMutex); (void)lockFrames;
+        m_stopLoop = true;
+        m_frameQueue_condition.notify_one();
+    }
     if (m_thread != nullptr) {
         m_thread->join();
         delete m_thread;
@@ -303,83 +381,164 @@ void MapPointsDetector::stopThread()
     }
 }
 
+void MapPointsDetector::setPerformanceMonitor(PerformanceMonitor * performanceMonitor)
+{
+    TMath_assert(!threadIsRunning());
+    m_performanceMonitor = performanceMonitor;
+    if (m_performanceMonitor != nullptr) {
+        m_stage_updateSeeds = m_performanceMonitor->registerStage("Update of seeds");
+        m_stage_initializeSeed = m_performanceMonitor->registerStage("Initialization of seeds");
+    }
+}
+
 void MapPointsDetector::addKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame)
 {
     TMath_assert(keyFrame->map() == m_map);
-    /*{
-        std::lock_guard<std::mutex> lockSeeds(m_seedMutex); (void)lockSeeds;
-        m_needToStopSeedUpdating = true;
-    }*/
     {
         std::lock_guard<std::mutex> lockFrames(m_framesQueueMutex); (void)lockFrames;
         m_keyFrame = keyFrame;
         m_isNewKeyFrame = true;
-        if ((int)m_framesQueue.size() >= m_maxNumberOfUsedFrames) {
-            m_framesQueue.erase(m_framesQueue.begin(),
-                m_framesQueue.begin() + ((m_maxNumberOfUsedFrames + 1) - (int)(m_framesQueue.size())));
-        }
-        m_framesQueue.push_back(std::make_shared<Frame>(*keyFrame));
-        m_frameQueue_condition.notify_one();
     }
+    if (!threadIsRunning())
+        return;
+    // images of key frame are not changed, so they are not copied
+    m_framesQueue.push(std::unique_ptr<Frame>(new Frame(*keyFrame)));
+    std::lock_guard<std::mutex> lockFrames(m_framesQueueMutex); (void)lockFrames;
+    m_frameQueue_condition.notify_one();
 }
 
 void MapPointsDetector::addFrame(Frame && frame)
 {
-    /*{
-        std::lock_guard<std::mutex> lockSeeds(m_seedMutex); (void)lockSeeds;
-        m_needToStopSeedUpdating = true;
-    }*/
-    {
-        std::lock_guard<std::mutex> lockFrames(m_framesQueueMutex); (void)lockFrames;
-        if ((int)m_framesQueue.size() >= m_maxNumberOfUsedFrames) {
-            m_framesQueue.erase(m_framesQueue.begin(),
-                m_framesQueue.begin() + ((m_maxNumberOfUsedFrames + 1) - (int)(m_framesQueue.size())));
-        }
-        m_framesQueue.push_back(std::make_shared<Frame>(frame));
-        m_frameQueue_condition.notify_one();
-    }
+    if (!threadIsRunning())
+        return;
+    // the image pyramid of frame is reused by tracker for next frames
+    m_framesQueue.push(std::unique_ptr<Frame>(new Frame(frame.camera(), frame.getCopyOfImagePyramid(),
+                                                        frame.rotation(), frame.translation())));
+    // the mutex is taken, so the notification isn't lost between the check of the queue and the waiting
+    std::lock_guard<std::mutex> lockFrames(m_framesQueueMutex); (void)lockFrames;
+    m_frameQueue_condition.notify_one();
+}
+
+std::size_t MapPointsDetector::countDroppedFrames() const
+{
+    return m_framesQueue.countDropped();
+}
+
+std::size_t MapPointsDetector::countProcessedFrames() const
+{
+    return m_countProcessedFrames.load();
+}
+
+MapPointsDetector::SeedStatistics MapPointsDetector::seedStatistics() const
+{
+    SeedStatistics statistics;
+    statistics.countSeeds = m_countSeeds.load();
+    statistics.countSeedGroups = m_countSeedGroups.load();
+    statistics.countUpdates = m_countSeedUpdates.load();
+    statistics.countFailedMatches = m_countFailedMatches.load();
+    statistics.countConverged = m_countConvergedSeeds.load();
+    statistics.countDiverged = m_countDivergedSeeds.load();
+    statistics.countRemoved = m_countRemovedSeeds.load();
+    return statistics;
 }
 
 void MapPointsDetector::loop()
 {
+    if (m_performanceMonitor != nullptr)
+        m_performanceMonitor->setThreadName("Mapping");
     for (;;) {
         {
             std::lock_guard<std::mutex> lock(m_thread_mutex); (void)lock;
             if (!m_thread_is_running)
                 break;
         }
-        std::shared_ptr<Frame> frame(nullptr);
         {
             std::unique_lock<std::mutex> lock(m_framesQueueMutex);
-            while (!m_isNewKeyFrame && m_framesQueue.empty() && m_thread_is_running)
-                m_frameQueue_condition.wait(lock);
-            {
-                std::lock_guard<std::mutex> lockSeeds(m_seedMutex); (void)lockSeeds;
-                m_needToStopSeedUpdating = false;
-            }
-            if (!m_framesQueue.empty()) {
-                frame = m_framesQueue[0];
-                m_framesQueue.erase(m_framesQueue.begin());
+            m_frameQueue_condition.wait(lock, [this] () {
+                return (m_isNewKeyFrame || !m_framesQueue.empty() || m_stopLoop);
+            });
+        }
+        std::unique_ptr<Frame> frame = m_framesQueue.pop();
+        std::weak_ptr<KeyFrame> keyFrame;
+        {
+            std::unique_lock<std::mutex> lock(m_framesQueueMutex); (void)lock;
+            if (m_isNewKeyFrame) {
+                keyFrame = m_keyFrame;
+                m_isNewKeyFrame = false;
+                m_keyFrame.reset();
             }
         }
+        std::shared_ptr<KeyFrame> newKeyFrame = keyFrame.lock();
+        if (!frame && !newKeyFrame)
+            continue;
+        if (m_performanceMonitor != nullptr)
+            m_performanceMonitor->start();
         if (frame) {
+            if (m_performanceMonitor != nullptr)
+                m_performanceMonitor->startTimer(m_stage_updateSeeds);
             _updateSeeds(*frame);
+            if (m_performanceMonitor != nullptr)
+                m_performanceMonitor->endTimer(m_stage_updateSeeds);
+            ++m_countProcessedFrames;
         }
-        {
-            std::weak_ptr<KeyFrame> keyFrame;
-            {
-                std::unique_lock<std::mutex> lock(m_framesQueueMutex); (void)lock;
-                if (m_isNewKeyFrame) {
-                    keyFrame = m_keyFrame;
-                    m_isNewKeyFrame = false;
-                    m_keyFrame.reset();
-                }
-            }
-            _initializeSeed(keyFrame.lock());
+        if (newKeyFrame) {
+            if (m_performanceMonitor != nullptr)
+                m_performanceMonitor->startTimer(m_stage_initializeSeed);
+            _initializeSeed(newKeyFrame);
+            newKeyFrame.reset();
+            if (m_performanceMonitor != nullptr)
+                m_performanceMonitor->endTimer(m_stage_initializeSeed);
         }
+        if (m_performanceMonitor != nullptr)
+            m_performanceMonitor->end();
     }
 }
 
+void MapPointsDetector::SeedGroup::eraseFirst(std::size_t count)
+{
+    localDirs.erase(localDirs.begin(), localDirs.begin() + count);
+    projections.erase(projections.begin(), projections.begin() + count);
+    imageLevels.erase(imageLevels.begin(), imageLevels.begin() + count);
+    a.erase(a.begin(), a.begin() + count);
+    b.erase(b.begin(), b.begin() + count);
+    mu.erase(mu.begin(), mu.begin() + count);
+    z_range.erase(z_range.begin(), z_range.begin() + count);
+    sigmaSquared.erase(sigmaSquared.begin(), sigmaSquared.begin() + count);
+    matches.clear();
+}
+
+void MapPointsDetector::SeedGroup::removeSeeds()
+{
+    if (matches.size() != size())
+        return;
+    // arrays are compacted in place, order of remaining seeds is kept
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < matches.size(); ++i) {
+        if (matches[i] == SeedMatch::Removed)
+            continue;
+        if (i != j) {
+            localDirs[j] = localDirs[i];
+            projections[j] = projections[i];
+            imageLevels[j] = imageLevels[i];
+            a[j] = a[i];
+            b[j] = b[i];
+            mu[j] = mu[i];
+            z_range[j] = z_range[i];
+            sigmaSquared[j] = sigmaSquared[i];
+        }
+        ++j;
+    }
+    localDirs.resize(j);
+    projections.resize(j);
+    imageLevels.resize(j);
+    a.resize(j);
+    b.resize(j);
+    mu.resize(j);
+    z_range.resize(j);
+    sigmaSquared.resize(j);
+    matches.clear();
+}
+
 void MapPointsDetector::_initializeSeed(const std::shared_ptr<KeyFrame> & keyFrame)
 {
     using namespace TMath;
@@ -392,7 +551,7 @@ void MapPointsDetector::_initializeSeed(const std::shared_ptr<KeyFrame> & keyFra
     std::lock_guard<std::mutex> lock_config(m_config_mutex); (void)lock_config;
     double depth_mean, depth_min;
 
-    MapResourceLocker lockerKeyFrame(&m_resourceManager, keyFrame.get()); (void)lockerKeyFrame;
+    MapResourceLocker lockerKeyFrame(&m_resourceManager, keyFrame.get(), MapResourceAccess::Shared); (void)lockerKeyFrame;
 
     if (keyFrame->isDeleted()) {
         m_map->unlock();
@@ -418,220 +577,281 @@ void MapPointsDetector::_initializeSeed(const std::shared_ptr<KeyFrame> & keyFra
     std::srand((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
                 std::chrono::system_clock::now().time_since_epoch()).count());
     std::random_shuffle(features.begin(), features.end());
+    SeedGroup group;
+    group.keyFrame = keyFrame;
+    group.deleted = false;
+    group.active = false;
+    group.localDirs.reserve(features.size());
+    group.projections.reserve(features.size());
+    group.imageLevels.reserve(features.size());
     for (auto it = features.begin(); it != features.end(); ++it) {
-        std::vector<ProjectionPoint> projections;
         Point2d l = camera->unproject(it->pos);
-        TVectord localDir = TVectord::create(l.x, l.y, 1.0).normalized();
-        projections.push_back({ keyFrame->camera(),
-                                it->pos.cast<float>(),
-                                keyFrame->rotation(),
-                                keyFrame->translation()
-                              });
-        m_seeds.push_back({ keyFrame,                               // keyFrame
-                            localDir,                               // localDir
-                            it->level,                              // imageLevel
-                            10.0f,                                  // a
-                            10.0f,                                  // b
-                            mu,                                     // mu
-                            z_range,                                // z_range
-                            sigmaSquared,                           // sigmaSquared
-                            projections                             // projections
-                          });
+        group.localDirs.push_back(TVector3d::create(l.x, l.y, 1.0).normalized());
+        group.projections.push_back(it->pos.cast<float>());
+        group.imageLevels.push_back(it->level);
     }
-    if (m_seeds.size() > 1000) {
-        auto to = m_seeds.begin();
-        std::advance(to, (m_seeds.size() - 1000));
-        m_seeds.erase(m_seeds.begin(), to);
+    group.a.assign(features.size(), 10.0f);
+    group.b.assign(features.size(), 10.0f);
+    group.mu.assign(features.size(), mu);
+    group.z_range.assign(features.size(), z_range);
+    group.sigmaSquared.assign(features.size(), sigmaSquared);
+    if (group.size() > 0) {
+        m_seedGroups.push_back(std::move(group));
+        _removeOldestSeeds(1000);
     }
+    _updateCountSeeds();
     m_map->unlock();
 }
 
+void MapPointsDetector::_removeOldestSeeds(std::size_t maxCountSeeds)
+{
+    std::size_t countSeeds = 0;
+    for (auto it = m_seedGroups.cbegin(); it != m_seedGroups.cend(); ++it)
+        countSeeds += it->size();
+    if (countSeeds <= maxCountSeeds)
+        return;
+    std::size_t countRemoved = countSeeds - maxCountSeeds;
+    m_countRemovedSeeds += countRemoved;
+    auto it = m_seedGroups.begin();
+    while (countRemoved >= it->size()) {
+        countRemoved -= it->size();
+        ++it;
+    }
+    it->eraseFirst(countRemoved);
+    m_seedGroups.erase(m_seedGroups.begin(), it);
+}
+
+void MapPointsDetector::_updateCountSeeds()
+{
+    std::size_t countSeeds = 0;
+    for (auto it = m_seedGroups.cbegin(); it != m_seedGroups.cend(); ++it)
+        countSeeds += it->size();
+    m_countSeeds = countSeeds;
+    m_countSeedGroups = m_seedGroups.size();
+}
+
 void MapPointsDetector::_updateSeeds(const Frame & frame)
 {
     using namespace TMath;
     std::lock_guard<std::mutex> lock_config(m_config_mutex); (void)lock_config;
 
-    m_map->lock();
-
-    TMatrixd frameRotation = frame.rotation(), invSeedRotation(3, 3), deltaRotation(3, 3);
-    TVectord frameTranslation = frame.translation(), invSeedTranslation(3), deltaTranslation(3);
-    TVectord v;
+    // The map isn't locked: seeds only read poses and images of their key frames under shared locks,
+    // so tracking works in parallel and waits only for a key frame which it changes.
+    // Key frames of all groups are locked together, poses are read only when all of them are locked.
+    auto itGroup = m_seedGroups.begin();
+    while (itGroup != m_seedGroups.end()) {
+        itGroup->lockedKeyFrame = itGroup->keyFrame.lock();
+        if (!itGroup->lockedKeyFrame) {
+            m_countRemovedSeeds += itGroup->size();
+            itGroup = m_seedGroups.erase(itGroup);
+            continue;
+        }
+        m_resourceManager.lock(itGroup->lockedKeyFrame.get(), MapResourceAccess::Shared);
+        ++itGroup;
+    }
+    TMatrix3d frameRotation = frame.rotation();
+    TVector3d frameTranslation = frame.translation();
+    m_seedOffsets.resize(m_seedGroups.size() + 1);
+    m_seedOffsets[0] = 0;
+    for (std::size_t i = 0; i < m_seedGroups.size(); ++i) {
+        SeedGroup & group = m_seedGroups[i];
+        m_seedOffsets[i + 1] = m_seedOffsets[i] + group.size();
+        const std::shared_ptr<KeyFrame> & keyFrame = group.lockedKeyFrame;
+        group.deleted = keyFrame->isDeleted();
+        group.active = !group.deleted && !keyFrame->equals(frame);
+        if (!group.active)
+            continue;
+        // the rotation of key frame is orthogonal, so its inverse is the transposed matrix
+        group.invRotation = TMatrix3d(keyFrame->rotation()).transposed();
+        group.invTranslation = group.invRotation * (- TVector3d(keyFrame->translation()));
+        group.deltaRotation = frameRotation * group.invRotation;
+        group.deltaTranslation = frameRotation * group.invTranslation + frameTranslation;
+        group.framePosition = multiplyTransposed(group.deltaRotation, - group.deltaTranslation);
+        group.deltaRotation_d = group.deltaRotation.toTMatrix();
+        group.deltaTranslation_d = group.deltaTranslation.toTVector();
+    }
+    std::size_t countSeeds = m_seedOffsets.back();
+    m_seedMatches.resize(countSeeds);
+    m_seedDepths.resize(countSeeds);
+    m_seedMatchProjections.resize(countSeeds);
+
+    // Seeds are searched by chunks in parallel, every seed writes only its own result.
+    const int sizeOfChunk = 16;
+    int countChunks = (int)((countSeeds + sizeOfChunk - 1) / sizeOfChunk);
+    m_nextSeedChunk = 0;
+    m_threadPool.run((int)m_contexts.size(), [this, &frame, countChunks] (int contextIndex) {
+        _searchSeeds(*m_contexts[(std::size_t)contextIndex], frame, countChunks);
+    });
+
+    for (auto it = m_seedGroups.rbegin(); it != m_seedGroups.rend(); ++it)
+        m_resourceManager.unlock(it->lockedKeyFrame.get(), MapResourceAccess::Shared);
+
+    // Results are applied serially in order of seeds, so they are the same as in serial search.
     Point2d focalLength = frame.camera()->pixelFocalLength();
     // law of chord (sehnensatz)
     double px_error_angle = std::atan(m_pixelNoise / (2.0 * std::max(focalLength.x, focalLength.y))) * 2.0;
-    //TVectorf result(3);
 
     Point2i gridSize = m_featureDetector.gridSize();
     int countCells = gridSize.y * gridSize.x;
     for (int i = 0; i < countCells; ++i)
         m_cellsLock[i] = false;
 
-    auto it = m_seeds.begin();
-    while (it != m_seeds.end()) {
-        {
-            std::lock_guard<std::mutex> lockSeeds(m_seedMutex); (void)lockSeeds;
-            if (m_needToStopSeedUpdating) {
-                m_needToStopSeedUpdating = false;
-                m_map->unlock();
-                return;
-            }
-        }
-        std::shared_ptr<KeyFrame> keyFrame = it->keyFrame.lock();
-        if (!keyFrame) {
-            it = m_seeds.erase(it);
-            continue;
-        }
-        MapResourceLocker lockerKeyFrame(&m_resourceManager, keyFrame.get()); (void)lockerKeyFrame;
-        if (keyFrame->isDeleted()) {
-            it = m_seeds.erase(it);
-            continue;
-        }
-        if (keyFrame->equals(frame)) {
-            ++it;
-            continue;
-        }
-
-        invSeedRotation = keyFrame->rotation();
-        if (!TTools::matrix3x3Invert(invSeedRotation)) {
-            it = m_seeds.erase(it);
-            continue;
-        }
-        invSeedTranslation = invSeedRotation * (- keyFrame->translation());
-
-        deltaRotation = frameRotation * invSeedRotation;
-        deltaTranslation = frameRotation * invSeedTranslation + frameTranslation;
-
-        v = deltaRotation * (it->localDir * (1.0f / it->mu)) + deltaTranslation;
-        if (v(2) < std::numeric_limits<float>::epsilon()) {
-            ++it;
-            continue;
-        }
-
-        if(!frame.imagePointInFrame(frame.camera()->project(Point2d(v(0) / v(2), v(1) / v(2))))) {
-            ++it; // point does not project in image
+    for (std::size_t i = 0; i < m_seedGroups.size(); ++i) {
+        SeedGroup & group = m_seedGroups[i];
+        if (group.deleted) {
+            m_countRemovedSeeds += group.size();
+            group.matches.assign(group.size(), SeedMatch::Removed);
             continue;
         }
+        const std::size_t offset = m_seedOffsets[i];
+        group.matches.assign(m_seedMatches.begin() + offset, m_seedMatches.begin() + offset + group.size());
+        for (std::size_t j = 0; j < group.size(); ++j) {
+            SeedMatch & match = group.matches[j];
+            if (match == SeedMatch::Skipped)
+                continue;
+            if (match == SeedMatch::Failed) {
+                group.b[j] += 1.0f; // increase outlier probability when no match was found
+                ++m_countFailedMatches;
+                continue;
+            }
+            int indexOfCell = m_featureDetector.indexOfCell(m_seedMatchProjections[offset + j]);
+            if (m_cellsLock[indexOfCell]) {
+                match = SeedMatch::Skipped;
+                continue;
+            }
+            m_cellsLock[indexOfCell] = true;
 
-        // we are using inverse depth coordinates
-        float sigma = std::sqrt(it->sigmaSquared);
-        float z_inv_min = it->mu + sigma;
-        float z_inv_max = std::max(it->mu - sigma, std::numeric_limits<float>::epsilon());
-        double z;
-        if (!_findEpipolarMatch(z, keyFrame, *it, frame, deltaRotation, deltaTranslation,
-                                1.0 / it->mu, 1.0 / z_inv_min, 1.0 / z_inv_max)) {
-            it->b += 1.0f; // increase outlier probability when no match was found
-            ++it;
-            //++n_failed_matches;
-            continue;
+            // compute tau
+            double z = m_seedDepths[offset + j];
+            double tau = _computeTau(group.framePosition, group.localDirs[j], z, px_error_angle);
+            double tau_inverse = 0.5 * (1.0 / std::max(0.0000001, z - tau) - 1.0 / (z + tau));
+
+            // update the estimate
+            _updateSeed(group, j, (float)(1.0 / z), (float)(tau_inverse * tau_inverse));
+            ++m_countSeedUpdates;
+
+            // if the seed has converged, we initialize a new candidate point and remove the seed
+            if (std::isnan(group.sigmaSquared[j])) {
+                match = SeedMatch::Removed;
+                ++m_countDivergedSeeds;
+            } else if (std::sqrt(group.sigmaSquared[j]) < group.z_range[j] / m_seedConvergenceSquaredSigmaThresh) {
+                TVector3d point = group.invRotation * (group.localDirs[j] * (1.0 / group.mu[j])) +
+                        group.invTranslation;
+                _addPreparedPoint(group, j, point.toTVector());
+                match = SeedMatch::Removed;
+                ++m_countConvergedSeeds;
+            }
         }
+    }
+    itGroup = m_seedGroups.begin();
+    while (itGroup != m_seedGroups.end()) {
+        itGroup->lockedKeyFrame.reset();
+        itGroup->removeSeeds();
+        if (itGroup->size() == 0)
+            itGroup = m_seedGroups.erase(itGroup);
+        else
+            ++itGroup;
+    }
+    _updateCountSeeds();
+    _commitPreparedPoints();
+}
 
-        int indexOfCell = m_featureDetector.indexOfCell(m_lastProjection);
-        if (m_cellsLock[indexOfCell]) {
-            ++it;
-            continue;
-        } else {
-            m_cellsLock[indexOfCell] = true;
+void MapPointsDetector::_searchSeeds(SearchContext & context, const Frame & frame, int countChunks)
+{
+    const std::size_t sizeOfChunk = 16;
+    for (;;) {
+        int chunk = m_nextSeedChunk++;
+        if (chunk >= countChunks)
+            break;
+        std::size_t begin = (std::size_t)chunk * sizeOfChunk;
+        std::size_t end = std::min(begin + sizeOfChunk, m_seedOffsets.back());
+        // index of group of the first seed of the chunk
+        std::size_t groupIndex = (std::size_t)(std::upper_bound(m_seedOffsets.cbegin(), m_seedOffsets.cend(), begin) -
+                                               m_seedOffsets.cbegin()) - 1;
+        for (std::size_t i = begin; i < end; ++i) {
+            while (i >= m_seedOffsets[groupIndex + 1])
+                ++groupIndex;
+            const SeedGroup & group = m_seedGroups[groupIndex];
+            m_seedMatches[i] = _searchSeed(context, group, i - m_seedOffsets[groupIndex], frame,
+                                           m_seedDepths[i], m_seedMatchProjections[i]);
         }
+    }
+}
 
-        //if (m_isNewKeyFrame)
-        //    m_featureDetector.setCellLock(m_lastProjection);
-
-        /*TVectord result(3);
-        double error = _getPointInWorld(result, it->projections);
-
-        if (error > 0.5) {
-            it = m_seeds.erase(it);
-            continue;
-        } else if (it->projections.size() >= 2) {
-            _addPreparedPoint(*it, result);
-            it = m_seeds.erase(it);
-            continue;
-        }*/
+MapPointsDetector::SeedMatch MapPointsDetector::_searchSeed(SearchContext & context,
+                                                            const SeedGroup & group, std::size_t index,
+                                                            const Frame & frame,
+                                                            double & depth, Point2f & projection) const
+{
+    using namespace TMath;
 
-        // compute tau
-        double tau = _computeTau(TTools::matrix3x3Inverted(deltaRotation) * (- deltaTranslation),
-                                 it->localDir, z, px_error_angle);
-        double tau_inverse = 0.5 * (1.0 / std::max(0.0000001, z - tau) - 1.0 / (z + tau));
+    if (!group.active)
+        return SeedMatch::Skipped;
+    const TVector3d & localDir = group.localDirs[index];
+    float mu = group.mu[index];
+    TVector3d v = group.deltaRotation * (localDir * (1.0 / mu)) + group.deltaTranslation;
+    if (v(2) < std::numeric_limits<float>::epsilon())
+        return SeedMatch::Skipped;
 
-        // update the estimate
-        _updateSeed(*it, (float)(1.0 / z), (float)(tau_inverse * tau_inverse));
-        //++n_updates;
+    if (!frame.imagePointInFrame(frame.camera()->project(Point2d(v(0) / v(2), v(1) / v(2)))))
+        return SeedMatch::Skipped; // point does not project in image
 
-        // if the seed has converged, we initialize a new candidate point and remove the seed
-        if (std::isnan(it->sigmaSquared)) {
-            it = m_seeds.erase(it);
-            continue;
-        } else if (std::sqrt(it->sigmaSquared) < it->z_range / m_seedConvergenceSquaredSigmaThresh) {
-            TVectord point = invSeedRotation * (it->localDir * (1.0 / it->mu)) + invSeedTranslation;
-            _addPreparedPoint(*it, point);
-            it = m_seeds.erase(it);
-            continue;
-        }
-        ++it;
-    }
-    _commitPreparedPoints();
-    m_map->unlock();
+    // we are using inverse depth coordinates
+    float sigma = std::sqrt(group.sigmaSquared[index]);
+    float z_inv_min = mu + sigma;
+    float z_inv_max = std::max(mu - sigma, std::numeric_limits<float>::epsilon());
+    if (!_findEpipolarMatch(context, depth, projection, group, index, frame,
+                            1.0 / mu, 1.0 / z_inv_min, 1.0 / z_inv_max))
+        return SeedMatch::Failed;
+    return SeedMatch::Found;
 }
 
-bool MapPointsDetector::_findEpipolarMatch(double & depth,
-                                           const std::shared_ptr<KeyFrame> & keyFrame,
-                                           Seed & seed, const Frame & secondFrame,
-                                           const TMath::TMatrixd & deltaRotation, const TMath::TVectord & deltaTranslation,
-                                           const double d_estimate, const double d_min, const double d_max)
+bool MapPointsDetector::_findEpipolarMatch(SearchContext & context, double & depth, Point2f & projection,
+                                           const SeedGroup & group, std::size_t index, const Frame & secondFrame,
+                                           const double d_estimate, const double d_min, const double d_max) const
 {
     using namespace TMath;
 
+    const TVector3d & localDir = group.localDirs[index];
+    const Point2f & seedProjection = group.projections[index];
+    int imageLevel = group.imageLevels[index];
+    const std::shared_ptr<KeyFrame> & keyFrame = group.lockedKeyFrame;
+
     // Compute start and end of epipolar line in old_kf for match search, on unit plane!
-    Point2d A = LocationOptimizer::project2d(deltaRotation * (seed.localDir * d_min) + deltaTranslation);
-    Point2d B = LocationOptimizer::project2d(deltaRotation * (seed.localDir * d_max) + deltaTranslation);
+    Point2d A = LocationOptimizer::project2d(group.deltaRotation * (localDir * d_min) + group.deltaTranslation);
+    Point2d B = LocationOptimizer::project2d(group.deltaRotation * (localDir * d_max) + group.deltaTranslation);
     Point2d epi_dir = A - B;
     std::shared_ptr<const Camera> secondCamera = secondFrame.camera();
 
     // Compute affine warp matrix
-    TMatrixf w(2, 2);
+    TMatrixf & w = context.warpMatrix;
+    TVectord & seedPoint = context.seedPoint;
+    seedPoint(0) = localDir(0) * d_estimate;
+    seedPoint(1) = localDir(1) * d_estimate;
+    seedPoint(2) = localDir(2) * d_estimate;
     MapProjector::getWarpMatrixAffine(w,
-                                      m_matcher.cursorSize().cast<float>(),
+                                      context.matcher.cursorSize().cast<float>(),
                                       keyFrame->camera(), secondCamera,
-                                      seed.projections[0].projection, seed.localDir * d_estimate, seed.imageLevel,
-                                      deltaRotation, deltaTranslation);
+                                      seedProjection, seedPoint, imageLevel,
+                                      group.deltaRotation_d, group.deltaTranslation_d);
 
     int search_level = MapProjector::getBestSearchLevel(w, secondFrame.countImageLevels() - 1);
 
     if (!TTools::matrix2x2Invert(w))
         return false;
 
-
     Point2f px_A = secondCamera->project(A).cast<float>();
     Point2f px_B = secondCamera->project(B).cast<float>();
     float search_scale = (float)(1 << search_level);
     float epi_length = (px_A - px_B).length() / search_scale;
 
-    Image<uchar> patch = m_matcher.patch();
+    Image<uchar> patch = context.matcher.patch();
 
-    MapProjector::warpAffine(patch, w, keyFrame->imageLevel(seed.imageLevel), seed.projections[0].projection,
-                             seed.imageLevel, search_level);
+    MapProjector::warpAffine(patch, w, keyFrame->imageLevel(imageLevel), seedProjection,
+                             imageLevel, search_level);
 
     ConstImage<uchar> searchImage = secondFrame.imageLevel(search_level);
 
-    /*if (epi_length < 2.0) {
-        m_lastProjection = (px_A + px_B) * 0.5f;
-        m_lastProjection /= search_scale;
-        m_matcher.setSecondImage(searchImage);
-        if (m_matcher.tracking2d_patch(m_lastProjection) != TrackingResult::Completed)
-            return false;
-        m_lastProjection *= search_scale;
-        Point2d cur = secondCamera->unproject(m_lastProjection);
-        TVectord curLocalDir = TVectord::create(cur.x, cur.y, 1.0).normalized();
-//        seed.projections.push_back({ secondCamera, m_lastProjection,
-//                                     secondFrame.rotation(),
-//                                     secondFrame.translation()
-//                                   });
-//        return true;
-          return TTools::depthFromTriangulation(depth,
-                                                deltaRotation, deltaTranslation,
-                                                seed.localDir, curLocalDir);
-    }*/
-
     int n_steps = (int)(epi_length / 0.7); // one step per pixel
     Point2d step = epi_dir / (double)n_steps;
     ++n_steps;
@@ -644,8 +864,11 @@ bool MapPointsDetector::_findEpipolarMatch(double & depth,
     Point2i last_checked_px_i(0, 0);
     Point2d px;
     Point2i px_i;
-    Point2i cursorSize = m_matcher.cursorSize() + Point2i(2, 2);
-    int zmssd_best = std::numeric_limits<int>::max();
+    Point2i cursorSize = context.matcher.cursorSize() + Point2i(2, 2);
+    std::vector<Point2i> & searchPoints = context.searchPoints;
+    std::vector<Point2d> & searchUVs = context.searchUVs;
+    searchPoints.resize(0);
+    searchUVs.resize(0);
     for (int i=0; i < n_steps; ++i, uv += step) {
         px = secondCamera->project(uv);
         px_i.set((int)(px.x / search_scale + 0.5), (int)(px.y / search_scale + 0.5)); // +0.5 to round to closest int
@@ -662,91 +885,80 @@ bool MapPointsDetector::_findEpipolarMatch(double & depth,
             continue;
         }
 
-        int zmssd = ZMSSD::compare(patch, Point2i(0, 0),
-                                   searchImage, px_i - cursorSize,
-                                   patch.size());
+        searchPoints.push_back(px_i - cursorSize);
+        searchUVs.push_back(uv);
+    }
 
-        if (zmssd < zmssd_best) {
-            zmssd_best = zmssd;
-            uv_best = uv;
+    std::vector<int> & zmssd = context.zmssd;
+    zmssd.resize(searchPoints.size());
+    ZMSSD::compare(zmssd.data(), patch, searchImage, searchPoints.data(), searchPoints.size());
+    int zmssd_best = std::numeric_limits<int>::max();
+    for (std::size_t i = 0; i < zmssd.size(); ++i) {
+        if (zmssd[i] < zmssd_best) {
+            zmssd_best = zmssd[i];
+            uv_best = searchUVs[i];
         }
     }
 
-    //if (zmssd_best < (patch.area() * 9000)) {
-        //if (m_subpix_refinement) {
-            m_lastProjection = secondCamera->project(uv_best).cast<float>();
-            m_lastProjection /= search_scale;
-            m_matcher.setSecondImage(searchImage);
-            if (m_matcher.tracking2d_patch(m_lastProjection) != TrackingResult::Completed)
-                return false;
-            m_lastProjection *= search_scale;
-            Point2d cur = secondCamera->unproject(m_lastProjection);
-            TVectord curLocalDir = TVectord::create(cur.x, cur.y, 1.0).normalized();
-            /*seed.projections.push_back({ secondCamera, m_lastProjection,
-                                         secondFrame.rotation(),
-                                         secondFrame.translation()
-                                       });
-            return true;*/
-            return TTools::depthFromTriangulation(depth,
-                                                  deltaRotation, deltaTranslation,
-                                                  seed.localDir, curLocalDir);
-        /*} else {
-            TVectord uvLocalDir = TVectord::create(uv_best.x, uv_best.y, 1.0).normalized();
-            return TTools::depthFromTriangulation(depth,
-                                                  deltaRotation, deltaTranslation,
-                                                  seed.localDir, uvLocalDir);
-        }*/
-    //}
-    return false;
+    projection = secondCamera->project(uv_best).cast<float>();
+    projection /= search_scale;
+    context.matcher.setSecondImage(searchImage);
+    if (context.matcher.tracking2d_patch(projection) != TrackingResult::Completed)
+        return false;
+    projection *= search_scale;
+    Point2d cur = secondCamera->unproject(projection);
+    TVector3d curLocalDir = TVector3d::create(cur.x, cur.y, 1.0).normalized();
+    return TTools::depthFromTriangulation(depth,
+                                          group.deltaRotation, group.deltaTranslation,
+                                          localDir, curLocalDir);
 }
 
-double MapPointsDetector::_computeTau(const TMath::TVectord & t, const TMath::TVectord & localDir,
-                                       double z, double px_error_angle)
+double MapPointsDetector::_computeTau(const TMath::TVector3d & t, const TMath::TVector3d & localDir,
+                                       double z, double px_error_angle) const
 {
     using namespace TMath;
-    TVectord a = localDir * z - t;
-    double t_length = std::sqrt(t(0) * t(0) +
-                                t(1) * t(1) +
-                                t(2) * t(2));
-    double a_length = std::sqrt(a(0) * a(0) + a(1) * a(1) + a(2) * a(2));
-    double alpha = std::acos((localDir(0) * t(0) +
-                              localDir(1) * t(1) +
-                              localDir(2) * t(2)) / t_length); // dot product
-    double beta = std::acos(- (a(0) * t(0) +
-                               a(1) * t(1) +
-                               a(2) * t(2)) / (t_length * a_length)); // dot product
+    TVector3d a = localDir * z - t;
+    double t_length = t.length();
+    double a_length = a.length();
+    double alpha = std::acos(dot(localDir, t) / t_length); // dot product
+    double beta = std::acos(- dot(a, t) / (t_length * a_length)); // dot product
     double beta_plus = beta + px_error_angle;
     double gamma_plus = M_PI - alpha - beta_plus; // triangle angles sum to PI
     double z_plus = t_length * std::sin(beta_plus) / std::sin(gamma_plus); // law of sines
     return (z_plus - z); // tau
 }
 
-void MapPointsDetector::_updateSeed(Seed & seed, float x, float tauSquared)
+void MapPointsDetector::_updateSeed(SeedGroup & group, std::size_t index, float x, float tauSquared)
 {
-    float norm_scale = sqrt(seed.sigmaSquared + tauSquared);
+    float & a = group.a[index];
+    float & b = group.b[index];
+    float & mu = group.mu[index];
+    float & sigmaSquared = group.sigmaSquared[index];
+
+    float norm_scale = sqrt(sigmaSquared + tauSquared);
     if (std::isnan(norm_scale))
         return;
 
-    float sSquared = 1.0f / (1.0f / seed.sigmaSquared + 1.0f / tauSquared);
-    float m = sSquared * (seed.mu / seed.sigmaSquared + x / tauSquared);
-    float C1 = seed.a / (seed.a + seed.b) * _pdf(x, seed.mu, norm_scale);
-    float C2 = seed.b / (seed.a + seed.b) * (1.0f / seed.z_range);
+    float sSquared = 1.0f / (1.0f / sigmaSquared + 1.0f / tauSquared);
+    float m = sSquared * (mu / sigmaSquared + x / tauSquared);
+    float C1 = a / (a + b) * _pdf(x, mu, norm_scale);
+    float C2 = b / (a + b) * (1.0f / group.z_range[index]);
     float normalization_constant = C1 + C2;
     C1 /= normalization_constant;
     C2 /= normalization_constant;
-    float f = C1 * (seed.a + 1.0f) / (seed.a + seed.b + 1.0f) + C2 * seed.a / (seed.a + seed.b + 1.0f);
-    float e = C1 * (seed.a + 1.0f) * (seed.a + 2.0f) / ((seed.a + seed.b + 1.0f) * (seed.a + seed.b + 2.0f))
-            + C2 * seed.a * (seed.a + 1.0f) / ((seed.a + seed.b + 1.0f) * (seed.a + seed.b + 2.0f));
+    float f = C1 * (a + 1.0f) / (a + b + 1.0f) + C2 * a / (a + b + 1.0f);
+    float e = C1 * (a + 1.0f) * (a + 2.0f) / ((a + b + 1.0f) * (a + b + 2.0f))
+            + C2 * a * (a + 1.0f) / ((a + b + 1.0f) * (a + b + 2.0f));
 
     // update parameters
-    float mu_new = C1 * m + C2 * seed.mu;
-    seed.sigmaSquared = C1 * (sSquared + m * m) + C2 * (seed.sigmaSquared + seed.mu * seed.mu) - mu_new * mu_new;
-    seed.mu = mu_new;
-    seed.a = (e - f) / (f - e / f);
-    seed.b = seed.a * (1.0f - f) / f;
+    float mu_new = C1 * m + C2 * mu;
+    sigmaSquared = C1 * (sSquared + m * m) + C2 * (sigmaSquared + mu * mu) - mu_new * mu_new;
+    mu = mu_new;
+    a = (e - f) / (f - e / f);
+    b = a * (1.0f - f) / f;
 }
 
-float MapPointsDetector::_pdf(float x, float mean, float scale)
+float MapPointsDetector::_pdf(float x, float mean, float scale) const
 {
     float exponent = x - mean;
     exponent *= - exponent;
@@ -755,17 +967,13 @@ float MapPointsDetector::_pdf(float x, float mean, float scale)
     return std::exp(exponent) / (scale * std::sqrt(2.0f * (float)(M_PI)));
 }
 
-void MapPointsDetector::_addPreparedPoint(Seed & seed, const TMath::TVectord & worldPoint)
+void MapPointsDetector::_addPreparedPoint(const SeedGroup & group, std::size_t index,
+                                          const TMath::TVectord & worldPoint)
 {
-
-    std::shared_ptr<KeyFrame> keyFrame = seed.keyFrame.lock();
-    if (!keyFrame)
-        return;
-
     new CandidateMapPoint(m_preparedCandidates,
-                          keyFrame,
-                          seed.projections[0].projection,
-                          seed.imageLevel,
+                          group.lockedKeyFrame,
+                          group.projections[index],
+                          group.imageLevels[index],
                           worldPoint);
     if (m_preparedCandidates->size() >= m_sizeOfCommitMapPoints) {
         _commitPreparedPoints();
@@ -793,48 +1001,4 @@ void MapPointsDetector::_commitPreparedPoints()
     }
 }
 
-double MapPointsDetector::_getPointInWorld(TMath::TVectord & result, const std::vector<ProjectionPoint> & projections) const
-{
-    using namespace TMath;
-
-    TMath_assert(projections.size() >= 2);
-    TMath_assert(result.size() == 3);
-    std::size_t i;
-    TMatrixd M((int)(projections.size() * 2), 4);
-    double * dataRow = M.firstDataRow();
-    for (i = 0; i < projections.size(); ++i) {
-        const ProjectionPoint& p = projections[i];
-        Point2d uv = p.camera->unproject(p.projection);
-        dataRow[0] = p.rotation(0, 0) - uv.x * p.rotation(2, 0);
-        dataRow[1] = p.rotation(0, 1) - uv.x * p.rotation(2, 1);
-        dataRow[2] = p.rotation(0, 2) - uv.x * p.rotation(2, 2);
-        dataRow[3] = p.translation(0) - uv.x * p.translation(2);
-        dataRow = &dataRow[4];
-
-        dataRow[0] = p.rotation(1, 0) - uv.y * p.rotation(2, 0);
-        dataRow[1] = p.rotation(1, 1) - uv.y * p.rotation(2, 1);
-        dataRow[2] = p.rotation(1, 2) - uv.y * p.rotation(2, 2);
-        dataRow[3] = p.translation(1) - uv.y * p.translation(2);
-        dataRow = &dataRow[4];
-    }
-    m_svd.compute(M, false);
-    const double * resultData = m_svd.V_transposed().getDataRow(3);
-    if (std::fabs(resultData[3]) < 1e-4)
-        return std::numeric_limits<double>::max();
-    result(0) = resultData[0] / resultData[3];
-    result(1) = resultData[1] / resultData[3];
-    result(2) = resultData[2] / resultData[3];
-    return std::fabs(m_svd.diagonalW()(3));
-    /*float maxErrorSquared = 0.0f, errorSquared;
-    for (i = 0; i < projections.size(); ++i) {
-        const ProjectionPoint & p = projections[i];
-        TVectorf v = p.rotation * result + p.translation;
-        errorSquared = (p.camera->project(Point2d((double)(v(0) / v(2)), (double)(v(1) / v(2)))).cast<float>() -
-                        p.projection).lengthSquared();
-        if (errorSquared > maxErrorSquared)
-            maxErrorSquared = errorSquared;
-    }
-    return maxErrorSquared;*/
-}
-
 }
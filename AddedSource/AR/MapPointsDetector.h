@@ -6,9 +6,10 @@
 #include <condition_variable>
 #include <memory>
 #include <vector>
-#include <list>
+#include <atomic>
 #include "TMath/TVector.h"
-#include "TMath/TSVD.h"
+#include "TMath/TVectorN.h"
+#include "TMath/TMatrixN.h"
 #include "Point2.h"
 #include "FeatureDetector.h"
 #include "Camera.h"
@@ -19,6 +20,10 @@
 #include "MapResourcesManager.h"
 #include "OpticalFlowCalculator.h"
 #include "Configurations.h"
+#include "SpscRingBuffer.h"
+#include "PerformanceMonitor.h"
+#include "WarpedPatchCache.h"
+#include "ThreadPool.h"
 
 namespace AR {
 
@@ -29,6 +34,17 @@ class CandidateMapPointsList;
 class MapPointsDetector
 {
 public:
+    // Counts of events are summed from creation of detector.
+    struct SeedStatistics
+    {
+        std::size_t countSeeds;         // seeds at the moment
+        std::size_t countSeedGroups;    // key frames with seeds at the moment
+        std::size_t countUpdates;       // seeds updated by matches on frames
+        std::size_t countFailedMatches; // epipolar searches without match
+        std::size_t countConverged;     // seeds became candidate points
+        std::size_t countDiverged;      // seeds removed because of invalid variance
+        std::size_t countRemoved;       // seeds of deleted key frames and the oldest seeds over the limit
+    };
 
     MapPointsDetector(Map * map);
     ~MapPointsDetector();
@@ -54,35 +70,80 @@ public:
     int countImageLevels() const;
     void setCountImageLevels(int count);
 
+    bool dropOldestFrames() const;
+    void setDropOldestFrames(bool enabled);
+
+    // Count of threads of epipolar search of seeds (0 - all hardware threads).
+    int countThreads() const;
+    void setCountThreads(int countThreads);
+
     bool threadIsRunning() const;
     void startThread();
     void stopThread();
 
+    // Stages of the thread of detector are measured by performanceMonitor, it can be nullptr.
+    void setPerformanceMonitor(PerformanceMonitor * performanceMonitor);
+
+    // Frames are passed through a lock-free queue, so these methods don't wait for the thread of detector.
     void addKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame);
     void addFrame(Frame && frame);
 
+    std::size_t countDroppedFrames() const;
+    std::size_t countProcessedFrames() const;
+
+    SeedStatistics seedStatistics() const;
+
     void loop();
 
 private:
     friend class CandidatesReader;
 
-    struct ProjectionPoint {
-        std::shared_ptr<const Camera> camera;
-        Point2f projection;
-        TMath::TMatrixd rotation;
-        TMath::TVectord translation;
+    enum class SeedMatch: uchar {
+        Skipped,
+        Failed,
+        Found,
+        Removed
     };
 
-    struct Seed {
+    // Seeds of one key frame, parameters of seeds are stored by arrays.
+    // The pose of the key frame relative to the frame is computed once for all seeds of the group.
+    struct SeedGroup {
         std::weak_ptr<KeyFrame> keyFrame;
-        TMath::TVectord localDir;
-        int imageLevel;
-        float a;                   //!< a of Beta distribution: When high, probability of inlier is large.
-        float b;                   //!< b of Beta distribution: When high, probability of outlier is large.
-        float mu;                  //!< Mean of normal distribution.
-        float z_range;             //!< Max range of the possible depth.
-        float sigmaSquared;        //!< Variance of normal distribution.
-        std::vector<ProjectionPoint> projections;
+        std::vector<TMath::TVector3d> localDirs;
+        std::vector<Point2f> projections; //!< Positions of seeds on the key frame.
+        std::vector<int> imageLevels;
+        std::vector<float> a;             //!< a of Beta distribution: When high, probability of inlier is large.
+        std::vector<float> b;             //!< b of Beta distribution: When high, probability of outlier is large.
+        std::vector<float> mu;            //!< Mean of normal distribution.
+        std::vector<float> z_range;       //!< Max range of the possible depth.
+        std::vector<float> sigmaSquared;  //!< Variance of normal distribution.
+
+        // Data of the processed frame, the key frame is kept and is locked while seeds are searched.
+        std::shared_ptr<KeyFrame> lockedKeyFrame;
+        bool deleted; //!< The key frame is deleted, it's read while the key frame is locked.
+        bool active;
+        TMath::TMatrix3d deltaRotation;
+        TMath::TVector3d deltaTranslation;
+        TMath::TMatrix3d invRotation;
+        TMath::TVector3d invTranslation;
+        TMath::TVector3d framePosition; //!< Position of the frame in the coordinate system of the key frame.
+        TMath::TMatrixd deltaRotation_d;
+        TMath::TVectord deltaTranslation_d;
+        std::vector<SeedMatch> matches; //!< Results of seeds on the frame, removed seeds are erased after updates.
+
+        std::size_t size() const { return mu.size(); }
+        void eraseFirst(std::size_t count);
+        void removeSeeds();
+    };
+
+    // Data of one thread of epipolar search.
+    struct SearchContext {
+        OpticalFlowCalculator matcher;
+        TMath::TMatrixf warpMatrix;
+        TMath::TVectord seedPoint;
+        std::vector<Point2i> searchPoints;
+        std::vector<Point2d> searchUVs;
+        std::vector<int> zmssd;
     };
 
     Map * m_map;
@@ -93,17 +154,36 @@ private:
     std::thread * m_thread;
     mutable std::mutex m_framesQueueMutex;
     std::condition_variable m_frameQueue_condition;
-    std::vector<std::shared_ptr<Frame>> m_framesQueue;
+    bool m_stopLoop; // guarded by m_framesQueueMutex like m_isNewKeyFrame
+    SpscRingBuffer<Frame> m_framesQueue;
+    std::atomic<std::size_t> m_countProcessedFrames;
+    PerformanceMonitor * m_performanceMonitor;
+    int m_stage_updateSeeds;
+    int m_stage_initializeSeed;
     std::weak_ptr<KeyFrame> m_keyFrame;
     bool m_isNewKeyFrame;
     bool * m_cellsLock;
-    Point2f m_lastProjection;
-    std::list<Seed> m_seeds;
-    std::mutex m_seedMutex;
-    bool m_needToStopSeedUpdating;
+    std::vector<SeedGroup> m_seedGroups;
+
+    // Results of epipolar search on the frame by seeds of all groups.
+    std::vector<std::size_t> m_seedOffsets;
+    std::vector<SeedMatch> m_seedMatches;
+    std::vector<double> m_seedDepths;
+    std::vector<Point2f> m_seedMatchProjections;
+    std::atomic<int> m_nextSeedChunk;
+
+    std::vector<std::unique_ptr<SearchContext>> m_contexts;
+    ThreadPool m_threadPool;
+
+    std::atomic<std::size_t> m_countSeedUpdates;
+    std::atomic<std::size_t> m_countFailedMatches;
+    std::atomic<std::size_t> m_countConvergedSeeds;
+    std::atomic<std::size_t> m_countDivergedSeeds;
+    std::atomic<std::size_t> m_countRemovedSeeds;
+    std::atomic<std::size_t> m_countSeeds;
+    std::atomic<std::size_t> m_countSeedGroups;
 
     FeatureDetector m_featureDetector;
-    OpticalFlowCalculator m_matcher;
 
     CandidateMapPointsList * m_preparedCandidates;
     CandidateMapPointsList * m_finalCandidates;
@@ -116,21 +196,22 @@ private:
     int m_maxCountCandidatePoints;
     float m_pixelNoise;
 
-    mutable TMath::TSVD<double> m_svd;
-
+    void _setCountThreads(int countThreads);
     void _initializeSeed(const std::shared_ptr<KeyFrame> & keyFrame);
+    void _removeOldestSeeds(std::size_t maxCountSeeds);
+    void _updateCountSeeds();
     void _updateSeeds(const Frame & frame);
-    bool _findEpipolarMatch(double & depth,
-                            const std::shared_ptr<KeyFrame> & keyFrame,
-                            Seed & seed, const Frame & secondFrame,
-                            const TMath::TMatrixd & deltaRotation, const TMath::TVectord & deltaTranslation,
-                            const double d_estimate, const double d_min, const double d_max);
-    double _computeTau(const TMath::TVectord & t, const TMath::TVectord & localDir, double z, double px_error_angle);
-    void _updateSeed(Seed & seed, float x, float tauSquared);
-    float _pdf(float x, float mean, float scale);
-    void _addPreparedPoint(Seed & seed, const TMath::TVectord & worldPoint);
+    void _searchSeeds(SearchContext & context, const Frame & frame, int countChunks);
+    SeedMatch _searchSeed(SearchContext & context, const SeedGroup & group, std::size_t index, const Frame & frame,
+                          double & depth, Point2f & projection) const;
+    bool _findEpipolarMatch(SearchContext & context, double & depth, Point2f & projection,
+                            const SeedGroup & group, std::size_t index, const Frame & secondFrame,
+                            const double d_estimate, const double d_min, const double d_max) const;
+    double _computeTau(const TMath::TVector3d & t, const TMath::TVector3d & localDir, double z, double px_error_angle) const;
+    void _updateSeed(SeedGroup & group, std::size_t index, float x, float tauSquared);
+    float _pdf(float x, float mean, float scale) const;
+    void _addPreparedPoint(const SeedGroup & group, std::size_t index, const TMath::TVectord & worldPoint);
     void _commitPreparedPoints();
-    double _getPointInWorld(TMath::TVectord & result, const std::vector<ProjectionPoint> & projections) const;
 };
 
 class CandidateMapPointsList
@@ -170,6 +251,8 @@ public:
     int imageLevel;
     TMath::TVectord position;
     MapPoint::Statistic statistic;
+    // Patch of the key frame which was warped to the last frames by MapProjector.
+    WarpedPatchCache::Entry warpedPatch;
 
 private:
     friend class CandidateMapPointsList;
@@ -9,6 +9,7 @@
 #include <climits>
 #include <limits>
 #include <iostream>
+#include <chrono>
 
 namespace AR {
 
@@ -21,9 +22,13 @@ MapProjector::MapProjector()
     m_builderTypeMapPoint = nullptr;
     m_builderTypeCandidatePoint = nullptr;
     m_mapPointsDetector = nullptr;
+    m_performanceMonitor = nullptr;
+    m_counter_cachedPatches = m_counter_warpedPatches = m_counter_savedWarpTime = -1;
+    setCountThreads(1);
     m_maxNumberOfUsedKeyFrames = 10;
     m_frameBorder = 5;
     m_maxNumberOfFeaturesOnFrame = 60;
+    m_projectionEpoch = 0;
     setGridSize(Point2i(20, 20));
     setCursorSize(Point2i(4, 4));
     setPixelEps(1e-3f);
@@ -37,6 +42,7 @@ Map * MapProjector::map() const
 void MapProjector::setMap(Map * map)
 {
     m_map = map;
+    m_warpedPatchCache.setMap(map);
 }
 
 MapResourcesManager * MapProjector::mapResourceManager() const
@@ -58,9 +64,9 @@ void MapProjector::setGridSize(const Point2i & gridSize)
 {
     m_gridSize = gridSize;
     int size = gridSize.x * gridSize.y;
-    m_cells.resize(size);
-    m_cells_candidates.resize(size);
-    m_cells_lock.resize(size);
+    m_cellsOffsets.assign(size + 1, 0);
+    m_cellsOffsets_candidates.assign(size + 1, 0);
+    m_cells_lock.assign(size, 0);
     m_cellOrders.resize(size);
     for (int i = 0; i < size; ++i)
         m_cellOrders[i] = i;
@@ -69,32 +75,35 @@ void MapProjector::setGridSize(const Point2i & gridSize)
 
 Point2i MapProjector::cursorSize() const
 {
-    return m_matcher.cursorSize();
+    return m_contexts[0]->matcher.cursorSize();
 }
 
 void MapProjector::setCursorSize(const Point2i & cursorSize)
 {
-    m_matcher.setCursorSize(cursorSize);
+    for (auto it = m_contexts.begin(); it != m_contexts.end(); ++it)
+        (*it)->matcher.setCursorSize(cursorSize);
 }
 
 float MapProjector::pixelEps() const
 {
-    return m_matcher.pixelEps();
+    return m_contexts[0]->matcher.pixelEps();
 }
 
 void MapProjector::setPixelEps(float eps)
 {
-    m_matcher.setPixelEps(eps);
+    for (auto it = m_contexts.begin(); it != m_contexts.end(); ++it)
+        (*it)->matcher.setPixelEps(eps);
 }
 
 int MapProjector::maxNumberIterations() const
 {
-    return m_matcher.numberIterations();
+    return m_contexts[0]->matcher.numberIterations();
 }
 
 void MapProjector::setMaxNumberIterations(int value)
 {
-    m_matcher.setNumberIterations(value);
+    for (auto it = m_contexts.begin(); it != m_contexts.end(); ++it)
+        (*it)->matcher.setNumberIterations(value);
 }
 
 int MapProjector::frameBorder() const
@@ -117,6 +126,36 @@ void MapProjector::setMaxNumberOfFeaturesOnFrame(const std::size_t & maxNumberOf
     m_maxNumberOfFeaturesOnFrame = maxNumberOfFeaturesOnFrame;
 }
 
+int MapProjector::countThreads() const
+{
+    return m_threadPool.countThreads();
+}
+
+void MapProjector::setCountThreads(int countThreads)
+{
+    m_threadPool.setCountThreads(countThreads);
+    std::size_t countContexts = (std::size_t)m_threadPool.countThreads();
+    if (m_contexts.size() == countContexts)
+        return;
+    std::size_t oldCountContexts = m_contexts.size();
+    m_contexts.resize(countContexts);
+    for (std::size_t i = oldCountContexts; i < countContexts; ++i) {
+        m_contexts[i].reset(new MatchingContext());
+        MatchingContext & context = *m_contexts[i];
+        context.resourceManager = nullptr;
+        context.lastSearchImageLevel = 0;
+        context.averageWarpDuration = 0.0;
+        if (i > 0) {
+            // parameters of matching are the same in all contexts
+            const OpticalFlowCalculator & firstMatcher = m_contexts[0]->matcher;
+            context.matcher.setCursorSize(firstMatcher.cursorSize());
+            context.matcher.setPixelEps(firstMatcher.pixelEps());
+            context.matcher.setNumberIterations(firstMatcher.numberIterations());
+        }
+    }
+    m_matchedCells.resize(countContexts);
+}
+
 std::size_t MapProjector::maxNumberOfUsedKeyFrames() const
 {
     return m_maxNumberOfUsedKeyFrames;
@@ -167,6 +206,26 @@ void MapProjector::setMapPointsDetector(MapPointsDetector* mapPointsDetector)
     m_mapPointsDetector = mapPointsDetector;
 }
 
+float MapProjector::warpedPatchMaxDrift() const
+{
+    return m_warpedPatchCache.maxDrift();
+}
+
+void MapProjector::setWarpedPatchMaxDrift(float maxDrift)
+{
+    m_warpedPatchCache.setMaxDrift(maxDrift);
+}
+
+void MapProjector::setPerformanceMonitor(PerformanceMonitor * performanceMonitor)
+{
+    m_performanceMonitor = performanceMonitor;
+    if (m_performanceMonitor != nullptr) {
+        m_counter_cachedPatches = m_performanceMonitor->registerCounter("Warped patches from cache");
+        m_counter_warpedPatches = m_performanceMonitor->registerCounter("Warped patches");
+        m_counter_savedWarpTime = m_performanceMonitor->registerCounter("Saved time of warping, ns");
+    }
+}
+
 void MapProjector::projectMapPoints(PreviewFrame & previewFrame,
                                     const PreviewFrame & prevPreviewFrame)
 {
@@ -174,10 +233,18 @@ void MapProjector::projectMapPoints(PreviewFrame & previewFrame,
     TMath_assert(m_builderTypeMapPoint != nullptr);
     TMath_assert(m_map != nullptr);
     Point2i targetImageSize = previewFrame.imageSize();
-    m_targetFrameBegin = m_matcher.cursorSize().cast<float>() + Point2f(m_frameBorder, m_frameBorder);
+    Point2i cursorSize = m_contexts[0]->matcher.cursorSize();
+    m_targetFrameBegin = cursorSize.cast<float>() + Point2f(m_frameBorder, m_frameBorder);
     m_targetFrameEnd = targetImageSize.cast<float>() - (m_targetFrameBegin + Point2f(1.0f, 1.0f));
     m_cellSize.set(targetImageSize.x / (float)m_gridSize.x, targetImageSize.y / (float)m_gridSize.y);
-    m_border = (m_matcher.cursorSize() + Point2i(1, 1)).cast<float>();
+    m_border = (cursorSize + Point2i(1, 1)).cast<float>();
+    // contexts are bound to threads of the pool and the calling thread has the first context,
+    // so it works with locks of the caller and doesn't need own manager
+    m_contexts[0]->resourceManager = m_resourceManager;
+    for (std::size_t i = 1; i < m_contexts.size(); ++i)
+        m_contexts[i]->resourceManager = (m_resourceManager != nullptr) ? &m_contexts[i]->ownResourceManager : nullptr;
+    m_targetFrame_rotation = previewFrame.rotation();
+    m_targetFrame_translation = previewFrame.translation();
     m_targetFrame_invRotation = TMath::TTools::matrix3x3Inverted(previewFrame.rotation());
     m_targetFrame_invTranslation = - m_targetFrame_invRotation * previewFrame.translation();
 
@@ -185,7 +252,6 @@ void MapProjector::projectMapPoints(PreviewFrame & previewFrame,
     std::size_t currentCountTrackingPoints = 0;
     m_successCurrentCandidatePoints.clear();
 
-    m_projectedMapPoints.clear();
     (void)prevPreviewFrame;
     /*std::shared_ptr<const Camera> prevCamera = prevPreviewFrame.camera();
     const std::vector<PreviewFrame::PreviewFeature>& oldFeatures = prevPreviewFrame.previewFeatures();
@@ -215,21 +281,60 @@ void MapProjector::projectMapPoints(PreviewFrame & previewFrame,
     std::srand((unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
                  std::chrono::system_clock::now().time_since_epoch()).count());
     std::random_shuffle(m_cellOrders.begin(), m_cellOrders.end());
-    std::size_t i;
-    for (i = 0; (i < m_cellOrders.size()) &&
-         (currentCountTrackingPoints < m_maxNumberOfFeaturesOnFrame);
-         ++i) {
-        if (_processMapPointOnCell(previewFrame, m_cellOrders[i])) {
-            ++currentCountTrackingPoints;
-        }
+
+    // Cells are taken by threads in order of m_cellOrders. Threads stop to take cells when enough cells are matched,
+    // so matches of all cells before the last taken cell are known and the first matches in order of cells
+    // are the same as in serial processing of cells. Threads may process cells after the last accepted cell,
+    // so failures of map points are collected by threads and are applied only for accepted cells and cells before them.
+    m_nextCellOrder = 0;
+    m_countMatchedCells = 0;
+    m_threadPool.runOnThreads([this, &previewFrame] (int thread) {
+        _matchMapPointsOnCells(previewFrame, thread);
+    });
+    m_sortedMatchedCells.resize(0);
+    for (std::size_t i = 0; i < m_contexts.size(); ++i) {
+        std::vector<MatchedCell> & matchedCells = m_matchedCells[i];
+        for (auto it = matchedCells.begin(); it != matchedCells.end(); ++it)
+            m_sortedMatchedCells.push_back(std::move(*it));
+        matchedCells.resize(0);
+        std::vector<MapPointFailure> & failures = m_contexts[i]->failures;
+        for (auto it = failures.begin(); it != failures.end(); ++it)
+            m_sortedFailures.push_back(std::move(*it));
+        failures.resize(0);
     }
+    std::sort(m_sortedMatchedCells.begin(), m_sortedMatchedCells.end(),
+              [] (const MatchedCell & a, const MatchedCell & b) { return (a.order < b.order); });
+    // cells after the last accepted cell aren't processed in serial processing, so their failures are discarded
+    int lastCellOrder = (int)m_cellOrders.size() - 1;
+    for (auto it = m_sortedMatchedCells.begin();
+         (it != m_sortedMatchedCells.end()) && (currentCountTrackingPoints < m_maxNumberOfFeaturesOnFrame);
+         ++it) {
+        previewFrame.addPreviewFeature({ it->mapPoint, it->projection, it->imageLevel });
+        m_cells_lock[it->cell] = true;
+        ++currentCountTrackingPoints;
+        if (currentCountTrackingPoints == m_maxNumberOfFeaturesOnFrame)
+            lastCellOrder = it->order;
+    }
+    m_sortedMatchedCells.resize(0);
+    // failures of one cell are found by one thread, so the stable sort keeps their serial order
+    std::stable_sort(m_sortedFailures.begin(), m_sortedFailures.end(),
+                     [] (const MapPointFailure & a, const MapPointFailure & b) { return (a.order < b.order); });
+    for (auto it = m_sortedFailures.begin(); (it != m_sortedFailures.end()) && (it->order <= lastCellOrder); ++it) {
+        MapResourceLocker lockerMapPoint(m_resourceManager, it->mapPoint.get()); (void)lockerMapPoint;
+        it->mapPoint->statistic().incFailed(it->countFailed);
+        if (it->alwaysFailed || (m_builderTypeMapPoint->getType(it->mapPoint->statistic()) == TypeMapPoint::Failed))
+            m_failedMapPoints.push_back(it->mapPoint);
+    }
+    m_sortedFailures.resize(0);
+
     if (currentCountTrackingPoints < m_maxNumberOfFeaturesOnFrame) {
+        MatchingContext & context = *m_contexts[0];
         CandidatesReader candidatesReader(m_mapPointsDetector);
         _projectCandidatesPointsOnGrid(previewFrame, candidatesReader.candidateMapPointsList());
-        for (i = 0;
+        for (std::size_t i = 0;
              (i < m_cellOrders.size()) && (currentCountTrackingPoints < m_maxNumberOfFeaturesOnFrame);
              ++i) {
-            if (_processCandidatePointOnCell(previewFrame, m_cellOrders[i])) {
+            if (_processCandidatePointOnCell(context, previewFrame, m_cellOrders[i])) {
                 ++currentCountTrackingPoints;
             }
         }
@@ -266,8 +371,7 @@ bool MapProjector::existCloseKeyFrame(PreviewFrame & previewFrame, double limitD
     TVectord translation = previewFrame.translation();
 
     for (auto it = m_visibleKeyFrames.begin(); it != m_visibleKeyFrames.end(); ++it) {
-        std::shared_ptr<const KeyFrame> keyFrame = it->keyFrame;
-        TVectord localPos = rotation * keyFrame->worldPosition() + translation;
+        TVectord localPos = rotation * m_map->keyFrameWorldPosition(it->keyFrame->index()) + translation;
         if (((std::fabs(localPos(0)) / depthMean) < limitDistance) &&
             ((std::fabs(localPos(1)) / depthMean) < limitDistance) &&
             ((std::fabs(localPos(2)) / depthMean) < limitDistance)) {
@@ -299,71 +403,118 @@ void MapProjector::deleteFaildedMapPoints()
 
 void MapProjector::_resetGrid()
 {
-    for (auto it = m_cells.begin(); it != m_cells.end(); ++it)
-        it->clear();
-    for (auto it = m_cells_candidates.begin(); it != m_cells_candidates.end(); ++it)
-        it->clear();
-    for (auto it = m_cells_lock.begin(); it != m_cells_lock.end(); ++it)
-        *it = false;
+    // buffers keep their capacity, so there are no allocations on every frame
+    m_projectedMapPoints.resize(0);
+    m_cells.resize(0);
+    std::fill(m_cellsOffsets.begin(), m_cellsOffsets.end(), 0);
+    m_projectedCandidates.resize(0);
+    m_cells_candidates.resize(0);
+    std::fill(m_cellsOffsets_candidates.begin(), m_cellsOffsets_candidates.end(), 0);
+    std::fill(m_cells_lock.begin(), m_cells_lock.end(), 0);
+    ++m_projectionEpoch;
 }
 
 void MapProjector::_findVisibleKeyFrames(const Frame & targetFrame)
 {
     TMath_assert(m_map != nullptr);
     m_visibleKeyFrames.resize(0);
-    TMath::TVectord targetTranslation = targetFrame.worldPosition();
+    if (m_maxNumberOfUsedKeyFrames == 0)
+        return;
+    TMath::TVectord targetPosition = targetFrame.worldPosition();
     std::size_t countKeyFrames = m_map->countKeyFrames();
-    for (std::size_t i = 0; i < countKeyFrames; ++i) {
-        std::shared_ptr<KeyFrame> keyFrame = m_map->keyFrame(i);
-        MapResourceLocker lockerKeyFrame(m_resourceManager, keyFrame.get()); (void)lockerKeyFrame;
-        std::size_t countFeatures = keyFrame->countFeatures();
-        for (std::size_t j = 0; j < countFeatures; ++j) {
-            std::shared_ptr<MapPoint> mapPoint = keyFrame->feature(j)->mapPoint();
-            m_resourceManager->lock(mapPoint.get());
-            TMath::TVectord v = targetFrame.rotation() * mapPoint->position() + targetFrame.translation();
-            m_resourceManager->unlock(mapPoint.get());
-            if (v(2) < std::numeric_limits<float>::epsilon())
-                continue;
-            Point2f p = targetFrame.camera()->project(Point2d(v(0) / v(2), v(1) / v(2))).cast<float>();
-            if ((p.x > m_targetFrameBegin.x) && (p.y > m_targetFrameBegin.y) &&
-                    (p.x < m_targetFrameEnd.x) && (p.y < m_targetFrameEnd.y)) {
-                m_visibleKeyFrames.push_back({ keyFrame,
-                                               (targetTranslation - targetFrame.translation()).lengthSquared(),
-                                               0 });
-                break;
+    // Key frames are checked from the nearest, so usually only a few of them are checked.
+    // If there aren't enough visible key frames, count of candidates is doubled.
+    std::size_t countCandidates = std::min(countKeyFrames, m_maxNumberOfUsedKeyFrames * 2);
+    std::size_t countChecked = 0;
+    while ((m_visibleKeyFrames.size() < m_maxNumberOfUsedKeyFrames) && (countChecked < countKeyFrames)) {
+        std::vector<std::shared_ptr<KeyFrame>> candidates = m_map->getNearestKeyFrames(targetPosition,
+                                                                                       countCandidates);
+        for (std::size_t i = countChecked;
+             (i < candidates.size()) && (m_visibleKeyFrames.size() < m_maxNumberOfUsedKeyFrames);
+             ++i) {
+            const std::shared_ptr<KeyFrame> & keyFrame = candidates[i];
+            MapResourceLocker lockerKeyFrame(m_resourceManager, keyFrame.get(), MapResourceAccess::Shared); (void)lockerKeyFrame;
+            std::size_t countFeatures = keyFrame->countFeatures();
+            for (std::size_t j = 0; j < countFeatures; ++j) {
+                std::shared_ptr<MapPoint> mapPoint = keyFrame->feature(j)->mapPoint();
+                m_resourceManager->lock(mapPoint.get(), MapResourceAccess::Shared);
+                TMath::TVectord v = targetFrame.rotation() * mapPoint->position() + targetFrame.translation();
+                m_resourceManager->unlock(mapPoint.get(), MapResourceAccess::Shared);
+                if (v(2) < std::numeric_limits<float>::epsilon())
+                    continue;
+                Point2f p = targetFrame.camera()->project(Point2d(v(0) / v(2), v(1) / v(2))).cast<float>();
+                if ((p.x > m_targetFrameBegin.x) && (p.y > m_targetFrameBegin.y) &&
+                        (p.x < m_targetFrameEnd.x) && (p.y < m_targetFrameEnd.y)) {
+                    m_visibleKeyFrames.push_back({ keyFrame,
+                                                   (m_map->keyFrameWorldPosition(keyFrame->index()) -
+                                                    targetPosition).lengthSquared(),
+                                                   0 });
+                    break;
+                }
             }
         }
+        countChecked = candidates.size();
+        countCandidates = std::min(countKeyFrames, countCandidates * 2);
+    }
+}
+
+// Counting sort of projected points by cells, order of points inside of cell is kept.
+template <typename ProjectedPoint>
+static void placeOnCells(std::vector<ProjectedPoint> & cells, std::vector<int> & offsets,
+                         std::vector<ProjectedPoint> & projectedPoints)
+{
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (auto it = projectedPoints.cbegin(); it != projectedPoints.cend(); ++it)
+        ++offsets[it->cell + 1];
+    for (std::size_t k = 1; k < offsets.size(); ++k)
+        offsets[k] += offsets[k - 1];
+    cells.resize(projectedPoints.size());
+    // offsets[k] is moved to the end of cell k while points are placed, so offsets are shifted back after it
+    for (auto it = projectedPoints.begin(); it != projectedPoints.end(); ++it)
+        cells[offsets[it->cell]++] = std::move(*it);
+    for (std::size_t k = offsets.size() - 1; k > 0; --k)
+        offsets[k] = offsets[k - 1];
+    offsets[0] = 0;
+    projectedPoints.resize(0);
+}
+
+// Stable insertion sort, cells have only a few points.
+template <typename ProjectedPoint, typename Score>
+static void sortCell(ProjectedPoint * begin, ProjectedPoint * end, Score score)
+{
+    for (ProjectedPoint * it = begin + 1; it < end; ++it) {
+        int itScore = score(*it);
+        ProjectedPoint * place = it;
+        while ((place > begin) && (score(*(place - 1)) < itScore))
+            --place;
+        if (place != it)
+            std::rotate(place, it, it + 1);
     }
-    std::size_t size = std::min(m_maxNumberOfUsedKeyFrames, m_visibleKeyFrames.size());
-    std::partial_sort(m_visibleKeyFrames.begin(), m_visibleKeyFrames.begin() + size, m_visibleKeyFrames.end(),
-              [] (const VisibleKeyFrame & a, const VisibleKeyFrame & b) -> bool {
-                  return (a.distanceSquared < b.distanceSquared);
-              });
-    m_visibleKeyFrames.resize(size);
 }
 
 void MapProjector::_projectMapPointsOnGrid(const Frame & frame)
 {
     for (auto it = m_visibleKeyFrames.begin(); it != m_visibleKeyFrames.end(); ++it) {
         std::shared_ptr<KeyFrame> keyFrame = it->keyFrame;
-        MapResourceLocker lockerKeyFrame(m_resourceManager, keyFrame.get()); (void)lockerKeyFrame;
+        MapResourceLocker lockerKeyFrame(m_resourceManager, keyFrame.get(), MapResourceAccess::Shared); (void)lockerKeyFrame;
         std::size_t countFeatures = keyFrame->countFeatures();
         for (std::size_t j = 0; j < countFeatures; ++j) {
             std::shared_ptr<MapPoint> mapPoint = keyFrame->feature(j)->mapPoint();
             MapResourceLocker lockerMapPoint(m_resourceManager, mapPoint.get()); (void)lockerMapPoint;
-            if (m_projectedMapPoints.find(mapPoint) == m_projectedMapPoints.end()) {
+            if (mapPoint->m_projectionEpoch != m_projectionEpoch) {
                 if (_projectMapPointOnGrid(frame, mapPoint)) {
                     ++it->countVisiblePoints;
                 }
-                m_projectedMapPoints.insert(mapPoint);
+                mapPoint->m_projectionEpoch = m_projectionEpoch;
             }
         }
     }
+    placeOnCells(m_cells, m_cellsOffsets, m_projectedMapPoints);
 }
 
 bool MapProjector::_projectMapPointOnGrid(const Frame & frame, const std::shared_ptr<MapPoint> & mapPoint)
 {
-    TMath::TVectord v = frame.rotation() * mapPoint->position() + frame.translation();
+    TMath::TVector3d v = m_targetFrame_rotation * mapPoint->_position3d() + m_targetFrame_translation;
     if (v(2) >= std::numeric_limits<float>::epsilon()) {
         Point2f p = frame.camera()->project(Point2d(v(0) / v(2), v(1) / v(2))).cast<float>();
         if ((p.x > m_targetFrameBegin.x) && (p.y > m_targetFrameBegin.y) &&
@@ -371,7 +522,9 @@ bool MapProjector::_projectMapPointOnGrid(const Frame & frame, const std::shared
             int k = ((int)(p.y / m_cellSize.y)) * m_gridSize.x + (int)(p.x / m_cellSize.x);
             if (m_cells_lock[k])
                 return false;
-            m_cells[k].push_back({ mapPoint, p });
+            m_projectedMapPoints.push_back({ mapPoint, p, k });
+            // the entry is created here, so the cache isn't resized while cells are matched by threads
+            m_warpedPatchCache.mapPointEntry(mapPoint.get());
             return true;
         }
     }
@@ -407,36 +560,59 @@ void MapProjector::_projectCandidatesPointsOnGrid(const Frame & frame,
                      delete e;
                 }
             } else {
-                m_cells_candidates[k].push_back({ e, p });
+                m_projectedCandidates.push_back({ e, p, k });
             }
         }
         e = e_next;
     }
+    placeOnCells(m_cells_candidates, m_cellsOffsets_candidates, m_projectedCandidates);
+}
+
+void MapProjector::_matchMapPointsOnCells(const PreviewFrame & targetFrame, int contextIndex)
+{
+    MatchingContext & context = *m_contexts[contextIndex];
+    std::vector<MatchedCell> & matchedCells = m_matchedCells[contextIndex];
+    int countCells = (int)m_cellOrders.size();
+    while (m_countMatchedCells.load() < m_maxNumberOfFeaturesOnFrame) {
+        int order = m_nextCellOrder++;
+        if (order >= countCells)
+            break;
+        MatchedCell matchedCell;
+        matchedCell.order = order;
+        matchedCell.cell = m_cellOrders[order];
+        context.cellOrder = order;
+        if (_processMapPointOnCell(context, targetFrame, matchedCell)) {
+            matchedCells.push_back(std::move(matchedCell));
+            ++m_countMatchedCells;
+        }
+    }
 }
 
-bool MapProjector::_processMapPointOnCell(PreviewFrame & targetFrame, int k)
+// Every map point is projected on one cell, so threads change only map points of their cells.
+bool MapProjector::_processMapPointOnCell(MatchingContext & context, const PreviewFrame & targetFrame,
+                                          MatchedCell & matchedCell)
 {
+    int k = matchedCell.cell;
     if (m_cells_lock[k])
         return false;
 
-    std::list<ProjectedMapPoint> & mapPoints = m_cells[k];
-    mapPoints.sort([](const ProjectedMapPoint & lhs,
-                      const ProjectedMapPoint & rhs) -> bool {
-           return (lhs.mapPoint->statistic().commonScore() > rhs.mapPoint->statistic().commonScore());
-    });
-    for (std::list<ProjectedMapPoint>::iterator it = mapPoints.begin(); it != mapPoints.end(); ++it) {
+    ProjectedMapPoint * begin = m_cells.data() + m_cellsOffsets[k];
+    ProjectedMapPoint * end = m_cells.data() + m_cellsOffsets[k + 1];
+    sortCell(begin, end, [] (const ProjectedMapPoint & p) { return p.mapPoint->statistic().commonScore(); });
+    for (ProjectedMapPoint * it = begin; it != end; ++it) {
         std::shared_ptr<MapPoint> mapPoint = it->mapPoint;
-        MapResourceLocker lockerMapPoint(m_resourceManager, mapPoint.get()); (void)lockerMapPoint;
-        if (_projectMapPoint(targetFrame, mapPoint, it->projection)) {
-            targetFrame.addPreviewFeature({ mapPoint, m_lastProjection, m_lastSearchImageLevel });
-            m_cells_lock[k] = true;
+        MapResourceLocker lockerMapPoint(context.resourceManager, mapPoint.get()); (void)lockerMapPoint;
+        if (_projectMapPoint(context, targetFrame, mapPoint, it->projection)) {
+            matchedCell.mapPoint = mapPoint;
+            matchedCell.projection = context.lastProjection;
+            matchedCell.imageLevel = context.lastSearchImageLevel;
             return true;
         }
     }
     return false;
 }
 
-bool MapProjector::_projectMapPoint(PreviewFrame & targetFrame,
+bool MapProjector::_projectMapPoint(MatchingContext & context, const PreviewFrame & targetFrame,
                                     const std::shared_ptr<MapPoint> & mapPoint,
                                     const Point2f & projection)
 {
@@ -447,7 +623,7 @@ bool MapProjector::_projectMapPoint(PreviewFrame & targetFrame,
     if (f == nullptr)
         return false;
     std::shared_ptr<const KeyFrame> f_keyFrame = f->keyFrame();
-    MapResourceLocker locker_f_keyFrame(m_resourceManager, f_keyFrame.get()); (void)locker_f_keyFrame;
+    MapResourceLocker locker_f_keyFrame(context.resourceManager, f_keyFrame.get(), MapResourceAccess::Shared); (void)locker_f_keyFrame;
 
     Point2f oldImagePoint = f->positionOnFrame() / (float)(1 << f->imageLevel());
     ConstImage<uchar> oldImage = f_keyFrame->imageLevel(f->imageLevel());
@@ -459,8 +635,7 @@ bool MapProjector::_projectMapPoint(PreviewFrame & targetFrame,
 
     TMatrixd f_keyFrame_worldRotation = f_keyFrame->rotation();
     if (!TTools::matrix3x3Invert(f_keyFrame_worldRotation)) {
-        mapPoint->statistic().incFailed(100);
-        m_failedMapPoints.push_back(mapPoint);
+        context.failures.push_back({ context.cellOrder, mapPoint, 100, true });
         return false;
     }
     TVectord f_keyFrame_worldPosition = - f_keyFrame_worldRotation * f_keyFrame->translation();
@@ -472,79 +647,64 @@ bool MapProjector::_projectMapPoint(PreviewFrame & targetFrame,
     }
     TMatrixf w(2, 2);
     getWarpMatrixAffine(w,
-                        m_matcher.cursorSize().cast<float>(),
+                        context.matcher.cursorSize().cast<float>(),
                         f_keyFrame->camera(), targetFrame.camera(), f->positionOnFrame(),
                         localMapPoint, f->imageLevel(),
                         deltaRotation, deltaTranslation);
-    m_lastSearchImageLevel = getBestSearchLevel(w, targetFrame.countImageLevels() - 1);
+    context.lastSearchImageLevel = getBestSearchLevel(w, targetFrame.countImageLevels() - 1);
     if (!TTools::matrix2x2Invert(w)) {
-        mapPoint->statistic().incFailed(3);
-        if (m_builderTypeMapPoint->getType(mapPoint->statistic()) == TypeMapPoint::Failed)
-            m_failedMapPoints.push_back(mapPoint);
+        context.failures.push_back({ context.cellOrder, mapPoint, 3, false });
         return false;
     }
-    warpAffine(m_matcher.patch(), w, oldImage, f->positionOnFrame(),
-               f->imageLevel(), m_lastSearchImageLevel);
-    m_matcher.setSecondImage(targetFrame.imageLevel(m_lastSearchImageLevel));
-    float scale = (float)(1 << m_lastSearchImageLevel);
-    m_lastProjection = projection / scale;
-    Point2f d = m_lastProjection;
-    if (m_matcher.tracking2d_patch(m_lastProjection) == TrackingResult::Fail) {
-        mapPoint->statistic().incFailed();
-        if (m_builderTypeMapPoint->getType(mapPoint->statistic()) == TypeMapPoint::Failed)
-            m_failedMapPoints.push_back(mapPoint);
+    _warpPatch(context, m_warpedPatchCache.mapPointEntry(mapPoint.get()), w, f_keyFrame.get(), oldImage,
+               f->positionOnFrame(), f->imageLevel());
+    context.matcher.setSecondImage(targetFrame.imageLevel(context.lastSearchImageLevel));
+    float scale = (float)(1 << context.lastSearchImageLevel);
+    context.lastProjection = projection / scale;
+    Point2f d = context.lastProjection;
+    if (context.matcher.tracking2d_patch(context.lastProjection) == TrackingResult::Fail) {
+        context.failures.push_back({ context.cellOrder, mapPoint, 1, false });
         return false;
     }
-    d -= m_lastProjection;
-    if ((std::fabs(d.x) > m_matcher.cursorWidth()) || (std::fabs(d.y) > m_matcher.cursorHeight())) {
-        mapPoint->statistic().incFailed();
-        if (m_builderTypeMapPoint->getType(mapPoint->statistic()) == TypeMapPoint::Failed)
-            m_failedMapPoints.push_back(mapPoint);
+    d -= context.lastProjection;
+    if ((std::fabs(d.x) > context.matcher.cursorWidth()) || (std::fabs(d.y) > context.matcher.cursorHeight())) {
+        context.failures.push_back({ context.cellOrder, mapPoint, 1, false });
         return false;
     }
-    m_lastProjection *= scale;
-    //debug.push_back({ m_matcher.patch().copy(), projection, scale });
+    context.lastProjection *= scale;
+    //debug.push_back({ context.matcher.patch().copy(), projection, scale });
     return true;
 }
 
-bool MapProjector::_processCandidatePointOnCell(PreviewFrame & targetFrame, int k)
+bool MapProjector::_processCandidatePointOnCell(MatchingContext & context, PreviewFrame & targetFrame, int k)
 {
     if (m_cells_lock[k])
         return false;
 
-    std::list<ProjectedCandidateMapPoint> & cell_candidates = m_cells_candidates[k];
-
-    cell_candidates.sort([](const ProjectedCandidateMapPoint & lhs,
-                            const ProjectedCandidateMapPoint & rhs) -> bool {
-                                return (lhs.candidateMapPoint->statistic.commonScore() >
-                                        rhs.candidateMapPoint->statistic.commonScore());
-                            });
-    auto it = cell_candidates.begin();
-    while (it != cell_candidates.end()) {
-        if (_projectCandidatePoint(targetFrame, it->candidateMapPoint, it->projection)) {
-            m_successCurrentCandidatePoints.push_back({ it->candidateMapPoint, m_lastProjection, m_lastSearchImageLevel });
+    ProjectedCandidateMapPoint * begin = m_cells_candidates.data() + m_cellsOffsets_candidates[k];
+    ProjectedCandidateMapPoint * end = m_cells_candidates.data() + m_cellsOffsets_candidates[k + 1];
+    sortCell(begin, end, [] (const ProjectedCandidateMapPoint & p) { return p.candidateMapPoint->statistic.commonScore(); });
+    // every cell is processed once per frame, so deleted candidates aren't used after it
+    for (ProjectedCandidateMapPoint * it = begin; it != end; ++it) {
+        if (_projectCandidatePoint(context, targetFrame, it->candidateMapPoint, it->projection)) {
+            m_successCurrentCandidatePoints.push_back({ it->candidateMapPoint, context.lastProjection, context.lastSearchImageLevel });
             //m_cells_lock[k] = true;
             return true;
-        } else {
-            if (m_builderTypeCandidatePoint->getType(it->candidateMapPoint->statistic) == TypeMapPoint::Failed) {
-                delete it->candidateMapPoint;
-                it = cell_candidates.erase(it);
-            } else {
-                ++it;
-            }
+        } else if (m_builderTypeCandidatePoint->getType(it->candidateMapPoint->statistic) == TypeMapPoint::Failed) {
+            delete it->candidateMapPoint;
         }
     }
     return false;
 }
 
-bool MapProjector::_projectCandidatePoint(PreviewFrame & targetFrame,
+bool MapProjector::_projectCandidatePoint(MatchingContext & context, PreviewFrame & targetFrame,
                                           CandidateMapPoint * candidateMapPoint,
                                           const Point2f & projection)
 {
     using namespace TMath;
 
     std::shared_ptr<KeyFrame> keyFrame = candidateMapPoint->keyFrame;
-    MapResourceLocker lockerKeyFrame(m_resourceManager, keyFrame.get()); (void)lockerKeyFrame;
+    MapResourceLocker lockerKeyFrame(context.resourceManager, keyFrame.get(), MapResourceAccess::Shared); (void)lockerKeyFrame;
 
     if (keyFrame->isDeleted()) {
         candidateMapPoint->statistic.incFailed(100);
@@ -580,37 +740,67 @@ bool MapProjector::_projectCandidatePoint(PreviewFrame & targetFrame,
 
     TMatrixf w(2, 2);
     getWarpMatrixAffine(w,
-                        m_matcher.cursorSize().cast<float>(),
+                        context.matcher.cursorSize().cast<float>(),
                         keyFrame->camera(), targetFrame.camera(), candidateMapPoint->projection,
                         localMapPoint, candidateMapPoint->imageLevel,
                         deltaRotation, deltaTranslation);
-    m_lastSearchImageLevel = getBestSearchLevel(w, targetFrame.countImageLevels() - 1);
+    context.lastSearchImageLevel = getBestSearchLevel(w, targetFrame.countImageLevels() - 1);
     if (!TTools::matrix2x2Invert(w)) {
         candidateMapPoint->statistic.incFailed(100);
         return false;
     }
-    warpAffine(m_matcher.patch(), w, oldImage, candidateMapPoint->projection,
-               candidateMapPoint->imageLevel, m_lastSearchImageLevel);
-    m_matcher.setSecondImage(targetFrame.imageLevel(m_lastSearchImageLevel));
-    float scale = (float)(1 << m_lastSearchImageLevel);
-    m_lastProjection = projection / scale;
-    Point2f d = m_lastProjection;
-    if (m_matcher.tracking2d_patch(m_lastProjection) == TrackingResult::Fail) {
+    _warpPatch(context, candidateMapPoint->warpedPatch, w, keyFrame.get(), oldImage,
+               candidateMapPoint->projection, candidateMapPoint->imageLevel);
+    context.matcher.setSecondImage(targetFrame.imageLevel(context.lastSearchImageLevel));
+    float scale = (float)(1 << context.lastSearchImageLevel);
+    context.lastProjection = projection / scale;
+    Point2f d = context.lastProjection;
+    if (context.matcher.tracking2d_patch(context.lastProjection) == TrackingResult::Fail) {
         candidateMapPoint->statistic.incFailed();
         return false;
     }
 
-    d -= m_lastProjection;
-    if ((std::fabs(d.x) > m_matcher.cursorWidth()) || (std::fabs(d.y) > m_matcher.cursorHeight())) {
+    d -= context.lastProjection;
+    if ((std::fabs(d.x) > context.matcher.cursorWidth()) || (std::fabs(d.y) > context.matcher.cursorHeight())) {
         candidateMapPoint->statistic.incFailed(3);
         return false;
     }
 
-    m_lastProjection *= scale;
-    //debug.push_back({ m_matcher.patch().copy(), projection, scale });
+    context.lastProjection *= scale;
+    //debug.push_back({ context.matcher.patch().copy(), projection, scale });
     return true;
 }
 
+void MapProjector::_warpPatch(MatchingContext & context,
+                              WarpedPatchCache::Entry & entry, const TMath::TMatrixf & invWarpMatrix,
+                              const KeyFrame * keyFrame, const ImageRef<uchar> & levelImage,
+                              const Point2f & imagePoint, int level)
+{
+    Image<uchar> patch = context.matcher.patch();
+    bool useCache = (m_warpedPatchCache.maxDrift() >= 0.0f);
+    if (useCache && m_warpedPatchCache.find(entry, patch, keyFrame, imagePoint, level,
+                                            invWarpMatrix, context.lastSearchImageLevel)) {
+        if (m_performanceMonitor != nullptr) {
+            m_performanceMonitor->addToCounter(m_counter_cachedPatches);
+            m_performanceMonitor->addToCounter(m_counter_savedWarpTime, (std::uint64_t)context.averageWarpDuration);
+        }
+        return;
+    }
+    std::chrono::steady_clock::time_point start;
+    if (m_performanceMonitor != nullptr)
+        start = std::chrono::steady_clock::now();
+    warpAffine(patch, invWarpMatrix, levelImage, imagePoint, level, context.lastSearchImageLevel);
+    if (m_performanceMonitor != nullptr) {
+        double duration = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        context.averageWarpDuration = (context.averageWarpDuration > 0.0) ?
+                    (context.averageWarpDuration * 0.95 + duration * 0.05) : duration;
+        m_performanceMonitor->addToCounter(m_counter_warpedPatches);
+    }
+    if (useCache)
+        m_warpedPatchCache.store(entry, patch, keyFrame, imagePoint, level, invWarpMatrix, context.lastSearchImageLevel);
+}
+
 void MapProjector::getWarpMatrixAffine(TMath::TMatrixf & warpMatrix,
                                        const Point2f & halfPatchSize,
                                        const std::shared_ptr<const Camera> & cameraA,
@@ -2,6 +2,7 @@
 #define AR_MAPPROJECTOR_H
 
 #include "TMath/TMatrix.h"
+#include "TMath/TMatrixN.h"
 #include "Image.h"
 #include "Feature.h"
 #include "Frame.h"
@@ -12,11 +13,14 @@
 #include "MapPoint.h"
 #include "OpticalFlowCalculator.h"
 #include "MapPointsDetector.h"
+#include "WarpedPatchCache.h"
+#include "PerformanceMonitor.h"
+#include "ThreadPool.h"
 #include <vector>
-#include <deque>
 #include <memory>
 #include <list>
-#include <set>
+#include <cstdint>
+#include <atomic>
 
 namespace AR {
 
@@ -59,6 +63,12 @@ public:
     std::size_t maxNumberOfFeaturesOnFrame() const;
     void setMaxNumberOfFeaturesOnFrame(const std::size_t & maxNumberOfFeaturesOnFrame);
 
+    // Cells of the grid are matched by several threads, every thread has own matcher and own manager of locks.
+    // Map objects must not be locked by the manager of projector when projectMapPoints() is called.
+    // If countThreads <= 0 then count of hardware threads is used.
+    int countThreads() const;
+    void setCountThreads(int countThreads);
+
     const BuilderTypePoint* builderTypeMapPoint() const;
     BuilderTypePoint* builderTypeMapPoint();
     void setBuilderTypeMapPoint(BuilderTypePoint * builderType);
@@ -70,6 +80,14 @@ public:
     MapPointsDetector * mapPointsDetector() const;
     void setMapPointsDetector(MapPointsDetector * mapPointsDetector);
 
+    // Max moving of corners of warped patches (in pixels of key frames) at which patches of the previous frames
+    // are used again, if it's negative then patches are warped on every frame.
+    float warpedPatchMaxDrift() const;
+    void setWarpedPatchMaxDrift(float maxDrift);
+
+    // Counters of the cache of warped patches are added to performanceMonitor, it can be nullptr.
+    void setPerformanceMonitor(PerformanceMonitor * performanceMonitor);
+
     void deleteFaildedMapPoints();
 
     void projectMapPoints(PreviewFrame & previewFrame,
@@ -108,12 +126,14 @@ private:
     {
         std::shared_ptr<MapPoint> mapPoint;
         Point2f projection;
+        int cell;
     };
 
     struct ProjectedCandidateMapPoint
     {
         CandidateMapPoint * candidateMapPoint;
         Point2f projection;
+        int cell;
     };
 
     struct SuccessCandidateMapPoint
@@ -123,6 +143,38 @@ private:
         int imageLevel;
     };
 
+    // State of matching of one thread.
+    // Failure of map point in matching on cell, it's applied to the statistic of map point after matching,
+    // only if the cell is before the last accepted cell.
+    struct MapPointFailure
+    {
+        int order; // index of cell in m_cellOrders
+        std::shared_ptr<MapPoint> mapPoint;
+        int countFailed;
+        bool alwaysFailed; // map point is failed regardless of its statistic
+    };
+
+    struct MatchingContext
+    {
+        OpticalFlowCalculator matcher;
+        MapResourcesManager * resourceManager;
+        MapResourcesManager ownResourceManager;
+        Point2f lastProjection;
+        int lastSearchImageLevel;
+        double averageWarpDuration; // in nanoseconds
+        int cellOrder; // order of the processed cell
+        std::vector<MapPointFailure> failures;
+    };
+
+    struct MatchedCell
+    {
+        int order; // index of cell in m_cellOrders
+        int cell;
+        std::shared_ptr<MapPoint> mapPoint;
+        Point2f projection;
+        int imageLevel;
+    };
+
     Map * m_map;
     MapResourcesManager * m_resourceManager;
 
@@ -132,40 +184,68 @@ private:
 
     Point2i m_gridSize;
     Point2f m_cellSize;
-    std::vector<std::list<ProjectedMapPoint>> m_cells;
-    std::vector<std::list<ProjectedCandidateMapPoint>> m_cells_candidates;
-    std::deque<bool> m_cells_lock;
+    // Projected points are collected in order of projection and then are placed by cells with counting sort,
+    // points of cell k are in range [offsets[k], offsets[k + 1]) of the cell buffer.
+    std::vector<ProjectedMapPoint> m_projectedMapPoints;
+    std::vector<ProjectedMapPoint> m_cells;
+    std::vector<int> m_cellsOffsets;
+    std::vector<ProjectedCandidateMapPoint> m_projectedCandidates;
+    std::vector<ProjectedCandidateMapPoint> m_cells_candidates;
+    std::vector<int> m_cellsOffsets_candidates;
+    std::vector<uchar> m_cells_lock;
     std::vector<int> m_cellOrders;
     std::vector<VisibleKeyFrame> m_visibleKeyFrames;
-    std::set<std::shared_ptr<MapPoint>> m_projectedMapPoints;
+    // Map points which are projected on the current frame have this value of MapPoint::m_projectionEpoch.
+    std::uint64_t m_projectionEpoch;
     Point2f m_targetFrameBegin, m_targetFrameEnd;
+    TMath::TMatrix3d m_targetFrame_rotation;
+    TMath::TVector3d m_targetFrame_translation;
     TMath::TMatrixd m_targetFrame_invRotation;
     TMath::TVectord m_targetFrame_invTranslation;
-    OpticalFlowCalculator m_matcher;
     Point2f m_border;
     std::vector<std::shared_ptr<MapPoint>> m_failedMapPoints;
-    Point2f m_lastProjection;
-    int m_lastSearchImageLevel;
+    // Contexts are bound to threads of m_threadPool, the first context is used by the calling thread
+    // with m_resourceManager and for candidate points.
+    std::vector<std::unique_ptr<MatchingContext>> m_contexts;
+    ThreadPool m_threadPool;
+    std::atomic<int> m_nextCellOrder;
+    std::atomic<std::size_t> m_countMatchedCells;
+    std::vector<std::vector<MatchedCell>> m_matchedCells; // by contexts
+    std::vector<MatchedCell> m_sortedMatchedCells;
+    std::vector<MapPointFailure> m_sortedFailures;
     BuilderTypePoint * m_builderTypeMapPoint;
     BuilderTypePoint * m_builderTypeCandidatePoint;
 
     MapPointsDetector * m_mapPointsDetector;
     std::list<SuccessCandidateMapPoint> m_successCurrentCandidatePoints;
 
+    WarpedPatchCache m_warpedPatchCache;
+    PerformanceMonitor * m_performanceMonitor;
+    int m_counter_cachedPatches;
+    int m_counter_warpedPatches;
+    int m_counter_savedWarpTime;
+
     void _resetGrid();
     void _findVisibleKeyFrames(const Frame & targetFrame);
     void _projectMapPointsOnGrid(const Frame & frame);
     bool _projectMapPointOnGrid(const Frame & frame, const std::shared_ptr<MapPoint> & mapPoint);
     void _projectCandidatesPointsOnGrid(const Frame & frame,
                                         CandidateMapPointsList * candidatesList);
-    bool _processMapPointOnCell(PreviewFrame & targetFrame, int k);
-    bool _projectMapPoint(PreviewFrame & targetFrame,
+    void _matchMapPointsOnCells(const PreviewFrame & targetFrame, int contextIndex);
+    // Matches the first possible map point of cell matchedCell.cell.
+    bool _processMapPointOnCell(MatchingContext & context, const PreviewFrame & targetFrame,
+                                MatchedCell & matchedCell);
+    bool _projectMapPoint(MatchingContext & context, const PreviewFrame & targetFrame,
                           const std::shared_ptr<MapPoint> & mapPoint,
                           const Point2f & projection);
-    bool _processCandidatePointOnCell(PreviewFrame & targetFrame, int k);
-    bool _projectCandidatePoint(PreviewFrame & targetFrame,
+    bool _processCandidatePointOnCell(MatchingContext & context, PreviewFrame & targetFrame, int k);
+    bool _projectCandidatePoint(MatchingContext & context, PreviewFrame & targetFrame,
                                 CandidateMapPoint * candidateMapPoint,
                                 const Point2f & projection);
+    // Warps patch of key frame to the patch of matcher on context.lastSearchImageLevel or takes it from the cache.
+    void _warpPatch(MatchingContext & context, WarpedPatchCache::Entry & entry, const TMath::TMatrixf & invWarpMatrix,
+                    const KeyFrame * keyFrame, const ImageRef<uchar> & levelImage,
+                    const Point2f & imagePoint, int level);
 };
 
 }
@@ -2,18 +2,20 @@
 
 namespace AR {
 
-MapResourceLocker::MapResourceLocker(MapResourcesManager * manager, const MapResourceObject * object)
+MapResourceLocker::MapResourceLocker(MapResourcesManager * manager, const MapResourceObject * object,
+                                     MapResourceAccess access)
 {
-    (void)manager;
-    (void)object;
-    /*m_manager = manager;
+    m_manager = manager;
     m_object = object;
-    m_manager->lock(m_object);*/
+    m_access = access;
+    if (m_manager != nullptr)
+        m_manager->lock(m_object, m_access);
 }
 
 MapResourceLocker::~MapResourceLocker()
 {
-    //m_manager->unlock(m_object);
+    if (m_manager != nullptr)
+        m_manager->unlock(m_object, m_access);
 }
 
 } // namespace AR
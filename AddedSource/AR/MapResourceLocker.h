@@ -9,12 +9,17 @@ namespace AR {
 class MapResourceLocker
 {
 public:
-    MapResourceLocker(MapResourcesManager * manager, const MapResourceObject * object);
+    MapResourceLocker(MapResourcesManager * manager, const MapResourceObject * object,
+                      MapResourceAccess access = MapResourceAccess::Exclusive);
     ~MapResourceLocker();
 
 private:
-    //MapResourcesManager * m_manager;
-    //const MapResourceObject * m_object;
+    MapResourcesManager * m_manager;
+    const MapResourceObject * m_object;
+    MapResourceAccess m_access;
+
+    MapResourceLocker(const MapResourceLocker & ) = delete;
+    void operator = (const MapResourceLocker & ) = delete;
 };
 
 } // AR
@@ -8,6 +8,9 @@ MapResourceObject::MapResourceObject(Map * map)
 {
     TMath_assert(map != nullptr);
     m_map = map;
+    m_countReaders = 0;
+    m_countWaitingWriters = 0;
+    m_isLockedByWriter = false;
 }
 
 const Map * MapResourceObject::map() const
@@ -20,4 +23,76 @@ Map * MapResourceObject::map()
     return m_map;
 }
 
+bool MapResourceObject::_tryLock(bool exclusive) const
+{
+    std::lock_guard<std::mutex> lock(m_lockMutex); (void)lock;
+    if (m_isLockedByWriter)
+        return false;
+    if (exclusive) {
+        if (m_countReaders > 0)
+            return false;
+        m_isLockedByWriter = true;
+    } else {
+        if (m_countWaitingWriters > 0)
+            return false;
+        ++m_countReaders;
+    }
+    return true;
+}
+
+void MapResourceObject::_lock(bool exclusive) const
+{
+    std::unique_lock<std::mutex> lock(m_lockMutex);
+    if (exclusive) {
+        ++m_countWaitingWriters;
+        while (m_isLockedByWriter || (m_countReaders > 0))
+            m_lockCondition.wait(lock);
+        --m_countWaitingWriters;
+        m_isLockedByWriter = true;
+    } else {
+        while (m_isLockedByWriter || (m_countWaitingWriters > 0))
+            m_lockCondition.wait(lock);
+        ++m_countReaders;
+    }
+}
+
+void MapResourceObject::_unlock(bool exclusive) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lockMutex); (void)lock;
+        if (exclusive) {
+            TMath_assert(m_isLockedByWriter);
+            m_isLockedByWriter = false;
+        } else {
+            TMath_assert(m_countReaders > 0);
+            --m_countReaders;
+            if (m_countReaders > 0)
+                return;
+        }
+    }
+    m_lockCondition.notify_all();
+}
+
+bool MapResourceObject::_tryUpgrade() const
+{
+    std::lock_guard<std::mutex> lock(m_lockMutex); (void)lock;
+    TMath_assert(m_countReaders > 0);
+    if (m_countReaders != 1)
+        return false;
+    m_countReaders = 0;
+    m_isLockedByWriter = true;
+    return true;
+}
+
+void MapResourceObject::_downgrade() const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lockMutex); (void)lock;
+        TMath_assert(m_isLockedByWriter);
+        m_isLockedByWriter = false;
+        m_countReaders = 1;
+    }
+    m_lockCondition.notify_all();
+}
+
 } // namespace AR
@@ -2,6 +2,7 @@
 #define AR_MAPRESOURCEOBJECT_H
 
 #include <mutex>
+#include <condition_variable>
 
 namespace AR {
 
@@ -24,7 +25,21 @@ private:
     friend class MapResourcesManager;
     friend class MapResourceLocker;
 
-    //mutable std::recursive_mutex m_mutex;
+    // Reader/writer lock of object, it's used only through MapResourcesManager.
+    // Waiting writers have priority over new readers.
+    mutable std::mutex m_lockMutex;
+    mutable std::condition_variable m_lockCondition;
+    mutable int m_countReaders;
+    mutable int m_countWaitingWriters;
+    mutable bool m_isLockedByWriter;
+
+    bool _tryLock(bool exclusive) const;
+    void _lock(bool exclusive) const;
+    void _unlock(bool exclusive) const;
+    // The only reader becomes the writer.
+    bool _tryUpgrade() const;
+    // The writer becomes a reader.
+    void _downgrade() const;
 };
 
 } // namespace AR
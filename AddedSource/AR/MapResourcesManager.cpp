@@ -5,43 +5,113 @@
 
 namespace AR {
 
-void MapResourcesManager::lock(const MapResourceObject * object)
+MapResourcesManager::MapResourcesManager()
 {
-    (void)object;
-    /*using namespace std;
-    if (!object->m_mutex.try_lock()) {
-        for (auto it = m_used_objects.begin(); it != m_used_objects.end(); ++it) {
-            (*it)->m_mutex.unlock();
+}
+
+MapResourcesManager::~MapResourcesManager()
+{
+    TMath_assert(m_usedObjects.empty());
+}
+
+std::size_t MapResourcesManager::countLockedObjects() const
+{
+    return m_usedObjects.size();
+}
+
+void MapResourcesManager::lock(const MapResourceObject * object, MapResourceAccess access)
+{
+    if (object == nullptr)
+        return;
+    bool exclusive = (access == MapResourceAccess::Exclusive);
+    auto it = _find(object);
+    if (it != m_usedObjects.end()) {
+        if (!exclusive) {
+            ++it->countShared;
+            return;
+        }
+        if (it->countExclusive > 0) {
+            ++it->countExclusive;
+            return;
+        }
+        ++it->countExclusive;
+        if (object->_tryUpgrade())
+            return;
+        object->_unlock(false);
+    } else {
+        if (object->_tryLock(exclusive)) {
+            m_usedObjects.push_back({ object, exclusive ? 0 : 1, exclusive ? 1 : 0 });
+            return;
         }
-        for (;;) {
-            object->m_mutex.lock();
-            for (auto it = m_used_objects.begin(); it != m_used_objects.end(); ++it) {
-                if (!(*it)->m_mutex.try_lock()) {
-                    for (auto it2 = m_used_objects.begin(); it2 != it; ++it2) {
-                        (*it2)->m_mutex.unlock();
-                    }
-                    goto nextTry;
-                }
-            }
-            break;
-            nextTry:
-            object->m_mutex.unlock();
+        m_usedObjects.push_back({ object, exclusive ? 0 : 1, exclusive ? 1 : 0 });
+        it = m_usedObjects.end() - 1;
+    }
+    std::size_t index = (std::size_t)(it - m_usedObjects.begin());
+    for (std::size_t i = 0; i < m_usedObjects.size(); ++i) {
+        if (i != index)
+            m_usedObjects[i].object->_unlock(m_usedObjects[i].countExclusive > 0);
+    }
+    _lockAll(index);
+}
+
+void MapResourcesManager::unlock(const MapResourceObject * object, MapResourceAccess access)
+{
+    if (object == nullptr)
+        return;
+    auto it = _find(object);
+    TMath_assert(it != m_usedObjects.end());
+    if (access == MapResourceAccess::Exclusive) {
+        TMath_assert(it->countExclusive > 0);
+        --it->countExclusive;
+        if (it->countExclusive > 0)
+            return;
+        if (it->countShared > 0) {
+            object->_downgrade();
+            return;
         }
+        object->_unlock(true);
+    } else {
+        TMath_assert(it->countShared > 0);
+        --it->countShared;
+        if ((it->countShared > 0) || (it->countExclusive > 0))
+            return;
+        object->_unlock(false);
     }
-    m_used_objects.push_back(object);*/
+    *it = m_usedObjects.back();
+    m_usedObjects.pop_back();
 }
 
-void MapResourcesManager::unlock(const MapResourceObject * object)
+std::vector<MapResourcesManager::UsedObject>::iterator MapResourcesManager::_find(const MapResourceObject * object)
 {
-    (void)object;
-    /*for (auto it = m_used_objects.begin(); it != m_used_objects.end(); ++it) {
-        if (*it == object) {
-            m_used_objects.erase(it);
-            object->m_mutex.unlock();
+    for (auto it = m_usedObjects.begin(); it != m_usedObjects.end(); ++it) {
+        if (it->object == object)
+            return it;
+    }
+    return m_usedObjects.end();
+}
+
+void MapResourcesManager::_lockAll(std::size_t blockingIndex)
+{
+    // nothing is locked here
+    for (;;) {
+        const UsedObject & blockingObject = m_usedObjects[blockingIndex];
+        blockingObject.object->_lock(blockingObject.countExclusive > 0);
+        std::size_t i = 0;
+        for (; i < m_usedObjects.size(); ++i) {
+            if (i == blockingIndex)
+                continue;
+            if (!m_usedObjects[i].object->_tryLock(m_usedObjects[i].countExclusive > 0))
+                break;
+        }
+        if (i == m_usedObjects.size())
             return;
+        for (std::size_t j = 0; j < i; ++j) {
+            if (j != blockingIndex)
+                m_usedObjects[j].object->_unlock(m_usedObjects[j].countExclusive > 0);
         }
+        blockingObject.object->_unlock(blockingObject.countExclusive > 0);
+        blockingIndex = i;
     }
-    assert(false);*/
 }
 
 } // namespace AR
@@ -12,17 +12,46 @@ namespace AR {
 class MapResourceObject;
 class MapResourceLocker;
 
+enum class MapResourceAccess: int {
+    Exclusive,
+    Shared
+};
+
+// Locks of map objects (key frames and map points) which are used by one thread,
+// every thread working with the map has own manager (ARSystem, MapPointsDetector).
+// Objects have reader/writer locks: readers take Shared access, code that changes objects takes Exclusive access.
+// Locks are recursive, Exclusive access includes Shared access of the same manager.
+// If an object can't be locked at once, all locks of the manager are released and are taken again
+// after waiting for this object, so threads never wait while they hold locks and deadlocks are impossible.
+// Note: data of objects locked before can be changed by other threads during this waiting.
 class MapResourcesManager
 {
 public:
-    void lock(const MapResourceObject * object);
-    void unlock(const MapResourceObject * object);
+    MapResourcesManager();
+    ~MapResourcesManager();
+
+    void lock(const MapResourceObject * object, MapResourceAccess access = MapResourceAccess::Exclusive);
+    void unlock(const MapResourceObject * object, MapResourceAccess access = MapResourceAccess::Exclusive);
+
+    std::size_t countLockedObjects() const;
 
 private:
     friend class MapResourceLocker;
 
-    //mutable std::mutex m_mutex;
-    //std::vector<const MapResourceObject*> m_used_objects;
+    struct UsedObject
+    {
+        const MapResourceObject * object;
+        int countShared;
+        int countExclusive;
+    };
+
+    std::vector<UsedObject> m_usedObjects;
+
+    MapResourcesManager(const MapResourcesManager & ) = delete;
+    void operator = (const MapResourcesManager & ) = delete;
+
+    std::vector<UsedObject>::iterator _find(const MapResourceObject * object);
+    void _lockAll(std::size_t blockingIndex);
 };
 
 } // namespace AR
@@ -0,0 +1,114 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace AR {
+
+MappedFile::MappedFile()
+{
+    m_data = nullptr;
+    m_size = 0;
+#if defined(_WIN32)
+    m_fileHandle = INVALID_HANDLE_VALUE;
+    m_mappingHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string & path)
+{
+    close();
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+    void * data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (data == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_fileHandle = file;
+    m_mappingHandle = mapping;
+    m_data = static_cast<unsigned char*>(data);
+    m_size = (std::size_t)fileSize.QuadPart;
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat fileInfo;
+    if ((fstat(file, &fileInfo) != 0) || (fileInfo.st_size <= 0)) {
+        ::close(file);
+        return false;
+    }
+    void * data = mmap(nullptr, (std::size_t)fileInfo.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    // the mapping keeps its own reference to the file
+    ::close(file);
+    if (data == MAP_FAILED)
+        return false;
+    m_data = static_cast<unsigned char*>(data);
+    m_size = (std::size_t)fileInfo.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data == nullptr)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mappingHandle);
+    CloseHandle(m_fileHandle);
+    m_fileHandle = INVALID_HANDLE_VALUE;
+    m_mappingHandle = NULL;
+#else
+    munmap(m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+    return (m_data != nullptr);
+}
+
+std::size_t MappedFile::size() const
+{
+    return m_size;
+}
+
+const unsigned char * MappedFile::data() const
+{
+    return m_data;
+}
+
+unsigned char * MappedFile::data()
+{
+    return m_data;
+}
+
+}
@@ -0,0 +1,40 @@
+#ifndef AR_MAPPEDFILE_H
+#define AR_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+namespace AR {
+
+// Read-only file mapped into memory.
+// The mapping is private (copy-on-write), so data can be changed in memory but changes never go to the file.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string & path);
+    void close();
+
+    bool isOpen() const;
+
+    std::size_t size() const;
+    const unsigned char * data() const;
+    unsigned char * data();
+
+private:
+    MappedFile(const MappedFile & ) = delete;
+    void operator = (const MappedFile & ) = delete;
+
+    unsigned char * m_data;
+    std::size_t m_size;
+#if defined(_WIN32)
+    void * m_fileHandle;
+    void * m_mappingHandle;
+#endif
+};
+
+}
+
+#endif // AR_MAPPEDFILE_H
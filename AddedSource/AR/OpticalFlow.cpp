@@ -7,6 +7,7 @@ namespace AR {
 
 OpticalFlow::OpticalFlow()
 {
+    m_firstImagesOfBatchUpdated = false;
     setCountLevels(3);
     setCursorSize(Point2i(15, 15));
 }
@@ -19,6 +20,7 @@ Point2i OpticalFlow::cursorSize() const
 void OpticalFlow::setCursorSize(const Point2i& size)
 {
     m_opticalFlowCalculator.setCursorSize(size);
+    m_opticalFlowBatch.setCursorSize(size);
     m_maxVelocitySquared = std::min(size.x, size.y);
     m_maxVelocitySquared *= m_maxVelocitySquared;
 }
@@ -31,6 +33,7 @@ float OpticalFlow::pixelEps() const
 void OpticalFlow::setPixelEps(float pixelEps)
 {
     m_opticalFlowCalculator.setPixelEps(pixelEps);
+    m_opticalFlowBatch.setPixelEps(pixelEps);
 }
 
 int OpticalFlow::maxNumberIterations() const
@@ -41,6 +44,7 @@ int OpticalFlow::maxNumberIterations() const
 void OpticalFlow::setMaxNumberIterations(int count)
 {
     m_opticalFlowCalculator.setNumberIterations(count);
+    m_opticalFlowBatch.setNumberIterations(count);
 }
 
 int OpticalFlow::countLevels() const
@@ -55,6 +59,17 @@ void OpticalFlow::setCountLevels(int count)
     m_levels_second.resize(std::max(count - 1, 0));
     m_shared_first = true;
     m_shared_second = true;
+    m_firstImagesOfBatchUpdated = false;
+}
+
+int OpticalFlow::countThreads() const
+{
+    return m_threadPool.countThreads();
+}
+
+void OpticalFlow::setCountThreads(int countThreads)
+{
+    m_threadPool.setCountThreads(countThreads);
 }
 
 void OpticalFlow::setFirstImage(const ImageRef<uchar>& firstImage)
@@ -81,6 +96,7 @@ void OpticalFlow::setFirstImage(const ImageRef<uchar>& firstImage)
         }
     }
     m_shared_first = false;
+    m_firstImagesOfBatchUpdated = false;
 }
 
 void OpticalFlow::setSecondImage(const ImageRef<uchar>& secondImage)
@@ -129,6 +145,7 @@ void OpticalFlow::setFirstImage(const Frame& frame)
         prevFirstImage = m_levels_first[i];
     }
     m_shared_first = true;
+    m_firstImagesOfBatchUpdated = false;
 }
 
 void OpticalFlow::setSecondImage(const Frame& frame)
@@ -181,6 +198,8 @@ void OpticalFlow::reset()
         m_levels_first[level] = Image<uchar>();
         m_levels_second[level] = Image<uchar>();
     }
+    m_opticalFlowBatch.clear();
+    m_firstImagesOfBatchUpdated = false;
 }
 
 TrackingResult OpticalFlow::tracking2d(Point2f& secondPosition, const Point2f& firstPosition)
@@ -227,49 +246,16 @@ void OpticalFlow::tracking2d(std::vector<TrackingResult>& success,
     } else {
         std::fill(success.begin(), success.end(), TrackingResult::Completed);
     }
-    Point2f p, prev;
+    _updateFirstImagesOfBatch();
     for (int level = m_levels_second.size() - 1; level >= 0; --level) {
         TMath_assert(m_levels_second[level].data() != nullptr);
-        m_opticalFlowCalculator.setFirstImage(m_levels_first[level]);
-        m_opticalFlowCalculator.setSecondImage(m_levels_second[level]);
-        float scale = (1 << level);
-        std::vector<Point2f>::iterator itSecond = secondPoints.begin();
-        std::vector<Point2f>::const_iterator itFirst = firstPoints.cbegin();
-        std::vector<TrackingResult>::iterator itSuccess = success.begin();
-        for ( ; itSecond != secondPoints.end(); ++itSecond, ++itFirst, ++itSuccess) {
-            if (*itSuccess == TrackingResult::Fail)
-                continue;
-            p = *itSecond / scale;
-            prev = p;
-            if (m_opticalFlowCalculator.tracking2d(p, *itFirst / scale) != TrackingResult::Fail) {
-                if ((p - prev).lengthSquared() < m_maxVelocitySquared) {
-                    *itSecond = p * scale;
-                } else {
-                    *itSuccess = TrackingResult::Fail;
-                }
-            }
-        }
+        m_opticalFlowBatch.tracking2d(m_threadPool, success, secondPoints, firstPoints,
+                                      level + 1, m_levels_second[level], (float)(1 << level),
+                                      m_maxVelocitySquared, false);
     }
     TMath_assert(m_level0_second.data() != nullptr);
-    m_opticalFlowCalculator.setFirstImage(m_level0_first);
-    m_opticalFlowCalculator.setSecondImage(m_level0_second);
-    std::vector<Point2f>::iterator itSecond = secondPoints.begin();
-    std::vector<Point2f>::const_iterator itFirst = firstPoints.cbegin();
-    std::vector<TrackingResult>::iterator itSuccess = success.begin();
-    for ( ; itSecond != secondPoints.end(); ++itSecond, ++itFirst, ++itSuccess) {
-        if (*itSuccess == TrackingResult::Fail)
-            continue;
-        p = *itSecond;
-        prev = p;
-        *itSuccess = m_opticalFlowCalculator.tracking2d(p, *itFirst);
-        if (*itSuccess != TrackingResult::Fail) {
-            if ((p - prev).lengthSquared() < m_maxVelocitySquared) {
-                *itSecond = p;
-            } else {
-                *itSuccess = TrackingResult::Fail;
-            }
-        }
-    }
+    m_opticalFlowBatch.tracking2d(m_threadPool, success, secondPoints, firstPoints,
+                                  0, m_level0_second, 1.0f, m_maxVelocitySquared, true);
 }
 
 TrackingResult OpticalFlow::tracking2dLK(Point2f& secondPosition, const Point2f& firstPosition)
@@ -316,49 +302,16 @@ void OpticalFlow::tracking2dLK(std::vector<TrackingResult>& success,
     } else {
         std::fill(success.begin(), success.end(), TrackingResult::Completed);
     }
-    Point2f p, prev;
+    _updateFirstImagesOfBatch();
     for (int level = m_levels_second.size() - 1; level >= 0; --level) {
         TMath_assert(m_levels_second[level].data() != nullptr);
-        m_opticalFlowCalculator.setFirstImage(m_levels_first[level]);
-        m_opticalFlowCalculator.setSecondImage(m_levels_second[level]);
-        float scale = (1 << level);
-        std::vector<Point2f>::iterator itSecond = secondPoints.begin();
-        std::vector<Point2f>::const_iterator itFirst = firstPoints.cbegin();
-        std::vector<TrackingResult>::iterator itSuccess = success.begin();
-        for ( ; itSecond != secondPoints.end(); ++itSecond, ++itFirst, ++itSuccess) {
-            if (*itSuccess == TrackingResult::Fail)
-                continue;
-            p = *itSecond / scale;
-            prev = p;
-            if (m_opticalFlowCalculator.tracking2dLK(p, *itFirst / scale) != TrackingResult::Fail) {
-                if ((p - prev).lengthSquared() < m_maxVelocitySquared) {
-                    *itSecond = p * scale;
-                } else {
-                    *itSuccess = TrackingResult::Fail;
-                }
-            }
-        }
+        m_opticalFlowBatch.tracking2dLK(m_threadPool, success, secondPoints, firstPoints,
+                                        level + 1, m_levels_second[level], (float)(1 << level),
+                                        m_maxVelocitySquared, false);
     }
     TMath_assert(m_level0_second.data() != nullptr);
-    m_opticalFlowCalculator.setFirstImage(m_level0_first);
-    m_opticalFlowCalculator.setSecondImage(m_level0_second);
-    std::vector<Point2f>::iterator itSecond = secondPoints.begin();
-    std::vector<Point2f>::const_iterator itFirst = firstPoints.cbegin();
-    std::vector<TrackingResult>::iterator itSuccess = success.begin();
-    for ( ; itSecond != secondPoints.end(); ++itSecond, ++itFirst, ++itSuccess) {
-        if (*itSuccess == TrackingResult::Fail)
-            continue;
-        p = *itSecond;
-        prev = p;
-        *itSuccess = m_opticalFlowCalculator.tracking2dLK(p, *itFirst);
-        if (*itSuccess != TrackingResult::Fail) {
-            if ((p - prev).lengthSquared() < m_maxVelocitySquared) {
-                *itSecond = p;
-            } else {
-                *itSuccess = TrackingResult::Fail;
-            }
-        }
-    }
+    m_opticalFlowBatch.tracking2dLK(m_threadPool, success, secondPoints, firstPoints,
+                                    0, m_level0_second, 1.0f, m_maxVelocitySquared, true);
 }
 
 TrackingResult OpticalFlow::tracking2d_line(Point2f& secondPosition, const Point2f& firstPosition, const Point2f& line_n)
@@ -435,6 +388,19 @@ void OpticalFlow::swapFirstSecondImages()
     for (std::size_t i = 0; i < m_levels_second.size(); ++i) {
         ImageRef<uchar>::swap(m_levels_first[i], m_levels_second[i]);
     }
+    m_firstImagesOfBatchUpdated = false;
+}
+
+void OpticalFlow::_updateFirstImagesOfBatch()
+{
+    if (m_firstImagesOfBatchUpdated)
+        return;
+    std::vector<ConstImage<uchar>> firstImages(m_levels_first.size() + 1);
+    firstImages[0] = m_level0_first;
+    for (std::size_t i = 0; i < m_levels_first.size(); ++i)
+        firstImages[i + 1] = m_levels_first[i];
+    m_opticalFlowBatch.setFirstImages(firstImages);
+    m_firstImagesOfBatchUpdated = true;
 }
 
 std::vector<Image<uchar>> OpticalFlow::getCopyOfImagePyramid_first() const
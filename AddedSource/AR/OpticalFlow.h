@@ -5,6 +5,8 @@
 #include <utility>
 #include "Image.h"
 #include "OpticalFlowCalculator.h"
+#include "OpticalFlowBatch.h"
+#include "ThreadPool.h"
 
 namespace AR {
 
@@ -27,6 +29,10 @@ public:
     int countLevels() const;
     void setCountLevels(int count);
 
+    // Threads for tracking of vectors of points (and for detection of features in FeatureDetector).
+    int countThreads() const;
+    void setCountThreads(int countThreads);
+
     ConstImage<uchar> firstImageAtLevel(int level) const;
     ConstImage<uchar> secondImageAtLevel(int level) const;
 
@@ -42,6 +48,7 @@ public:
     void swapFirstSecondImages();
 
     TrackingResult tracking2d(Point2f& secondPosition, const Point2f& firstPosition);
+    // Vectors of points are tracked by OpticalFlowBatch, gradients of the first images are computed once.
     void tracking2d(std::vector<TrackingResult>& success,
                     std::vector<Point2f>& secondPoints,
                     const std::vector<Point2f>& firstPoints);
@@ -65,8 +72,13 @@ protected:
     std::vector<Image<uchar>> m_levels_first;
     std::vector<Image<uchar>> m_levels_second;
     OpticalFlowCalculator m_opticalFlowCalculator;
+    OpticalFlowBatch m_opticalFlowBatch;
+    bool m_firstImagesOfBatchUpdated;
+    ThreadPool m_threadPool;
 
     float m_maxVelocitySquared;
+
+    void _updateFirstImagesOfBatch();
 };
 
 }
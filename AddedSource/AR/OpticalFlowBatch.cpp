@@ -0,0 +1,596 @@
+#include "OpticalFlowBatch.h"
+#include "ImageProcessing.h"
+#include "TMath/TMath.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AR_OPTICALFLOWBATCH_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AR_OPTICALFLOWBATCH_AVX2
+#define AR_OPTICALFLOWBATCH_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define AR_OPTICALFLOWBATCH_AVX2
+#define AR_OPTICALFLOWBATCH_TARGET_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AR_OPTICALFLOWBATCH_NEON
+#include <arm_neon.h>
+#endif
+
+namespace AR {
+
+// Kernels interpolate a patch of the second image with weights w (TL, TR, BL, BR) and compute
+// sums[0] = sum(wdt * gradientX), sums[1] = sum(wdt * gradientY), sums[2] = sum(wdt),
+// where wdt = (pixel + offset - template) * gaussian.
+// Template, gradientX and gradientY follow each other in the patch with stride * height floats.
+// Scalar kernel processes width pixels of rows, vectorized kernels process stride pixels (stride is a multiple of 8),
+// padding pixels have zero weights.
+
+typedef void (*PatchKernel)(float* sums, const uchar* image, int imageStride, const float* w,
+                            const float* patch, const float* gaussian, int width, int stride, int height,
+                            float offset);
+
+static void accumulate_Scalar(float* sums, const uchar* image, int imageStride, const float* w,
+                              const float* patch, const float* gaussian, int width, int stride, int height,
+                              float offset)
+{
+    const int area = stride * height;
+    const float* templ = patch;
+    const float* gradientX = &patch[area];
+    const float* gradientY = &patch[area * 2];
+    const uchar* imageStr = image;
+    const uchar* imageStrNext = &image[imageStride];
+    float bx = 0.0f, by = 0.0f, bz = 0.0f;
+    float pixelValue, wdt;
+    for (int y = 0; y < height; ++y) {
+        int k = y * stride;
+        for (int x = 0; x < width; ++x, ++k) {
+            pixelValue = w[0] * imageStr[x] + w[1] * imageStr[x + 1] +
+                         w[2] * imageStrNext[x] + w[3] * imageStrNext[x + 1] + offset;
+            wdt = (pixelValue - templ[k]) * gaussian[k];
+            bx += wdt * gradientX[k];
+            by += wdt * gradientY[k];
+            bz += wdt;
+        }
+        imageStr = imageStrNext;
+        imageStrNext = &imageStrNext[imageStride];
+    }
+    sums[0] = bx;
+    sums[1] = by;
+    sums[2] = bz;
+}
+
+#if defined(AR_OPTICALFLOWBATCH_SSE2)
+
+static inline float horizontalSum_SSE2(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline __m128 load4_SSE2(const uchar* p)
+{
+    int v;
+    std::memcpy(&v, p, sizeof(int));
+    __m128i zero = _mm_setzero_si128();
+    __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero));
+}
+
+static void accumulate_SSE2(float* sums, const uchar* image, int imageStride, const float* w,
+                            const float* patch, const float* gaussian, int width, int stride, int height,
+                            float offset)
+{
+    (void)width;
+    const int area = stride * height;
+    const float* templ = patch;
+    const float* gradientX = &patch[area];
+    const float* gradientY = &patch[area * 2];
+    const __m128 wTL = _mm_set1_ps(w[0]), wTR = _mm_set1_ps(w[1]), wBL = _mm_set1_ps(w[2]), wBR = _mm_set1_ps(w[3]);
+    const __m128 vOffset = _mm_set1_ps(offset);
+    __m128 bx = _mm_setzero_ps(), by = _mm_setzero_ps(), bz = _mm_setzero_ps();
+    const uchar* imageStr = image;
+    const uchar* imageStrNext = &image[imageStride];
+    for (int y = 0; y < height; ++y) {
+        int k = y * stride;
+        for (int x = 0; x < stride; x += 4, k += 4) {
+            __m128 pixelValue = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wTL, load4_SSE2(&imageStr[x])),
+                                                      _mm_mul_ps(wTR, load4_SSE2(&imageStr[x + 1]))),
+                                           _mm_add_ps(_mm_mul_ps(wBL, load4_SSE2(&imageStrNext[x])),
+                                                      _mm_mul_ps(wBR, load4_SSE2(&imageStrNext[x + 1]))));
+            __m128 wdt = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(pixelValue, vOffset), _mm_loadu_ps(&templ[k])),
+                                    _mm_loadu_ps(&gaussian[k]));
+            bx = _mm_add_ps(bx, _mm_mul_ps(wdt, _mm_loadu_ps(&gradientX[k])));
+            by = _mm_add_ps(by, _mm_mul_ps(wdt, _mm_loadu_ps(&gradientY[k])));
+            bz = _mm_add_ps(bz, wdt);
+        }
+        imageStr = imageStrNext;
+        imageStrNext = &imageStrNext[imageStride];
+    }
+    sums[0] = horizontalSum_SSE2(bx);
+    sums[1] = horizontalSum_SSE2(by);
+    sums[2] = horizontalSum_SSE2(bz);
+}
+
+#endif
+
+#if defined(AR_OPTICALFLOWBATCH_AVX2)
+
+AR_OPTICALFLOWBATCH_TARGET_AVX2
+static inline float horizontalSum_AVX2(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(s);
+}
+
+AR_OPTICALFLOWBATCH_TARGET_AVX2
+static inline __m256 load8_AVX2(const uchar* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+
+AR_OPTICALFLOWBATCH_TARGET_AVX2
+static void accumulate_AVX2(float* sums, const uchar* image, int imageStride, const float* w,
+                            const float* patch, const float* gaussian, int width, int stride, int height,
+                            float offset)
+{
+    (void)width;
+    const int area = stride * height;
+    const float* templ = patch;
+    const float* gradientX = &patch[area];
+    const float* gradientY = &patch[area * 2];
+    const __m256 wTL = _mm256_set1_ps(w[0]), wTR = _mm256_set1_ps(w[1]);
+    const __m256 wBL = _mm256_set1_ps(w[2]), wBR = _mm256_set1_ps(w[3]);
+    const __m256 vOffset = _mm256_set1_ps(offset);
+    __m256 bx = _mm256_setzero_ps(), by = _mm256_setzero_ps(), bz = _mm256_setzero_ps();
+    const uchar* imageStr = image;
+    const uchar* imageStrNext = &image[imageStride];
+    for (int y = 0; y < height; ++y) {
+        int k = y * stride;
+        for (int x = 0; x < stride; x += 8, k += 8) {
+            __m256 pixelValue = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wTL, load8_AVX2(&imageStr[x])),
+                                                            _mm256_mul_ps(wTR, load8_AVX2(&imageStr[x + 1]))),
+                                              _mm256_add_ps(_mm256_mul_ps(wBL, load8_AVX2(&imageStrNext[x])),
+                                                            _mm256_mul_ps(wBR, load8_AVX2(&imageStrNext[x + 1]))));
+            __m256 wdt = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(pixelValue, vOffset),
+                                                     _mm256_loadu_ps(&templ[k])),
+                                       _mm256_loadu_ps(&gaussian[k]));
+            bx = _mm256_add_ps(bx, _mm256_mul_ps(wdt, _mm256_loadu_ps(&gradientX[k])));
+            by = _mm256_add_ps(by, _mm256_mul_ps(wdt, _mm256_loadu_ps(&gradientY[k])));
+            bz = _mm256_add_ps(bz, wdt);
+        }
+        imageStr = imageStrNext;
+        imageStrNext = &imageStrNext[imageStride];
+    }
+    sums[0] = horizontalSum_AVX2(bx);
+    sums[1] = horizontalSum_AVX2(by);
+    sums[2] = horizontalSum_AVX2(bz);
+}
+
+#endif
+
+#if defined(AR_OPTICALFLOWBATCH_NEON)
+
+static inline float horizontalSum_NEON(float32x4_t v)
+{
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+static void accumulate_NEON(float* sums, const uchar* image, int imageStride, const float* w,
+                            const float* patch, const float* gaussian, int width, int stride, int height,
+                            float offset)
+{
+    (void)width;
+    const int area = stride * height;
+    const float* templ = patch;
+    const float* gradientX = &patch[area];
+    const float* gradientY = &patch[area * 2];
+    const float32x4_t vOffset = vdupq_n_f32(offset);
+    float32x4_t bx = vdupq_n_f32(0.0f), by = vdupq_n_f32(0.0f), bz = vdupq_n_f32(0.0f);
+    const uchar* imageStr = image;
+    const uchar* imageStrNext = &image[imageStride];
+    for (int y = 0; y < height; ++y) {
+        int k = y * stride;
+        for (int x = 0; x < stride; x += 8) {
+            uint16x8_t tl = vmovl_u8(vld1_u8(&imageStr[x]));
+            uint16x8_t tr = vmovl_u8(vld1_u8(&imageStr[x + 1]));
+            uint16x8_t bl = vmovl_u8(vld1_u8(&imageStrNext[x]));
+            uint16x8_t br = vmovl_u8(vld1_u8(&imageStrNext[x + 1]));
+            for (int h = 0; h < 2; ++h, k += 4) {
+                float32x4_t pixelValue = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(tl) : vget_low_u16(tl))), w[0]);
+                pixelValue = vmlaq_n_f32(pixelValue, vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(tr) : vget_low_u16(tr))), w[1]);
+                pixelValue = vmlaq_n_f32(pixelValue, vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(bl) : vget_low_u16(bl))), w[2]);
+                pixelValue = vmlaq_n_f32(pixelValue, vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(br) : vget_low_u16(br))), w[3]);
+                float32x4_t wdt = vmulq_f32(vsubq_f32(vaddq_f32(pixelValue, vOffset), vld1q_f32(&templ[k])),
+                                            vld1q_f32(&gaussian[k]));
+                bx = vmlaq_f32(bx, wdt, vld1q_f32(&gradientX[k]));
+                by = vmlaq_f32(by, wdt, vld1q_f32(&gradientY[k]));
+                bz = vaddq_f32(bz, wdt);
+            }
+        }
+        imageStr = imageStrNext;
+        imageStrNext = &imageStrNext[imageStride];
+    }
+    sums[0] = horizontalSum_NEON(bx);
+    sums[1] = horizontalSum_NEON(by);
+    sums[2] = horizontalSum_NEON(bz);
+}
+
+#endif
+
+static PatchKernel selectPatchKernel()
+{
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_OPTICALFLOWBATCH_AVX2)
+    case ImageProcessing::InstructionSet::AVX2:
+        return accumulate_AVX2;
+#endif
+#if defined(AR_OPTICALFLOWBATCH_SSE2)
+#if !defined(AR_OPTICALFLOWBATCH_AVX2)
+    case ImageProcessing::InstructionSet::AVX2:
+#endif
+    case ImageProcessing::InstructionSet::SSE2:
+        return accumulate_SSE2;
+#endif
+#if defined(AR_OPTICALFLOWBATCH_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        return accumulate_NEON;
+#endif
+    default:
+        break;
+    }
+    return accumulate_Scalar;
+}
+
+static void computeGradients(Image<float>& gradientX, Image<float>& gradientY, const ImageRef<uchar>& image)
+{
+    if (gradientX.size() != image.size()) {
+        gradientX = Image<float>(image.size());
+        gradientY = Image<float>(image.size());
+    }
+    const int width = image.width(), height = image.height();
+    std::fill(gradientX.data(), gradientX.data() + width, 0.0f);
+    std::fill(gradientY.data(), gradientY.data() + width, 0.0f);
+    for (int y = 1; y < height - 1; ++y) {
+        const uchar* str = image.pointer(0, y);
+        const uchar* strPrev = &str[-width];
+        const uchar* strNext = &str[width];
+        float* gradientXStr = gradientX.pointer(0, y);
+        float* gradientYStr = gradientY.pointer(0, y);
+        gradientXStr[0] = gradientYStr[0] = 0.0f;
+        for (int x = 1; x < width - 1; ++x) {
+            gradientXStr[x] = (str[x + 1] - str[x - 1]) * 0.5f;
+            gradientYStr[x] = (strNext[x] - strPrev[x]) * 0.5f;
+        }
+        gradientXStr[width - 1] = gradientYStr[width - 1] = 0.0f;
+    }
+    std::fill(gradientX.pointer(0, height - 1), gradientX.pointer(0, height - 1) + width, 0.0f);
+    std::fill(gradientY.pointer(0, height - 1), gradientY.pointer(0, height - 1) + width, 0.0f);
+}
+
+OpticalFlowBatch::OpticalFlowBatch()
+{
+    m_numberIterations = 8;
+    m_pixelEps = 1e-2f;
+    setCursorSize(Point2i(4, 4));
+}
+
+Point2i OpticalFlowBatch::cursorSize() const
+{
+    return m_cursorSize;
+}
+
+void OpticalFlowBatch::setCursorSize(const Point2i& cursorSize)
+{
+    assert((cursorSize.x > 0) && (cursorSize.y > 0));
+    m_cursorSize = cursorSize;
+    m_pathSize = m_cursorSize * 2 + Point2i(1, 1);
+    m_pathStride = (m_pathSize.x + 7) & ~7;
+    // the same gaussian as in OpticalFlowCalculator, padding pixels have zero weights
+    float sigmaGaussian = std::max(m_cursorSize.x, m_cursorSize.y) / 2.5f;
+    float sigmaSquare = sigmaGaussian * sigmaGaussian;
+    float k1 = (float)(1.0 / (2.0 * M_PI * sigmaSquare));
+    float invK2 = 1.0f / (2.0f * sigmaSquare);
+    m_gaussian.assign(m_pathStride * m_pathSize.y, 0.0f);
+    Point2i p;
+    for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
+        float* gaussianStr = &m_gaussian[(p.y + m_cursorSize.y) * m_pathStride + m_cursorSize.x];
+        for (p.x = - m_cursorSize.x; p.x <= m_cursorSize.x; ++p.x)
+            gaussianStr[p.x] = k1 * std::exp(- p.lengthSquared() * invK2);
+    }
+    m_buffers.clear();
+}
+
+int OpticalFlowBatch::numberIterations() const
+{
+    return m_numberIterations;
+}
+
+void OpticalFlowBatch::setNumberIterations(int numberIterations)
+{
+    m_numberIterations = numberIterations;
+}
+
+float OpticalFlowBatch::pixelEps() const
+{
+    return m_pixelEps;
+}
+
+void OpticalFlowBatch::setPixelEps(float pixelEps)
+{
+    m_pixelEps = std::fabs(pixelEps);
+}
+
+void OpticalFlowBatch::setFirstImages(const std::vector<ConstImage<uchar>>& firstImages)
+{
+    m_firstImages.resize(firstImages.size());
+    for (std::size_t i = 0; i < firstImages.size(); ++i) {
+        FirstImage& first = m_firstImages[i];
+        first.image = firstImages[i];
+        computeGradients(first.gradientX, first.gradientY, first.image);
+    }
+}
+
+void OpticalFlowBatch::clear()
+{
+    m_firstImages.clear();
+}
+
+void OpticalFlowBatch::tracking2d(ThreadPool& threadPool,
+                                  std::vector<TrackingResult>& success,
+                                  std::vector<Point2f>& secondPoints,
+                                  const std::vector<Point2f>& firstPoints,
+                                  int firstIndex, const ImageRef<uchar>& secondImage,
+                                  float scale, float maxVelocitySquared, bool lastLevel)
+{
+    _tracking(threadPool, false, success, secondPoints, firstPoints,
+              firstIndex, secondImage, scale, maxVelocitySquared, lastLevel);
+}
+
+void OpticalFlowBatch::tracking2dLK(ThreadPool& threadPool,
+                                    std::vector<TrackingResult>& success,
+                                    std::vector<Point2f>& secondPoints,
+                                    const std::vector<Point2f>& firstPoints,
+                                    int firstIndex, const ImageRef<uchar>& secondImage,
+                                    float scale, float maxVelocitySquared, bool lastLevel)
+{
+    _tracking(threadPool, true, success, secondPoints, firstPoints,
+              firstIndex, secondImage, scale, maxVelocitySquared, lastLevel);
+}
+
+void OpticalFlowBatch::_tracking(ThreadPool& threadPool, bool LK,
+                                 std::vector<TrackingResult>& success,
+                                 std::vector<Point2f>& secondPoints,
+                                 const std::vector<Point2f>& firstPoints,
+                                 int firstIndex, const ImageRef<uchar>& secondImage,
+                                 float scale, float maxVelocitySquared, bool lastLevel)
+{
+    TMath_assert((firstIndex >= 0) && (firstIndex < (int)m_firstImages.size()));
+    TMath_assert((success.size() == secondPoints.size()) && (secondPoints.size() == firstPoints.size()));
+    const FirstImage& first = m_firstImages[firstIndex];
+    const int countPoints = (int)secondPoints.size();
+    const int countTasks = std::max(std::min(threadPool.countThreads(), countPoints), 1);
+    if ((int)m_buffers.size() < countTasks)
+        m_buffers.resize(countTasks);
+    const std::size_t bufferSize = m_pathStride * m_pathSize.y * 3;
+    threadPool.run(countTasks, [&, this] (int task) {
+        std::vector<float>& buffer = m_buffers[task];
+        if (buffer.size() != bufferSize)
+            buffer.assign(bufferSize, 0.0f);
+        int end = (int)(((long long)countPoints * (task + 1)) / countTasks);
+        Point2f p, prev;
+        for (int i = (int)(((long long)countPoints * task) / countTasks); i < end; ++i) {
+            if (success[i] == TrackingResult::Fail)
+                continue;
+            p = secondPoints[i] / scale;
+            prev = p;
+            TrackingResult result = LK ?
+                        _tracking2dLK(p, firstPoints[i] / scale, buffer.data(), first, secondImage) :
+                        _tracking2d(p, firstPoints[i] / scale, buffer.data(), first, secondImage);
+            if (lastLevel)
+                success[i] = result;
+            if (result != TrackingResult::Fail) {
+                if ((p - prev).lengthSquared() < maxVelocitySquared) {
+                    secondPoints[i] = p * scale;
+                } else {
+                    success[i] = TrackingResult::Fail;
+                }
+            }
+        }
+    });
+}
+
+void OpticalFlowBatch::_getPatch(float* patch, const FirstImage& first, const Point2f& beginPoint) const
+{
+    Point2i beginPoint_i((int)std::floor(beginPoint.x), (int)std::floor(beginPoint.y));
+    TMath_assert((beginPoint_i.x >= 0) && (beginPoint_i.y >= 0));
+    TMath_assert(((beginPoint_i.x + m_pathSize.x + 1) <= first.image.width()) &&
+                 ((beginPoint_i.y + m_pathSize.y + 1) <= first.image.height()));
+    Point2f sub_pix(beginPoint.x - beginPoint_i.x, beginPoint.y - beginPoint_i.y);
+    // interpolation weights
+    const float wTL = (1.0f - sub_pix.x) * (1.0f - sub_pix.y);
+    const float wTR = sub_pix.x * (1.0f - sub_pix.y);
+    const float wBL = (1.0f - sub_pix.x) * sub_pix.y;
+    const float wBR = sub_pix.x * sub_pix.y;
+
+    const int width = first.image.width();
+    const int area = m_pathStride * m_pathSize.y;
+    float* templ = patch;
+    float* gradientX = &patch[area];
+    float* gradientY = &patch[area * 2];
+    const uchar* imageStr = first.image.pointer(beginPoint_i);
+    const float* gradientXStr = first.gradientX.pointer(beginPoint_i);
+    const float* gradientYStr = first.gradientY.pointer(beginPoint_i);
+    for (int y = 0; y < m_pathSize.y; ++y) {
+        int k = y * m_pathStride;
+        for (int x = 0; x < m_pathSize.x; ++x, ++k) {
+            templ[k] = wTL * imageStr[x] + wTR * imageStr[x + 1] +
+                       wBL * imageStr[x + width] + wBR * imageStr[x + width + 1];
+            gradientX[k] = wTL * gradientXStr[x] + wTR * gradientXStr[x + 1] +
+                           wBL * gradientXStr[x + width] + wBR * gradientXStr[x + width + 1];
+            gradientY[k] = wTL * gradientYStr[x] + wTR * gradientYStr[x + 1] +
+                           wBL * gradientYStr[x + width] + wBR * gradientYStr[x + width + 1];
+        }
+        imageStr = &imageStr[width];
+        gradientXStr = &gradientXStr[width];
+        gradientYStr = &gradientYStr[width];
+    }
+}
+
+TrackingResult OpticalFlowBatch::_tracking2d(Point2f& position, const Point2f& imagePosition, float* patch,
+                                             const FirstImage& first, const ImageRef<uchar>& secondImage) const
+{
+    const Point2i begin = m_cursorSize + Point2i(2, 2);
+    Point2i end = first.image.size() - (m_cursorSize + Point2i(3, 3));
+    if ((imagePosition.x < begin.x) || (imagePosition.y < begin.y) ||
+        (imagePosition.x >= end.x) || (imagePosition.y >= end.y))
+        return TrackingResult::Fail;
+    // the template of OpticalFlowCalculator is shifted by half of pixel, it's kept for the same results
+    _getPatch(patch, first, Point2f(imagePosition.x - (m_cursorSize.x + 0.5f),
+                                    imagePosition.y - (m_cursorSize.y + 0.5f)));
+
+    const int area = m_pathStride * m_pathSize.y;
+    const float* gradientX = &patch[area];
+    const float* gradientY = &patch[area * 2];
+    TMath::TMatrixf H(3, 3);
+    H.setZero();
+    for (int k = 0; k < area; ++k) {
+        float g = m_gaussian[k];
+        float wdx = gradientX[k] * g, wdy = gradientY[k] * g;
+        H(0, 0) += gradientX[k] * wdx;
+        H(0, 1) += gradientX[k] * wdy;
+        H(0, 2) += wdx;
+        H(1, 1) += gradientY[k] * wdy;
+        H(1, 2) += wdy;
+        H(2, 2) += g;
+    }
+    H(1, 0) = H(0, 1);
+    H(2, 0) = H(0, 2);
+    H(2, 1) = H(1, 2);
+
+    if (!TMath::TTools::matrix3x3Invert(H))
+        return TrackingResult::Fail;
+
+    PatchKernel kernel = selectPatchKernel();
+    end = secondImage.size() - (m_cursorSize + Point2i(3, 3));
+    Point2i position_i;
+    Point2f sub_pix;
+    float w[4], sums[3];
+    float mean_diff = 0.0f;
+    Point2f prevDelta;
+    for (int iteration = 0; iteration < m_numberIterations; ++iteration) {
+        position_i.x = (int)std::floor(position.x);
+        position_i.y = (int)std::floor(position.y);
+
+        if ((position_i.x < begin.x) || (position_i.y < begin.y) ||
+            (position_i.x >= end.x) || (position_i.y >= end.y))
+            return TrackingResult::Fail;
+
+        // compute interpolation weights
+        sub_pix.x = position.x - position_i.x;
+        sub_pix.y = position.y - position_i.y;
+
+        w[0] = (1.0f - sub_pix.x) * (1.0f - sub_pix.y);
+        w[1] = sub_pix.x * (1.0f - sub_pix.y);
+        w[2] = (1.0f - sub_pix.x) * sub_pix.y;
+        w[3] = sub_pix.x * sub_pix.y;
+
+        kernel(sums, secondImage.pointer(position_i - m_cursorSize), secondImage.width(), w,
+               patch, m_gaussian.data(), m_pathSize.x, m_pathStride, m_pathSize.y, mean_diff);
+
+        Point2f delta(H(0, 0) * sums[0] + H(0, 1) * sums[1] + H(0, 2) * sums[2],
+                      H(1, 0) * sums[0] + H(1, 1) * sums[1] + H(1, 2) * sums[2]);
+        position -= delta;
+        mean_diff += H(2, 0) * sums[0] + H(2, 1) * sums[1] + H(2, 2) * sums[2];
+
+        if (iteration > 0) {
+            if ((std::fabs(delta.x + prevDelta.x) < m_pixelEps) && (std::fabs(delta.y + prevDelta.y) < m_pixelEps)) {
+                return TrackingResult::Completed;
+            }
+        }
+        prevDelta = delta;
+    }
+    return TrackingResult::Uncompleted;
+}
+
+TrackingResult OpticalFlowBatch::_tracking2dLK(Point2f& position, const Point2f& imagePosition, float* patch,
+                                               const FirstImage& first, const ImageRef<uchar>& secondImage) const
+{
+    const Point2i begin = m_cursorSize + Point2i(2, 2);
+    Point2i end = first.image.size() - (m_cursorSize + Point2i(3, 3));
+    if ((imagePosition.x < begin.x) || (imagePosition.y < begin.y) ||
+        (imagePosition.x >= end.x) || (imagePosition.y >= end.y))
+        return TrackingResult::Fail;
+    // the template of OpticalFlowCalculator is shifted by half of pixel, it's kept for the same results
+    _getPatch(patch, first, Point2f(imagePosition.x - (m_cursorSize.x + 0.5f),
+                                    imagePosition.y - (m_cursorSize.y + 0.5f)));
+
+    const int area = m_pathStride * m_pathSize.y;
+    const float* gradientX = &patch[area];
+    const float* gradientY = &patch[area * 2];
+    float Dxx = 0.0f, Dxy = 0.0f, Dyy = 0.0f;
+    for (int k = 0; k < area; ++k) {
+        float wdx = gradientX[k] * m_gaussian[k];
+        Dxx += gradientX[k] * wdx;
+        Dxy += gradientY[k] * wdx;
+        Dyy += gradientY[k] * gradientY[k] * m_gaussian[k];
+    }
+    float det = Dxx * Dyy - Dxy * Dxy;
+    if (std::fabs(det) < 1e-5)
+        return TrackingResult::Fail;
+
+    float t = Dxx;
+    Dxx = Dyy / det;
+    Dyy = t / det;
+    Dxy = - Dxy / det;
+
+    PatchKernel kernel = selectPatchKernel();
+    end = secondImage.size() - (m_cursorSize + Point2i(3, 3));
+    Point2i position_i;
+    Point2f sub_pix;
+    float w[4], sums[3];
+    Point2f delta, prevDelta;
+    for (int iteration = 0; iteration < m_numberIterations; ++iteration) {
+        position_i.x = (int)std::floor(position.x);
+        position_i.y = (int)std::floor(position.y);
+
+        if ((position_i.x < begin.x) || (position_i.y < begin.y) ||
+            (position_i.x >= end.x) || (position_i.y >= end.y))
+            return TrackingResult::Fail;
+
+        // compute interpolation weights
+        sub_pix.x = position.x - position_i.x;
+        sub_pix.y = position.y - position_i.y;
+
+        w[0] = (1.0f - sub_pix.x) * (1.0f - sub_pix.y);
+        w[1] = sub_pix.x * (1.0f - sub_pix.y);
+        w[2] = (1.0f - sub_pix.x) * sub_pix.y;
+        w[3] = sub_pix.x * sub_pix.y;
+
+        kernel(sums, secondImage.pointer(position_i - m_cursorSize), secondImage.width(), w,
+               patch, m_gaussian.data(), m_pathSize.x, m_pathStride, m_pathSize.y, 0.0f);
+
+        delta.set(Dxx * sums[0] + Dxy * sums[1], Dxy * sums[0] + Dyy * sums[1]);
+        position -= delta;
+
+        if (iteration > 0) {
+            if ((std::fabs(delta.x + prevDelta.x) < m_pixelEps) && (std::fabs(delta.y + prevDelta.y) < m_pixelEps)) {
+                return TrackingResult::Completed;
+            }
+        }
+        prevDelta = delta;
+    }
+    return TrackingResult::Uncompleted;
+}
+
+}
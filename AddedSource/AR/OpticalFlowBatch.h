@@ -0,0 +1,84 @@
+#ifndef AR_OPTICALFLOWBATCH_H
+#define AR_OPTICALFLOWBATCH_H
+
+#include <vector>
+#include "Image.h"
+#include "OpticalFlowCalculator.h"
+#include "ThreadPool.h"
+
+namespace AR {
+
+// Tracking of many points on one level of image pyramids, it's the batched variant of
+// OpticalFlowCalculator::tracking2d() and OpticalFlowCalculator::tracking2dLK() for OpticalFlow.
+// Gradients of first images are computed once by setFirstImages(), patches of points are interpolated from them,
+// so unlike OpticalFlowCalculator patches aren't rounded to bytes and results can differ a bit.
+// Rows of patches are processed by kernels of the instruction set selected by ImageProcessing::setInstructionSet().
+// Points are split into contiguous parts for threads, every point is tracked independently,
+// so results don't depend on count of threads.
+class OpticalFlowBatch
+{
+public:
+    OpticalFlowBatch();
+
+    Point2i cursorSize() const;
+    void setCursorSize(const Point2i& cursorSize);
+
+    int numberIterations() const;
+    void setNumberIterations(int numberIterations);
+
+    float pixelEps() const;
+    void setPixelEps(float pixelEps);
+
+    // Images of the first pyramid, images are referenced (not copied), gradients are computed.
+    void setFirstImages(const std::vector<ConstImage<uchar>>& firstImages);
+    void clear();
+
+    // Tracks points from the first image with index firstIndex to secondImage, positions are divided by scale.
+    // If lastLevel then success gets results of tracking, else only failed points (by maxVelocitySquared) are marked.
+    void tracking2d(ThreadPool& threadPool,
+                    std::vector<TrackingResult>& success,
+                    std::vector<Point2f>& secondPoints,
+                    const std::vector<Point2f>& firstPoints,
+                    int firstIndex, const ImageRef<uchar>& secondImage,
+                    float scale, float maxVelocitySquared, bool lastLevel);
+    void tracking2dLK(ThreadPool& threadPool,
+                      std::vector<TrackingResult>& success,
+                      std::vector<Point2f>& secondPoints,
+                      const std::vector<Point2f>& firstPoints,
+                      int firstIndex, const ImageRef<uchar>& secondImage,
+                      float scale, float maxVelocitySquared, bool lastLevel);
+
+private:
+    struct FirstImage {
+        ConstImage<uchar> image;
+        Image<float> gradientX;
+        Image<float> gradientY;
+    };
+
+    Point2i m_cursorSize;
+    Point2i m_pathSize;
+    int m_pathStride;
+    std::vector<float> m_gaussian;
+    int m_numberIterations;
+    float m_pixelEps;
+
+    std::vector<FirstImage> m_firstImages;
+    // template, gradientX and gradientY of a patch for every task
+    std::vector<std::vector<float>> m_buffers;
+
+    void _tracking(ThreadPool& threadPool, bool LK,
+                   std::vector<TrackingResult>& success,
+                   std::vector<Point2f>& secondPoints,
+                   const std::vector<Point2f>& firstPoints,
+                   int firstIndex, const ImageRef<uchar>& secondImage,
+                   float scale, float maxVelocitySquared, bool lastLevel);
+    void _getPatch(float* patch, const FirstImage& first, const Point2f& beginPoint) const;
+    TrackingResult _tracking2d(Point2f& position, const Point2f& imagePosition, float* patch,
+                               const FirstImage& first, const ImageRef<uchar>& secondImage) const;
+    TrackingResult _tracking2dLK(Point2f& position, const Point2f& imagePosition, float* patch,
+                                 const FirstImage& first, const ImageRef<uchar>& secondImage) const;
+};
+
+}
+
+#endif // AR_OPTICALFLOWBATCH_H
@@ -0,0 +1,572 @@
+#include "PatchComparison.h"
+#include "ImageProcessing.h"
+#include "TMath/TMath.h"
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AR_PATCHCOMPARISON_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AR_PATCHCOMPARISON_AVX2
+#define AR_PATCHCOMPARISON_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define AR_PATCHCOMPARISON_AVX2
+#define AR_PATCHCOMPARISON_TARGET_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AR_PATCHCOMPARISON_NEON
+#include <arm_neon.h>
+#endif
+
+namespace AR {
+
+// Sums of pixels of two areas, they give SSD, ZMSSD and NCC.
+struct PatchSums
+{
+    int a;
+    int b;
+    int aa;
+    int bb;
+    int ab;
+};
+
+// Kernels get pointers to top-left pixels of areas and widths of images as strides.
+// Vector kernels process columns by groups and the rest of columns by scalar code.
+
+template <typename Type>
+static int ssdColumns_Scalar(const Type * a, const Type * b, int begin, int width)
+{
+    int sum = 0, d;
+    for (int x = begin; x < width; ++x) {
+        d = a[x] - b[x];
+        sum += d * d;
+    }
+    return sum;
+}
+
+template <typename Type>
+static void sumsColumns_Scalar(PatchSums & sums, const Type * a, const Type * b, int begin, int width)
+{
+    for (int x = begin; x < width; ++x) {
+        sums.a += a[x];
+        sums.b += b[x];
+        sums.aa += a[x] * a[x];
+        sums.bb += b[x] * b[x];
+        sums.ab += a[x] * b[x];
+    }
+}
+
+template <typename Type>
+static int ssd_Scalar(const Type * a, int strideA, const Type * b, int strideB, int width, int height)
+{
+    int sum = 0;
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB)
+        sum += ssdColumns_Scalar(a, b, 0, width);
+    return sum;
+}
+
+template <typename Type>
+static PatchSums sums_Scalar(const Type * a, int strideA, const Type * b, int strideB, int width, int height)
+{
+    PatchSums sums = { 0, 0, 0, 0, 0 };
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB)
+        sumsColumns_Scalar(sums, a, b, 0, width);
+    return sums;
+}
+
+#if defined(AR_PATCHCOMPARISON_SSE2)
+
+static inline int horizontalSum_SSE2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static inline __m128i load8_SSE2(const uchar * p)
+{
+    return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline __m128i load8x2_SSE2(const uchar * p, int stride)
+{
+    return _mm_unpacklo_epi64(load8_SSE2(p), load8_SSE2(&p[stride]));
+}
+
+// Mask of the last width % 8 bytes of 8 bytes, the tail of row is loaded from (width - 8) and
+// the bytes that were already processed are cleared.
+static inline __m128i tailMask_SSE2(int width)
+{
+    const int rest = width % 8;
+    const unsigned long long mask = (rest == 0) ? 0ULL : (~0ULL << ((8 - rest) * 8));
+    return _mm_set_epi32(0, 0, (int)(mask >> 32), (int)(mask & 0xFFFFFFFFULL));
+}
+
+static int ssd8x8_SSE2(const uchar * a, int strideA, const uchar * b, int strideB)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (int y = 0; y < 8; y += 2, a += strideA * 2, b += strideB * 2) {
+        __m128i va = load8x2_SSE2(a, strideA);
+        __m128i vb = load8x2_SSE2(b, strideB);
+        __m128i dLow = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+        __m128i dHigh = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(dLow, dLow), _mm_madd_epi16(dHigh, dHigh)));
+    }
+    return horizontalSum_SSE2(sum);
+}
+
+static int ssd_SSE2(const uchar * a, int strideA, const uchar * b, int strideB, int width, int height)
+{
+    if ((width == 8) && (height == 8))
+        return ssd8x8_SSE2(a, strideA, b, strideB);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    int tail = 0;
+    const int end = width - (width % 8);
+    const bool maskedTail = (end != width) && (width > 8);
+    const __m128i mask = tailMask_SSE2(width);
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < end; x += 8) {
+            __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(load8_SSE2(&a[x]), zero),
+                                      _mm_unpacklo_epi8(load8_SSE2(&b[x]), zero));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(d, d));
+        }
+        if (maskedTail) {
+            __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_and_si128(load8_SSE2(&a[width - 8]), mask), zero),
+                                      _mm_unpacklo_epi8(_mm_and_si128(load8_SSE2(&b[width - 8]), mask), zero));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(d, d));
+        } else {
+            tail += ssdColumns_Scalar(a, b, end, width);
+        }
+    }
+    return horizontalSum_SSE2(sum) + tail;
+}
+
+// 16 pixels of every area in 16-bit lanes
+static inline void accumulateSums_SSE2(__m128i & sumA, __m128i & sumB,
+                                       __m128i & sumAA, __m128i & sumBB, __m128i & sumAB,
+                                       __m128i va, __m128i vb, __m128i zero)
+{
+    sumA = _mm_add_epi64(sumA, _mm_sad_epu8(va, zero));
+    sumB = _mm_add_epi64(sumB, _mm_sad_epu8(vb, zero));
+    __m128i aLow = _mm_unpacklo_epi8(va, zero), aHigh = _mm_unpackhi_epi8(va, zero);
+    __m128i bLow = _mm_unpacklo_epi8(vb, zero), bHigh = _mm_unpackhi_epi8(vb, zero);
+    sumAA = _mm_add_epi32(sumAA, _mm_add_epi32(_mm_madd_epi16(aLow, aLow), _mm_madd_epi16(aHigh, aHigh)));
+    sumBB = _mm_add_epi32(sumBB, _mm_add_epi32(_mm_madd_epi16(bLow, bLow), _mm_madd_epi16(bHigh, bHigh)));
+    sumAB = _mm_add_epi32(sumAB, _mm_add_epi32(_mm_madd_epi16(aLow, bLow), _mm_madd_epi16(aHigh, bHigh)));
+}
+
+static PatchSums sums_SSE2(const uchar * a, int strideA, const uchar * b, int strideB, int width, int height)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sumA = zero, sumB = zero, sumAA = zero, sumBB = zero, sumAB = zero;
+    PatchSums sums = { 0, 0, 0, 0, 0 };
+    if ((width == 8) && (height == 8)) {
+        for (int y = 0; y < 8; y += 2, a += strideA * 2, b += strideB * 2)
+            accumulateSums_SSE2(sumA, sumB, sumAA, sumBB, sumAB,
+                                load8x2_SSE2(a, strideA), load8x2_SSE2(b, strideB), zero);
+    } else {
+        const int end = width - (width % 8);
+        const bool maskedTail = (end != width) && (width > 8);
+        const __m128i mask = tailMask_SSE2(width);
+        for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+            for (int x = 0; x < end; x += 8)
+                // the high half is zero, so it doesn't change sums
+                accumulateSums_SSE2(sumA, sumB, sumAA, sumBB, sumAB,
+                                    load8_SSE2(&a[x]), load8_SSE2(&b[x]), zero);
+            if (maskedTail) {
+                accumulateSums_SSE2(sumA, sumB, sumAA, sumBB, sumAB,
+                                    _mm_and_si128(load8_SSE2(&a[width - 8]), mask),
+                                    _mm_and_si128(load8_SSE2(&b[width - 8]), mask), zero);
+            } else {
+                sumsColumns_Scalar(sums, a, b, end, width);
+            }
+        }
+    }
+    sums.a += _mm_cvtsi128_si32(_mm_add_epi64(sumA, _mm_unpackhi_epi64(sumA, sumA)));
+    sums.b += _mm_cvtsi128_si32(_mm_add_epi64(sumB, _mm_unpackhi_epi64(sumB, sumB)));
+    sums.aa += horizontalSum_SSE2(sumAA);
+    sums.bb += horizontalSum_SSE2(sumBB);
+    sums.ab += horizontalSum_SSE2(sumAB);
+    return sums;
+}
+
+#endif
+
+#if defined(AR_PATCHCOMPARISON_AVX2)
+
+AR_PATCHCOMPARISON_TARGET_AVX2
+static inline int horizontalSum_AVX2(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+AR_PATCHCOMPARISON_TARGET_AVX2
+static int ssd_AVX2(const int * a, int strideA, const int * b, int strideB, int width, int height)
+{
+    __m256i sum = _mm256_setzero_si256();
+    int tail = 0;
+    const int end = width - (width % 8);
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < end; x += 8) {
+            __m256i d = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&a[x])),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&b[x])));
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(d, d));
+        }
+        tail += ssdColumns_Scalar(a, b, end, width);
+    }
+    return horizontalSum_AVX2(sum) + tail;
+}
+
+AR_PATCHCOMPARISON_TARGET_AVX2
+static PatchSums sums_AVX2(const int * a, int strideA, const int * b, int strideB, int width, int height)
+{
+    __m256i sumA = _mm256_setzero_si256(), sumB = sumA, sumAA = sumA, sumBB = sumA, sumAB = sumA;
+    PatchSums sums = { 0, 0, 0, 0, 0 };
+    const int end = width - (width % 8);
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < end; x += 8) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&a[x]));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&b[x]));
+            sumA = _mm256_add_epi32(sumA, va);
+            sumB = _mm256_add_epi32(sumB, vb);
+            sumAA = _mm256_add_epi32(sumAA, _mm256_mullo_epi32(va, va));
+            sumBB = _mm256_add_epi32(sumBB, _mm256_mullo_epi32(vb, vb));
+            sumAB = _mm256_add_epi32(sumAB, _mm256_mullo_epi32(va, vb));
+        }
+        sumsColumns_Scalar(sums, a, b, end, width);
+    }
+    sums.a += horizontalSum_AVX2(sumA);
+    sums.b += horizontalSum_AVX2(sumB);
+    sums.aa += horizontalSum_AVX2(sumAA);
+    sums.bb += horizontalSum_AVX2(sumBB);
+    sums.ab += horizontalSum_AVX2(sumAB);
+    return sums;
+}
+
+#endif
+
+#if defined(AR_PATCHCOMPARISON_NEON)
+
+static inline int horizontalSum_NEON(int32x4_t v)
+{
+    int32x2_t s = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+    return vget_lane_s32(vpadd_s32(s, s), 0);
+}
+
+static inline int horizontalSum_NEON(uint32x4_t v)
+{
+    return horizontalSum_NEON(vreinterpretq_s32_u32(v));
+}
+
+static int ssd_NEON(const uchar * a, int strideA, const uchar * b, int strideB, int width, int height)
+{
+    int32x4_t sum = vdupq_n_s32(0);
+    int tail = 0;
+    const int end = width - (width % 8);
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < end; x += 8) {
+            int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(&a[x]), vld1_u8(&b[x])));
+            sum = vmlal_s16(sum, vget_low_s16(d), vget_low_s16(d));
+            sum = vmlal_s16(sum, vget_high_s16(d), vget_high_s16(d));
+        }
+        tail += ssdColumns_Scalar(a, b, end, width);
+    }
+    return horizontalSum_NEON(sum) + tail;
+}
+
+static PatchSums sums_NEON(const uchar * a, int strideA, const uchar * b, int strideB, int width, int height)
+{
+    uint32x4_t sumA = vdupq_n_u32(0), sumB = sumA, sumAA = sumA, sumBB = sumA, sumAB = sumA;
+    PatchSums sums = { 0, 0, 0, 0, 0 };
+    const int end = width - (width % 8);
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < end; x += 8) {
+            uint16x8_t va = vmovl_u8(vld1_u8(&a[x]));
+            uint16x8_t vb = vmovl_u8(vld1_u8(&b[x]));
+            sumA = vpadalq_u16(sumA, va);
+            sumB = vpadalq_u16(sumB, vb);
+            sumAA = vmlal_u16(vmlal_u16(sumAA, vget_low_u16(va), vget_low_u16(va)), vget_high_u16(va), vget_high_u16(va));
+            sumBB = vmlal_u16(vmlal_u16(sumBB, vget_low_u16(vb), vget_low_u16(vb)), vget_high_u16(vb), vget_high_u16(vb));
+            sumAB = vmlal_u16(vmlal_u16(sumAB, vget_low_u16(va), vget_low_u16(vb)), vget_high_u16(va), vget_high_u16(vb));
+        }
+        sumsColumns_Scalar(sums, a, b, end, width);
+    }
+    sums.a += horizontalSum_NEON(sumA);
+    sums.b += horizontalSum_NEON(sumB);
+    sums.aa += horizontalSum_NEON(sumAA);
+    sums.bb += horizontalSum_NEON(sumBB);
+    sums.ab += horizontalSum_NEON(sumAB);
+    return sums;
+}
+
+static int ssd_NEON(const int * a, int strideA, const int * b, int strideB, int width, int height)
+{
+    int32x4_t sum = vdupq_n_s32(0);
+    int tail = 0;
+    const int end = width - (width % 4);
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < end; x += 4) {
+            int32x4_t d = vsubq_s32(vld1q_s32(&a[x]), vld1q_s32(&b[x]));
+            sum = vmlaq_s32(sum, d, d);
+        }
+        tail += ssdColumns_Scalar(a, b, end, width);
+    }
+    return horizontalSum_NEON(sum) + tail;
+}
+
+static PatchSums sums_NEON(const int * a, int strideA, const int * b, int strideB, int width, int height)
+{
+    int32x4_t sumA = vdupq_n_s32(0), sumB = sumA, sumAA = sumA, sumBB = sumA, sumAB = sumA;
+    PatchSums sums = { 0, 0, 0, 0, 0 };
+    const int end = width - (width % 4);
+    for (int y = 0; y < height; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < end; x += 4) {
+            int32x4_t va = vld1q_s32(&a[x]);
+            int32x4_t vb = vld1q_s32(&b[x]);
+            sumA = vaddq_s32(sumA, va);
+            sumB = vaddq_s32(sumB, vb);
+            sumAA = vmlaq_s32(sumAA, va, va);
+            sumBB = vmlaq_s32(sumBB, vb, vb);
+            sumAB = vmlaq_s32(sumAB, va, vb);
+        }
+        sumsColumns_Scalar(sums, a, b, end, width);
+    }
+    sums.a += horizontalSum_NEON(sumA);
+    sums.b += horizontalSum_NEON(sumB);
+    sums.aa += horizontalSum_NEON(sumAA);
+    sums.bb += horizontalSum_NEON(sumBB);
+    sums.ab += horizontalSum_NEON(sumAB);
+    return sums;
+}
+
+#endif
+
+static int ssd(const uchar * a, int strideA, const uchar * b, int strideB, int width, int height)
+{
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_PATCHCOMPARISON_SSE2)
+    case ImageProcessing::InstructionSet::SSE2:
+    case ImageProcessing::InstructionSet::AVX2:
+        return ssd_SSE2(a, strideA, b, strideB, width, height);
+#endif
+#if defined(AR_PATCHCOMPARISON_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        return ssd_NEON(a, strideA, b, strideB, width, height);
+#endif
+    default:
+        break;
+    }
+    return ssd_Scalar(a, strideA, b, strideB, width, height);
+}
+
+static PatchSums sums(const uchar * a, int strideA, const uchar * b, int strideB, int width, int height)
+{
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_PATCHCOMPARISON_SSE2)
+    case ImageProcessing::InstructionSet::SSE2:
+    case ImageProcessing::InstructionSet::AVX2:
+        return sums_SSE2(a, strideA, b, strideB, width, height);
+#endif
+#if defined(AR_PATCHCOMPARISON_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        return sums_NEON(a, strideA, b, strideB, width, height);
+#endif
+    default:
+        break;
+    }
+    return sums_Scalar(a, strideA, b, strideB, width, height);
+}
+
+// There are no 32-bit multiplications in SSE2, so int images use scalar code if AVX2 isn't available.
+static int ssd(const int * a, int strideA, const int * b, int strideB, int width, int height)
+{
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_PATCHCOMPARISON_AVX2)
+    case ImageProcessing::InstructionSet::AVX2:
+        return ssd_AVX2(a, strideA, b, strideB, width, height);
+#endif
+#if defined(AR_PATCHCOMPARISON_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        return ssd_NEON(a, strideA, b, strideB, width, height);
+#endif
+    default:
+        break;
+    }
+    return ssd_Scalar(a, strideA, b, strideB, width, height);
+}
+
+static PatchSums sums(const int * a, int strideA, const int * b, int strideB, int width, int height)
+{
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_PATCHCOMPARISON_AVX2)
+    case ImageProcessing::InstructionSet::AVX2:
+        return sums_AVX2(a, strideA, b, strideB, width, height);
+#endif
+#if defined(AR_PATCHCOMPARISON_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        return sums_NEON(a, strideA, b, strideB, width, height);
+#endif
+    default:
+        break;
+    }
+    return sums_Scalar(a, strideA, b, strideB, width, height);
+}
+
+static int zmssdFromSums(const PatchSums & s, int area)
+{
+    const std::int64_t d = (std::int64_t)s.a - s.b;
+    return (s.aa + s.bb - 2 * s.ab) - (int)((d * d) / area);
+}
+
+static float nccFromSums(const PatchSums & s, int area)
+{
+    const double varianceA = (double)area * s.aa - (double)s.a * s.a;
+    const double varianceB = (double)area * s.bb - (double)s.b * s.b;
+    const double denominator = varianceA * varianceB;
+    if (denominator <= 0.0)
+        return 0.0f;
+    return (float)(((double)area * s.ab - (double)s.a * s.b) / std::sqrt(denominator));
+}
+
+// Functor of area that selects the kernel and processes areas of whole images as one row.
+template <typename Type>
+struct PatchArea
+{
+    const Type * a;
+    int strideA;
+    const Type * b;
+    int strideB;
+    int width;
+    int height;
+
+    PatchArea(const ImageRef<Type>& imageA, const Point2i& pointA,
+              const ImageRef<Type>& imageB, const Point2i& pointB,
+              const Point2i& size)
+    {
+        TMath_assert((size.x > 0) && (size.y > 0));
+        TMath_assert((pointA.x >= 0) && (pointA.y >= 0));
+        TMath_assert(((pointA.x + size.x) <= imageA.width()) && ((pointA.y + size.y) <= imageA.height()));
+        TMath_assert((pointB.x >= 0) && (pointB.y >= 0));
+        TMath_assert(((pointB.x + size.x) <= imageB.width()) && ((pointB.y + size.y) <= imageB.height()));
+        a = imageA.pointer(pointA);
+        strideA = imageA.width();
+        b = imageB.pointer(pointB);
+        strideB = imageB.width();
+        width = size.x;
+        height = size.y;
+        if ((strideA == width) && (strideB == width) && (height != 8)) {
+            width *= height;
+            height = 1;
+        }
+    }
+
+    int ssd() const { return AR::ssd(a, strideA, b, strideB, width, height); }
+    PatchSums sums() const { return AR::sums(a, strideA, b, strideB, width, height); }
+    int area() const { return width * height; }
+};
+
+int SSD::compare(const ImageRef<uchar>& imageA, const Point2i& pointA,
+                 const ImageRef<uchar>& imageB, const Point2i& pointB,
+                 const Point2i& size)
+{
+    return PatchArea<uchar>(imageA, pointA, imageB, pointB, size).ssd();
+}
+
+int SSD::compare(const ImageRef<int>& imageA, const Point2i& pointA,
+                 const ImageRef<int>& imageB, const Point2i& pointB,
+                 const Point2i& size)
+{
+    return PatchArea<int>(imageA, pointA, imageB, pointB, size).ssd();
+}
+
+void SSD::compare(int* scores, const ImageRef<uchar>& patch,
+                  const ImageRef<uchar>& image, const Point2i* points, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        scores[i] = PatchArea<uchar>(patch, Point2i(0, 0), image, points[i], patch.size()).ssd();
+}
+
+void SSD::compare(int* scores, const ImageRef<int>& patch,
+                  const ImageRef<int>& image, const Point2i* points, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        scores[i] = PatchArea<int>(patch, Point2i(0, 0), image, points[i], patch.size()).ssd();
+}
+
+int ZMSSD::compare(const ImageRef<uchar>& imageA, const Point2i& pointA,
+                   const ImageRef<uchar>& imageB, const Point2i& pointB,
+                   const Point2i& size)
+{
+    PatchArea<uchar> area(imageA, pointA, imageB, pointB, size);
+    return zmssdFromSums(area.sums(), area.area());
+}
+
+int ZMSSD::compare(const ImageRef<int>& imageA, const Point2i& pointA,
+                   const ImageRef<int>& imageB, const Point2i& pointB,
+                   const Point2i& size)
+{
+    PatchArea<int> area(imageA, pointA, imageB, pointB, size);
+    return zmssdFromSums(area.sums(), area.area());
+}
+
+void ZMSSD::compare(int* scores, const ImageRef<uchar>& patch,
+                    const ImageRef<uchar>& image, const Point2i* points, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        PatchArea<uchar> area(patch, Point2i(0, 0), image, points[i], patch.size());
+        scores[i] = zmssdFromSums(area.sums(), area.area());
+    }
+}
+
+void ZMSSD::compare(int* scores, const ImageRef<int>& patch,
+                    const ImageRef<int>& image, const Point2i* points, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        PatchArea<int> area(patch, Point2i(0, 0), image, points[i], patch.size());
+        scores[i] = zmssdFromSums(area.sums(), area.area());
+    }
+}
+
+float NCC::compare(const ImageRef<uchar>& imageA, const Point2i& pointA,
+                   const ImageRef<uchar>& imageB, const Point2i& pointB,
+                   const Point2i& size)
+{
+    PatchArea<uchar> area(imageA, pointA, imageB, pointB, size);
+    return nccFromSums(area.sums(), area.area());
+}
+
+float NCC::compare(const ImageRef<int>& imageA, const Point2i& pointA,
+                   const ImageRef<int>& imageB, const Point2i& pointB,
+                   const Point2i& size)
+{
+    PatchArea<int> area(imageA, pointA, imageB, pointB, size);
+    return nccFromSums(area.sums(), area.area());
+}
+
+void NCC::compare(float* scores, const ImageRef<uchar>& patch,
+                  const ImageRef<uchar>& image, const Point2i* points, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        PatchArea<uchar> area(patch, Point2i(0, 0), image, points[i], patch.size());
+        scores[i] = nccFromSums(area.sums(), area.area());
+    }
+}
+
+void NCC::compare(float* scores, const ImageRef<int>& patch,
+                  const ImageRef<int>& image, const Point2i* points, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        PatchArea<int> area(patch, Point2i(0, 0), image, points[i], patch.size());
+        scores[i] = nccFromSums(area.sums(), area.area());
+    }
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef AR_PATCHCOMPARISON_H
+#define AR_PATCHCOMPARISON_H
+
+#include <cstddef>
+#include "Point2.h"
+#include "Image.h"
+
+namespace AR {
+
+// Kernels use the instruction set selected by ImageProcessing::setInstructionSet().
+// Sums are accumulated in int like in scalar code, so patches must be small enough to not overflow.
+// Patches 8x8 have special kernels, areas which are whole images (like small images of Map) are processed as one row.
+// Batch variants compare one patch with areas of the image, points are top-left corners of areas.
+
+/// Sum of Squared Differences
+class SSD
+{
+public:
+    static int compare(const ImageRef<uchar>& imageA, const Point2i& pointA,
+                       const ImageRef<uchar>& imageB, const Point2i& pointB,
+                       const Point2i& size);
+    static int compare(const ImageRef<int>& imageA, const Point2i& pointA,
+                       const ImageRef<int>& imageB, const Point2i& pointB,
+                       const Point2i& size);
+
+    static void compare(int* scores, const ImageRef<uchar>& patch,
+                        const ImageRef<uchar>& image, const Point2i* points, std::size_t count);
+    static void compare(int* scores, const ImageRef<int>& patch,
+                        const ImageRef<int>& image, const Point2i* points, std::size_t count);
+};
+
+/// Zero Mean Sum of Squared Differences
+class ZMSSD
+{
+public:
+    static int compare(const ImageRef<uchar>& imageA, const Point2i& pointA,
+                       const ImageRef<uchar>& imageB, const Point2i& pointB,
+                       const Point2i& size);
+    static int compare(const ImageRef<int>& imageA, const Point2i& pointA,
+                       const ImageRef<int>& imageB, const Point2i& pointB,
+                       const Point2i& size);
+
+    static void compare(int* scores, const ImageRef<uchar>& patch,
+                        const ImageRef<uchar>& image, const Point2i* points, std::size_t count);
+    static void compare(int* scores, const ImageRef<int>& patch,
+                        const ImageRef<int>& image, const Point2i* points, std::size_t count);
+};
+
+/// Normalized Cross Correlation, the result is in [-1, 1], it's 0 if one of areas is flat.
+class NCC
+{
+public:
+    static float compare(const ImageRef<uchar>& imageA, const Point2i& pointA,
+                         const ImageRef<uchar>& imageB, const Point2i& pointB,
+                         const Point2i& size);
+    static float compare(const ImageRef<int>& imageA, const Point2i& pointA,
+                         const ImageRef<int>& imageB, const Point2i& pointB,
+                         const Point2i& size);
+
+    static void compare(float* scores, const ImageRef<uchar>& patch,
+                        const ImageRef<uchar>& image, const Point2i* points, std::size_t count);
+    static void compare(float* scores, const ImageRef<int>& patch,
+                        const ImageRef<int>& image, const Point2i* points, std::size_t count);
+};
+
+}
+
+#endif // AR_PATCHCOMPARISON_H
@@ -0,0 +1,275 @@
+#include "PatchJacobian.h"
+#include "ImageProcessing.h"
+#include "TMath/TMath.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AR_PATCHJACOBIAN_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AR_PATCHJACOBIAN_AVX2
+#define AR_PATCHJACOBIAN_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define AR_PATCHJACOBIAN_AVX2
+#define AR_PATCHJACOBIAN_TARGET_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AR_PATCHJACOBIAN_NEON
+#include <arm_neon.h>
+#endif
+
+namespace AR {
+
+// Sums of a patch are stored as A_raw (N * (N + 1) / 2 values), B (N values) and error.
+template <int N>
+struct PatchSumsInfo
+{
+    static const int countA = (N * (N + 1)) / 2;
+    static const int countSums = countA + N + 1;
+};
+
+// Kernels get squareSigma and its inverse value, the weight is computed with multiplication instead of division.
+
+template <int N>
+static void accumulate_Scalar(float * sums, const float * jacobian, const float * residuals, const float * gaussian,
+                              int stride, float squareSigma, float invSquareSigma)
+{
+    int i, j, t;
+    float dt, e, s, w, wdt, wJ;
+    for (int k = 0; k < stride; ++k) {
+        dt = residuals[k];
+        e = dt * dt;
+        if (e > squareSigma)
+            continue;
+        s = 1.0f - e * invSquareSigma;
+        w = gaussian[k] * (s * s);
+        wdt = w * dt;
+        t = 0;
+        for (i = 0; i < N; ++i) {
+            wJ = jacobian[i * stride + k] * w;
+            for (j = 0; j <= i; ++j) {
+                sums[t] += wJ * jacobian[j * stride + k];
+                ++t;
+            }
+        }
+        for (i = 0; i < N; ++i)
+            sums[t + i] += jacobian[i * stride + k] * wdt;
+        sums[t + N] += wdt * dt;
+    }
+}
+
+#if defined(AR_PATCHJACOBIAN_SSE2)
+
+static inline float horizontalSum_SSE2(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+template <int N>
+static void accumulate_SSE2(float * sums, const float * jacobian, const float * residuals, const float * gaussian,
+                            int stride, float squareSigma, float invSquareSigma)
+{
+    const int countSums = PatchSumsInfo<N>::countSums;
+    __m128 acc[countSums];
+    int i, j, t;
+    for (i = 0; i < countSums; ++i)
+        acc[i] = _mm_setzero_ps();
+    const __m128 vSquareSigma = _mm_set1_ps(squareSigma);
+    const __m128 vInvSquareSigma = _mm_set1_ps(invSquareSigma);
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 J[N];
+    for (int k = 0; k < stride; k += 4) {
+        __m128 dt = _mm_loadu_ps(&residuals[k]);
+        __m128 e = _mm_mul_ps(dt, dt);
+        __m128 s = _mm_sub_ps(one, _mm_mul_ps(e, vInvSquareSigma));
+        __m128 w = _mm_mul_ps(_mm_loadu_ps(&gaussian[k]), _mm_mul_ps(s, s));
+        w = _mm_andnot_ps(_mm_cmpgt_ps(e, vSquareSigma), w);
+        __m128 wdt = _mm_mul_ps(w, dt);
+        for (i = 0; i < N; ++i)
+            J[i] = _mm_loadu_ps(&jacobian[i * stride + k]);
+        t = 0;
+        for (i = 0; i < N; ++i) {
+            __m128 wJ = _mm_mul_ps(J[i], w);
+            for (j = 0; j <= i; ++j) {
+                acc[t] = _mm_add_ps(acc[t], _mm_mul_ps(wJ, J[j]));
+                ++t;
+            }
+        }
+        for (i = 0; i < N; ++i)
+            acc[t + i] = _mm_add_ps(acc[t + i], _mm_mul_ps(J[i], wdt));
+        acc[t + N] = _mm_add_ps(acc[t + N], _mm_mul_ps(wdt, dt));
+    }
+    for (i = 0; i < countSums; ++i)
+        sums[i] = horizontalSum_SSE2(acc[i]);
+}
+
+#endif
+
+#if defined(AR_PATCHJACOBIAN_AVX2)
+
+AR_PATCHJACOBIAN_TARGET_AVX2
+static inline float horizontalSum_AVX2(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(s);
+}
+
+template <int N>
+AR_PATCHJACOBIAN_TARGET_AVX2
+static void accumulate_AVX2(float * sums, const float * jacobian, const float * residuals, const float * gaussian,
+                            int stride, float squareSigma, float invSquareSigma)
+{
+    const int countSums = PatchSumsInfo<N>::countSums;
+    __m256 acc[countSums];
+    int i, j, t;
+    for (i = 0; i < countSums; ++i)
+        acc[i] = _mm256_setzero_ps();
+    const __m256 vSquareSigma = _mm256_set1_ps(squareSigma);
+    const __m256 vInvSquareSigma = _mm256_set1_ps(invSquareSigma);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 J[N];
+    for (int k = 0; k < stride; k += 8) {
+        __m256 dt = _mm256_loadu_ps(&residuals[k]);
+        __m256 e = _mm256_mul_ps(dt, dt);
+        __m256 s = _mm256_sub_ps(one, _mm256_mul_ps(e, vInvSquareSigma));
+        __m256 w = _mm256_mul_ps(_mm256_loadu_ps(&gaussian[k]), _mm256_mul_ps(s, s));
+        w = _mm256_andnot_ps(_mm256_cmp_ps(e, vSquareSigma, _CMP_GT_OQ), w);
+        __m256 wdt = _mm256_mul_ps(w, dt);
+        for (i = 0; i < N; ++i)
+            J[i] = _mm256_loadu_ps(&jacobian[i * stride + k]);
+        t = 0;
+        for (i = 0; i < N; ++i) {
+            __m256 wJ = _mm256_mul_ps(J[i], w);
+            for (j = 0; j <= i; ++j) {
+                acc[t] = _mm256_add_ps(acc[t], _mm256_mul_ps(wJ, J[j]));
+                ++t;
+            }
+        }
+        for (i = 0; i < N; ++i)
+            acc[t + i] = _mm256_add_ps(acc[t + i], _mm256_mul_ps(J[i], wdt));
+        acc[t + N] = _mm256_add_ps(acc[t + N], _mm256_mul_ps(wdt, dt));
+    }
+    for (i = 0; i < countSums; ++i)
+        sums[i] = horizontalSum_AVX2(acc[i]);
+}
+
+#endif
+
+#if defined(AR_PATCHJACOBIAN_NEON)
+
+static inline float horizontalSum_NEON(float32x4_t v)
+{
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+template <int N>
+static void accumulate_NEON(float * sums, const float * jacobian, const float * residuals, const float * gaussian,
+                            int stride, float squareSigma, float invSquareSigma)
+{
+    const int countSums = PatchSumsInfo<N>::countSums;
+    float32x4_t acc[countSums];
+    int i, j, t;
+    for (i = 0; i < countSums; ++i)
+        acc[i] = vdupq_n_f32(0.0f);
+    const float32x4_t vSquareSigma = vdupq_n_f32(squareSigma);
+    const float32x4_t vInvSquareSigma = vdupq_n_f32(invSquareSigma);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    float32x4_t J[N];
+    for (int k = 0; k < stride; k += 4) {
+        float32x4_t dt = vld1q_f32(&residuals[k]);
+        float32x4_t e = vmulq_f32(dt, dt);
+        float32x4_t s = vsubq_f32(one, vmulq_f32(e, vInvSquareSigma));
+        float32x4_t w = vmulq_f32(vld1q_f32(&gaussian[k]), vmulq_f32(s, s));
+        w = vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(w), vcgtq_f32(e, vSquareSigma)));
+        float32x4_t wdt = vmulq_f32(w, dt);
+        for (i = 0; i < N; ++i)
+            J[i] = vld1q_f32(&jacobian[i * stride + k]);
+        t = 0;
+        for (i = 0; i < N; ++i) {
+            float32x4_t wJ = vmulq_f32(J[i], w);
+            for (j = 0; j <= i; ++j) {
+                acc[t] = vmlaq_f32(acc[t], wJ, J[j]);
+                ++t;
+            }
+        }
+        for (i = 0; i < N; ++i)
+            acc[t + i] = vmlaq_f32(acc[t + i], J[i], wdt);
+        acc[t + N] = vmlaq_f32(acc[t + N], wdt, dt);
+    }
+    for (i = 0; i < countSums; ++i)
+        sums[i] = horizontalSum_NEON(acc[i]);
+}
+
+#endif
+
+template <int N>
+static void accumulate(float * sums, const float * jacobian, const float * residuals, const float * gaussian,
+                       int stride, float squareSigma, float invSquareSigma)
+{
+    switch (ImageProcessing::instructionSet()) {
+#if defined(AR_PATCHJACOBIAN_AVX2)
+    case ImageProcessing::InstructionSet::AVX2:
+        accumulate_AVX2<N>(sums, jacobian, residuals, gaussian, stride, squareSigma, invSquareSigma);
+        return;
+#endif
+#if defined(AR_PATCHJACOBIAN_SSE2)
+#if !defined(AR_PATCHJACOBIAN_AVX2)
+    case ImageProcessing::InstructionSet::AVX2:
+#endif
+    case ImageProcessing::InstructionSet::SSE2:
+        accumulate_SSE2<N>(sums, jacobian, residuals, gaussian, stride, squareSigma, invSquareSigma);
+        return;
+#endif
+#if defined(AR_PATCHJACOBIAN_NEON)
+    case ImageProcessing::InstructionSet::NEON:
+        accumulate_NEON<N>(sums, jacobian, residuals, gaussian, stride, squareSigma, invSquareSigma);
+        return;
+#endif
+    default:
+        break;
+    }
+    accumulate_Scalar<N>(sums, jacobian, residuals, gaussian, stride, squareSigma, invSquareSigma);
+}
+
+int PatchJacobian::stride(int area)
+{
+    return (area + 7) & ~7;
+}
+
+void PatchJacobian::accumulate(double * A_raw, double * B, double & error, int countParameters,
+                               const float * jacobian, const float * residuals, const float * gaussian,
+                               int stride, float squareSigma)
+{
+    TMath_assert((stride % 8) == 0);
+    float sums[PatchSumsInfo<6>::countSums];
+    std::fill(sums, sums + PatchSumsInfo<6>::countSums, 0.0f);
+    float invSquareSigma = (squareSigma > 0.0f) ? (1.0f / squareSigma) : 0.0f;
+    int countA;
+    switch (countParameters) {
+    case 3:
+        AR::accumulate<3>(sums, jacobian, residuals, gaussian, stride, squareSigma, invSquareSigma);
+        countA = PatchSumsInfo<3>::countA;
+        break;
+    case 6:
+        AR::accumulate<6>(sums, jacobian, residuals, gaussian, stride, squareSigma, invSquareSigma);
+        countA = PatchSumsInfo<6>::countA;
+        break;
+    default:
+        TMath_assert(false);
+        return;
+    }
+    for (int i = 0; i < countA; ++i)
+        A_raw[i] += sums[i];
+    for (int i = 0; i < countParameters; ++i)
+        B[i] += sums[countA + i];
+    error += sums[countA + countParameters];
+}
+
+}
@@ -0,0 +1,27 @@
+#ifndef AR_PATCHJACOBIAN_H
+#define AR_PATCHJACOBIAN_H
+
+namespace AR {
+
+// Normal equations of patches for inverse compositional image alignment (Tracker, RotationTracker).
+// Jacobian of a patch is stored as structure of arrays: row i contains i-th derivative for all pixels of the patch,
+// every row has stride(area) floats. Residuals and gaussian weights of pixels have the same stride,
+// padding pixels must have zero jacobians, residuals and weights.
+// Kernels use the instruction set selected by ImageProcessing::setInstructionSet().
+class PatchJacobian
+{
+public:
+    // Count of floats of a row, it's a multiple of 8.
+    static int stride(int area);
+
+    // Adds sums of the patch: A_raw += J * J.transposed() * w (lower triangle by rows, like in Tracker),
+    // B += J * w * dt, error += w * dt * dt, where w = gaussian * TukeyRobustCost::weight(dt * dt, squareSigma).
+    // Sums of the patch are computed in float, countParameters is 3 or 6.
+    static void accumulate(double * A_raw, double * B, double & error, int countParameters,
+                           const float * jacobian, const float * residuals, const float * gaussian,
+                           int stride, float squareSigma);
+};
+
+}
+
+#endif // AR_PATCHJACOBIAN_H
@@ -2,119 +2,339 @@
 #include <algorithm>
 #include <numeric>
 #include <cassert>
-#include <climits>
 #include <limits>
+#include <fstream>
+#include <iomanip>
 
 namespace AR {
 
-PerformanceMonitor::PerformanceMonitor()
+std::atomic<std::uint64_t> PerformanceMonitor::_static_count_monitors(0);
+
+// Trace is limited, so forgotten enabled trace doesn't take all memory.
+static const std::size_t maxCountTraceEvents = 1 << 22;
+
+void PerformanceMonitor::RingBuffer::reset(std::size_t size)
+{
+    values.assign(std::max(size, (std::size_t)1), 0);
+    next = 0;
+    count = 0;
+}
+
+void PerformanceMonitor::RingBuffer::push(std::uint64_t value)
+{
+    values[next] = value;
+    next = (next + 1) % values.size();
+    count = std::min(count + 1, values.size());
+}
+
+std::uint64_t PerformanceMonitor::RingBuffer::average() const
+{
+    if (count == 0)
+        return 0;
+    return std::accumulate(values.begin(), values.begin() + count, (std::uint64_t)0) / count;
+}
+
+PerformanceMonitor::PerformanceMonitor():
+    m_serial(++_static_count_monitors),
+    m_epoch(std::chrono::steady_clock::now())
 {
     m_countUsedTimes = 10;
-    m_currentCommonTime.first = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch());
-    m_currentCommonTime.second = m_currentCommonTime.first;
+    m_mainThread = std::numeric_limits<std::size_t>::max();
+    m_frameDurations.reset(m_countUsedTimes);
+    m_lastFrameDuration = 0;
+    m_traceEnabled = false;
+    for (int i = 0; i < maxCountCounters; ++i)
+        m_counterValues[i] = 0;
+}
+
+PerformanceMonitor::~PerformanceMonitor()
+{
 }
 
 std::size_t PerformanceMonitor::countUsedTimes() const
 {
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
     return m_countUsedTimes;
 }
 
 void PerformanceMonitor::setCountUsedTimes(const std::size_t& countUsedTimes)
 {
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    if (m_countUsedTimes == countUsedTimes)
+        return;
     m_countUsedTimes = countUsedTimes;
+    for (RingBuffer& durations : m_stageDurations)
+        durations.reset(m_countUsedTimes);
+    m_frameDurations.reset(m_countUsedTimes);
+}
+
+int PerformanceMonitor::registerStage(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    auto it = std::find(m_stageNames.begin(), m_stageNames.end(), name);
+    if (it != m_stageNames.end())
+        return (int)(it - m_stageNames.begin());
+    m_stageNames.push_back(name);
+    m_stageDurations.emplace_back();
+    m_stageDurations.back().reset(m_countUsedTimes);
+    m_stageCounts.push_back(0);
+    return (int)(m_stageNames.size() - 1);
+}
+
+std::size_t PerformanceMonitor::countStages() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    return m_stageNames.size();
+}
+
+std::string PerformanceMonitor::stageName(int stage) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    return m_stageNames[stage];
 }
 
 std::size_t PerformanceMonitor::countTimers() const
 {
-    return m_timers.size();
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    std::size_t count = 0;
+    for (const std::vector<Timer>& timers : m_threadTimers)
+        count += timers.size();
+    return count;
 }
 
 PerformanceMonitor::Timer PerformanceMonitor::timer(std::size_t index) const
 {
-    return m_timers[index];
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    for (const std::vector<Timer>& timers : m_threadTimers) {
+        if (index < timers.size()) {
+            Timer timer = timers[index];
+            timer.duration = m_stageDurations[timer.stage].average();
+            timer.countMeasurements = m_stageCounts[timer.stage];
+            return timer;
+        }
+        index -= timers.size();
+    }
+    assert(false);
+    return Timer();
+}
+
+std::chrono::nanoseconds PerformanceMonitor::commonTime() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    if (m_frameDurations.count == 0)
+        return std::chrono::nanoseconds(m_lastFrameDuration);
+    return std::chrono::nanoseconds(m_frameDurations.average());
+}
+
+void PerformanceMonitor::startTimer(int stage)
+{
+    assert(stage >= 0);
+    ThreadRecorder* recorder = _recorder();
+    if ((int)recorder->starts.size() <= stage)
+        recorder->starts.resize(stage + 1, 0);
+    recorder->starts[stage] = _now();
+}
+
+void PerformanceMonitor::endTimer(int stage)
+{
+    std::uint64_t now = _now();
+    ThreadRecorder* recorder = _recorder();
+    assert(stage < (int)recorder->starts.size());
+    std::uint64_t begin = recorder->starts[stage];
+    recorder->measurements.push_back({ stage, begin, now - begin });
+    if (!recorder->inFrame)
+        _publish(recorder, false, 0);
+}
+
+int PerformanceMonitor::registerCounter(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    auto it = std::find(m_counterNames.begin(), m_counterNames.end(), name);
+    if (it != m_counterNames.end())
+        return (int)(it - m_counterNames.begin());
+    if ((int)m_counterNames.size() >= maxCountCounters)
+        return -1;
+    m_counterNames.push_back(name);
+    return (int)(m_counterNames.size() - 1);
 }
 
-std::chrono::milliseconds PerformanceMonitor::commonTime() const
+std::size_t PerformanceMonitor::countCounters() const
 {
-    if (m_commonTimes.empty())
-        return m_currentCommonTime.second - m_currentCommonTime.first;
-    return std::accumulate(m_commonTimes.begin(), m_commonTimes.end(), std::chrono::milliseconds(0)) /
-                            m_commonTimes.size();
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    return m_counterNames.size();
 }
 
-void PerformanceMonitor::startTimer(const std::string& name)
+PerformanceMonitor::Counter PerformanceMonitor::counter(int id) const
 {
-    auto it = m_running_timers.find(name);
-    if (it == m_running_timers.end()) {
-        m_running_timers.insert(std::pair<std::string, TimerInfo>(
-                                    name,
-                                    { std::vector<std::chrono::milliseconds>(),
-                                      std::chrono::duration_cast<std::chrono::milliseconds>(
-                                        std::chrono::system_clock::now().time_since_epoch()),
-                                      m_currentIndex }));
-    } else {
-        it->second.last_start = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch());
-        it->second.currentIndex = m_currentIndex;
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    if ((id < 0) || (id >= (int)m_counterNames.size()))
+        return { std::string(), 0 };
+    return { m_counterNames[id], m_counterValues[id].load() };
+}
+
+void PerformanceMonitor::addToCounter(int id, std::uint64_t value)
+{
+    if ((id < 0) || (id >= maxCountCounters))
+        return;
+    m_counterValues[id].fetch_add(value, std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::start()
+{
+    ThreadRecorder* recorder = _recorder();
+    recorder->inFrame = true;
+    recorder->measurements.clear();
+    recorder->frameBegin = _now();
+}
+
+void PerformanceMonitor::end()
+{
+    ThreadRecorder* recorder = _recorder();
+    if (!recorder->inFrame)
+        return;
+    recorder->inFrame = false;
+    _publish(recorder, true, _now() - recorder->frameBegin);
+}
+
+void PerformanceMonitor::setThreadName(const std::string& name)
+{
+    ThreadRecorder* recorder = _recorder();
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    recorder->name = name;
+}
+
+bool PerformanceMonitor::traceEnabled() const
+{
+    return m_traceEnabled.load();
+}
+
+void PerformanceMonitor::setTraceEnabled(bool enabled)
+{
+    m_traceEnabled = enabled;
+}
+
+void PerformanceMonitor::clearTrace()
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    m_trace.clear();
+}
+
+static void writeJsonString(std::ostream& stream, const std::string& text)
+{
+    stream << '"';
+    for (char c : text) {
+        if ((c == '"') || (c == '\\'))
+            stream << '\\' << c;
+        else if ((unsigned char)c < 0x20)
+            stream << ' ';
+        else
+            stream << c;
     }
-    ++m_currentIndex;
+    stream << '"';
 }
 
-void PerformanceMonitor::endTimer(const std::string& name)
+bool PerformanceMonitor::saveTrace(const std::string& path) const
 {
-    auto it = m_running_timers.find(name);
-    if (it != m_running_timers.end()) {
-        if (it->second.durations.size() > m_countUsedTimes) {
-            it->second.durations.erase(it->second.durations.begin(),
-                                       it->second.durations.begin() +
-                                         ((it->second.durations.size() + 1) - m_countUsedTimes));
-        }
-        it->second.durations.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(
-                                       std::chrono::system_clock::now().time_since_epoch()) - it->second.last_start);
-    } else {
-        assert(false);
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    file << std::fixed << std::setprecision(3);
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    for (const std::unique_ptr<ThreadRecorder>& recorder : m_recorders) {
+        file << (first ? "\n" : ",\n");
+        first = false;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << recorder->index
+             << ",\"args\":{\"name\":";
+        writeJsonString(file, recorder->name.empty() ? ("Thread " + std::to_string(recorder->index)) : recorder->name);
+        file << "}}";
+    }
+    for (const TraceEvent& event : m_trace) {
+        file << (first ? "\n" : ",\n");
+        first = false;
+        file << "{\"name\":";
+        writeJsonString(file, m_stageNames[event.measurement.stage]);
+        file << ",\"cat\":\"AR\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+             << ",\"ts\":" << (event.measurement.begin * 1e-3)
+             << ",\"dur\":" << (event.measurement.duration * 1e-3) << "}";
     }
+    file << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return file.good();
 }
 
-void PerformanceMonitor::start()
+std::uint64_t PerformanceMonitor::_now() const
 {
-    m_currentIndex = 0;
-    m_timers.resize(0);
-    for (auto it = m_running_timers.begin(); it != m_running_timers.end(); ++it) {
-        it->second.currentIndex = std::numeric_limits<std::size_t>::max();
+    return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+PerformanceMonitor::ThreadRecorder* PerformanceMonitor::_recorder()
+{
+    // the last used recorder of thread, serial number distinguishes monitors created at the same address
+    static thread_local std::uint64_t cachedSerial = 0;
+    static thread_local ThreadRecorder* cachedRecorder = nullptr;
+    if (cachedSerial == m_serial)
+        return cachedRecorder;
+    std::thread::id id = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    ThreadRecorder* recorder = nullptr;
+    for (const std::unique_ptr<ThreadRecorder>& r : m_recorders) {
+        if (r->id == id) {
+            recorder = r.get();
+            break;
+        }
     }
-    m_currentCommonTime.first = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch());
+    if (recorder == nullptr) {
+        m_recorders.emplace_back(new ThreadRecorder());
+        recorder = m_recorders.back().get();
+        recorder->index = m_recorders.size() - 1;
+        recorder->id = id;
+        recorder->inFrame = false;
+        recorder->frameBegin = 0;
+        m_threadTimers.resize(m_recorders.size());
+    }
+    cachedSerial = m_serial;
+    cachedRecorder = recorder;
+    return recorder;
 }
 
-void PerformanceMonitor::end()
+void PerformanceMonitor::_publish(ThreadRecorder* recorder, bool endOfFrame, std::uint64_t frameDuration)
 {
-    m_currentCommonTime.second = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch());
-    if (m_commonTimes.size() >= m_countUsedTimes) {
-        m_commonTimes.erase(m_commonTimes.begin(), m_commonTimes.begin() + ((m_commonTimes.size() + 1) - m_countUsedTimes));
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    std::vector<Timer>& timers = m_threadTimers[recorder->index];
+    if (endOfFrame) {
+        // stages which are not measured in this frame are removed
+        timers.clear();
+        if (m_mainThread == std::numeric_limits<std::size_t>::max())
+            m_mainThread = recorder->index;
+        if (m_mainThread == recorder->index) {
+            m_frameDurations.push(frameDuration);
+            m_lastFrameDuration = frameDuration;
+        }
     }
-    m_commonTimes.push_back(m_currentCommonTime.second - m_currentCommonTime.first);
-    std::vector<Timer> timers;
-    std::vector<std::pair<std::size_t, std::size_t>> indices;
-    for (auto it = m_running_timers.begin(); it != m_running_timers.end(); ) {
-        if (it->second.currentIndex == std::numeric_limits<std::size_t>::max()) {
-            it = m_running_timers.erase(it);
+    std::stable_sort(recorder->measurements.begin(), recorder->measurements.end(),
+                     [] (const Measurement& a, const Measurement& b) { return (a.begin < b.begin); });
+    bool traceEnabled = m_traceEnabled.load() && (m_trace.size() < maxCountTraceEvents);
+    for (const Measurement& measurement : recorder->measurements) {
+        m_stageDurations[measurement.stage].push(measurement.duration);
+        ++m_stageCounts[measurement.stage];
+        if (traceEnabled)
+            m_trace.push_back({ recorder->index, measurement });
+        auto it = std::find_if(timers.begin(), timers.end(), [&measurement] (const Timer& timer) {
+            return (timer.stage == measurement.stage);
+        });
+        if (it == timers.end()) {
+            timers.push_back({ m_stageNames[measurement.stage], measurement.stage, recorder->index,
+                               0, measurement.duration, 0 });
+        } else if (endOfFrame) {
+            // the stage is measured several times in frame
+            it->lastDuration += measurement.duration;
         } else {
-            indices.push_back({ timers.size(), it->second.currentIndex });
-            timers.push_back({ it->first, (std::size_t)it->second.getAvgDuration().count() });
-            ++it;
+            it->lastDuration = measurement.duration;
         }
     }
-    std::sort(indices.begin(), indices.end(), [] (const std::pair<std::size_t, std::size_t>& a,
-                                                  const std::pair<std::size_t, std::size_t>& b) {
-        return (a.second < b.second);
-    });
-    m_timers.resize(timers.size());
-    for (std::size_t i = 0; i < timers.size(); ++i) {
-        m_timers[i] = timers[indices[i].first];
-    }
+    recorder->measurements.clear();
 }
 
 }
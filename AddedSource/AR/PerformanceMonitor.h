@@ -1,63 +1,148 @@
 #ifndef AR_PERFORMANCEMONITOR_H
 #define AR_PERFORMANCEMONITOR_H
 
-#include <map>
 #include <string>
-#include <utility>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <chrono>
-#include <algorithm>
-#include <numeric>
+#include <cstdint>
 
 namespace AR {
 
+// Durations of stages of processing, measured by steady_clock in nanoseconds.
+// Stages are registered once and timers are started and ended by integer ids of stages.
+// Every thread records own measurements: start() and end() delimit frame of the calling thread and measurements
+// of frame are published at end(), measurements out of frames are published at endTimer().
+// Last countUsedTimes() durations of every stage are kept in a ring buffer for average durations.
+// If trace is enabled, all published measurements are kept for export to Chrome trace event format.
 class PerformanceMonitor
 {
 public:
     struct Timer
     {
         std::string name;
-        std::size_t duration;
+        int stage;
+        std::size_t thread; // index of thread in order of the first measurement
+        std::uint64_t duration; // average in nanoseconds
+        std::uint64_t lastDuration; // in nanoseconds, measured in the last processed frame
+        std::uint64_t countMeasurements; // count of all published measurements of stage
     };
 
+    struct Counter
+    {
+        std::string name;
+        std::uint64_t value;
+    };
+
+    static const int maxCountCounters = 64;
+
     PerformanceMonitor();
+    ~PerformanceMonitor();
 
     std::size_t countUsedTimes() const;
     void setCountUsedTimes(const std::size_t& countUsedTimes);
 
+    // Stages with the same name have the same id.
+    int registerStage(const std::string& name);
+    std::size_t countStages() const;
+    std::string stageName(int stage) const;
+
+    // Timers of stages measured in the last frames of threads, sorted by threads and by order in frames.
     std::size_t countTimers() const;
     Timer timer(std::size_t index) const;
 
-    std::chrono::milliseconds commonTime() const;
+    // Average duration of frames of the first thread called start().
+    std::chrono::nanoseconds commonTime() const;
 
-    void startTimer(const std::string& name);
-    void endTimer(const std::string& name);
+    void startTimer(int stage);
+    void endTimer(int stage);
+
+    // Counters of events (hits of caches and so on) accumulated from creation of monitor.
+    // Counters with the same name have the same id, values can be added in any thread without locks.
+    // If there are maxCountCounters counters already, registerCounter() returns -1, invalid ids are ignored.
+    int registerCounter(const std::string& name);
+    std::size_t countCounters() const;
+    Counter counter(int id) const;
+    void addToCounter(int id, std::uint64_t value = 1);
 
     void start();
     void end();
 
+    // Name of the calling thread in trace.
+    void setThreadName(const std::string& name);
+
+    bool traceEnabled() const;
+    void setTraceEnabled(bool enabled);
+    void clearTrace();
+    // Trace in JSON of Chrome trace event format (chrome://tracing, Perfetto).
+    bool saveTrace(const std::string& path) const;
+
 private:
-    struct TimerInfo
+    struct RingBuffer
+    {
+        std::vector<std::uint64_t> values;
+        std::size_t next;
+        std::size_t count;
+
+        void reset(std::size_t size);
+        void push(std::uint64_t value);
+        std::uint64_t average() const;
+    };
+
+    struct Measurement
+    {
+        int stage;
+        std::uint64_t begin; // in nanoseconds from creation of monitor
+        std::uint64_t duration;
+    };
+
+    // State of thread, it's changed only by own thread without locks.
+    struct ThreadRecorder
     {
-        std::vector<std::chrono::milliseconds> durations;
-        std::chrono::milliseconds last_start;
-        std::size_t currentIndex;
-
-        std::chrono::milliseconds getAvgDuration() const
-        {
-            if (durations.empty())
-                return std::chrono::milliseconds(0);
-            return std::accumulate(durations.begin(), durations.end(), std::chrono::milliseconds(0)) /
-                                    durations.size();
-        }
+        std::size_t index;
+        std::thread::id id;
+        std::string name;
+        bool inFrame;
+        std::uint64_t frameBegin;
+        std::vector<std::uint64_t> starts; // by stages
+        std::vector<Measurement> measurements;
     };
 
-    std::map<std::string, TimerInfo> m_running_timers;
-    std::size_t m_currentIndex;
-    std::vector<Timer> m_timers;
-    std::vector<std::chrono::milliseconds> m_commonTimes;
-    std::pair<std::chrono::milliseconds, std::chrono::milliseconds> m_currentCommonTime;
+    PerformanceMonitor(const PerformanceMonitor& ) = delete;
+    void operator = (const PerformanceMonitor& ) = delete;
+
+    const std::uint64_t m_serial;
+    const std::chrono::steady_clock::time_point m_epoch;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::string> m_stageNames;
+    std::vector<RingBuffer> m_stageDurations;
+    std::vector<std::uint64_t> m_stageCounts;
+    std::vector<std::unique_ptr<ThreadRecorder>> m_recorders;
+    std::vector<std::vector<Timer>> m_threadTimers; // by indices of threads
+    std::size_t m_mainThread;
+    RingBuffer m_frameDurations;
+    std::uint64_t m_lastFrameDuration;
     std::size_t m_countUsedTimes;
+    std::vector<std::string> m_counterNames;
+    std::atomic<std::uint64_t> m_counterValues[maxCountCounters];
+
+    std::atomic<bool> m_traceEnabled;
+    struct TraceEvent
+    {
+        std::size_t thread;
+        Measurement measurement;
+    };
+    std::vector<TraceEvent> m_trace;
+
+    static std::atomic<std::uint64_t> _static_count_monitors;
+
+    std::uint64_t _now() const;
+    ThreadRecorder* _recorder();
+    void _publish(ThreadRecorder* recorder, bool endOfFrame, std::uint64_t frameDuration);
 };
 
 }
@@ -115,7 +115,7 @@ void PreviewFrame::getDepth(MapResourcesManager * manager, double & depthMean, d
     vectorDepth.reserve(features.size());
     depthMin = std::numeric_limits<double>::max();
     for (auto it = features.begin(); it != features.end(); ++it) {
-        MapResourceLocker lockerR(manager, it->mapPoint.get()); (void)lockerR;
+        MapResourceLocker lockerR(manager, it->mapPoint.get(), MapResourceAccess::Shared); (void)lockerR;
         TVectord localPos = rotation * it->mapPoint->position() + translation;
         if (depthMin > localPos(2))
             depthMin = localPos(2);
@@ -0,0 +1,108 @@
+#include "Ransac.h"
+#include "TMath/TMath.h"
+
+namespace AR {
+
+Ransac::Ransac()
+{
+    m_maxCountIterations = 1000;
+    m_confidence = 0.99;
+    m_seed = 5489U;
+    m_nextIteration = 0;
+    m_countIterations = 0;
+    m_bestScore = 0.0;
+    m_countInliers = 0;
+}
+
+int Ransac::maxCountIterations() const
+{
+    return m_maxCountIterations;
+}
+
+void Ransac::setMaxCountIterations(int maxCountIterations)
+{
+    TMath_assert(maxCountIterations > 0);
+    m_maxCountIterations = maxCountIterations;
+}
+
+double Ransac::confidence() const
+{
+    return m_confidence;
+}
+
+void Ransac::setConfidence(double confidence)
+{
+    TMath_assert(confidence > 0.0);
+    m_confidence = confidence;
+}
+
+int Ransac::countThreads() const
+{
+    return m_threadPool.countThreads();
+}
+
+void Ransac::setCountThreads(int countThreads)
+{
+    m_threadPool.setCountThreads(countThreads);
+}
+
+unsigned int Ransac::seed() const
+{
+    return m_seed;
+}
+
+void Ransac::setSeed(unsigned int seed)
+{
+    m_seed = seed;
+}
+
+int Ransac::countIterations() const
+{
+    return m_countIterations.load();
+}
+
+int Ransac::countInliers() const
+{
+    return m_countInliers;
+}
+
+void Ransac::_prepareProgressiveSampling(int countPoints, int sampleSize)
+{
+    // Growth function of PROSAC (Chum, Matas, 2005): T_n is the expected count of samples from the first n points
+    // among maxCountIterations() samples from all points, iteration t uses the first n points while t <= T'_n.
+    m_subsetSizes.resize(m_maxCountIterations);
+    m_subsetLastPoints.resize(m_maxCountIterations);
+    int n = sampleSize, i;
+    double T_n = (double)m_maxCountIterations;
+    for (i = 0; i < sampleSize; ++i)
+        T_n *= (sampleSize - i) / (double)(countPoints - i);
+    double T_n_prime = 1.0;
+    for (int t = 1; t <= m_maxCountIterations; ++t) {
+        while ((t > T_n_prime) && (n < countPoints)) {
+            ++n;
+            double T_n_next = (T_n * n) / (double)(n - sampleSize);
+            T_n_prime += std::ceil(T_n_next - T_n);
+            T_n = T_n_next;
+        }
+        m_subsetSizes[t - 1] = n;
+        m_subsetLastPoints[t - 1] = (t <= T_n_prime) && (n < countPoints);
+    }
+}
+
+int Ransac::_updatedCountIterations(int countInliers, int countPoints, int sampleSize) const
+{
+    if (m_confidence >= 1.0)
+        return m_maxCountIterations;
+    double w = countInliers / (double)countPoints;
+    double p = 1.0 - std::pow(w, (double)sampleSize);
+    if (p <= std::numeric_limits<double>::epsilon())
+        return 1;
+    if (p >= 1.0)
+        return m_maxCountIterations;
+    double k = std::log(1.0 - m_confidence) / std::log(p);
+    if (k >= (double)m_maxCountIterations)
+        return m_maxCountIterations;
+    return std::max((int)std::ceil(k), 1);
+}
+
+}
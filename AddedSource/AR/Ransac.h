@@ -0,0 +1,166 @@
+#ifndef AR_RANSAC_H
+#define AR_RANSAC_H
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include "ThreadPool.h"
+#include "TMath/Random_mt19937.h"
+
+namespace AR {
+
+// Robust estimation of models by random minimal samples with truncated scores (MSAC).
+// The count of hypotheses is reduced by the bound log(1 - confidence) / log(1 - w^s), where w is the ratio
+// of inliers of the best hypothesis and s is the size of samples.
+// If points are sorted by quality (the best first), samples can be drawn progressively from the best points (PROSAC).
+// Hypotheses are evaluated by threads of the pool, every thread has own generator of random numbers,
+// evaluation of a hypothesis is stopped when its score becomes worse than the best score of all threads.
+//
+// Estimator defines:
+//     typedef ... Model;
+//     static const int sampleSize;
+//     static const int maxCountModels;                  - maximal count of models from one sample
+//     int computeModels(Model * models, const int * sample, int thread);
+//                                                       - models from sample of indices of points,
+//                                                         thread is index in [0, countThreads())
+//     double error(const Model & model, int point) const;
+class Ransac
+{
+public:
+    Ransac();
+
+    int maxCountIterations() const;
+    void setMaxCountIterations(int maxCountIterations);
+
+    // If confidence >= 1 then all maxCountIterations() hypotheses are evaluated.
+    double confidence() const;
+    void setConfidence(double confidence);
+
+    int countThreads() const;
+    void setCountThreads(int countThreads);
+
+    // Generator of thread i is seeded by seed + i.
+    unsigned int seed() const;
+    void setSeed(unsigned int seed);
+
+    // Count of evaluated hypotheses of the last run.
+    int countIterations() const;
+    // Count of inliers (error <= maxError) of the best model of the last run.
+    int countInliers() const;
+
+    template <typename Estimator>
+    bool run(typename Estimator::Model & bestModel, Estimator & estimator,
+             int countPoints, double maxError, bool progressive);
+
+private:
+    int m_maxCountIterations;
+    double m_confidence;
+    unsigned int m_seed;
+    ThreadPool m_threadPool;
+
+    // size of subset of points and if the last point of subset must be in sample for every iteration
+    std::vector<int> m_subsetSizes;
+    std::vector<bool> m_subsetLastPoints;
+
+    std::mutex m_mutex;
+    std::atomic<int> m_nextIteration;
+    std::atomic<int> m_countIterations;
+    std::atomic<double> m_bestScore;
+    int m_countInliers;
+
+    void _prepareProgressiveSampling(int countPoints, int sampleSize);
+    int _updatedCountIterations(int countInliers, int countPoints, int sampleSize) const;
+};
+
+template <typename Estimator>
+bool Ransac::run(typename Estimator::Model & bestModel, Estimator & estimator,
+                 int countPoints, double maxError, bool progressive)
+{
+    typedef typename Estimator::Model Model;
+    const int sampleSize = Estimator::sampleSize;
+    m_countInliers = 0;
+    m_countIterations = 0;
+    if (countPoints < sampleSize)
+        return false;
+    if (progressive)
+        _prepareProgressiveSampling(countPoints, sampleSize);
+    m_nextIteration = 0;
+    m_countIterations = m_maxCountIterations;
+    m_bestScore = std::numeric_limits<double>::max();
+    bool found = false;
+    m_threadPool.run(m_threadPool.countThreads(), [&] (int thread) {
+        TMath::Random_mt19937 rnd(m_seed + (unsigned int)thread);
+        int sample[Estimator::sampleSize];
+        Model models[Estimator::maxCountModels];
+        int i, j, k;
+        for (;;) {
+            int iteration = m_nextIteration.fetch_add(1);
+            if (iteration >= m_countIterations.load())
+                break;
+            int subsetSize = countPoints, countRandomPoints = sampleSize;
+            if (progressive) {
+                subsetSize = m_subsetSizes[iteration];
+                if (m_subsetLastPoints[iteration]) {
+                    sample[sampleSize - 1] = subsetSize - 1;
+                    --subsetSize;
+                    --countRandomPoints;
+                }
+            }
+            for (i = 0; i < countRandomPoints; ++i) {
+                bool isUnique;
+                do {
+                    isUnique = true;
+                    sample[i] = (int)rnd((unsigned int)subsetSize);
+                    for (j = 0; j < i; ++j) {
+                        if (sample[j] == sample[i]) {
+                            isUnique = false;
+                            break;
+                        }
+                    }
+                } while (!isUnique);
+            }
+            int countModels = estimator.computeModels(models, sample, thread);
+            for (k = 0; k < countModels; ++k) {
+                const Model & model = models[k];
+                double bestScore = m_bestScore.load();
+                double score = 0.0, error;
+                int countInliers = 0;
+                for (i = 0; i < countPoints; ++i) {
+                    error = estimator.error(model, i);
+                    if (error <= maxError) {
+                        score += error;
+                        ++countInliers;
+                    } else {
+                        score += maxError;
+                    }
+                    if (((i & 15) == 15) && (score >= bestScore)) {
+                        bestScore = m_bestScore.load();
+                        if (score >= bestScore)
+                            break;
+                    }
+                }
+                if ((i < countPoints) || !(score < bestScore))
+                    continue;
+                std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+                if (score < m_bestScore.load()) {
+                    m_bestScore = score;
+                    m_countInliers = countInliers;
+                    bestModel = model;
+                    found = true;
+                    int countIterations = _updatedCountIterations(countInliers, countPoints, sampleSize);
+                    if (countIterations < m_countIterations.load())
+                        m_countIterations = countIterations;
+                }
+            }
+        }
+    });
+    m_countIterations = std::min(m_nextIteration.load(), m_countIterations.load());
+    return found;
+}
+
+}
+
+#endif // AR_RANSAC_H
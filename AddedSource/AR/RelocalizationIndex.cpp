@@ -0,0 +1,243 @@
+#include "RelocalizationIndex.h"
+#include "KeyFrame.h"
+#include "PatchComparison.h"
+#include "TMath/TMath.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace AR {
+
+RelocalizationIndex::RelocalizationIndex()
+{
+    m_root = -1;
+    m_countIndexedEntries = 0;
+    m_countRemovedEntries = 0;
+    m_lastCountComparisons = 0;
+}
+
+void RelocalizationIndex::onCreateKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    _addEntry(keyFrame);
+}
+
+void RelocalizationIndex::onDeleteKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if ((it->key == keyFrame.get()) && !it->removed) {
+            it->removed = true;
+            it->keyFrame.reset();
+            it->smallImage = ConstImage<int>();
+            ++m_countRemovedEntries;
+            break;
+        }
+    }
+}
+
+void RelocalizationIndex::onResetMap()
+{
+    clear();
+}
+
+void RelocalizationIndex::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    m_entries.clear();
+    m_nodes.clear();
+    m_root = -1;
+    m_countIndexedEntries = 0;
+    m_countRemovedEntries = 0;
+}
+
+std::size_t RelocalizationIndex::countKeyFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    return m_entries.size() - m_countRemovedEntries;
+}
+
+std::size_t RelocalizationIndex::lastCountComparisons() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    return m_lastCountComparisons;
+}
+
+std::vector<RelocalizationIndex::Candidate> RelocalizationIndex::find(const ConstImage<int> & smallImage,
+                                                                      std::size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+    m_lastCountComparisons = 0;
+    std::vector<Candidate> result;
+    if (count == 0)
+        return result;
+
+    bool needRebuild = false;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->removed || (it->smallImage.size() == smallImage.size()))
+            continue;
+        // size of small images was changed, so small images of key frames were recomputed
+        std::shared_ptr<KeyFrame> keyFrame = it->keyFrame.lock();
+        if (keyFrame)
+            it->smallImage = keyFrame->smallImage();
+        if (!keyFrame || (it->smallImage.size() != smallImage.size())) {
+            it->removed = true;
+            ++m_countRemovedEntries;
+        } else {
+            _computeDescriptor(it->descriptor, it->smallImage);
+        }
+        needRebuild = true;
+    }
+    std::size_t countChanges = (m_entries.size() - m_countIndexedEntries) + m_countRemovedEntries;
+    if (needRebuild || (countChanges > std::max((std::size_t)8, m_entries.size() / 4)))
+        _rebuild();
+
+    Descriptor descriptor;
+    _computeDescriptor(descriptor, smallImage);
+    std::vector<std::pair<int, int>> best;
+    best.reserve(count + 1);
+    _search(m_root, descriptor, smallImage, best, count);
+    for (std::size_t i = m_countIndexedEntries; i < m_entries.size(); ++i)
+        _check((int)i, _distance(descriptor, m_entries[i].descriptor), smallImage, best, count);
+
+    result.reserve(best.size());
+    for (auto it = best.cbegin(); it != best.cend(); ++it) {
+        std::shared_ptr<KeyFrame> keyFrame = m_entries[it->second].keyFrame.lock();
+        if (keyFrame)
+            result.push_back({ keyFrame, it->first });
+    }
+    return result;
+}
+
+void RelocalizationIndex::_addEntry(const std::shared_ptr<KeyFrame> & keyFrame)
+{
+    Entry entry;
+    entry.key = keyFrame.get();
+    entry.keyFrame = keyFrame;
+    entry.smallImage = keyFrame->smallImage();
+    entry.removed = false;
+    _computeDescriptor(entry.descriptor, entry.smallImage);
+    m_entries.push_back(entry);
+}
+
+void RelocalizationIndex::_rebuild()
+{
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+                                   [] (const Entry & entry) { return entry.removed; }),
+                    m_entries.end());
+    m_countRemovedEntries = 0;
+    m_countIndexedEntries = m_entries.size();
+    m_nodes.clear();
+    m_nodes.reserve(m_entries.size());
+    m_buildBuffer.resize(m_entries.size());
+    for (std::size_t i = 0; i < m_entries.size(); ++i)
+        m_buildBuffer[i] = std::make_pair(0.0f, (int)i);
+    m_root = _buildNode(0, m_buildBuffer.size());
+}
+
+int RelocalizationIndex::_buildNode(std::size_t begin, std::size_t end)
+{
+    if (begin >= end)
+        return -1;
+    int nodeIndex = (int)m_nodes.size();
+    m_nodes.push_back({ m_buildBuffer[begin].second, 0.0f, -1, -1 });
+    const Descriptor & vantagePoint = m_entries[m_buildBuffer[begin].second].descriptor;
+    for (std::size_t i = begin + 1; i < end; ++i)
+        m_buildBuffer[i].first = _distance(vantagePoint, m_entries[m_buildBuffer[i].second].descriptor);
+    std::size_t middle = (begin + 1 + end) / 2;
+    if (middle < end) {
+        std::nth_element(m_buildBuffer.begin() + (begin + 1), m_buildBuffer.begin() + middle,
+                         m_buildBuffer.begin() + end);
+        m_nodes[nodeIndex].radius = m_buildBuffer[middle].first;
+    }
+    int inside = _buildNode(begin + 1, middle);
+    int outside = _buildNode(middle, end);
+    m_nodes[nodeIndex].inside = inside;
+    m_nodes[nodeIndex].outside = outside;
+    return nodeIndex;
+}
+
+void RelocalizationIndex::_search(int nodeIndex, const Descriptor & descriptor, const ConstImage<int> & smallImage,
+                                  std::vector<std::pair<int, int>> & best, std::size_t count)
+{
+    if (nodeIndex < 0)
+        return;
+    const Node & node = m_nodes[nodeIndex];
+    float distance = _distance(descriptor, m_entries[node.entry].descriptor);
+    _check(node.entry, distance, smallImage, best, count);
+    if (distance < node.radius) {
+        _search(node.inside, descriptor, smallImage, best, count);
+        if ((distance + _threshold(best, count)) >= node.radius)
+            _search(node.outside, descriptor, smallImage, best, count);
+    } else {
+        _search(node.outside, descriptor, smallImage, best, count);
+        if ((distance - _threshold(best, count)) <= node.radius)
+            _search(node.inside, descriptor, smallImage, best, count);
+    }
+}
+
+void RelocalizationIndex::_check(int entryIndex, float distance, const ConstImage<int> & smallImage,
+                                 std::vector<std::pair<int, int>> & best, std::size_t count)
+{
+    const Entry & entry = m_entries[entryIndex];
+    if (entry.removed)
+        return;
+    if (distance > _threshold(best, count))
+        return;
+    int score = _score(entry.smallImage, smallImage);
+    ++m_lastCountComparisons;
+    if ((best.size() == count) && (score >= best.back().first))
+        return;
+    std::pair<int, int> item(score, entryIndex);
+    best.insert(std::upper_bound(best.begin(), best.end(), item), item);
+    if (best.size() > count)
+        best.pop_back();
+}
+
+float RelocalizationIndex::_threshold(const std::vector<std::pair<int, int>> & best, std::size_t count)
+{
+    if (best.size() < count)
+        return std::numeric_limits<float>::max();
+    // the margin covers rounding errors of descriptors
+    return std::sqrt((float)best.back().first) * 1.0001f + 1e-3f;
+}
+
+void RelocalizationIndex::_computeDescriptor(Descriptor & descriptor, const ConstImage<int> & smallImage)
+{
+    descriptor.fill(0.0f);
+    Point2i gridSize(std::min(smallImage.width(), (int)descriptorGridSize),
+                     std::min(smallImage.height(), (int)descriptorGridSize));
+    if ((gridSize.x == 0) || (gridSize.y == 0))
+        return;
+    Point2i blockSize(smallImage.width() / gridSize.x, smallImage.height() / gridSize.y);
+    // by Cauchy-Schwarz inequality (sum of differences)^2 / area <= sum of squared differences in block
+    float scale = 1.0f / std::sqrt((float)(blockSize.x * blockSize.y));
+    for (int cy = 0; cy < gridSize.y; ++cy) {
+        for (int cx = 0; cx < gridSize.x; ++cx) {
+            int sum = 0;
+            const int * row = smallImage.pointer(cx * blockSize.x, cy * blockSize.y);
+            for (int y = 0; y < blockSize.y; ++y, row += smallImage.width()) {
+                for (int x = 0; x < blockSize.x; ++x)
+                    sum += row[x];
+            }
+            descriptor[cy * descriptorGridSize + cx] = sum * scale;
+        }
+    }
+}
+
+float RelocalizationIndex::_distance(const Descriptor & a, const Descriptor & b)
+{
+    float sum = 0.0f;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return std::sqrt(sum);
+}
+
+int RelocalizationIndex::_score(const ConstImage<int> & a, const ConstImage<int> & b)
+{
+    return SSD::compare(a, Point2i(0, 0), b, Point2i(0, 0), b.size());
+}
+
+} // namespace AR
@@ -0,0 +1,93 @@
+#ifndef AR_RELOCALIZATIONINDEX_H
+#define AR_RELOCALIZATIONINDEX_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <array>
+#include "Image.h"
+#include "Map.h"
+
+namespace AR {
+
+class KeyFrame;
+
+// Search of key frames with the nearest small images, the score is SSD of small images.
+// Every small image has a coarse descriptor - sums of blocks scaled so that euclidean distance between
+// descriptors is not greater than square root of the score. Descriptors are placed into a vantage-point tree,
+// so the search gives the same key frames as the full scan but compares small images only for a few of them.
+// The index is updated as a listener of the map, new key frames are placed into the tree on the next search.
+class RelocalizationIndex:
+        public Map::MapListener
+{
+public:
+    struct Candidate
+    {
+        std::shared_ptr<KeyFrame> keyFrame;
+        int score;
+    };
+
+    RelocalizationIndex();
+
+    void onCreateKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame) override;
+    void onDeleteKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame) override;
+    void onResetMap() override;
+
+    void clear();
+    std::size_t countKeyFrames() const;
+
+    // Returns up to count key frames sorted by score.
+    std::vector<Candidate> find(const ConstImage<int> & smallImage, std::size_t count);
+
+    // Count of compared small images on the last search.
+    std::size_t lastCountComparisons() const;
+
+private:
+    static const int descriptorGridSize = 8;
+    typedef std::array<float, descriptorGridSize * descriptorGridSize> Descriptor;
+
+    struct Entry
+    {
+        const KeyFrame * key;
+        std::weak_ptr<KeyFrame> keyFrame;
+        ConstImage<int> smallImage;
+        Descriptor descriptor;
+        bool removed;
+    };
+
+    struct Node
+    {
+        int entry;
+        float radius;
+        int inside;
+        int outside;
+    };
+
+    mutable std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+    std::vector<Node> m_nodes;
+    int m_root;
+    std::size_t m_countIndexedEntries;
+    std::size_t m_countRemovedEntries;
+    std::size_t m_lastCountComparisons;
+
+    std::vector<std::pair<float, int>> m_buildBuffer;
+
+    void _addEntry(const std::shared_ptr<KeyFrame> & keyFrame);
+    void _rebuild();
+    int _buildNode(std::size_t begin, std::size_t end);
+
+    static void _computeDescriptor(Descriptor & descriptor, const ConstImage<int> & smallImage);
+    static float _distance(const Descriptor & a, const Descriptor & b);
+    static int _score(const ConstImage<int> & a, const ConstImage<int> & b);
+
+    void _search(int nodeIndex, const Descriptor & descriptor, const ConstImage<int> & smallImage,
+                 std::vector<std::pair<int, int>> & best, std::size_t count);
+    void _check(int entryIndex, float distance, const ConstImage<int> & smallImage,
+                std::vector<std::pair<int, int>> & best, std::size_t count);
+    static float _threshold(const std::vector<std::pair<int, int>> & best, std::size_t count);
+};
+
+} // namespace AR
+
+#endif // AR_RELOCALIZATIONINDEX_H
@@ -2,6 +2,7 @@
 #include "Camera.h"
 #include "TMath/TMath.h"
 #include "TukeyRobustCost.h"
+#include "PatchJacobian.h"
 #include <cmath>
 #include <algorithm>
 
@@ -15,6 +16,8 @@ RotationTracker::RotationTracker():
     m_last_X.setZero();
     m_countTrackedFeatures = 0;
     m_gaussian = nullptr;
+    m_doublePrecision = false;
+    m_jacobianStride = 0;
     setCursorSize(Point2i(2, 2));
     m_eps = 3e-5;
     m_numberIterations = 12;
@@ -118,7 +121,10 @@ void RotationTracker::setCursorSize(const Point2i& cursorSize)
     m_cursorSize = cursorSize;
     m_sigmaGaussian = std::max(m_cursorSize.x, m_cursorSize.y) / 3.0f;
     int memSize = (m_cursorSize.y * 2 + 1) * (m_cursorSize.x * 2 + 1);
-    m_gaussian = static_cast<float*>(realloc(m_gaussian, sizeof(float) * memSize));
+    // weights of padding pixels of PatchJacobian are zero
+    int paddedSize = PatchJacobian::stride(memSize);
+    m_gaussian = static_cast<float*>(realloc(m_gaussian, sizeof(float) * paddedSize));
+    std::fill(m_gaussian + memSize, m_gaussian + paddedSize, 0.0f);
     _solveGaussian();
 }
 
@@ -126,6 +132,17 @@ int RotationTracker::countTrackedFeatures() const
 {
     return m_countTrackedFeatures;
 }
+
+bool RotationTracker::doublePrecision() const
+{
+    return m_doublePrecision;
+}
+
+void RotationTracker::setDoublePrecision(bool doublePrecision)
+{
+    m_doublePrecision = doublePrecision;
+}
+
 void RotationTracker::_setSigmaGaussian(float sigma)
 {
     m_sigmaGaussian = sigma;
@@ -167,13 +184,28 @@ bool RotationTracker::tracking()
     using namespace TMath;
     TMath_assert((m_firstFrameImagePyramid.size() > 0) && (m_secondFrameImagePyramid.size() > 0));
     Point2i patchSize = m_cursorSize * 2 + Point2i(1, 1);
-    m_jacobian_cashe = Image<double>(Point2i(patchSize.y * patchSize.x * 6, (int)m_featuresInfo.size()));
-    m_pixels_cashe = Image<float>(Point2i(patchSize.y * patchSize.x, (int)m_featuresInfo.size()));
+    int patchArea = patchSize.y * patchSize.x;
+    m_jacobianStride = PatchJacobian::stride(patchArea);
+    if (m_doublePrecision) {
+        m_jacobian_cashe = Image<double>(Point2i(patchArea * 6, (int)m_featuresInfo.size()));
+    } else {
+        // rows of derivatives have padding pixels, they must be zero
+        m_floatJacobian_cashe = Image<float>(Point2i(m_jacobianStride * 3, (int)m_featuresInfo.size()));
+        std::fill(m_floatJacobian_cashe.data(), m_floatJacobian_cashe.data() + m_floatJacobian_cashe.area(), 0.0f);
+        m_residuals.assign(m_jacobianStride, 0.0f);
+    }
+    m_pixels_cashe = Image<float>(Point2i(patchArea, (int)m_featuresInfo.size()));
     int i = 0;
     for (std::vector<FeatureInfo>::iterator it = m_featuresInfo.begin();
             it != m_featuresInfo.end();
             ++it) {
-        it->jacobian_cache = m_jacobian_cashe.pointer(0, i);
+        if (m_doublePrecision) {
+            it->jacobian_cache = m_jacobian_cashe.pointer(0, i);
+            it->floatJacobian_cache = nullptr;
+        } else {
+            it->jacobian_cache = nullptr;
+            it->floatJacobian_cache = m_floatJacobian_cashe.pointer(0, i);
+        }
         it->pixels_cache = m_pixels_cashe.pointer(0, i);
         ++i;
     }
@@ -284,7 +316,7 @@ void RotationTracker::_computeLevelInfo(const TMath::TMatrixd& deltaRotation, co
 
     float dt, featureError;
 
-    int k;
+    int j, k;
 
     for (std::size_t i = 0; i < m_featuresInfo.size(); ++i) {
         FeatureInfo& featureInfo = m_featuresInfo[i];
@@ -343,6 +375,7 @@ void RotationTracker::_computeLevelInfo(const TMath::TMatrixd& deltaRotation, co
         const uchar* secondImageStrNext = &secondImageStr[secondImage.width()];
 
         double* jacobian_cache = featureInfo.jacobian_cache;
+        float* floatJacobian_cache = featureInfo.floatJacobian_cache;
         float* pixels_cache = featureInfo.pixels_cache;
         k = 0;
         for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
@@ -367,11 +400,17 @@ void RotationTracker::_computeLevelInfo(const TMath::TMatrixd& deltaRotation, co
                        (imageStrNextNext[p.x] - imageStr[p.x]) * w_bl +
                        (imageStrNextNext[p.x + 1] - imageStr[p.x + 1]) * w_br) * 0.5f;
 
-                //don't believe in optimizator
-                jacobian_cache[0] = (featureInfo.J_x(0) * d.x + featureInfo.J_y(0) * d.y) * commonMultiplier;
-                jacobian_cache[1] = (featureInfo.J_x(1) * d.x + featureInfo.J_y(1) * d.y) * commonMultiplier;
-                jacobian_cache[2] = (featureInfo.J_x(2) * d.x + featureInfo.J_y(2) * d.y) * commonMultiplier;
-                jacobian_cache = &jacobian_cache[3];
+                if (jacobian_cache != nullptr) {
+                    //don't believe in optimizator
+                    jacobian_cache[0] = (featureInfo.J_x(0) * d.x + featureInfo.J_y(0) * d.y) * commonMultiplier;
+                    jacobian_cache[1] = (featureInfo.J_x(1) * d.x + featureInfo.J_y(1) * d.y) * commonMultiplier;
+                    jacobian_cache[2] = (featureInfo.J_x(2) * d.x + featureInfo.J_y(2) * d.y) * commonMultiplier;
+                    jacobian_cache = &jacobian_cache[3];
+                } else {
+                    for (j = 0; j < 3; ++j)
+                        floatJacobian_cache[j * m_jacobianStride + k] =
+                                (float)((featureInfo.J_x(j) * d.x + featureInfo.J_y(j) * d.y) * commonMultiplier);
+                }
             }
             imageStrPrev = imageStr;
             imageStr = imageStrNext;
@@ -402,8 +441,7 @@ double RotationTracker::_optimize(TMath::TMatrixd& deltaRotation, TMath::TVector
 
     double A_raw[6];
 
-    TVectord B(3);
-    B.setZero();
+    double B_raw[3] = { 0.0, 0.0, 0.0 };
 
     int i, j, k, t;
 
@@ -455,6 +493,23 @@ double RotationTracker::_optimize(TMath::TMatrixd& deltaRotation, TMath::TVector
         const uchar* imageStrNext = &imageStr[secondImage.width()];
         k = 0;
         const float* pixels_cache = featureInfo.pixels_cache;
+        if (featureInfo.floatJacobian_cache != nullptr) {
+            float* residuals = m_residuals.data();
+            for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
+                for (p.x = - m_cursorSize.x; p.x <= m_cursorSize.x; ++p.x, ++k) {
+                    residuals[k] = (imageStr[p.x] * w_tl +
+                                    imageStr[p.x + 1] * w_tr +
+                                    imageStrNext[p.x] * w_bl +
+                                    imageStrNext[p.x + 1] * w_br) - pixels_cache[k];
+                }
+                imageStr = imageStrNext;
+                imageStrNext = &imageStrNext[secondImage.width()];
+            }
+            PatchJacobian::accumulate(A_raw, B_raw, error, 3, featureInfo.floatJacobian_cache,
+                                      residuals, m_gaussian, m_jacobianStride, m_sigmaSquared);
+            ++m_countTrackedFeatures;
+            continue;
+        }
         const double* jacobian_cache = featureInfo.jacobian_cache;
         for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
             for (p.x = - m_cursorSize.x; p.x <= m_cursorSize.x; ++p.x, ++k) {
@@ -473,7 +528,7 @@ double RotationTracker::_optimize(TMath::TMatrixd& deltaRotation, TMath::TVector
                         A_raw[t] += jacobian_cache[i] * jacobian_cache[j] * weight;//J * J.transposed() * w
                         ++t;
                     }
-                    B(i) += jacobian_cache[i] * wdt; // J * w
+                    B_raw[i] += jacobian_cache[i] * wdt; // J * w
                 }
 
                 ++pixels_cache;
@@ -499,6 +554,9 @@ double RotationTracker::_optimize(TMath::TMatrixd& deltaRotation, TMath::TVector
         ++t;
     }
     TCholesky<double> cholesky(A);
+    TVectord B(3);
+    for (i = 0; i < 3; ++i)
+        B(i) = B_raw[i];
     m_last_X = cholesky.backsub(B);
     for (i = 0; i < 3; ++i) {
         if (std::isnan(m_last_X(i)))
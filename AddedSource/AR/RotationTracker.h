@@ -35,6 +35,10 @@ public:
 
     int countTrackedFeatures() const;
 
+    // Float jacobians and kernels of PatchJacobian are used by default, the double path is kept for comparison.
+    bool doublePrecision() const;
+    void setDoublePrecision(bool doublePrecision);
+
     void reset();
 
     bool tracking();
@@ -68,6 +72,7 @@ private:
         bool visible;
         float* pixels_cache;
         double* jacobian_cache;
+        float* floatJacobian_cache;
         TMath::TVectord localPosition;
         TMath::TVectord J_x, J_y;
     };
@@ -77,6 +82,7 @@ private:
     int m_minLevel;
     int m_maxLevel;
     Point2i m_cursorSize;
+    bool m_doublePrecision;
 
     float* m_gaussian;
     float m_sigmaGaussian;
@@ -84,6 +90,9 @@ private:
 
     Image<float> m_pixels_cashe;
     Image<double> m_jacobian_cashe;
+    Image<float> m_floatJacobian_cashe;
+    int m_jacobianStride;
+    std::vector<float> m_residuals;
 
     std::vector<ConstImage<uchar>> m_firstFrameImagePyramid;
     TMath::TMatrixd m_firstRotation;
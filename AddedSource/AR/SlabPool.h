@@ -0,0 +1,159 @@
+#ifndef AR_SLABPOOL_H
+#define AR_SLABPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <type_traits>
+#include <new>
+#include "TMath/TMath.h"
+
+namespace AR {
+
+// Count of objects in one slab of SlabPool, blocks of slabs have arrays of this size.
+const std::size_t countObjectsInSlab = 256;
+
+struct EmptySlabBlock
+{
+};
+
+// Slot of object in SlabPool and generation of slot when object was allocated. Handles don't own objects,
+// they are used as keys of per-object data (see WarpedPatchCache).
+struct SlabHandle
+{
+    std::uint32_t slot;
+    std::uint32_t generation;
+};
+
+// Storage of objects of the map in slabs - contiguous arrays of countObjectsInSlab objects, slabs are never moved.
+// Every slab has Block - additional data of objects stored as structure of arrays (i-th element of arrays of block
+// belongs to i-th object of slab).
+// Every slot has generation: it's odd while slot is used and it's increased when slot is allocated and freed,
+// so handles of freed objects differ from handles of new objects in the same slot.
+// Objects are constructed by placement new in memory from allocate() and are owned by shared_ptr from makeShared(),
+// the deleter keeps the pool, so objects can outlive their map. Objects can be freed in any thread.
+template <typename T, typename Block = EmptySlabBlock>
+class SlabPool:
+        public std::enable_shared_from_this<SlabPool<T, Block>>
+{
+public:
+    static const std::size_t maxCountSlabs = 16384;
+
+    SlabPool():
+        m_countSlots(0)
+    {
+        m_slabs.reserve(maxCountSlabs);
+    }
+
+    ~SlabPool()
+    {
+        for (Slab * slab : m_slabs)
+            delete slab;
+    }
+
+    std::size_t countSlots() const
+    {
+        return m_countSlots.load();
+    }
+
+    // Memory for a new object in slot. Throws std::bad_alloc if all maxCountSlabs slabs are used -
+    // m_slabs can't grow past its reserved memory, because it's read without lock.
+    void * allocate(std::size_t & slot)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+        if (m_freeSlots.empty()) {
+            if (m_slabs.size() >= maxCountSlabs)
+                throw std::bad_alloc();
+            m_slabs.push_back(new Slab());
+            std::size_t begin = (m_slabs.size() - 1) * countObjectsInSlab;
+            for (std::size_t i = countObjectsInSlab; i > 0; --i)
+                m_freeSlots.push_back(begin + i - 1);
+            m_countSlots = m_slabs.size() * countObjectsInSlab;
+        }
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        Slab * slab = m_slabs[slot / countObjectsInSlab];
+        ++slab->generations[slot % countObjectsInSlab];
+        return &slab->objects[slot % countObjectsInSlab];
+    }
+
+    // Object constructed in slot by allocate().
+    std::shared_ptr<T> makeShared(T * object, std::size_t slot)
+    {
+        return std::shared_ptr<T>(object, Deleter{ this->shared_from_this(), slot });
+    }
+
+    bool isUsed(std::size_t slot) const
+    {
+        return (_slab(slot)->generations[slot % countObjectsInSlab].load() & 1) != 0;
+    }
+
+    T * object(std::size_t slot) const
+    {
+        return reinterpret_cast<T*>(&_slab(slot)->objects[slot % countObjectsInSlab]);
+    }
+
+    Block & block(std::size_t slot) const
+    {
+        return _slab(slot)->block;
+    }
+
+    SlabHandle handle(std::size_t slot) const
+    {
+        return SlabHandle{ (std::uint32_t)slot, _slab(slot)->generations[slot % countObjectsInSlab].load() };
+    }
+
+private:
+    struct Slab
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type objects[countObjectsInSlab];
+        std::atomic<std::uint32_t> generations[countObjectsInSlab];
+        Block block;
+
+        Slab()
+        {
+            for (std::size_t i = 0; i < countObjectsInSlab; ++i)
+                generations[i] = 0;
+        }
+    };
+
+    struct Deleter
+    {
+        std::shared_ptr<SlabPool> pool;
+        std::size_t slot;
+
+        void operator()(T * object) const
+        {
+            object->~T();
+            pool->_free(slot);
+        }
+    };
+
+    SlabPool(const SlabPool & ) = delete;
+    void operator = (const SlabPool & ) = delete;
+
+    // Memory of m_slabs is reserved, so slabs can be read without lock.
+    std::vector<Slab*> m_slabs;
+    std::vector<std::size_t> m_freeSlots;
+    std::atomic<std::size_t> m_countSlots;
+    std::mutex m_mutex;
+
+    Slab * _slab(std::size_t slot) const
+    {
+        return m_slabs.data()[slot / countObjectsInSlab];
+    }
+
+    void _free(std::size_t slot)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+        ++_slab(slot)->generations[slot % countObjectsInSlab];
+        m_freeSlots.push_back(slot);
+    }
+};
+
+}
+
+#endif // AR_SLABPOOL_H
@@ -0,0 +1,215 @@
+#ifndef AR_SPSCRINGBUFFER_H
+#define AR_SPSCRINGBUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cassert>
+
+namespace AR {
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+// Every slot holds an item stamped with its sequence number and is taken with an atomic exchange,
+// so the producer can overwrite the oldest item without waiting for the consumer.
+// The limit of items can be changed at any time, but it can't be greater than capacity. With DropOldest policy
+// the producer drops items older than the limit itself, so not more than limit items are kept while the consumer
+// is stalled. Nodes of items are preallocated (capacity + 2: items of slots, the node taken by the consumer and
+// the node of the new item), so push() and pop() don't allocate memory.
+template <typename T>
+class SpscRingBuffer
+{
+public:
+    enum class Policy
+    {
+        DropOldest,
+        DropNewest
+    };
+
+    SpscRingBuffer(std::size_t capacity):
+        m_capacity(capacity)
+    {
+        assert(capacity > 0);
+        m_countNodes = m_capacity + 2;
+        m_nodes = new Node[m_countNodes];
+        for (std::size_t i = 0; i < m_countNodes; ++i)
+            m_nodes[i].isFree.store(true, std::memory_order_relaxed);
+        m_nextNode = 0;
+        m_producerTail = 0;
+        m_slots = new std::atomic<Node*>[m_capacity];
+        for (std::size_t i = 0; i < m_capacity; ++i)
+            m_slots[i].store(nullptr, std::memory_order_relaxed);
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_limit.store(m_capacity, std::memory_order_relaxed);
+        m_policy.store((int)Policy::DropOldest, std::memory_order_relaxed);
+        m_countDropped.store(0, std::memory_order_relaxed);
+        m_countPopped.store(0, std::memory_order_relaxed);
+    }
+
+    ~SpscRingBuffer()
+    {
+        delete[] m_slots;
+        delete[] m_nodes;
+    }
+
+    std::size_t capacity() const { return m_capacity; }
+
+    std::size_t limit() const { return m_limit.load(std::memory_order_relaxed); }
+    void setLimit(std::size_t limit)
+    {
+        m_limit.store(std::max(std::min(limit, m_capacity), (std::size_t)1), std::memory_order_relaxed);
+    }
+
+    Policy policy() const { return (Policy)m_policy.load(std::memory_order_relaxed); }
+    void setPolicy(Policy policy) { m_policy.store((int)policy, std::memory_order_relaxed); }
+
+    std::size_t countDropped() const { return m_countDropped.load(std::memory_order_relaxed); }
+    std::size_t countPopped() const { return m_countPopped.load(std::memory_order_relaxed); }
+
+    bool empty() const
+    {
+        return (m_head.load(std::memory_order_acquire) <= m_tail.load(std::memory_order_acquire));
+    }
+
+    // Called only from producer thread. Returns false if the item was dropped.
+    bool push(std::unique_ptr<T> && item)
+    {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        std::size_t tail = m_tail.load(std::memory_order_acquire);
+        // the consumer can take the last item before the producer has moved the head
+        if ((policy() == Policy::DropNewest) && (tail < head) && ((head - tail) >= limit())) {
+            m_countDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Node * node = _takeFreeNode();
+        node->sequence = head;
+        node->item = std::move(item);
+        Node * prev = m_slots[head % m_capacity].exchange(node, std::memory_order_acq_rel);
+        if (prev != nullptr) {
+            // the consumer didn't take it in time
+            _freeNode(prev);
+            m_countDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_head.store(head + 1, std::memory_order_release);
+        if (policy() == Policy::DropOldest) {
+            // items older than the limit are dropped, if the consumer didn't take them yet
+            std::size_t currentLimit = limit();
+            std::size_t sequence = std::max(m_producerTail, (head + 1 > m_capacity) ? (head + 1 - m_capacity) : 0);
+            for (; (sequence + currentLimit) <= head; ++sequence) {
+                Node * oldNode = m_slots[sequence % m_capacity].exchange(nullptr, std::memory_order_acq_rel);
+                if (oldNode != nullptr) {
+                    _freeNode(oldNode);
+                    m_countDropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            m_producerTail = sequence;
+        }
+        return true;
+    }
+
+    // Called only from consumer thread. Returns nullptr if the queue is empty.
+    std::unique_ptr<T> pop()
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            std::size_t head = m_head.load(std::memory_order_acquire);
+            // the item can be taken before the producer has moved the head
+            if (head <= tail)
+                break;
+            std::size_t currentLimit = limit();
+            if ((head - tail) > currentLimit) {
+                std::size_t newTail = head - currentLimit;
+                if ((newTail - tail) > m_capacity)
+                    tail = newTail - m_capacity;
+                for (; tail < newTail; ++tail)
+                    _dropSlot(tail % m_capacity, newTail);
+                continue;
+            }
+            Node * node = m_slots[tail % m_capacity].exchange(nullptr, std::memory_order_acq_rel);
+            if (node == nullptr) {
+                ++tail;
+                continue;
+            }
+            if (node->sequence < tail) {
+                _freeNode(node);
+                m_countDropped.fetch_add(1, std::memory_order_relaxed);
+                ++tail;
+                continue;
+            }
+            // if the slot was overwritten, older items are skipped
+            tail = node->sequence + 1;
+            m_tail.store(tail, std::memory_order_release);
+            std::unique_ptr<T> item = std::move(node->item);
+            _freeNode(node);
+            m_countPopped.fetch_add(1, std::memory_order_relaxed);
+            return item;
+        }
+        m_tail.store(tail, std::memory_order_release);
+        return std::unique_ptr<T>();
+    }
+
+private:
+    struct Node
+    {
+        std::size_t sequence;
+        std::unique_ptr<T> item;
+        std::atomic<bool> isFree; // node can be taken by the producer
+    };
+
+    const std::size_t m_capacity;
+    std::size_t m_countNodes;
+    Node * m_nodes;
+    std::size_t m_nextNode;     // used only by the producer
+    std::size_t m_producerTail; // sequence of the oldest item which may be dropped by the producer
+    std::atomic<Node*> * m_slots;
+    std::atomic<std::size_t> m_head;
+    std::atomic<std::size_t> m_tail;
+    std::atomic<std::size_t> m_limit;
+    std::atomic<int> m_policy;
+    std::atomic<std::size_t> m_countDropped;
+    std::atomic<std::size_t> m_countPopped;
+
+    SpscRingBuffer(const SpscRingBuffer &) = delete;
+    SpscRingBuffer & operator = (const SpscRingBuffer &) = delete;
+
+    void _dropSlot(std::size_t slotIndex, std::size_t minSequence)
+    {
+        Node * node = m_slots[slotIndex].exchange(nullptr, std::memory_order_acq_rel);
+        if (node == nullptr)
+            return;
+        if (node->sequence >= minSequence) {
+            // the item is new, so we return it back if the producer didn't write into this slot
+            Node * expected = nullptr;
+            if (m_slots[slotIndex].compare_exchange_strong(expected, node, std::memory_order_acq_rel))
+                return;
+        }
+        _freeNode(node);
+        m_countDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Called only from producer thread. At most capacity nodes are in slots and one node is taken by the consumer,
+    // so one of the nodes is free.
+    Node * _takeFreeNode()
+    {
+        for (;;) {
+            Node * node = &m_nodes[m_nextNode];
+            m_nextNode = (m_nextNode + 1) % m_countNodes;
+            if (node->isFree.load(std::memory_order_acquire)) {
+                node->isFree.store(false, std::memory_order_relaxed);
+                return node;
+            }
+        }
+    }
+
+    // Called from any of threads by the owner of the node.
+    void _freeNode(Node * node)
+    {
+        node->item.reset();
+        node->isFree.store(true, std::memory_order_release);
+    }
+};
+
+}
+
+#endif // AR_SPSCRINGBUFFER_H
@@ -0,0 +1,132 @@
+#include "ThreadPool.h"
+#include "TMath/TMath.h"
+#include <algorithm>
+
+namespace AR {
+
+ThreadPool::ThreadPool(int countThreads)
+{
+    m_stop = false;
+    m_generation = 0;
+    m_countBusyWorkers = 0;
+    m_task = nullptr;
+    m_countTasks = 0;
+    m_nextTask = 0;
+    m_tasksOnThreads = false;
+    setCountThreads(countThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+    _stopWorkers();
+}
+
+int ThreadPool::countThreads() const
+{
+    return (int)m_workers.size() + 1;
+}
+
+void ThreadPool::setCountThreads(int countThreads)
+{
+    if (countThreads <= 0)
+        countThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+    if (countThreads == this->countThreads())
+        return;
+    _stopWorkers();
+    _startWorkers(countThreads - 1);
+}
+
+void ThreadPool::run(int countTasks, const std::function<void(int)> & task)
+{
+    if (m_workers.empty() || (countTasks <= 1)) {
+        for (int i = 0; i < countTasks; ++i)
+            task(i);
+        return;
+    }
+    _start(countTasks, task, false);
+}
+
+void ThreadPool::runOnThreads(const std::function<void(int)> & task)
+{
+    if (m_workers.empty()) {
+        task(0);
+        return;
+    }
+    _start(countThreads(), task, true);
+}
+
+void ThreadPool::_start(int countTasks, const std::function<void(int)> & task, bool tasksOnThreads)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+        m_task = &task;
+        m_countTasks = countTasks;
+        m_nextTask = 0;
+        m_tasksOnThreads = tasksOnThreads;
+        m_countBusyWorkers = (int)m_workers.size();
+        ++m_generation;
+    }
+    m_startCondition.notify_all();
+    _executeTasks(0);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finishCondition.wait(lock, [this] () { return (m_countBusyWorkers == 0); });
+    m_task = nullptr;
+}
+
+void ThreadPool::_startWorkers(int countWorkers)
+{
+    TMath_assert(m_workers.empty());
+    m_stop = false;
+    m_workers.reserve(countWorkers);
+    // generation is passed from here, so workers which start late don't skip the first run()
+    for (int i = 0; i < countWorkers; ++i)
+        m_workers.push_back(std::thread(&ThreadPool::_workerLoop, this, i + 1, m_generation));
+}
+
+void ThreadPool::_stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+        m_stop = true;
+    }
+    m_startCondition.notify_all();
+    for (auto it = m_workers.begin(); it != m_workers.end(); ++it)
+        it->join();
+    m_workers.clear();
+}
+
+void ThreadPool::_workerLoop(int thread, unsigned int generation)
+{
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_startCondition.wait(lock, [this, generation] () { return m_stop || (m_generation != generation); });
+            if (m_stop)
+                return;
+            generation = m_generation;
+        }
+        _executeTasks(thread);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex); (void)lock;
+            --m_countBusyWorkers;
+            if (m_countBusyWorkers == 0)
+                m_finishCondition.notify_one();
+        }
+    }
+}
+
+void ThreadPool::_executeTasks(int thread)
+{
+    if (m_tasksOnThreads) {
+        (*m_task)(thread);
+        return;
+    }
+    for (;;) {
+        int index = m_nextTask.fetch_add(1);
+        if (index >= m_countTasks)
+            break;
+        (*m_task)(index);
+    }
+}
+
+} // namespace AR
@@ -0,0 +1,60 @@
+#ifndef AR_THREADPOOL_H
+#define AR_THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace AR {
+
+// Pool of worker threads for parallel loops. The calling thread executes tasks too, so a pool with one thread
+// hasn't worker threads and executes tasks serially. Tasks are taken by threads in any order, so for reproducible
+// results every task must write only its own data and the caller must combine results in order of tasks.
+// run() must not be called from several threads at the same time.
+class ThreadPool
+{
+public:
+    ThreadPool(int countThreads = 1);
+    ~ThreadPool();
+
+    int countThreads() const;
+    // If countThreads <= 0 then count of hardware threads is used.
+    void setCountThreads(int countThreads);
+
+    // Calls task(index) for every index in [0, countTasks) and waits while all tasks are finished.
+    void run(int countTasks, const std::function<void(int)> & task);
+    // Calls task(thread) once in every thread of pool and waits while all tasks are finished.
+    // The calling thread has index 0, so the task can use resources bound to the calling thread (locks and so on).
+    void runOnThreads(const std::function<void(int)> & task);
+
+private:
+    ThreadPool(const ThreadPool & ) = delete;
+    void operator = (const ThreadPool & ) = delete;
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_startCondition;
+    std::condition_variable m_finishCondition;
+    bool m_stop;
+    unsigned int m_generation;
+    int m_countBusyWorkers;
+
+    const std::function<void(int)> * m_task;
+    int m_countTasks;
+    std::atomic<int> m_nextTask;
+    bool m_tasksOnThreads; // index of task is index of thread
+
+    void _startWorkers(int countWorkers);
+    void _stopWorkers();
+    void _workerLoop(int thread, unsigned int generation);
+    void _start(int countTasks, const std::function<void(int)> & task, bool tasksOnThreads);
+    void _executeTasks(int thread);
+};
+
+} // namespace AR
+
+#endif // AR_THREADPOOL_H
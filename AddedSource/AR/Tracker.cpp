@@ -6,7 +6,9 @@
 #include "MapPoint.h"
 #include "TMath/TMath.h"
 #include "TukeyRobustCost.h"
+#include "PatchJacobian.h"
 #include <cmath>
+#include <algorithm>
 
 namespace AR {
 
@@ -19,6 +21,8 @@ Tracker::Tracker():
     m_countTrackedFeatures = 0;
     m_gaussian = nullptr;
     m_resourceManager = nullptr;
+    m_doublePrecision = false;
+    m_jacobianStride = 0;
     setCursorSize(Point2i(2, 2));
     m_eps = 3e-4;
     m_numberIterations = 20;
@@ -45,22 +49,20 @@ void Tracker::setFirstFrame(const std::shared_ptr<KeyFrame> & keyFrame)
     m_firstTranslation = keyFrame->translation();
     m_featuresInfo.resize(0);
     m_featuresInfo.reserve(keyFrame->countFeatures());
-    TMath::TVectord firstWorldPosition = - m_firstRotation.refTransposed() * m_firstTranslation;
+    TVector3d firstWorldPosition = - m_firstRotation.refTransposed() * m_firstTranslation;
     FeatureInfo featureInfo;
-    featureInfo.J_x = TVectord(6);
-    featureInfo.J_y = TVectord(6);
-    TVectord J_x(6), J_y(6);
+    TVector6d J_x, J_y;
     Camera::ProjectionInfo projectionInfo;
     TMatrixd projectionDerivatives;
     for (int i = 0; i < keyFrame->countFeatures(); ++i) {
         std::shared_ptr<const Feature> feature = keyFrame->feature(i);
         std::shared_ptr<const MapPoint> mapPoint = feature->mapPoint();
         if (mapPoint) {
-            MapResourceLocker lockerMapPoint(m_resourceManager, mapPoint.get()); (void)lockerMapPoint;
+            MapResourceLocker lockerMapPoint(m_resourceManager, mapPoint.get(), MapResourceAccess::Shared); (void)lockerMapPoint;
             Point2d p = m_firstCamera->unproject(feature->positionOnFrame(), projectionInfo);
             featureInfo.imagePosition = feature->positionOnFrame();
-            featureInfo.localPosition = TVectord::create(p.x, p.y, 1.0).normalized() *
-                    (mapPoint->position() - firstWorldPosition).length();
+            featureInfo.localPosition = TVector3d::create(p.x, p.y, 1.0).normalized() *
+                    (TVector3d(mapPoint->position()) - firstWorldPosition).length();
             LocationOptimizer::jacobian_xyz2uv(J_x, J_y, featureInfo.localPosition);
             projectionDerivatives = m_firstCamera->getProjectionDerivatives(projectionInfo);
             for (int j = 0; j < 6; ++j) {
@@ -83,23 +85,21 @@ void Tracker::setFirstFrame(PreviewFrame & frame)
     m_firstRotation = frame.rotation();
     m_firstTranslation = frame.translation();
     m_featuresInfo.resize(frame.countPreviewFeatures());
-    TVectord firstWorldPosition = - m_firstRotation.refTransposed() * m_firstTranslation;
-    TVectord J_x(6), J_y(6);
+    TVector3d firstWorldPosition = - m_firstRotation.refTransposed() * m_firstTranslation;
+    TVector6d J_x, J_y;
     Camera::ProjectionInfo projectionInfo;
     TMatrixd projectionDerivatives;
     for (std::size_t i = 0; i < frame.countPreviewFeatures(); ++i) {
         PreviewFrame::PreviewFeature & feature = frame.previewFeature(i);
         FeatureInfo & featureInfo = m_featuresInfo[i];
         std::shared_ptr<const MapPoint> mapPoint = feature.mapPoint;
-        MapResourceLocker lockerMapPoint(m_resourceManager, mapPoint.get()); (void)lockerMapPoint;
+        MapResourceLocker lockerMapPoint(m_resourceManager, mapPoint.get(), MapResourceAccess::Shared); (void)lockerMapPoint;
         Point2d p = m_firstCamera->unproject(feature.positionOnFrame, projectionInfo);
         featureInfo.imagePosition = feature.positionOnFrame;
-        featureInfo.localPosition = TVectord::create(p.x, p.y, 1.0).normalized() *
-                (mapPoint->position() - firstWorldPosition).length();
+        featureInfo.localPosition = TVector3d::create(p.x, p.y, 1.0).normalized() *
+                (TVector3d(mapPoint->position()) - firstWorldPosition).length();
         LocationOptimizer::jacobian_xyz2uv(J_x, J_y, featureInfo.localPosition);
         projectionDerivatives = m_firstCamera->getProjectionDerivatives(projectionInfo);
-        featureInfo.J_x = TVectord(6);
-        featureInfo.J_y = TVectord(6);
         for (int j = 0; j < 6; ++j) {
             featureInfo.J_x(j) = projectionDerivatives(0, 0) * J_x(j) + projectionDerivatives(0, 1) * J_y(j);
             featureInfo.J_y(j) = projectionDerivatives(1, 0) * J_x(j) + projectionDerivatives(1, 1) * J_y(j);
@@ -174,7 +174,10 @@ void Tracker::setCursorSize(const Point2i& cursorSize)
     m_cursorSize = cursorSize;
     m_sigmaGaussian = std::max(m_cursorSize.x, m_cursorSize.y) / 3.0f;
     int memSize = (m_cursorSize.y * 2 + 1) * (m_cursorSize.x * 2 + 1);
-    m_gaussian = static_cast<float*>(realloc(m_gaussian, sizeof(float) * memSize));
+    // weights of padding pixels of PatchJacobian are zero
+    int paddedSize = PatchJacobian::stride(memSize);
+    m_gaussian = static_cast<float*>(realloc(m_gaussian, sizeof(float) * paddedSize));
+    std::fill(m_gaussian + memSize, m_gaussian + paddedSize, 0.0f);
     _solveGaussian();
 }
 
@@ -182,6 +185,27 @@ int Tracker::countTrackedFeatures() const
 {
     return m_countTrackedFeatures;
 }
+
+int Tracker::countThreads() const
+{
+    return m_threadPool.countThreads();
+}
+
+void Tracker::setCountThreads(int countThreads)
+{
+    m_threadPool.setCountThreads(countThreads);
+}
+
+bool Tracker::doublePrecision() const
+{
+    return m_doublePrecision;
+}
+
+void Tracker::setDoublePrecision(bool doublePrecision)
+{
+    m_doublePrecision = doublePrecision;
+}
+
 void Tracker::_setSigmaGaussian(float sigma)
 {
     m_sigmaGaussian = sigma;
@@ -233,13 +257,28 @@ void Tracker::tracking()
     using namespace TMath;
     TMath_assert((m_firstFrameImagePyramid.size() > 0) && (m_secondFrameImagePyramid.size() > 0));
     Point2i patchSize = m_cursorSize * 2 + Point2i(1, 1);
-    m_jacobian_cashe = Image<double>(Point2i(patchSize.y * patchSize.x * 6, (int)m_featuresInfo.size()));
-    m_pixels_cashe = Image<float>(Point2i(patchSize.y * patchSize.x, (int)m_featuresInfo.size()));
+    int patchArea = patchSize.y * patchSize.x;
+    m_jacobianStride = PatchJacobian::stride(patchArea);
+    const int countFeatures = (int)m_featuresInfo.size();
+    if (m_doublePrecision) {
+        _reserveCashe(m_jacobian_cashe, patchArea * 6, countFeatures);
+    } else {
+        // rows of derivatives have padding pixels, they must be zero
+        _reserveCashe(m_floatJacobian_cashe, m_jacobianStride * 6, countFeatures);
+        std::fill(m_floatJacobian_cashe.data(), m_floatJacobian_cashe.pointer(0, countFeatures), 0.0f);
+    }
+    _reserveCashe(m_pixels_cashe, patchArea, countFeatures);
     int i = 0;
     for (std::vector<FeatureInfo>::iterator it = m_featuresInfo.begin();
             it != m_featuresInfo.end();
             ++it) {
-        it->jacobian_cache = m_jacobian_cashe.pointer(0, i);
+        if (m_doublePrecision) {
+            it->jacobian_cache = m_jacobian_cashe.pointer(0, i);
+            it->floatJacobian_cache = nullptr;
+        } else {
+            it->jacobian_cache = nullptr;
+            it->floatJacobian_cache = m_floatJacobian_cashe.pointer(0, i);
+        }
         it->pixels_cache = m_pixels_cashe.pointer(0, i);
         ++i;
     }
@@ -252,10 +291,10 @@ void Tracker::tracking()
     TMatrixd firstInvRotation = m_firstRotation;
     if (!TTools::matrix3x3Invert(firstInvRotation))
         return;
-    TMatrixd deltaRotation = m_secondRotation * firstInvRotation;
-    TVectord deltaTranslation = m_secondRotation * (- firstInvRotation * m_firstTranslation) + m_secondTranslation;
-    TMatrixd prevDeltaRotation, currentDeltaRotation;
-    TVectord prevDeltaTranslation, currentDeltaTranslation;
+    TMatrix3d deltaRotation = m_secondRotation * firstInvRotation;
+    TVector3d deltaTranslation = m_secondRotation * (- firstInvRotation * m_firstTranslation) + m_secondTranslation;
+    TMatrix3d prevDeltaRotation, currentDeltaRotation;
+    TVector3d prevDeltaTranslation, currentDeltaTranslation;
     for (int level = maxLevel; level >= minLevel; --level) {
         _computeLevelInfo(deltaRotation, deltaTranslation, level);
         prevDeltaRotation = deltaRotation;
@@ -283,15 +322,38 @@ void Tracker::tracking()
             deltaTranslation = prevDeltaTranslation;
         }
     }
-    m_secondRotation = deltaRotation * m_firstRotation;
-    m_secondTranslation = deltaRotation * m_firstTranslation + deltaTranslation;
+    m_secondRotation = (deltaRotation * TMatrix3d(m_firstRotation)).toTMatrix();
+    m_secondTranslation = (deltaRotation * TVector3d(m_firstTranslation) + deltaTranslation).toTVector();
 }
 
-void Tracker::_computeLevelInfo(const TMath::TMatrixd& deltaRotation, const TMath::TVectord& deltaTranslation, int level)
+void Tracker::_computeLevelInfo(const TMath::TMatrix3d& deltaRotation, const TMath::TVector3d& deltaTranslation, int level)
 {
-    using namespace TMath;
+    m_featureSquareErrors.resize(m_featuresInfo.size());
+    int countParts = m_threadPool.countThreads();
+    m_threadPool.run(countParts, [&] (int part) {
+        std::size_t end = _partEnd(part, countParts);
+        for (std::size_t i = _partEnd(part - 1, countParts); i < end; ++i) {
+            FeatureInfo& featureInfo = m_featuresInfo[i];
+            _computeFeatureInfo(featureInfo, m_featureSquareErrors[i], deltaRotation, deltaTranslation, level);
+        }
+    });
 
     m_square_errors.resize(0);
+    for (std::size_t i = 0; i < m_featuresInfo.size(); ++i) {
+        if (m_featuresInfo[i].visible)
+            m_square_errors.push_back(m_featureSquareErrors[i]);
+    }
+    if (m_square_errors.empty())
+        m_sigmaSquared = 1.0f;
+    else
+        m_sigmaSquared = TMath::TukeyRobustCost::findSquareSigma(m_square_errors);
+}
+
+void Tracker::_computeFeatureInfo(FeatureInfo& featureInfo, float& squareError,
+                                  const TMath::TMatrix3d& deltaRotation, const TMath::TVector3d& deltaTranslation,
+                                  int level) const
+{
+    using namespace TMath;
 
     ConstImage<uchar> firstImage = m_firstFrameImagePyramid[level];
     ConstImage<uchar> secondImage = m_secondFrameImagePyramid[level];
@@ -301,7 +363,7 @@ void Tracker::_computeLevelInfo(const TMath::TMatrixd& deltaRotation, const TMat
 
     float scale = 1.0f / (float)(1 << level);
 
-    TVectord v;
+    TVector3d v;
 
     Point2i p;
     Point2i pos_i;
@@ -318,89 +380,85 @@ void Tracker::_computeLevelInfo(const TMath::TMatrixd& deltaRotation, const TMat
 
     float dt, featureError;
 
-    int k;
+    int i, k;
 
-    for (std::size_t i = 0; i < m_featuresInfo.size(); ++i) {
-        FeatureInfo& featureInfo = m_featuresInfo[i];
-
-        pos = featureInfo.imagePosition * scale;
-        pos_i.set((int)std::floor(pos.x), (int)std::floor(pos.y));
-
-        if ((pos_i.x < begin.x) || (pos_i.y < begin.y) ||
-                (pos_i.x > end.x) || (pos_i.y > end.y)) {
-            featureInfo.visible = false;
-            continue;
-        }
+    pos = featureInfo.imagePosition * scale;
+    pos_i.set((int)std::floor(pos.x), (int)std::floor(pos.y));
 
-        featureInfo.visible = true;
-
-        featureError = 0.0f;
+    if ((pos_i.x < begin.x) || (pos_i.y < begin.y) ||
+            (pos_i.x > end.x) || (pos_i.y > end.y)) {
+        featureInfo.visible = false;
+        return;
+    }
 
-        subpix.set(pos.x - pos_i.x, pos.y - pos_i.y);
-        w_tl = (1.0f - subpix.x) * (1.0f - subpix.y);
-        w_tr = subpix.x * (1.0f - subpix.y);
-        w_bl = (1.0f - subpix.x) * subpix.y;
-        w_br = subpix.x * subpix.y;
+    featureInfo.visible = true;
 
-        const uchar* imageStr = firstImage.pointer(pos_i.x, pos_i.y - m_cursorSize.y);
-        const uchar* imageStrPrev = &imageStr[-firstImage.width()];
-        const uchar* imageStrNext = &imageStr[firstImage.width()];
-        const uchar* imageStrNextNext = &imageStrNext[firstImage.width()];
+    featureError = 0.0f;
 
-        if (!featureInfo.visible)
-            continue;
+    subpix.set(pos.x - pos_i.x, pos.y - pos_i.y);
+    w_tl = (1.0f - subpix.x) * (1.0f - subpix.y);
+    w_tr = subpix.x * (1.0f - subpix.y);
+    w_bl = (1.0f - subpix.x) * subpix.y;
+    w_br = subpix.x * subpix.y;
 
-        v = deltaRotation * featureInfo.localPosition + deltaTranslation;
+    const uchar* imageStr = firstImage.pointer(pos_i.x, pos_i.y - m_cursorSize.y);
+    const uchar* imageStrPrev = &imageStr[-firstImage.width()];
+    const uchar* imageStrNext = &imageStr[firstImage.width()];
+    const uchar* imageStrNextNext = &imageStrNext[firstImage.width()];
 
-        if (v(2) <= std::numeric_limits<float>::epsilon()) {
-            featureInfo.visible = false;
-            continue;
-        }
+    v = deltaRotation * featureInfo.localPosition + deltaTranslation;
 
-        sec_pos = m_secondCamera->project(Point2d(v(0) / v(2), v(1) / v(2))).cast<float>() * scale;
-        sec_pos_i.set((int)std::floor(sec_pos.x), (int)std::floor(sec_pos.y));
+    if (v(2) <= std::numeric_limits<float>::epsilon()) {
+        featureInfo.visible = false;
+        return;
+    }
 
-        if ((sec_pos_i.x < begin.x) || (sec_pos_i.y < begin.y) ||
-                (sec_pos_i.x > end.x) || (sec_pos_i.y > end.y)) {
-            featureInfo.visible = false;
-            continue;
-        }
+    sec_pos = m_secondCamera->project(Point2d(v(0) / v(2), v(1) / v(2))).cast<float>() * scale;
+    sec_pos_i.set((int)std::floor(sec_pos.x), (int)std::floor(sec_pos.y));
 
-        sec_subpix.set((float)(sec_pos.x - sec_pos_i.x), (float)(sec_pos.y - sec_pos_i.y));
+    if ((sec_pos_i.x < begin.x) || (sec_pos_i.y < begin.y) ||
+            (sec_pos_i.x > end.x) || (sec_pos_i.y > end.y)) {
+        featureInfo.visible = false;
+        return;
+    }
 
-        sec_w_tl = (1.0f - sec_subpix.x) * (1.0f - sec_subpix.y);
-        sec_w_tr = sec_subpix.x * (1.0f - sec_subpix.y);
-        sec_w_bl = (1.0f - sec_subpix.x) * sec_subpix.y;
-        sec_w_br = sec_subpix.x * sec_subpix.y;
+    sec_subpix.set((float)(sec_pos.x - sec_pos_i.x), (float)(sec_pos.y - sec_pos_i.y));
 
-        const uchar* secondImageStr = secondImage.pointer(sec_pos_i.x, sec_pos_i.y - m_cursorSize.y);
-        const uchar* secondImageStrNext = &secondImageStr[secondImage.width()];
+    sec_w_tl = (1.0f - sec_subpix.x) * (1.0f - sec_subpix.y);
+    sec_w_tr = sec_subpix.x * (1.0f - sec_subpix.y);
+    sec_w_bl = (1.0f - sec_subpix.x) * sec_subpix.y;
+    sec_w_br = sec_subpix.x * sec_subpix.y;
 
-        double* jacobian_cache = featureInfo.jacobian_cache;
-        float* pixels_cache = featureInfo.pixels_cache;
-        k = 0;
-        for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
-            for (p.x = - m_cursorSize.x; p.x <= m_cursorSize.x; ++p.x, ++k) {
-                *pixels_cache = imageStr[p.x] * w_tl +
-                                imageStr[p.x + 1] * w_tr +
-                                imageStrNext[p.x] * w_bl +
-                                imageStrNext[p.x + 1] * w_br;
-                dt = (secondImageStr[p.x] * sec_w_tl +
-                      secondImageStr[p.x + 1] * sec_w_tr +
-                      secondImageStrNext[p.x] * sec_w_bl +
-                      secondImageStrNext[p.x + 1] * sec_w_br) - *pixels_cache;
-                featureError += dt * m_gaussian[k];
-                ++pixels_cache;
-
-                d.x = ((imageStr[p.x + 1] - imageStr[p.x - 1]) * w_tl +
-                       (imageStr[p.x + 2] - imageStr[p.x]) * w_tr +
-                       (imageStrNext[p.x + 1] - imageStrNext[p.x - 1]) * w_bl +
-                       (imageStrNext[p.x + 2] - imageStrNext[p.x]) * w_br) * 0.5f;
-                d.y = ((imageStrNext[p.x] - imageStrPrev[p.x]) * w_tl +
-                       (imageStrNext[p.x + 1] - imageStrPrev[p.x + 1]) * w_tr +
-                       (imageStrNextNext[p.x] - imageStr[p.x]) * w_bl +
-                       (imageStrNextNext[p.x + 1] - imageStr[p.x + 1]) * w_br) * 0.5f;
+    const uchar* secondImageStr = secondImage.pointer(sec_pos_i.x, sec_pos_i.y - m_cursorSize.y);
+    const uchar* secondImageStrNext = &secondImageStr[secondImage.width()];
 
+    double* jacobian_cache = featureInfo.jacobian_cache;
+    float* floatJacobian_cache = featureInfo.floatJacobian_cache;
+    float* pixels_cache = featureInfo.pixels_cache;
+    k = 0;
+    for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
+        for (p.x = - m_cursorSize.x; p.x <= m_cursorSize.x; ++p.x, ++k) {
+            *pixels_cache = imageStr[p.x] * w_tl +
+                            imageStr[p.x + 1] * w_tr +
+                            imageStrNext[p.x] * w_bl +
+                            imageStrNext[p.x + 1] * w_br;
+            dt = (secondImageStr[p.x] * sec_w_tl +
+                  secondImageStr[p.x + 1] * sec_w_tr +
+                  secondImageStrNext[p.x] * sec_w_bl +
+                  secondImageStrNext[p.x + 1] * sec_w_br) - *pixels_cache;
+            featureError += dt * m_gaussian[k];
+            ++pixels_cache;
+
+            d.x = ((imageStr[p.x + 1] - imageStr[p.x - 1]) * w_tl +
+                   (imageStr[p.x + 2] - imageStr[p.x]) * w_tr +
+                   (imageStrNext[p.x + 1] - imageStrNext[p.x - 1]) * w_bl +
+                   (imageStrNext[p.x + 2] - imageStrNext[p.x]) * w_br) * 0.5f;
+            d.y = ((imageStrNext[p.x] - imageStrPrev[p.x]) * w_tl +
+                   (imageStrNext[p.x + 1] - imageStrPrev[p.x + 1]) * w_tr +
+                   (imageStrNextNext[p.x] - imageStr[p.x]) * w_bl +
+                   (imageStrNextNext[p.x + 1] - imageStr[p.x + 1]) * w_br) * 0.5f;
+
+            if (jacobian_cache != nullptr) {
                 //don't believe in optimizator
                 jacobian_cache[0] = (featureInfo.J_x(0) * d.x + featureInfo.J_y(0) * d.y) * commonMultiplier;
                 jacobian_cache[1] = (featureInfo.J_x(1) * d.x + featureInfo.J_y(1) * d.y) * commonMultiplier;
@@ -409,27 +467,97 @@ void Tracker::_computeLevelInfo(const TMath::TMatrixd& deltaRotation, const TMat
                 jacobian_cache[4] = (featureInfo.J_x(4) * d.x + featureInfo.J_y(4) * d.y) * commonMultiplier;
                 jacobian_cache[5] = (featureInfo.J_x(5) * d.x + featureInfo.J_y(5) * d.y) * commonMultiplier;
                 jacobian_cache = &jacobian_cache[6];
+            } else {
+                for (i = 0; i < 6; ++i)
+                    floatJacobian_cache[i * m_jacobianStride + k] =
+                            (float)((featureInfo.J_x(i) * d.x + featureInfo.J_y(i) * d.y) * commonMultiplier);
             }
-            imageStrPrev = imageStr;
-            imageStr = imageStrNext;
-            imageStrNext = imageStrNextNext;
-            imageStrNextNext = &imageStrNextNext[firstImage.width()];
+        }
+        imageStrPrev = imageStr;
+        imageStr = imageStrNext;
+        imageStrNext = imageStrNextNext;
+        imageStrNextNext = &imageStrNextNext[firstImage.width()];
+
+        secondImageStr = secondImageStrNext;
+        secondImageStrNext = &secondImageStrNext[secondImage.width()];
+    }
+    squareError = featureError * featureError;
+}
+
+double Tracker::_optimize(TMath::TMatrix3d& deltaRotation, TMath::TVector3d& deltaTranslation, int level)
+{
+    using namespace TMath;
 
-            secondImageStr = secondImageStrNext;
-            secondImageStrNext = &secondImageStrNext[secondImage.width()];
+    int countParts = m_threadPool.countThreads();
+    m_accumulators.resize(countParts);
+    m_threadPool.run(countParts, [&] (int part) {
+        Accumulator & accumulator = m_accumulators[part];
+        std::fill(accumulator.A_raw, accumulator.A_raw + 21, 0.0);
+        std::fill(accumulator.B, accumulator.B + 6, 0.0);
+        accumulator.error = 0.0;
+        accumulator.countTrackedFeatures = 0;
+        accumulator.residuals.assign(m_jacobianStride, 0.0f);
+        std::size_t end = _partEnd(part, countParts);
+        for (std::size_t f = _partEnd(part - 1, countParts); f < end; ++f)
+            _accumulateFeature(accumulator, m_featuresInfo[f], deltaRotation, deltaTranslation, level);
+    });
+
+    // sums of parts are added in order of parts, so the result doesn't depend on order of execution of parts
+    double A_raw[21];
+    TVector6d B;
+    double error = 0.0;
+    int i, j, t;
+    std::fill(A_raw, A_raw + 21, 0.0);
+    B.setZero();
+    m_countTrackedFeatures = 0;
+    for (auto it = m_accumulators.cbegin(); it != m_accumulators.cend(); ++it) {
+        for (i = 0; i < 21; ++i)
+            A_raw[i] += it->A_raw[i];
+        for (i = 0; i < 6; ++i)
+            B(i) += it->B[i];
+        error += it->error;
+        m_countTrackedFeatures += it->countTrackedFeatures;
+    }
+
+    if (m_countTrackedFeatures == 0)
+        return std::numeric_limits<double>::max();
+
+    TMatrixd A(6, 6);
+    t = 0;
+    for (i = 0; i < 6; ++i) {
+        for (j = 0; j < i; ++j) {
+            A(i, j) = A(j, i) = A_raw[t];
+            ++t;
         }
-        m_square_errors.push_back(featureError * featureError);
+        A(i, i) = A_raw[t];
+        ++t;
     }
-    if (m_square_errors.empty())
-        m_sigmaSquared = 1.0f;
-    else
-        m_sigmaSquared = TukeyRobustCost::findSquareSigma(m_square_errors);
+    TCholesky<double> cholesky(A);
+    m_last_X = cholesky.backsub(B.toTVector());
+    for (i = 0; i < 6; ++i) {
+        if (std::isnan(m_last_X[i]))
+            return std::numeric_limits<double>::max();
+    }
+
+    TMatrix3d dRotation;
+    TVector3d dTranslation;
+    TTools::exp_transform(dRotation, dTranslation, TVector6d(m_last_X));
+
+    deltaRotation = dRotation * deltaRotation;
+    deltaTranslation = dRotation * deltaTranslation + dTranslation;
+
+    return (error * m_invMaxErrorSquared) / (double)m_countTrackedFeatures;
 }
 
-double Tracker::_optimize(TMath::TMatrixd& deltaRotation, TMath::TVectord& deltaTranslation, int level)
+void Tracker::_accumulateFeature(Accumulator& accumulator, FeatureInfo& featureInfo,
+                                 const TMath::TMatrix3d& deltaRotation, const TMath::TVector3d& deltaTranslation,
+                                 int level) const
 {
     using namespace TMath;
 
+    if (!featureInfo.visible)
+        return;
+
     ConstImage<uchar> secondImage = m_secondFrameImagePyramid[level];
 
     Point2i begin = m_cursorSize + Point2i(1, 1);
@@ -437,16 +565,8 @@ double Tracker::_optimize(TMath::TMatrixd& deltaRotation, TMath::TVectord& delta
 
     float scale = 1.0f / (float)(1 << level);
 
-    double A_raw[21];
-
-    TVectord B(6);
-    B.setZero();
-
     int i, j, k, t;
 
-    for (i = 0; i < 21; ++i)
-        A_raw[i] = 0.0;
-
     Point2i p;
     Point2i pos_i;
     Point2f pos;
@@ -454,102 +574,89 @@ double Tracker::_optimize(TMath::TMatrixd& deltaRotation, TMath::TVectord& delta
     float w_tl, w_tr, w_bl, w_br;
     float dt, wdt, weight;
 
-    TVectord v;
-
-    double error = 0.0;
-    m_countTrackedFeatures = 0;
+    TVector3d v = deltaRotation * featureInfo.localPosition + deltaTranslation;
 
-    for (std::size_t f = 0; f < m_featuresInfo.size(); ++f) {
-        FeatureInfo& featureInfo = m_featuresInfo[f];
-
-        if (!featureInfo.visible)
-            continue;
-
-        v = deltaRotation * featureInfo.localPosition + deltaTranslation;
+    if (v(2) <= std::numeric_limits<float>::epsilon()) {
+        featureInfo.visible = false;
+        return;
+    }
 
-        if (v(2) <= std::numeric_limits<float>::epsilon()) {
-            featureInfo.visible = false;
-            continue;
-        }
+    pos = m_secondCamera->project(Point2d(v(0) / v(2), v(1) / v(2))).cast<float>() * scale;
+    pos_i.set((int)std::floor(pos.x), (int)std::floor(pos.y));
 
-        pos = m_secondCamera->project(Point2d(v(0) / v(2), v(1) / v(2))).cast<float>() * scale;
-        pos_i.set((int)std::floor(pos.x), (int)std::floor(pos.y));
+    if ((pos_i.x < begin.x) || (pos_i.y < begin.y) ||
+            (pos_i.x > end.x) || (pos_i.y > end.y)) {
+        featureInfo.visible = false;
+        return;
+    }
 
-        if ((pos_i.x < begin.x) || (pos_i.y < begin.y) ||
-                (pos_i.x > end.x) || (pos_i.y > end.y)) {
-            featureInfo.visible = false;
-            continue;
-        }
+    subpix.set((float)(pos.x - pos_i.x), (float)(pos.y - pos_i.y));
 
-        subpix.set((float)(pos.x - pos_i.x), (float)(pos.y - pos_i.y));
+    w_tl = (1.0f - subpix.x) * (1.0f - subpix.y);
+    w_tr = subpix.x * (1.0f - subpix.y);
+    w_bl = (1.0f - subpix.x) * subpix.y;
+    w_br = subpix.x * subpix.y;
 
-        w_tl = (1.0f - subpix.x) * (1.0f - subpix.y);
-        w_tr = subpix.x * (1.0f - subpix.y);
-        w_bl = (1.0f - subpix.x) * subpix.y;
-        w_br = subpix.x * subpix.y;
+    double * A_raw = accumulator.A_raw;
+    double * B = accumulator.B;
 
-        const uchar* imageStr = secondImage.pointer(pos_i.x, pos_i.y - m_cursorSize.y);
-        const uchar* imageStrNext = &imageStr[secondImage.width()];
-        k = 0;
-        const float* pixels_cache = featureInfo.pixels_cache;
-        const double* jacobian_cache = featureInfo.jacobian_cache;
+    const uchar* imageStr = secondImage.pointer(pos_i.x, pos_i.y - m_cursorSize.y);
+    const uchar* imageStrNext = &imageStr[secondImage.width()];
+    k = 0;
+    const float* pixels_cache = featureInfo.pixels_cache;
+    if (featureInfo.floatJacobian_cache != nullptr) {
+        // residuals of the patch are computed by rows and normal equations of the whole patch are summed by the kernel
+        float* residuals = accumulator.residuals.data();
         for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
             for (p.x = - m_cursorSize.x; p.x <= m_cursorSize.x; ++p.x, ++k) {
-                dt = (imageStr[p.x] * w_tl +
-                      imageStr[p.x + 1] * w_tr +
-                      imageStrNext[p.x] * w_bl +
-                      imageStrNext[p.x + 1] * w_br) - *pixels_cache;
-                weight = m_gaussian[k] * TukeyRobustCost::weight(dt * dt, m_sigmaSquared);
-                wdt = dt * weight;
-
-                error += wdt * dt;
-
-                t = 0;
-                for (i = 0; i < 6; ++i) {
-                    for (j = 0; j <= i; ++j) {
-                        A_raw[t] += jacobian_cache[i] * jacobian_cache[j] * weight;//J * J.transposed() * w
-                        ++t;
-                    }
-                    B(i) += jacobian_cache[i] * wdt; // J * w
-                }
-
-                ++pixels_cache;
-                jacobian_cache = &jacobian_cache[6];
+                residuals[k] = (imageStr[p.x] * w_tl +
+                                imageStr[p.x + 1] * w_tr +
+                                imageStrNext[p.x] * w_bl +
+                                imageStrNext[p.x + 1] * w_br) - pixels_cache[k];
             }
             imageStr = imageStrNext;
             imageStrNext = &imageStrNext[secondImage.width()];
         }
-        ++m_countTrackedFeatures;
+        PatchJacobian::accumulate(A_raw, B, accumulator.error, 6, featureInfo.floatJacobian_cache,
+                                  residuals, m_gaussian, m_jacobianStride, m_sigmaSquared);
+        ++accumulator.countTrackedFeatures;
+        return;
     }
+    const double* jacobian_cache = featureInfo.jacobian_cache;
+    for (p.y = - m_cursorSize.y; p.y <= m_cursorSize.y; ++p.y) {
+        for (p.x = - m_cursorSize.x; p.x <= m_cursorSize.x; ++p.x, ++k) {
+            dt = (imageStr[p.x] * w_tl +
+                  imageStr[p.x + 1] * w_tr +
+                  imageStrNext[p.x] * w_bl +
+                  imageStrNext[p.x + 1] * w_br) - *pixels_cache;
+            weight = m_gaussian[k] * TukeyRobustCost::weight(dt * dt, m_sigmaSquared);
+            wdt = dt * weight;
+
+            accumulator.error += wdt * dt;
+
+            t = 0;
+            for (i = 0; i < 6; ++i) {
+                for (j = 0; j <= i; ++j) {
+                    A_raw[t] += jacobian_cache[i] * jacobian_cache[j] * weight;//J * J.transposed() * w
+                    ++t;
+                }
+                B[i] += jacobian_cache[i] * wdt; // J * w
+            }
 
-    if (m_countTrackedFeatures == 0)
-        return std::numeric_limits<double>::max();
-
-    TMatrixd A(6, 6);
-    t = 0;
-    for (i = 0; i < 6; ++i) {
-        for (j = 0; j < i; ++j) {
-            A(i, j) = A(j, i) = A_raw[t];
-            ++t;
+            ++pixels_cache;
+            jacobian_cache = &jacobian_cache[6];
         }
-        A(i, i) = A_raw[t];
-        ++t;
-    }
-    TCholesky<double> cholesky(A);
-    m_last_X = cholesky.backsub(B);
-    for (i = 0; i < 6; ++i) {
-        if (std::isnan(m_last_X[i]))
-            return std::numeric_limits<double>::max();
+        imageStr = imageStrNext;
+        imageStrNext = &imageStrNext[secondImage.width()];
     }
+    ++accumulator.countTrackedFeatures;
+}
 
-    TMatrixd dRotation(3, 3);
-    TVectord dTranslation(3);
-    TTools::exp_transform(dRotation, dTranslation, m_last_X);
-
-    deltaRotation = dRotation * deltaRotation;
-    deltaTranslation = dRotation * deltaTranslation + dTranslation;
-
-    return (error * m_invMaxErrorSquared) / (double)m_countTrackedFeatures;
+std::size_t Tracker::_partEnd(int part, int countParts) const
+{
+    if (part < 0)
+        return 0;
+    return (m_featuresInfo.size() * (part + 1)) / countParts;
 }
 
 bool Tracker::_needToStop() const
@@ -6,9 +6,11 @@
 #include "Image.h"
 #include "TMath/TVector.h"
 #include "TMath/TMatrix.h"
+#include "TMath/TMatrixN.h"
 #include "KeyFrame.h"
 #include "PreviewFrame.h"
 #include "MapResourcesManager.h"
+#include "ThreadPool.h"
 
 namespace AR {
 
@@ -38,6 +40,16 @@ public:
 
     int countTrackedFeatures() const;
 
+    // Features are split into countThreads parts and sums of parts are added in order of parts,
+    // so results are the same for the same count of threads. If countThreads <= 0 then count of hardware threads is used.
+    int countThreads() const;
+    void setCountThreads(int countThreads);
+
+    // By default jacobians of patches are float and normal equations of patches are summed by vectorized kernels
+    // of PatchJacobian. The double path is slower, it's kept for comparison of accuracy.
+    bool doublePrecision() const;
+    void setDoublePrecision(bool doublePrecision);
+
     void reset();
 
     void tracking();
@@ -54,8 +66,17 @@ private:
         bool visible;
         float * pixels_cache;
         double* jacobian_cache;
-        TMath::TVectord localPosition;
-        TMath::TVectord J_x, J_y;
+        float* floatJacobian_cache;
+        TMath::TVector3d localPosition;
+        TMath::TVector6d J_x, J_y;
+    };
+
+    struct Accumulator {
+        double A_raw[21];
+        double B[6];
+        double error;
+        std::size_t countTrackedFeatures;
+        std::vector<float> residuals;
     };
 
     double m_eps;
@@ -63,6 +84,7 @@ private:
     int m_minLevel;
     int m_maxLevel;
     Point2i m_cursorSize;
+    bool m_doublePrecision;
 
     float * m_gaussian;
     float m_sigmaGaussian;
@@ -70,6 +92,8 @@ private:
 
     Image<float> m_pixels_cashe;
     Image<double> m_jacobian_cashe;
+    Image<float> m_floatJacobian_cashe;
+    int m_jacobianStride;
 
     std::vector<ConstImage<uchar>> m_firstFrameImagePyramid;
     TMath::TMatrixd m_firstRotation;
@@ -91,12 +115,32 @@ private:
 
     MapResourcesManager * m_resourceManager;
 
+    ThreadPool m_threadPool;
+    std::vector<Accumulator> m_accumulators;
+    std::vector<float> m_featureSquareErrors;
+
     void _solveGaussian();
     void _setSigmaGaussian(float sigma);
 
-    void _computeLevelInfo(const TMath::TMatrixd & deltaRotation, const TMath::TVectord & deltaTranslation, int level);
-    double _optimize(TMath::TMatrixd & deltaRotation, TMath::TVectord & deltaTranslation, int level);
+    void _computeLevelInfo(const TMath::TMatrix3d & deltaRotation, const TMath::TVector3d & deltaTranslation, int level);
+    void _computeFeatureInfo(FeatureInfo & featureInfo, float & squareError,
+                             const TMath::TMatrix3d & deltaRotation, const TMath::TVector3d & deltaTranslation,
+                             int level) const;
+    double _optimize(TMath::TMatrix3d & deltaRotation, TMath::TVector3d & deltaTranslation, int level);
+    void _accumulateFeature(Accumulator & accumulator, FeatureInfo & featureInfo,
+                            const TMath::TMatrix3d & deltaRotation, const TMath::TVector3d & deltaTranslation,
+                            int level) const;
+    std::size_t _partEnd(int part, int countParts) const;
     bool _needToStop() const;
+
+    // Caches are reallocated only if they have not enough rows, so they are reused by frames with different counts
+    // of features.
+    template <typename Type>
+    static void _reserveCashe(Image<Type> & cashe, int width, int countRows)
+    {
+        if ((cashe.width() != width) || (cashe.height() < countRows))
+            cashe = Image<Type>(Point2i(width, ((countRows + 63) / 64) * 64));
+    }
 };
 
 }
@@ -0,0 +1,139 @@
+#include "WarpedPatchCache.h"
+#include "MapPoint.h"
+#include "KeyFrame.h"
+#include <algorithm>
+#include <cstring>
+
+namespace AR {
+
+WarpedPatchCache::WarpedPatchCache():
+    m_epoch(1)
+{
+    m_map = nullptr;
+    m_maxDrift = 0.05f;
+}
+
+WarpedPatchCache::~WarpedPatchCache()
+{
+    if (m_map != nullptr)
+        m_map->removeListener(this);
+}
+
+Map * WarpedPatchCache::map() const
+{
+    return m_map;
+}
+
+void WarpedPatchCache::setMap(Map * map)
+{
+    if (m_map == map)
+        return;
+    if (m_map != nullptr)
+        m_map->removeListener(this);
+    m_map = map;
+    if (m_map != nullptr)
+        m_map->addListener(this);
+    clear();
+}
+
+float WarpedPatchCache::maxDrift() const
+{
+    return m_maxDrift;
+}
+
+void WarpedPatchCache::setMaxDrift(float maxDrift)
+{
+    m_maxDrift = maxDrift;
+}
+
+WarpedPatchCache::Entry & WarpedPatchCache::mapPointEntry(const MapPoint * mapPoint)
+{
+    SlabHandle handle = mapPoint->handle();
+    if (handle.slot >= m_mapPointEntries.size()) {
+        m_mapPointEntries.resize(((handle.slot / countObjectsInSlab) + 1) * countObjectsInSlab);
+        m_mapPointGenerations.resize(m_mapPointEntries.size(), 0);
+    }
+    Entry & entry = m_mapPointEntries[handle.slot];
+    if (m_mapPointGenerations[handle.slot] != handle.generation) {
+        m_mapPointGenerations[handle.slot] = handle.generation;
+        entry.epoch = 0;
+    }
+    return entry;
+}
+
+bool WarpedPatchCache::find(const Entry & entry, Image<uchar> & patch,
+                            const KeyFrame * keyFrame, const Point2f & point, int imageLevel,
+                            const TMath::TMatrixf & invWarpMatrix, int searchLevel) const
+{
+    if ((entry.epoch != m_epoch.load()) || (entry.keyFrame != keyFrame) ||
+            (entry.imageLevel != imageLevel) || (entry.searchLevel != searchLevel) ||
+            (entry.point.x != point.x) || (entry.point.y != point.y) ||
+            (entry.patch.size() != (std::size_t)patch.area())) {
+        return false;
+    }
+    // pixels of the patch are mapped to the key frame image by invWarpMatrix * (p - center) * (1 << searchLevel),
+    // so displacements of corners are linear in differences of matrices
+    float halfWidth = (patch.width() - 1) * 0.5f * (float)(1 << searchLevel);
+    float halfHeight = (patch.height() - 1) * 0.5f * (float)(1 << searchLevel);
+    float d00 = (invWarpMatrix(0, 0) - entry.invWarpMatrix[0]) * halfWidth;
+    float d01 = (invWarpMatrix(0, 1) - entry.invWarpMatrix[1]) * halfHeight;
+    float d10 = (invWarpMatrix(1, 0) - entry.invWarpMatrix[2]) * halfWidth;
+    float d11 = (invWarpMatrix(1, 1) - entry.invWarpMatrix[3]) * halfHeight;
+    float maxDriftSquared = m_maxDrift * m_maxDrift;
+    for (int i = 0; i < 2; ++i) {
+        float sign = (i == 0) ? 1.0f : -1.0f;
+        float dx = d00 + sign * d01;
+        float dy = d10 + sign * d11;
+        if ((dx * dx + dy * dy) > maxDriftSquared)
+            return false;
+    }
+    std::memcpy(patch.data(), entry.patch.data(), entry.patch.size());
+    return true;
+}
+
+void WarpedPatchCache::store(Entry & entry, const ImageRef<uchar> & patch,
+                             const KeyFrame * keyFrame, const Point2f & point, int imageLevel,
+                             const TMath::TMatrixf & invWarpMatrix, int searchLevel)
+{
+    entry.keyFrame = keyFrame;
+    entry.point = point;
+    entry.imageLevel = imageLevel;
+    entry.searchLevel = searchLevel;
+    entry.epoch = m_epoch.load();
+    entry.invWarpMatrix[0] = invWarpMatrix(0, 0);
+    entry.invWarpMatrix[1] = invWarpMatrix(0, 1);
+    entry.invWarpMatrix[2] = invWarpMatrix(1, 0);
+    entry.invWarpMatrix[3] = invWarpMatrix(1, 1);
+    entry.patch.assign(patch.data(), patch.data() + patch.area());
+}
+
+void WarpedPatchCache::clear()
+{
+    ++m_epoch;
+}
+
+void WarpedPatchCache::onDeleteKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame)
+{
+    (void)keyFrame;
+    clear();
+}
+
+void WarpedPatchCache::onTransformMap(const TMath::TMatrixd & rotation, const TMath::TVectord & translation)
+{
+    (void)rotation;
+    (void)translation;
+    clear();
+}
+
+void WarpedPatchCache::onScaleMap(double scale)
+{
+    (void)scale;
+    clear();
+}
+
+void WarpedPatchCache::onResetMap()
+{
+    clear();
+}
+
+} // namespace AR
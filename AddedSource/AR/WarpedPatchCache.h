@@ -0,0 +1,86 @@
+#ifndef AR_WARPEDPATCHCACHE_H
+#define AR_WARPEDPATCHCACHE_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "TMath/TMatrix.h"
+#include "Image.h"
+#include "Map.h"
+
+namespace AR {
+
+class KeyFrame;
+class MapPoint;
+
+// Patches of key frames which were warped to frames by MapProjector.
+// The relative pose of a frame and a key frame changes a little between consecutive frames, so a patch warped
+// on a previous frame is used again if it was warped from the same point of the same key frame to the same search
+// level and corners of the patch are moved by the new warp not further than maxDrift() pixels of the key frame.
+// Patches of map points are stored by slots of map points in the map, patches of candidate points are stored
+// in candidates. The cache is a listener of the map, all patches become invalid after transformation, scaling
+// or reset of the map and after deletion of key frames.
+class WarpedPatchCache:
+        public Map::MapListener
+{
+public:
+    struct Entry
+    {
+        const KeyFrame * keyFrame;
+        Point2f point; // on the image of level 0 of the key frame
+        int imageLevel;
+        int searchLevel;
+        std::uint64_t epoch;
+        float invWarpMatrix[4];
+        std::vector<uchar> patch;
+
+        Entry():
+            keyFrame(nullptr),
+            epoch(0)
+        {
+        }
+    };
+
+    WarpedPatchCache();
+    ~WarpedPatchCache();
+
+    Map * map() const;
+    void setMap(Map * map);
+
+    float maxDrift() const;
+    void setMaxDrift(float maxDrift);
+
+    // Entry of map point, it's invalid if it was stored for other map point in the same slot.
+    Entry & mapPointEntry(const MapPoint * mapPoint);
+
+    // Copies the cached patch to patch if the entry was stored for the same point and a close warp.
+    bool find(const Entry & entry, Image<uchar> & patch,
+              const KeyFrame * keyFrame, const Point2f & point, int imageLevel,
+              const TMath::TMatrixf & invWarpMatrix, int searchLevel) const;
+    void store(Entry & entry, const ImageRef<uchar> & patch,
+               const KeyFrame * keyFrame, const Point2f & point, int imageLevel,
+               const TMath::TMatrixf & invWarpMatrix, int searchLevel);
+
+    void clear();
+
+    void onDeleteKeyFrame(const std::shared_ptr<KeyFrame> & keyFrame) override;
+    void onTransformMap(const TMath::TMatrixd & rotation, const TMath::TVectord & translation) override;
+    void onScaleMap(double scale) override;
+    void onResetMap() override;
+
+private:
+    WarpedPatchCache(const WarpedPatchCache & ) = delete;
+    void operator = (const WarpedPatchCache & ) = delete;
+
+    Map * m_map;
+    float m_maxDrift;
+    // Entries of previous epochs are invalid, events of the map can come from other threads.
+    std::atomic<std::uint64_t> m_epoch;
+    std::vector<Entry> m_mapPointEntries;
+    std::vector<std::uint32_t> m_mapPointGenerations;
+};
+
+} // namespace AR
+
+#endif // AR_WARPEDPATCHCACHE_H
@@ -6,9 +6,9 @@
 
 namespace AR {
 
-void FastCorner::fast_corner_detect_10(const ImageRef<unsigned char>& im,
-                                        const Point2i& begin, const Point2i& end,
-                                        std::vector<Corner>& corners, int barrier)
+void FastCorner::_fast_corner_detect_10_tree(const ImageRef<unsigned char>& im,
+                                             const Point2i& begin, const Point2i& end,
+                                             std::vector<Corner>& corners, int barrier)
 {
     int beginx = std::max(begin.x, 3);
     int beginy = std::max(begin.y, 3);
@@ -19,6 +19,8 @@ void FastCorner::fast_corner_detect_10(const ImageRef<unsigned char>& im,
 
     _make_fast_pixel_offset(stride);
     Corner corner;
+    corner.score = 0;
+    corner.level = 0;
 
     const unsigned char* data = im.data();
     //const bool* mdata = mask.data();
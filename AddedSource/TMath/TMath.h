@@ -3,6 +3,8 @@
 
 #include "TVector.h"
 #include "TMatrix.h"
+#include "TVectorN.h"
+#include "TMatrixN.h"
 #include "TTools.h"
 #include "TSVD.h"
 #include "TCholesky.h"
@@ -8,6 +8,8 @@ HEADERS += \
     $$PWD/TSVD.h \
     $$PWD/TTools.h \
     $$PWD/TVector.h \
+    $$PWD/TVectorN.h \
+    $$PWD/TMatrixN.h \
     $$PWD/TWLS.h \
     $$PWD/TMatrix_impl.h \
     $$PWD/TTools_impl.h
@@ -0,0 +1,360 @@
+#ifndef TMATH_TMATRIXN_H
+#define TMATH_TMATRIXN_H
+
+#include "TMatrix.h"
+#include "TVectorN.h"
+
+namespace TMath {
+
+// Matrix with sizes known at compile time, data is stored inside of object by rows like in TMatrix.
+// It can be converted from and to TMatrix.
+template<typename Type, int Rows, int Cols>
+class TMatrixN
+{
+public:
+    typedef Type TypeElement;
+
+    static_assert((Rows > 0) && (Cols > 0), "Sizes of matrix must be positive");
+
+    TMatrixN()
+    {
+    }
+
+    TMatrixN(const TMatrix<Type>& matrix)
+    {
+        TMath_assert((matrix.rows() == Rows) && (matrix.cols() == Cols));
+        copyDataFrom(matrix.data());
+    }
+
+    explicit TMatrixN(const Type* dataFrom)
+    {
+        copyDataFrom(dataFrom);
+    }
+
+    TMatrix<Type> toTMatrix() const
+    {
+        return TMatrix<Type>(Rows, Cols, &m_data[0][0]);
+    }
+
+    TMatrixN<Type, Rows, Cols>& operator = (const TMatrix<Type>& matrix)
+    {
+        TMath_assert((matrix.rows() == Rows) && (matrix.cols() == Cols));
+        copyDataFrom(matrix.data());
+        return (*this);
+    }
+
+    static TMatrixN<Type, Rows, Cols> Identity()
+    {
+        TMatrixN<Type, Rows, Cols> result;
+        result.setToIdentity();
+        return result;
+    }
+
+    inline const Type* data() const
+    {
+        return &m_data[0][0];
+    }
+
+    inline Type* data()
+    {
+        return &m_data[0][0];
+    }
+
+    static constexpr int rows()
+    {
+        return Rows;
+    }
+
+    static constexpr int cols()
+    {
+        return Cols;
+    }
+
+    static constexpr bool isSquareMatrix()
+    {
+        return (Rows == Cols);
+    }
+
+    inline Type* getDataRow(int row)
+    {
+        TMath_assert((row >= 0) && (row < Rows));
+        return m_data[row];
+    }
+
+    inline const Type* getDataRow(int row) const
+    {
+        TMath_assert((row >= 0) && (row < Rows));
+        return m_data[row];
+    }
+
+    inline const Type& operator ()(int row, int col) const
+    {
+        TMath_assert((row >= 0) && (row < Rows) && (col >= 0) && (col < Cols));
+        return m_data[row][col];
+    }
+
+    inline Type& operator ()(int row, int col)
+    {
+        TMath_assert((row >= 0) && (row < Rows) && (col >= 0) && (col < Cols));
+        return m_data[row][col];
+    }
+
+    inline void copyDataFrom(const Type* dataFrom)
+    {
+        Type* data = &m_data[0][0];
+        for (int i=0; i<Rows*Cols; ++i)
+            data[i] = dataFrom[i];
+    }
+
+    void setZero()
+    {
+        fill(Type(0));
+    }
+
+    void fill(Type value)
+    {
+        Type* data = &m_data[0][0];
+        for (int i=0; i<Rows*Cols; ++i)
+            data[i] = value;
+    }
+
+    void setToIdentity()
+    {
+        for (int i=0; i<Rows; ++i) {
+            for (int j=0; j<Cols; ++j)
+                m_data[i][j] = (i == j) ? Type(1) : Type(0);
+        }
+    }
+
+    void setDiagonal(const TVectorN<Type, (Rows < Cols) ? Rows : Cols>& diagonal)
+    {
+        setZero();
+        for (int i=0; i<diagonal.size(); ++i)
+            m_data[i][i] = diagonal(i);
+    }
+
+    TMatrixN<Type, Rows, Cols> operator - () const
+    {
+        TMatrixN<Type, Rows, Cols> result;
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                result.m_data[i][j] = - m_data[i][j];
+        return result;
+    }
+
+    TMatrixN<Type, Rows, Cols> operator * (Type val) const
+    {
+        TMatrixN<Type, Rows, Cols> result;
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                result.m_data[i][j] = m_data[i][j] * val;
+        return result;
+    }
+
+    void operator *= (Type val)
+    {
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                m_data[i][j] *= val;
+    }
+
+    TMatrixN<Type, Rows, Cols> operator + (const TMatrixN<Type, Rows, Cols>& matrix) const
+    {
+        TMatrixN<Type, Rows, Cols> result;
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                result.m_data[i][j] = m_data[i][j] + matrix.m_data[i][j];
+        return result;
+    }
+
+    TMatrixN<Type, Rows, Cols> operator - (const TMatrixN<Type, Rows, Cols>& matrix) const
+    {
+        TMatrixN<Type, Rows, Cols> result;
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                result.m_data[i][j] = m_data[i][j] - matrix.m_data[i][j];
+        return result;
+    }
+
+    void operator += (const TMatrixN<Type, Rows, Cols>& matrix)
+    {
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                m_data[i][j] += matrix.m_data[i][j];
+    }
+
+    void operator -= (const TMatrixN<Type, Rows, Cols>& matrix)
+    {
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                m_data[i][j] -= matrix.m_data[i][j];
+    }
+
+    inline TVectorN<Type, Cols> getRow(int row) const
+    {
+        return TVectorN<Type, Cols>(getDataRow(row));
+    }
+
+    TVectorN<Type, Rows> getColumn(int col) const
+    {
+        TMath_assert((col >= 0) && (col < Cols));
+        TVectorN<Type, Rows> result;
+        for (int i=0; i<Rows; ++i)
+            result(i) = m_data[i][col];
+        return result;
+    }
+
+    void setRow(int row, const TVectorN<Type, Cols>& vector)
+    {
+        TMath_assert((row >= 0) && (row < Rows));
+        for (int j=0; j<Cols; ++j)
+            m_data[row][j] = vector(j);
+    }
+
+    void setColumn(int col, const TVectorN<Type, Rows>& vector)
+    {
+        TMath_assert((col >= 0) && (col < Cols));
+        for (int i=0; i<Rows; ++i)
+            m_data[i][col] = vector(i);
+    }
+
+    template<int SliceRows, int SliceCols>
+    TMatrixN<Type, SliceRows, SliceCols> slice(int beginRow = 0, int beginCol = 0) const
+    {
+        TMath_assert((beginRow >= 0) && ((beginRow + SliceRows) <= Rows));
+        TMath_assert((beginCol >= 0) && ((beginCol + SliceCols) <= Cols));
+        TMatrixN<Type, SliceRows, SliceCols> result;
+        for (int i=0; i<SliceRows; ++i)
+            for (int j=0; j<SliceCols; ++j)
+                result(i, j) = m_data[beginRow + i][beginCol + j];
+        return result;
+    }
+
+    template<int FillRows, int FillCols>
+    void fill(int beginRow, int beginCol, const TMatrixN<Type, FillRows, FillCols>& matrix)
+    {
+        TMath_assert((beginRow >= 0) && ((beginRow + FillRows) <= Rows));
+        TMath_assert((beginCol >= 0) && ((beginCol + FillCols) <= Cols));
+        for (int i=0; i<FillRows; ++i)
+            for (int j=0; j<FillCols; ++j)
+                m_data[beginRow + i][beginCol + j] = matrix(i, j);
+    }
+
+    TMatrixN<Type, Cols, Rows> transposed() const
+    {
+        TMatrixN<Type, Cols, Rows> result;
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                result(j, i) = m_data[i][j];
+        return result;
+    }
+
+    void transpose()
+    {
+        static_assert(Rows == Cols, "Matrix must be square");
+        for (int i=1; i<Rows; ++i)
+            for (int j=0; j<i; ++j)
+                std::swap(m_data[i][j], m_data[j][i]);
+    }
+
+    template<typename CastType>
+    inline TMatrixN<CastType, Rows, Cols> cast() const
+    {
+        TMatrixN<CastType, Rows, Cols> result;
+        for (int i=0; i<Rows; ++i)
+            for (int j=0; j<Cols; ++j)
+                result(i, j) = (CastType)m_data[i][j];
+        return result;
+    }
+
+    bool operator == (const TMatrixN<Type, Rows, Cols>& b) const
+    {
+        for (int i=0; i<Rows; ++i) {
+            for (int j=0; j<Cols; ++j) {
+                if (std::fabs(m_data[i][j] - b.m_data[i][j]) > std::numeric_limits<Type>::epsilon())
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator != (const TMatrixN<Type, Rows, Cols>& b) const
+    {
+        return !(operator == (b));
+    }
+
+private:
+    Type m_data[Rows][Cols];
+};
+
+typedef TMatrixN<float, 2, 2> TMatrix2f;
+typedef TMatrixN<float, 3, 3> TMatrix3f;
+typedef TMatrixN<float, 6, 6> TMatrix6f;
+typedef TMatrixN<double, 2, 2> TMatrix2d;
+typedef TMatrixN<double, 3, 3> TMatrix3d;
+typedef TMatrixN<double, 6, 6> TMatrix6d;
+
+template<typename Type, int Rows, int Cols>
+inline TMatrixN<Type, Rows, Cols> operator * (Type value, const TMatrixN<Type, Rows, Cols>& matrix)
+{
+    return matrix * value;
+}
+
+template<typename Type, int Rows, int Inner, int Cols>
+TMatrixN<Type, Rows, Cols> operator * (const TMatrixN<Type, Rows, Inner>& a, const TMatrixN<Type, Inner, Cols>& b)
+{
+    TMatrixN<Type, Rows, Cols> result;
+    for (int i=0; i<Rows; ++i) {
+        for (int j=0; j<Cols; ++j) {
+            Type sum = a(i, 0) * b(0, j);
+            for (int k=1; k<Inner; ++k)
+                sum += a(i, k) * b(k, j);
+            result(i, j) = sum;
+        }
+    }
+    return result;
+}
+
+template<typename Type, int Size>
+inline void operator *= (TMatrixN<Type, Size, Size>& a, const TMatrixN<Type, Size, Size>& b)
+{
+    a = a * b;
+}
+
+template<typename Type, int Rows, int Cols>
+TVectorN<Type, Rows> operator * (const TMatrixN<Type, Rows, Cols>& matrix, const TVectorN<Type, Cols>& vector)
+{
+    TVectorN<Type, Rows> result;
+    for (int i=0; i<Rows; ++i) {
+        const Type* dataRow = matrix.getDataRow(i);
+        Type sum = dataRow[0] * vector(0);
+        for (int j=1; j<Cols; ++j)
+            sum += dataRow[j] * vector(j);
+        result(i) = sum;
+    }
+    return result;
+}
+
+template<typename Type, int Rows, int Cols>
+TVectorN<Type, Cols> operator * (const TVectorN<Type, Rows>& vector, const TMatrixN<Type, Rows, Cols>& matrix)
+{
+    TVectorN<Type, Cols> result;
+    for (int j=0; j<Cols; ++j) {
+        Type sum = vector(0) * matrix(0, j);
+        for (int i=1; i<Rows; ++i)
+            sum += vector(i) * matrix(i, j);
+        result(j) = sum;
+    }
+    return result;
+}
+
+// Product of transposed matrix and vector without creation of transposed matrix.
+template<typename Type, int Rows, int Cols>
+TVectorN<Type, Cols> multiplyTransposed(const TMatrixN<Type, Rows, Cols>& matrix, const TVectorN<Type, Rows>& vector)
+{
+    return vector * matrix;
+}
+
+} //namespace TMath
+
+#endif // TMATH_TMATRIXN_H
@@ -3,6 +3,7 @@
 
 #include "TVector.h"
 #include "TMatrix.h"
+#include "TMatrixN.h"
 
 #include <cmath>
 #include <utility>
@@ -182,9 +183,9 @@ namespace TTools
     inline static bool computeLUP_decomposition(TMatrix<Type>& inoutMatrix, TVector<int>& P);
 
     //Compute a rotation exponential using the Rodrigues Formula.
-    template <typename Type>
-    inline static void exp_rodrigues(TMatrix<Type>& outRotationMatrix,
-                                     const TVector<Type>& w, const Type A, const Type B)
+    template <typename Type, typename MatrixType, typename VectorType>
+    inline static void exp_rodrigues(MatrixType& outRotationMatrix,
+                                     const VectorType& w, const Type A, const Type B)
     {
         TMath_assert((outRotationMatrix.rows() >= 3) && (outRotationMatrix.cols() >= 3));
         TMath_assert(w.size() >= 3);
@@ -332,6 +333,40 @@ namespace TTools
         exp_rodrigues(outRotationMatrix, w, A, B);
     }
 
+    template <typename Type>
+    inline static void exp_transform(TMatrixN<Type, 3, 3>& outRotationMatrix, TVectorN<Type, 3>& outTranslation,
+                                     const TVectorN<Type, 6>& mu)
+    {
+        static const Type one_6th = Type(1.0 / 6.0);
+        static const Type one_20th = Type(1.0 / 20.0);
+        const TVectorN<Type, 3> w = mu.template slice<3>(3);
+        const TVectorN<Type, 3> mu_3 = mu.template slice<3>(0);
+        const Type theta_square = dot(w, w);
+        const Type theta = std::sqrt(theta_square);
+        Type A, B;
+
+        const TVectorN<Type, 3> crossVector = cross3(w, mu_3);
+        if (theta_square < 1e-8) {
+            A = Type(1.0) - one_6th * theta_square;
+            B = Type(0.5);
+            outTranslation = mu_3 + Type(0.5) * crossVector;
+        } else {
+            Type C;
+            if (theta_square < 1e-6) {
+                C = one_6th * (Type(1) - one_20th * theta_square);
+                A = Type(1.0) - theta_square * C;
+                B = Type(0.5) - (Type)(0.25 * one_6th * theta_square);
+            } else {
+                const Type inv_theta = Type(1) / theta;
+                A = std::sin(theta) * inv_theta;
+                B = (Type(1) - std::cos(theta)) * (inv_theta * inv_theta);
+                C = (Type(1) - A) * (inv_theta * inv_theta);
+            }
+            outTranslation = mu_3 + B * crossVector + C * cross3(w, crossVector);
+        }
+        exp_rodrigues(outRotationMatrix, w, A, B);
+    }
+
     template <typename Type>
     inline static TMatrix<Type> exp_transformMatrix(const TVector<Type>& mu)
     {
@@ -633,6 +668,27 @@ namespace TTools
         return true;
     }
 
+    template <typename Type>
+    inline static bool depthFromTriangulation(Type& depth,
+                                              const TMatrixN<Type, 3, 3>& deltaRotation,
+                                              const TVectorN<Type, 3>& deltaTranslation,
+                                              const TVectorN<Type, 3>& camDirA,
+                                              const TVectorN<Type, 3>& camDirB)
+    {
+        const TVectorN<Type, 3> camDirA_2 = deltaRotation * camDirA;
+        Type A_00 = dot(camDirA_2, camDirA_2);
+        Type A_01 = dot(camDirA_2, camDirB);
+        Type A_11 = dot(camDirB, camDirB);
+        Type det = A_00 * A_11 - A_01 * A_01;
+        if (std::fabs(det) < std::numeric_limits<Type>::epsilon())
+            return false;
+        //depth = - (AtA^-1 * A^t * deltaTranslation);
+        depth = - (A_11 * dot(camDirA_2, deltaTranslation) - A_01 * dot(camDirB, deltaTranslation)) / det;
+        if (depth < std::numeric_limits<Type>::epsilon())
+            return false;
+        return true;
+    }
+
     //!RADIANS!
     template <typename Type>
     inline static TVector<Type> rotationMatrixToEulerAngles_3d(const TMatrix<Type>& rotationMatrix)
@@ -0,0 +1,311 @@
+#ifndef TMATH_TVECTORN_H
+#define TMATH_TVECTORN_H
+
+#include "TVector.h"
+
+namespace TMath {
+
+// Vector with size known at compile time. Data is stored inside of object, so creation and copying
+// don't use heap. It has the same operators as TVector and can be converted from and to TVector.
+template<typename Type, int Size>
+class TVectorN
+{
+public:
+    typedef Type TypeElement;
+
+    static_assert(Size > 0, "Size of vector must be positive");
+
+    static TVectorN<Type, Size> create(Type x, Type y)
+    {
+        static_assert(Size == 2, "Size of vector must be 2");
+        TVectorN<Type, Size> v;
+        v(0) = x;
+        v(1) = y;
+        return v;
+    }
+
+    static TVectorN<Type, Size> create(Type x, Type y, Type z)
+    {
+        static_assert(Size == 3, "Size of vector must be 3");
+        TVectorN<Type, Size> v;
+        v(0) = x;
+        v(1) = y;
+        v(2) = z;
+        return v;
+    }
+
+    static TVectorN<Type, Size> create(Type x, Type y, Type z, Type w)
+    {
+        static_assert(Size == 4, "Size of vector must be 4");
+        TVectorN<Type, Size> v;
+        v(0) = x;
+        v(1) = y;
+        v(2) = z;
+        v(3) = w;
+        return v;
+    }
+
+    TVectorN()
+    {
+    }
+
+    TVectorN(const TVector<Type>& vector)
+    {
+        TMath_assert(vector.size() == Size);
+        for (int i=0; i<Size; ++i)
+            m_data[i] = vector(i);
+    }
+
+    explicit TVectorN(const Type* dataFrom)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] = dataFrom[i];
+    }
+
+    TVector<Type> toTVector() const
+    {
+        return TVector<Type>(Size, m_data);
+    }
+
+    TVectorN<Type, Size>& operator = (const TVector<Type>& vector)
+    {
+        TMath_assert(vector.size() == Size);
+        for (int i=0; i<Size; ++i)
+            m_data[i] = vector(i);
+        return (*this);
+    }
+
+    void setZero()
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] = (Type)0;
+    }
+
+    static constexpr int size()
+    {
+        return Size;
+    }
+
+    inline Type& operator() (int index)
+    {
+        TMath_assert((index >= 0) && (index < Size));
+        return m_data[index];
+    }
+
+    inline const Type& operator() (int index) const
+    {
+        TMath_assert((index >= 0) && (index < Size));
+        return m_data[index];
+    }
+
+    inline Type& operator[] (int index)
+    {
+        TMath_assert((index >= 0) && (index < Size));
+        return m_data[index];
+    }
+
+    inline const Type& operator[] (int index) const
+    {
+        TMath_assert((index >= 0) && (index < Size));
+        return m_data[index];
+    }
+
+    inline const Type* data() const
+    {
+        return m_data;
+    }
+
+    inline Type* data()
+    {
+        return m_data;
+    }
+
+    TVectorN<Type, Size> operator - () const
+    {
+        TVectorN<Type, Size> result;
+        for (int i=0; i<Size; ++i)
+            result(i) = - m_data[i];
+        return result;
+    }
+
+    TVectorN<Type, Size> operator + (const TVectorN<Type, Size>& vector) const
+    {
+        TVectorN<Type, Size> result;
+        for (int i=0; i<Size; ++i)
+            result(i) = m_data[i] + vector(i);
+        return result;
+    }
+
+    void operator += (const TVectorN<Type, Size>& vector)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] += vector(i);
+    }
+
+    TVectorN<Type, Size> operator - (const TVectorN<Type, Size>& vector) const
+    {
+        TVectorN<Type, Size> result;
+        for (int i=0; i<Size; ++i)
+            result(i) = m_data[i] - vector(i);
+        return result;
+    }
+
+    void operator -= (const TVectorN<Type, Size>& vector)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] -= vector(i);
+    }
+
+    TVectorN<Type, Size> operator * (Type val) const
+    {
+        TVectorN<Type, Size> result;
+        for (int i=0; i<Size; ++i)
+            result(i) = m_data[i] * val;
+        return result;
+    }
+
+    TVectorN<Type, Size> operator / (Type val) const
+    {
+        TVectorN<Type, Size> result;
+        for (int i=0; i<Size; ++i)
+            result(i) = m_data[i] / val;
+        return result;
+    }
+
+    void operator *= (const TVectorN<Type, Size>& vector)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] *= vector(i);
+    }
+
+    void operator *= (Type val)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] *= val;
+    }
+
+    void operator /= (const TVectorN<Type, Size>& vector)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] /= vector(i);
+    }
+
+    void operator /= (Type val)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] /= val;
+    }
+
+    Type lengthSquared() const
+    {
+        Type result = m_data[0] * m_data[0];
+        for (int i=1; i<Size; ++i)
+            result += m_data[i] * m_data[i];
+        return result;
+    }
+
+    Type length() const
+    {
+        return std::sqrt(lengthSquared());
+    }
+
+    Type normalize()
+    {
+        Type l = length();
+        if (l < std::numeric_limits<Type>::epsilon()) {
+            setZero();
+            return Type(0);
+        }
+        for (int i=0; i<Size; ++i)
+            m_data[i] /= l;
+        return l;
+    }
+
+    TVectorN<Type, Size> normalized() const
+    {
+        TVectorN<Type, Size> result = *this;
+        result.normalize();
+        return result;
+    }
+
+    template<int SliceSize>
+    TVectorN<Type, SliceSize> slice(int beginIndex = 0) const
+    {
+        TMath_assert((beginIndex >= 0) && ((beginIndex + SliceSize) <= Size));
+        return TVectorN<Type, SliceSize>(&m_data[beginIndex]);
+    }
+
+    void fill(Type value)
+    {
+        for (int i=0; i<Size; ++i)
+            m_data[i] = value;
+    }
+
+    template<int FillSize>
+    void fill(int beginIndex, const TVectorN<Type, FillSize>& v)
+    {
+        TMath_assert((beginIndex >= 0) && ((beginIndex + FillSize) <= Size));
+        for (int i=0; i<FillSize; ++i)
+            m_data[beginIndex + i] = v(i);
+    }
+
+    template<typename CastType>
+    TVectorN<CastType, Size> cast() const
+    {
+        TVectorN<CastType, Size> result;
+        for (int i = 0; i < Size; ++i) {
+            result(i) = (CastType)m_data[i];
+        }
+        return result;
+    }
+
+    bool operator == (const TVectorN<Type, Size>& b) const
+    {
+        for (int i = 0; i < Size; ++i) {
+            if (std::fabs(m_data[i] - b(i)) > std::numeric_limits<Type>::epsilon())
+                return false;
+        }
+        return true;
+    }
+    bool operator != (const TVectorN<Type, Size>& b) const
+    {
+        return !(operator == (b));
+    }
+
+private:
+    Type m_data[Size];
+};
+
+typedef TVectorN<float, 2> TVector2f;
+typedef TVectorN<float, 3> TVector3f;
+typedef TVectorN<float, 6> TVector6f;
+typedef TVectorN<double, 2> TVector2d;
+typedef TVectorN<double, 3> TVector3d;
+typedef TVectorN<double, 6> TVector6d;
+
+template<typename Type, int Size>
+inline TVectorN<Type, Size> operator * (Type value, const TVectorN<Type, Size>& vector)
+{
+    return vector * value;
+}
+
+template<typename Type, int Size>
+Type dot(const TVectorN<Type, Size>& a, const TVectorN<Type, Size>& b)
+{
+    Type result = a(0) * b(0);
+    for (int i=1; i<Size; ++i)
+        result += a(i) * b(i);
+    return result;
+}
+
+template<typename Type>
+TVectorN<Type, 3> cross3(const TVectorN<Type, 3>& a, const TVectorN<Type, 3>& b)
+{
+    return TVectorN<Type, 3>::create(a(1) * b(2) - a(2) * b(1),
+                                     a(2) * b(0) - a(0) * b(2),
+                                     a(0) * b(1) - a(1) * b(0));
+}
+
+} //namespace TMath
+
+#endif // TMATH_TVECTORN_H
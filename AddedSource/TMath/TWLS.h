@@ -3,6 +3,7 @@
 
 #include "TTools.h"
 #include "TCholesky.h"
+#include "TVectorN.h"
 
 namespace TMath {
 
@@ -88,6 +89,31 @@ public:
         }
     }
 
+    /// Add a single measurement with the Jacobian of fixed size
+    template<int Size>
+    inline void addMeasurement(Type m, const TVectorN<Type, Size>& J, Type weight)
+    {
+        TMath_assert(m_invA.rows() == Size);
+        for(int r=0; r < Size; ++r) {
+            Type Jw = weight * J(r);
+            m_B(r) += m * Jw;
+            for(int c=r; c<Size; ++c)
+                m_invA(r, c) += Jw * J(c);
+        }
+    }
+
+    /// Add a single measurement with the Jacobian of fixed size
+    template<int Size>
+    inline void addMeasurement(Type m, const TVectorN<Type, Size>& J)
+    {
+        TMath_assert(m_invA.rows() == Size);
+        for(int r=0; r < Size; ++r) {
+            m_B(r) += m * J(r);
+            for(int c=r; c<Size; ++c)
+                m_invA(r, c) += J(r) * J(c);
+        }
+    }
+
     /// Add multiple measurements at once (much more efficiently)
     /// @param m The measurements to add
     /// @param J The Jacobian matrix \f$\frac{\partial\text{m}_i}{\partial\text{param}_j}\f$
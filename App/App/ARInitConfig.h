@@ -33,6 +33,9 @@ class ARInitConfig:
     Q_PROPERTY(float pixelEps READ pixelEps WRITE setPixelEps NOTIFY configChanged)
     Q_PROPERTY(int maxNumberIterationsForOpticalFlow READ maxNumberIterationsForOpticalFlow
                WRITE setMaxNumberIterationsForOpticalFlow NOTIFY configChanged)
+    Q_PROPERTY(int featureCountThreads READ featureCountThreads WRITE setFeatureCountThreads NOTIFY configChanged)
+    Q_PROPERTY(double ransacConfidence READ ransacConfidence WRITE setRansacConfidence NOTIFY configChanged)
+    Q_PROPERTY(int ransacCountThreads READ ransacCountThreads WRITE setRansacCountThreads NOTIFY configChanged)
 public:
     AR::InitConfiguration get() const
     {
@@ -279,6 +282,36 @@ public:
         emit configChanged();
     }
 
+    int featureCountThreads() const
+    {
+        return m_config.featureCountThreads;
+    }
+    void setFeatureCountThreads(int value)
+    {
+        m_config.featureCountThreads = value;
+        emit configChanged();
+    }
+
+    double ransacConfidence() const
+    {
+        return m_config.ransacConfidence;
+    }
+    void setRansacConfidence(double value)
+    {
+        m_config.ransacConfidence = value;
+        emit configChanged();
+    }
+
+    int ransacCountThreads() const
+    {
+        return m_config.ransacCountThreads;
+    }
+    void setRansacCountThreads(int value)
+    {
+        m_config.ransacCountThreads = value;
+        emit configChanged();
+    }
+
 signals:
     void configChanged();
 
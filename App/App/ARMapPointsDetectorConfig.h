@@ -36,6 +36,9 @@ class ARMapPointsDetectorConfig:
                WRITE setMaxNumberIterationsForOpticalFlow NOTIFY configChanged)
     Q_PROPERTY(int maxCountCandidatePoints READ maxCountCandidatePoints
                WRITE setMaxCountCandidatePoints NOTIFY configChanged)
+    Q_PROPERTY(bool asynchronous READ asynchronous WRITE setAsynchronous NOTIFY configChanged)
+    Q_PROPERTY(bool dropOldestFrames READ dropOldestFrames WRITE setDropOldestFrames NOTIFY configChanged)
+    Q_PROPERTY(int countThreads READ countThreads WRITE setCountThreads NOTIFY configChanged)
 public:
     AR::MapPointsDetectorConfiguration get() const
     {
@@ -142,6 +145,36 @@ public:
         emit configChanged();
     }
 
+    bool asynchronous() const
+    {
+        return m_config.asynchronous;
+    }
+    void setAsynchronous(bool enabled)
+    {
+        m_config.asynchronous = enabled;
+        emit configChanged();
+    }
+
+    bool dropOldestFrames() const
+    {
+        return m_config.dropOldestFrames;
+    }
+    void setDropOldestFrames(bool enabled)
+    {
+        m_config.dropOldestFrames = enabled;
+        emit configChanged();
+    }
+
+    int countThreads() const
+    {
+        return m_config.countThreads;
+    }
+    void setCountThreads(int countThreads)
+    {
+        m_config.countThreads = countThreads;
+        emit configChanged();
+    }
+
     float seedConvergenceSquaredSigmaThresh() const
     {
         return m_config.seedConvergenceSquaredSigmaThresh;
@@ -2,6 +2,8 @@
 #include <QModelIndex>
 #include <QMutexLocker>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
 
 
 ARPerformanceMonitorModel::ARPerformanceMonitorModel(QObject* parent):
@@ -96,7 +98,9 @@ void ARPerformanceMonitorModel::updateModel()
     if (!m_performanceMonitor)
         return;
     //m_commonTime = 0;
-    m_commonTime = std::max((int)m_performanceMonitor->commonTime().count(), 1);
+    // durations of monitor are in nanoseconds, the common time is shown in milliseconds
+    float commonTime = std::max((float)m_performanceMonitor->commonTime().count(), 1.0f);
+    m_commonTime = std::max((int)std::lround(commonTime * 1e-6f), 1);
     emit commonTimeChanged();
     QVector<int> roles;
     roles.push_back(StepRoles::SizeOfPart);
@@ -106,7 +110,7 @@ void ARPerformanceMonitorModel::updateModel()
         //m_commonTime += (int)timer.duration;
         if (indexData < m_data.size()) {
             if (timer.name == m_data[indexData].name) {
-                m_data[indexData].sizeOfPart = timer.duration / (float)m_commonTime;
+                m_data[indexData].sizeOfPart = timer.duration / commonTime;
                 emit dataChanged(index(indexData), index(indexData), roles);
                 ++indexData;
             } else {
@@ -116,21 +120,21 @@ void ARPerformanceMonitorModel::updateModel()
                     m_data.erase(m_data.begin() + indexData, m_data.end());
                     endRemoveRows();
                     beginInsertRows(QModelIndex(), indexData, indexData);
-                    m_data.insert(m_data.end(), { timer.name, timer.duration / (float)m_commonTime });
+                    m_data.insert(m_data.end(), { timer.name, timer.duration / commonTime });
                     endInsertRows();
                     ++indexData;
                 } else {
                     beginRemoveRows(QModelIndex(), indexData, foundedIndex - 1);
                     m_data.erase(m_data.begin() + indexData, m_data.begin() + foundedIndex);
                     endRemoveRows();
-                    m_data[indexData].sizeOfPart = timer.duration / (float)m_commonTime;
+                    m_data[indexData].sizeOfPart = timer.duration / commonTime;
                     emit dataChanged(index(indexData), index(indexData), roles);
                     ++indexData;
                 }
             }
         } else {
             beginInsertRows(QModelIndex(), indexData, indexData);
-            m_data.insert(m_data.begin() + indexData, { timer.name, timer.duration / (float)m_commonTime });
+            m_data.insert(m_data.begin() + indexData, { timer.name, timer.duration / commonTime });
             endInsertRows();
             ++indexData;
         }
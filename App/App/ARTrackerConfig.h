@@ -47,6 +47,16 @@ class ARTrackerConfig:
     Q_PROPERTY(int maxCountKeyFrames READ maxCountKeyFrames WRITE setMaxCountKeyFrames NOTIFY configChanged)
     Q_PROPERTY(int featureMaxNumberIterations READ featureMaxNumberIterations
                WRITE setFeatureMaxNumberIterations NOTIFY configChanged)
+    Q_PROPERTY(float warpedPatchMaxDrift READ warpedPatchMaxDrift
+               WRITE setWarpedPatchMaxDrift NOTIFY configChanged)
+    Q_PROPERTY(int featureCountThreads READ featureCountThreads
+               WRITE setFeatureCountThreads NOTIFY configChanged)
+    Q_PROPERTY(bool localBundleAdjustment READ localBundleAdjustment
+               WRITE setLocalBundleAdjustment NOTIFY configChanged)
+    Q_PROPERTY(int localBundleAdjustment_countKeyFrames READ localBundleAdjustment_countKeyFrames
+               WRITE setLocalBundleAdjustment_countKeyFrames NOTIFY configChanged)
+    Q_PROPERTY(int localBundleAdjustment_numberIterations READ localBundleAdjustment_numberIterations
+               WRITE setLocalBundleAdjustment_numberIterations NOTIFY configChanged)
     Q_PROPERTY(double tracker_eps READ tracker_eps WRITE setTracker_eps NOTIFY configChanged)
     Q_PROPERTY(double tracker_numberIterations READ tracker_numberIterations
                WRITE setTracker_numberIterations NOTIFY configChanged)
@@ -56,6 +66,12 @@ class ARTrackerConfig:
                WRITE setTracker_maxImageLevel NOTIFY configChanged)
     Q_PROPERTY(QSize tracker_cursorSize READ tracker_cursorSize
                WRITE setTracker_cursorSize NOTIFY configChanged)
+    Q_PROPERTY(int tracker_countThreads READ tracker_countThreads
+               WRITE setTracker_countThreads NOTIFY configChanged)
+    Q_PROPERTY(bool tracker_doublePrecision READ tracker_doublePrecision
+               WRITE setTracker_doublePrecision NOTIFY configChanged)
+    Q_PROPERTY(bool pipelinedProcessing READ pipelinedProcessing
+               WRITE setPipelinedProcessing NOTIFY configChanged)
 
 public:
     AR::TrackingConfiguration get() const
@@ -343,6 +359,56 @@ public:
         emit configChanged();
     }
 
+    float warpedPatchMaxDrift() const
+    {
+        return m_config.warpedPatchMaxDrift;
+    }
+    void setWarpedPatchMaxDrift(float value)
+    {
+        m_config.warpedPatchMaxDrift = value;
+        emit configChanged();
+    }
+
+    int featureCountThreads() const
+    {
+        return m_config.featureCountThreads;
+    }
+    void setFeatureCountThreads(int value)
+    {
+        m_config.featureCountThreads = value;
+        emit configChanged();
+    }
+
+    bool localBundleAdjustment() const
+    {
+        return m_config.localBundleAdjustment;
+    }
+    void setLocalBundleAdjustment(bool value)
+    {
+        m_config.localBundleAdjustment = value;
+        emit configChanged();
+    }
+
+    int localBundleAdjustment_countKeyFrames() const
+    {
+        return m_config.localBundleAdjustment_countKeyFrames;
+    }
+    void setLocalBundleAdjustment_countKeyFrames(int value)
+    {
+        m_config.localBundleAdjustment_countKeyFrames = value;
+        emit configChanged();
+    }
+
+    int localBundleAdjustment_numberIterations() const
+    {
+        return m_config.localBundleAdjustment_numberIterations;
+    }
+    void setLocalBundleAdjustment_numberIterations(int value)
+    {
+        m_config.localBundleAdjustment_numberIterations = value;
+        emit configChanged();
+    }
+
     double tracker_eps() const
     {
         return m_config.tracker_eps;
@@ -393,6 +459,36 @@ public:
         emit configChanged();
     }
 
+    int tracker_countThreads() const
+    {
+        return m_config.tracker_countThreads;
+    }
+    void setTracker_countThreads(int value)
+    {
+        m_config.tracker_countThreads = value;
+        emit configChanged();
+    }
+
+    bool tracker_doublePrecision() const
+    {
+        return m_config.tracker_doublePrecision;
+    }
+    void setTracker_doublePrecision(bool value)
+    {
+        m_config.tracker_doublePrecision = value;
+        emit configChanged();
+    }
+
+    bool pipelinedProcessing() const
+    {
+        return m_config.pipelinedProcessing;
+    }
+    void setPipelinedProcessing(bool enabled)
+    {
+        m_config.pipelinedProcessing = enabled;
+        emit configChanged();
+    }
+
 signals:
     void configChanged();
 
@@ -0,0 +1,23 @@
+QT -= core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle qt
+
+TARGET = ARReplay
+TEMPLATE = app
+
+INCLUDEPATH += .
+INCLUDEPATH += $$PWD/../../AddedSource
+
+include ($$PWD/../../AddedSource/AR/AR.pri)
+include ($$PWD/../../AddedSource/TMath/TMath.pri)
+
+SOURCES += main.cpp \
+    FrameSequence.cpp \
+    ReplayStatistics.cpp \
+    AllocationCounter.cpp
+
+HEADERS += \
+    FrameSequence.h \
+    ReplayStatistics.h \
+    AllocationCounter.h
@@ -0,0 +1,48 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<std::uint64_t> countAllocationsOfProcess(0);
+static std::atomic<std::uint64_t> countLargeAllocationsOfProcess(0);
+
+static void * allocate(std::size_t size)
+{
+    countAllocationsOfProcess.fetch_add(1, std::memory_order_relaxed);
+    if (size >= AllocationCounter::largeAllocationSize)
+        countLargeAllocationsOfProcess.fetch_add(1, std::memory_order_relaxed);
+    void * memory = std::malloc((size > 0) ? size : 1);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void * operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void * operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void * memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+    std::free(memory);
+}
+
+std::uint64_t AllocationCounter::countAllocations()
+{
+    return countAllocationsOfProcess.load();
+}
+
+std::uint64_t AllocationCounter::countLargeAllocations()
+{
+    return countLargeAllocationsOfProcess.load();
+}
@@ -0,0 +1,19 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Counts of allocations by global operator new in all threads of the process (ARReplay, AllocationCheck).
+// Allocations of at least largeAllocationSize bytes are counted separately, these are allocations of images
+// of frames and buffers of the size of frames which must not be done in steady-state tracking.
+class AllocationCounter
+{
+public:
+    static const std::size_t largeAllocationSize = 16 * 1024;
+
+    static std::uint64_t countAllocations();
+    static std::uint64_t countLargeAllocations();
+};
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,125 @@
+#include "FrameSequence.h"
+#include <fstream>
+#include <sstream>
+
+FrameSequence::FrameSequence()
+{
+    m_frameSize.setZero();
+    m_pixelFormat = PixelFormat::Gray;
+}
+
+bool FrameSequence::open(const std::string& directory)
+{
+    m_directory = directory;
+    if (!m_directory.empty() && (m_directory.back() != '/') && (m_directory.back() != '\\'))
+        m_directory += '/';
+    m_frames.clear();
+    m_frameSize.setZero();
+
+    std::ifstream indexFile(m_directory + "index.txt");
+    if (!indexFile.is_open()) {
+        m_errorString = "Failed to open " + m_directory + "index.txt";
+        return false;
+    }
+    bool headerIsRead = false;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(indexFile, line)) {
+        ++lineNumber;
+        if (line.empty() || (line[0] == '#'))
+            continue;
+        std::istringstream stream(line);
+        if (!headerIsRead) {
+            std::string format;
+            if (!(stream >> m_frameSize.x >> m_frameSize.y >> format) ||
+                    (m_frameSize.x <= 0) || (m_frameSize.y <= 0)) {
+                m_errorString = "Invalid header of index.txt";
+                return false;
+            }
+            if (format == "gray") {
+                m_pixelFormat = PixelFormat::Gray;
+            } else if (format == "rgba") {
+                m_pixelFormat = PixelFormat::Rgba;
+            } else {
+                m_errorString = "Unknown pixel format: " + format;
+                return false;
+            }
+            headerIsRead = true;
+            continue;
+        }
+        FrameInfo info;
+        if (!(stream >> info.timestamp >> info.fileName)) {
+            m_errorString = "Invalid line " + std::to_string(lineNumber) + " of index.txt";
+            return false;
+        }
+        std::string mark;
+        info.nextTrackingState = (stream >> mark) && (mark == "next");
+        m_frames.push_back(info);
+    }
+    if (!headerIsRead) {
+        m_errorString = "Empty index.txt";
+        return false;
+    }
+    m_buffer.resize(m_frameSize.y * m_frameSize.x * ((m_pixelFormat == PixelFormat::Rgba) ? 4 : 1));
+    return true;
+}
+
+const std::string& FrameSequence::errorString() const
+{
+    return m_errorString;
+}
+
+AR::Point2i FrameSequence::frameSize() const
+{
+    return m_frameSize;
+}
+
+FrameSequence::PixelFormat FrameSequence::pixelFormat() const
+{
+    return m_pixelFormat;
+}
+
+std::size_t FrameSequence::countFrames() const
+{
+    return m_frames.size();
+}
+
+const FrameSequence::FrameInfo& FrameSequence::frameInfo(std::size_t index) const
+{
+    return m_frames[index];
+}
+
+bool FrameSequence::hasStateMarks() const
+{
+    for (const FrameInfo& info : m_frames) {
+        if (info.nextTrackingState)
+            return true;
+    }
+    return false;
+}
+
+bool FrameSequence::readFrame(AR::Image<AR::Rgba>& outFrame, std::size_t index)
+{
+    std::ifstream file(m_directory + m_frames[index].fileName, std::ios::binary);
+    if (!file.is_open()) {
+        m_errorString = "Failed to open " + m_frames[index].fileName;
+        return false;
+    }
+    if (!file.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size())) {
+        m_errorString = "Unexpected end of " + m_frames[index].fileName;
+        return false;
+    }
+    if (outFrame.size() != m_frameSize)
+        outFrame = AR::Image<AR::Rgba>(m_frameSize);
+    const int area = outFrame.area();
+    AR::Rgba* outPtr = outFrame.data();
+    const unsigned char* ptr = m_buffer.data();
+    if (m_pixelFormat == PixelFormat::Rgba) {
+        for (int i = 0; i < area; ++i, ++outPtr, ptr += 4)
+            outPtr->set(ptr[0], ptr[1], ptr[2], ptr[3]);
+    } else {
+        for (int i = 0; i < area; ++i, ++outPtr, ++ptr)
+            outPtr->set(*ptr, *ptr, *ptr);
+    }
+    return true;
+}
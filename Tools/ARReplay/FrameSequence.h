@@ -0,0 +1,56 @@
+#ifndef FRAMESEQUENCE_H
+#define FRAMESEQUENCE_H
+
+#include "AR/Image.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Recorded sequence of camera frames.
+// The directory contains raw frames (without headers) and a text file "index.txt":
+//     <width> <height> <gray|rgba>
+//     <timestamp in microseconds> <file name> [next]
+//     ...
+// Lines starting with '#' are ignored. The mark "next" means that AR::ARSystem::nextTrackingState()
+// was called before this frame (the tap of user on the screen).
+class FrameSequence
+{
+public:
+    enum class PixelFormat
+    {
+        Gray,
+        Rgba
+    };
+
+    struct FrameInfo
+    {
+        std::int64_t timestamp;
+        std::string fileName;
+        bool nextTrackingState;
+    };
+
+    FrameSequence();
+
+    bool open(const std::string& directory);
+
+    const std::string& errorString() const;
+
+    AR::Point2i frameSize() const;
+    PixelFormat pixelFormat() const;
+
+    std::size_t countFrames() const;
+    const FrameInfo& frameInfo(std::size_t index) const;
+    bool hasStateMarks() const;
+
+    bool readFrame(AR::Image<AR::Rgba>& outFrame, std::size_t index);
+
+private:
+    std::string m_directory;
+    std::string m_errorString;
+    AR::Point2i m_frameSize;
+    PixelFormat m_pixelFormat;
+    std::vector<FrameInfo> m_frames;
+    std::vector<unsigned char> m_buffer;
+};
+
+#endif // FRAMESEQUENCE_H
@@ -0,0 +1,129 @@
+#include "ReplayStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+ReplayStatistics::ReplayStatistics()
+{
+    m_frames.name = "Frame";
+    m_frames.countMeasurements = 0;
+    m_totalTime = 0.0;
+    m_countSteadyStateFrames = 0;
+    m_countFramesWithLargeAllocations = 0;
+    m_countLargeAllocations = 0;
+}
+
+void ReplayStatistics::addFrame(const AR::PerformanceMonitor* performanceMonitor, double frameDuration)
+{
+    if (performanceMonitor != nullptr) {
+        for (std::size_t i = 0; i < performanceMonitor->countTimers(); ++i) {
+            AR::PerformanceMonitor::Timer timer = performanceMonitor->timer(i);
+            Stage& stage = _stage(timer.name);
+            // stages of other threads (MapPointsDetector) can be not measured again after the previous frame
+            if (timer.countMeasurements == stage.countMeasurements)
+                continue;
+            stage.countMeasurements = timer.countMeasurements;
+            stage.durations.push_back(timer.lastDuration * 1e-6);
+        }
+    }
+    m_frames.durations.push_back(frameDuration);
+    m_totalTime += frameDuration;
+}
+
+void ReplayStatistics::addSteadyStateFrame(std::uint64_t countLargeAllocations)
+{
+    ++m_countSteadyStateFrames;
+    if (countLargeAllocations > 0) {
+        ++m_countFramesWithLargeAllocations;
+        m_countLargeAllocations += countLargeAllocations;
+    }
+}
+
+std::size_t ReplayStatistics::countFrames() const
+{
+    return m_frames.durations.size();
+}
+
+double ReplayStatistics::totalTime() const
+{
+    return m_totalTime;
+}
+
+ReplayStatistics::Stage& ReplayStatistics::_stage(const std::string& name)
+{
+    for (Stage& stage : m_stages) {
+        if (stage.name == name)
+            return stage;
+    }
+    m_stages.push_back({ name, std::vector<double>(), 0 });
+    return m_stages.back();
+}
+
+double ReplayStatistics::percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0.0;
+    std::size_t rank = (std::size_t)std::ceil(p * values.size());
+    std::size_t index = (rank > 0) ? std::min(rank, values.size()) - 1 : 0;
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+std::size_t ReplayStatistics::peakResidentSetSize()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS info;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info)))
+        return (std::size_t)info.PeakWorkingSetSize;
+    return 0;
+#elif defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (std::size_t)usage.ru_maxrss;
+    return 0;
+#elif defined(__unix__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (std::size_t)usage.ru_maxrss * 1024;
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+void ReplayStatistics::print(std::ostream& stream) const
+{
+    stream << std::fixed << std::setprecision(3);
+    stream << std::left << std::setw(44) << "Stage" << std::right
+           << std::setw(8) << "count"
+           << std::setw(11) << "p50, ms"
+           << std::setw(11) << "p95, ms"
+           << std::setw(11) << "p99, ms"
+           << std::setw(11) << "max, ms" << std::endl;
+    std::vector<const Stage*> stages;
+    for (const Stage& stage : m_stages)
+        stages.push_back(&stage);
+    stages.push_back(&m_frames);
+    for (const Stage* stage : stages) {
+        stream << std::left << std::setw(44) << stage->name << std::right
+               << std::setw(8) << stage->durations.size()
+               << std::setw(11) << percentile(stage->durations, 0.50)
+               << std::setw(11) << percentile(stage->durations, 0.95)
+               << std::setw(11) << percentile(stage->durations, 0.99)
+               << std::setw(11) << percentile(stage->durations, 1.0) << std::endl;
+    }
+    stream << std::endl;
+    stream << "Frames: " << countFrames() << std::endl;
+    stream << "Throughput: " << ((m_totalTime > 0.0) ? (countFrames() * 1000.0 / m_totalTime) : 0.0)
+           << " fps" << std::endl;
+    stream << "Peak RSS: " << (peakResidentSetSize() / (1024.0 * 1024.0)) << " MiB" << std::endl;
+    stream << "Steady-state frames: " << m_countSteadyStateFrames << ", with large allocations: "
+           << m_countFramesWithLargeAllocations << " (" << m_countLargeAllocations << " allocations)" << std::endl;
+}
@@ -0,0 +1,47 @@
+#ifndef REPLAYSTATISTICS_H
+#define REPLAYSTATISTICS_H
+
+#include "AR/PerformanceMonitor.h"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+// Collects durations of stages of AR::ARSystem::process for each frame of replay.
+class ReplayStatistics
+{
+public:
+    struct Stage
+    {
+        std::string name;
+        std::vector<double> durations; // in milliseconds
+        std::uint64_t countMeasurements;
+    };
+
+    ReplayStatistics();
+
+    // performanceMonitor can be nullptr if durations of stages are not available.
+    void addFrame(const AR::PerformanceMonitor* performanceMonitor, double frameDuration);
+    // Frame of tracking without new key frames, all buffers of this frame must be reused.
+    void addSteadyStateFrame(std::uint64_t countLargeAllocations);
+
+    std::size_t countFrames() const;
+    double totalTime() const;
+
+    void print(std::ostream& stream) const;
+
+    static double percentile(std::vector<double> values, double p);
+    static std::size_t peakResidentSetSize();
+
+private:
+    std::vector<Stage> m_stages;
+    Stage m_frames;
+    double m_totalTime;
+    std::size_t m_countSteadyStateFrames;
+    std::size_t m_countFramesWithLargeAllocations;
+    std::uint64_t m_countLargeAllocations;
+
+    Stage& _stage(const std::string& name);
+};
+
+#endif // REPLAYSTATISTICS_H
@@ -0,0 +1,297 @@
+#include "FrameSequence.h"
+#include "ReplayStatistics.h"
+#include "AllocationCounter.h"
+#include "AR/ARSystem.h"
+#include "AR/Camera.h"
+#include "AR/KeyFrame.h"
+#include "AR/MapPoint.h"
+#include "AR/Feature.h"
+#include "AR/LocationOptimizer.h"
+#include "AR/ImageBufferPool.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <thread>
+
+// Offline replay of a recorded frame sequence through AR::ARSystem.
+// Usage:
+//     ARReplay <directory> [--camera fx fy cx cy d] [--second-frame N] [--warmup N] [--pipelined] [--async-mapping]
+//              [--save-map file] [--load-map file] [--tracker-threads N] [--tracker-double] [--feature-threads N]
+//              [--ransac-threads N] [--ransac-confidence p] [--trace file] [--search-threads N]
+//              [--patch-drift d] [--local-ba] [--seed-threads N]
+// If index.txt has no "next" marks, the first frame is used as the first frame of initialization
+// and nextTrackingState() is called on frame N (--second-frame, 30 by default) to force it.
+// The first frames (--warmup, 0 by default) are processed but are not included into statistics.
+// With --pipelined frames are fed with the timestamps of the sequence to the pipelined mode of ARSystem,
+// only the time of process() calls and the number of dropped frames are reported.
+// With --async-mapping new map points are detected in the thread of AR::MapPointsDetector,
+// statistics of its depth-filter seeds are printed after the replay.
+// With --save-map the map is saved after the replay. With --load-map the map is loaded before the replay,
+// initialization is skipped and the number of frames before relocalization is reported.
+// --tracker-threads sets TrackingConfiguration::tracker_countThreads (1 by default, 0 - all hardware threads).
+// --tracker-double selects the double path of the tracker instead of float kernels for comparison of accuracy.
+// --feature-threads sets InitConfiguration::featureCountThreads (1 by default, 0 - all hardware threads).
+// --ransac-threads and --ransac-confidence set InitConfiguration::ransacCountThreads (1 by default)
+// and InitConfiguration::ransacConfidence (0.99 by default, 1 - all countTimes hypotheses are evaluated).
+// --search-threads sets TrackingConfiguration::featureCountThreads (1 by default, 0 - all hardware threads).
+// --patch-drift sets TrackingConfiguration::warpedPatchMaxDrift (0.05 by default, -1 - patches aren't cached),
+// counters of the performance monitor (hits of the cache of warped patches) are printed after the replay.
+// With --local-ba poses of key frames and map points are refined in the thread of AR::LocalBundleAdjustment
+// (TrackingConfiguration::localBundleAdjustment), the mean reprojection error of the map is printed after the replay.
+// --seed-threads sets MapPointsDetectorConfiguration::countThreads (1 by default, 0 - all hardware threads).
+// With --trace durations of stages of all threads are saved in Chrome trace event format (chrome://tracing, Perfetto).
+// Large allocations (see AllocationCounter) are counted in steady-state frames - frames of tracking after the warmup
+// without new key frames, images of these frames must be taken from AR::ImageBufferPool.
+
+static void printUsage()
+{
+    std::cout << "Usage: ARReplay <directory> [--camera fx fy cx cy d] [--second-frame N] [--warmup N] [--pipelined] [--async-mapping]"
+              << " [--save-map file] [--load-map file] [--tracker-threads N] [--tracker-double]"
+              << " [--feature-threads N] [--ransac-threads N] [--ransac-confidence p] [--trace file]"
+              << " [--search-threads N] [--patch-drift d] [--local-ba] [--seed-threads N]" << std::endl;
+}
+
+static const char* trackingStateName(AR::TrackingState state)
+{
+    switch (state) {
+    case AR::TrackingState::Undefining:
+        return "Undefining";
+    case AR::TrackingState::CaptureFirstFrame:
+        return "CaptureFirstFrame";
+    case AR::TrackingState::CaptureSecondFrame:
+        return "CaptureSecondFrame";
+    case AR::TrackingState::Tracking:
+        return "Tracking";
+    case AR::TrackingState::LostTracking:
+        return "LostTracking";
+    }
+    return "";
+}
+
+// Mean distance between features of key frames and projections of their map points in pixels.
+static double meanReprojectionError(AR::Map* map)
+{
+    double sumErrors = 0.0;
+    std::size_t countErrors = 0;
+    map->lock();
+    for (std::size_t i = 0; i < map->countKeyFrames(); ++i) {
+        std::shared_ptr<const AR::KeyFrame> keyFrame = map->keyFrame(i);
+        TMath::TMatrixd rotation = keyFrame->rotation();
+        TMath::TVectord translation = keyFrame->translation();
+        for (int j = 0; j < keyFrame->countFeatures(); ++j) {
+            std::shared_ptr<const AR::Feature> feature = keyFrame->feature(j);
+            std::shared_ptr<const AR::MapPoint> mapPoint = feature->mapPoint();
+            if (!mapPoint || mapPoint->isDeleted())
+                continue;
+            TMath::TVectord v = rotation * mapPoint->position() + translation;
+            if (v(2) <= 0.0)
+                continue;
+            AR::Point2d projection = keyFrame->camera()->project(AR::LocationOptimizer::project2d(v));
+            AR::Point2f position = feature->positionOnFrame();
+            sumErrors += (projection - AR::Point2d(position.x, position.y)).length();
+            ++countErrors;
+        }
+    }
+    map->unlock();
+    return (countErrors > 0) ? (sumErrors / countErrors) : 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    TMath::TVectord cameraParameters = AR::Camera::defaultCameraParameters;
+    std::size_t secondFrame = 30;
+    std::size_t countWarmupFrames = 0;
+    bool pipelined = false;
+    bool asyncMapping = false;
+    std::string saveMapPath, loadMapPath, tracePath;
+    int countTrackerThreads = 1;
+    int countFeatureThreads = 1;
+    int countRansacThreads = 1;
+    double ransacConfidence = 0.99;
+    bool trackerDoublePrecision = false;
+    float warpedPatchMaxDrift = AR::TrackingConfiguration().warpedPatchMaxDrift;
+    int countSearchThreads = 1;
+    bool localBundleAdjustment = false;
+    int countSeedThreads = 1;
+    for (int i = 2; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "--camera") == 0) && ((i + 5) < argc)) {
+            for (int j = 0; j < 5; ++j)
+                cameraParameters(j) = std::atof(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--second-frame") == 0) && ((i + 1) < argc)) {
+            secondFrame = (std::size_t)std::atoi(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--warmup") == 0) && ((i + 1) < argc)) {
+            countWarmupFrames = (std::size_t)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--pipelined") == 0) {
+            pipelined = true;
+        } else if (std::strcmp(argv[i], "--async-mapping") == 0) {
+            asyncMapping = true;
+        } else if ((std::strcmp(argv[i], "--save-map") == 0) && ((i + 1) < argc)) {
+            saveMapPath = argv[++i];
+        } else if ((std::strcmp(argv[i], "--load-map") == 0) && ((i + 1) < argc)) {
+            loadMapPath = argv[++i];
+        } else if ((std::strcmp(argv[i], "--tracker-threads") == 0) && ((i + 1) < argc)) {
+            countTrackerThreads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--tracker-double") == 0) {
+            trackerDoublePrecision = true;
+        } else if ((std::strcmp(argv[i], "--patch-drift") == 0) && ((i + 1) < argc)) {
+            warpedPatchMaxDrift = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--local-ba") == 0) {
+            localBundleAdjustment = true;
+        } else if ((std::strcmp(argv[i], "--seed-threads") == 0) && ((i + 1) < argc)) {
+            countSeedThreads = std::atoi(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--search-threads") == 0) && ((i + 1) < argc)) {
+            countSearchThreads = std::atoi(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--feature-threads") == 0) && ((i + 1) < argc)) {
+            countFeatureThreads = std::atoi(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--ransac-threads") == 0) && ((i + 1) < argc)) {
+            countRansacThreads = std::atoi(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--ransac-confidence") == 0) && ((i + 1) < argc)) {
+            ransacConfidence = std::atof(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--trace") == 0) && ((i + 1) < argc)) {
+            tracePath = argv[++i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    FrameSequence sequence;
+    if (!sequence.open(argv[1])) {
+        std::cerr << sequence.errorString() << std::endl;
+        return 1;
+    }
+    const bool useStateMarks = sequence.hasStateMarks();
+
+    AR::ARSystem arSystem;
+    AR::InitConfiguration initConfiguration;
+    initConfiguration.featureCountThreads = countFeatureThreads;
+    initConfiguration.ransacCountThreads = countRansacThreads;
+    initConfiguration.ransacConfidence = ransacConfidence;
+    arSystem.setInitConfiguration(initConfiguration);
+    AR::TrackingConfiguration trackingConfiguration;
+    trackingConfiguration.pipelinedProcessing = pipelined;
+    trackingConfiguration.tracker_countThreads = countTrackerThreads;
+    trackingConfiguration.tracker_doublePrecision = trackerDoublePrecision;
+    trackingConfiguration.warpedPatchMaxDrift = warpedPatchMaxDrift;
+    trackingConfiguration.featureCountThreads = countSearchThreads;
+    trackingConfiguration.localBundleAdjustment = localBundleAdjustment;
+    arSystem.setTrackingConfiguration(trackingConfiguration);
+    AR::MapPointsDetectorConfiguration mapPointsDetectorConfiguration;
+    mapPointsDetectorConfiguration.asynchronous = asyncMapping;
+    mapPointsDetectorConfiguration.countThreads = countSeedThreads;
+    arSystem.setMapPointsDetectorConfiguration(mapPointsDetectorConfiguration);
+    arSystem.setCameraParameters(cameraParameters);
+    std::shared_ptr<const AR::PerformanceMonitor> performanceMonitor = arSystem.performanceMonitor();
+    arSystem.performanceMonitor()->setTraceEnabled(!tracePath.empty());
+    if (!loadMapPath.empty()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!arSystem.loadMap(loadMapPath)) {
+            std::cerr << "Failed to load map: " << loadMapPath << std::endl;
+            return 1;
+        }
+        std::cout << "Map loaded in " << std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start).count() * 1e-3 << " ms" << std::endl;
+    }
+    std::size_t firstTrackedFrame = sequence.countFrames();
+
+    ReplayStatistics statistics;
+    std::size_t countStates[5] = { 0, 0, 0, 0, 0 };
+    AR::Image<AR::Rgba> frame;
+    std::chrono::steady_clock::time_point replayStart = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < sequence.countFrames(); ++i) {
+        if (!sequence.readFrame(frame, i)) {
+            std::cerr << sequence.errorString() << std::endl;
+            return 1;
+        }
+        if (!loadMapPath.empty()) {
+            // the map is loaded, so initialization isn't needed
+        } else if (useStateMarks) {
+            if (sequence.frameInfo(i).nextTrackingState)
+                arSystem.nextTrackingState();
+        } else if (i == 0) {
+            arSystem.nextTrackingState();
+        } else if ((i == secondFrame) && (arSystem.trackingState() == AR::TrackingState::CaptureSecondFrame)) {
+            arSystem.nextTrackingState();
+        }
+        if (pipelined) {
+            std::this_thread::sleep_until(replayStart + std::chrono::microseconds(
+                                              sequence.frameInfo(i).timestamp - sequence.frameInfo(0).timestamp));
+        }
+        bool wasTracking = (arSystem.trackingState() == AR::TrackingState::Tracking);
+        std::size_t countKeyFrames = arSystem.map()->countKeyFrames();
+        std::uint64_t countLargeAllocations = AllocationCounter::countLargeAllocations();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        arSystem.process(frame);
+        double duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count() * 1e-3;
+        countLargeAllocations = AllocationCounter::countLargeAllocations() - countLargeAllocations;
+        ++countStates[(int)arSystem.trackingState()];
+        if ((firstTrackedFrame == sequence.countFrames()) && (arSystem.trackingState() == AR::TrackingState::Tracking))
+            firstTrackedFrame = i;
+        if (i >= countWarmupFrames) {
+            statistics.addFrame(pipelined ? nullptr : performanceMonitor.get(), duration);
+            if (!pipelined && !asyncMapping && wasTracking &&
+                    (arSystem.trackingState() == AR::TrackingState::Tracking) &&
+                    (arSystem.map()->countKeyFrames() == countKeyFrames))
+                statistics.addSteadyStateFrame(countLargeAllocations);
+        }
+    }
+    if (pipelined) {
+        arSystem.setPipelinedProcessing(false);
+        std::cout << "Dropped frames: " << arSystem.countDroppedFrames() << std::endl;
+    }
+    if (asyncMapping) {
+        std::cout << "Frames processed by map points detector: "
+                  << arSystem.mapPointsDetector()->countProcessedFrames() << std::endl;
+        std::cout << "Frames dropped by map points detector: "
+                  << arSystem.mapPointsDetector()->countDroppedFrames() << std::endl;
+        AR::MapPointsDetector::SeedStatistics seeds = arSystem.mapPointsDetector()->seedStatistics();
+        std::cout << "Seeds: " << seeds.countSeeds << " in " << seeds.countSeedGroups << " key frames" << std::endl;
+        std::cout << "Seed updates: " << seeds.countUpdates << ", failed matches: " << seeds.countFailedMatches
+                  << std::endl;
+        std::cout << "Seeds converged: " << seeds.countConverged << ", diverged: " << seeds.countDiverged
+                  << ", removed: " << seeds.countRemoved << std::endl;
+    }
+
+    if (!tracePath.empty()) {
+        if (!performanceMonitor->saveTrace(tracePath)) {
+            std::cerr << "Failed to save trace: " << tracePath << std::endl;
+            return 1;
+        }
+        std::cout << "Trace saved: " << tracePath << std::endl;
+    }
+
+    statistics.print(std::cout);
+    std::cout << std::endl;
+    for (int i = 0; i < 5; ++i) {
+        std::cout << trackingStateName((AR::TrackingState)i) << ": " << countStates[i] << " frames" << std::endl;
+    }
+    std::cout << "Key frames: " << arSystem.map()->countKeyFrames() << std::endl;
+    std::cout << "Map points: " << arSystem.map()->countMapPoints() << std::endl;
+    std::cout << "Mean reprojection error: " << meanReprojectionError(arSystem.map()) << " px" << std::endl;
+    for (std::size_t i = 0; i < performanceMonitor->countCounters(); ++i) {
+        AR::PerformanceMonitor::Counter counter = performanceMonitor->counter((int)i);
+        std::cout << counter.name << ": " << counter.value << std::endl;
+    }
+    AR::ImageBufferPool::Statistics imageBuffers = AR::ImageBufferPool::statistics();
+    std::cout << "Image buffers: " << imageBuffers.countHeapAllocations << " allocated, "
+              << imageBuffers.countReuses << " reused" << std::endl;
+    if (!loadMapPath.empty())
+        std::cout << "Frames before relocalization: " << firstTrackedFrame << std::endl;
+    if (!saveMapPath.empty()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!arSystem.saveMap(saveMapPath)) {
+            std::cerr << "Failed to save map: " << saveMapPath << std::endl;
+            return 1;
+        }
+        std::cout << "Map saved in " << std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start).count() * 1e-3 << " ms" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,20 @@
+QT -= core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle qt
+
+TARGET = AllocationCheck
+TEMPLATE = app
+
+INCLUDEPATH += .
+INCLUDEPATH += $$PWD/../ARReplay
+INCLUDEPATH += $$PWD/../../AddedSource
+
+include ($$PWD/../../AddedSource/AR/AR.pri)
+include ($$PWD/../../AddedSource/TMath/TMath.pri)
+
+SOURCES += main.cpp \
+    $$PWD/../ARReplay/AllocationCounter.cpp
+
+HEADERS += \
+    $$PWD/../ARReplay/AllocationCounter.h
@@ -0,0 +1,218 @@
+#include "AllocationCounter.h"
+#include "AR/ARSystem.h"
+#include "AR/Camera.h"
+#include "AR/ImageBufferPool.h"
+#include "AR/ImageProcessing.h"
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <random>
+#include <string>
+#include <algorithm>
+
+// Check of large allocations of steady-state frames, it doesn't need recorded sequences.
+// Usage:
+//     AllocationCheck [--frames N] [--warmup N]
+// Frames of a textured plane are rendered for a camera which moves along it. Large allocations (see AllocationCounter)
+// are counted in steady-state frames, frames after warmup (--warmup, 10 by default) create buffers of new sizes
+// and caches. The check fails if there are large allocations in steady-state frames.
+// The first part works with AR::ImageBufferPool directly: pyramids of frames are built in new images, copies
+// of the last pyramids are kept like pyramids of preview frames and key frames, so images of every frame are
+// taken from free lists of the pool.
+// The second part processes frames by AR::ARSystem (the first frame and frame 30 are frames of initialization),
+// steady-state frames are frames of tracking without new key frames like in ARReplay.
+
+static const AR::Point2i frameSize(640, 480);
+static const int sizeOfTexture = 1024;
+static const std::size_t secondFrame = 30;
+static const std::size_t minCountSteadyStateFrames = 50;
+static const int countImageLevels = 3;
+static const std::size_t countKeptPyramids = 3;
+
+// Texture of the plane - random blobs, so there are enough corners for tracking.
+static std::vector<float> createTexture()
+{
+    std::vector<float> texture(sizeOfTexture * sizeOfTexture, 0.0f);
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> random(0.0f, 1.0f);
+    for (int i = 0; i < 3000; ++i) {
+        float x = random(generator) * sizeOfTexture, y = random(generator) * sizeOfTexture;
+        float radius = 3.0f + random(generator) * 20.0f;
+        float value = (random(generator) * 2.0f - 1.0f) * 60.0f;
+        for (int v = (int)(y - radius); v <= (int)(y + radius); ++v) {
+            for (int u = (int)(x - radius); u <= (int)(x + radius); ++u) {
+                if (((u - x) * (u - x) + (v - y) * (v - y)) < (radius * radius)) {
+                    int tu = ((u % sizeOfTexture) + sizeOfTexture) % sizeOfTexture;
+                    int tv = ((v % sizeOfTexture) + sizeOfTexture) % sizeOfTexture;
+                    texture[tv * sizeOfTexture + tu] += value;
+                }
+            }
+        }
+    }
+    return texture;
+}
+
+static float textureValue(const std::vector<float> & texture, int x, int y)
+{
+    x = ((x % sizeOfTexture) + sizeOfTexture) % sizeOfTexture;
+    y = ((y % sizeOfTexture) + sizeOfTexture) % sizeOfTexture;
+    return texture[y * sizeOfTexture + x];
+}
+
+// The plane is at distance 3 from the camera. The camera moves along the plane at first (for initialization),
+// then it moves around with small rotations.
+static void renderFrame(AR::Image<AR::Rgba> & frame, const std::vector<float> & texture, std::size_t index)
+{
+    double tx, ty, yaw;
+    if (index < 40) {
+        tx = 0.008 * index;
+        ty = 0.0;
+        yaw = 0.0;
+    } else {
+        double a = (index - 40) * 0.05;
+        tx = 0.32 + 0.15 * std::sin(a);
+        ty = 0.1 * (1.0 - std::cos(a));
+        yaw = 0.05 * std::sin(a * 0.7);
+    }
+    double cosYaw = std::cos(yaw), sinYaw = std::sin(yaw);
+    double fx = frameSize.x, fy = frameSize.y * 1.33;
+    double cx = frameSize.x * 0.5 - 0.5, cy = frameSize.y * 0.5 - 0.5;
+    AR::Rgba * ptr = frame.data();
+    for (int v = 0; v < frameSize.y; ++v) {
+        for (int u = 0; u < frameSize.x; ++u, ++ptr) {
+            double dx = (u - cx) / fx, dy = (v - cy) / fy;
+            double rx = cosYaw * dx + sinYaw, rz = - sinYaw * dx + cosYaw;
+            double k = 3.0 / rz;
+            double px = (tx + k * rx) * 300.0 + sizeOfTexture / 2, py = (ty + k * dy) * 300.0 + sizeOfTexture / 2;
+            int ix = (int)std::floor(px), iy = (int)std::floor(py);
+            float ax = (float)(px - ix), ay = (float)(py - iy);
+            float value = 128.0f + (1.0f - ax) * (1.0f - ay) * textureValue(texture, ix, iy) +
+                                   ax * (1.0f - ay) * textureValue(texture, ix + 1, iy) +
+                                   (1.0f - ax) * ay * textureValue(texture, ix, iy + 1) +
+                                   ax * ay * textureValue(texture, ix + 1, iy + 1);
+            unsigned char c = (unsigned char)std::max(0.0f, std::min(255.0f, value));
+            ptr->set(c, c, c);
+        }
+    }
+}
+
+static bool checkImageBufferPool(const std::vector<float> & texture, std::size_t countFrames,
+                                 std::size_t countWarmupFrames)
+{
+    AR::Image<AR::Rgba> frame(frameSize);
+    std::deque<std::vector<AR::Image<uchar>>> keptPyramids;
+    std::size_t countSteadyStateFrames = 0;
+    std::size_t countFramesWithLargeAllocations = 0;
+    std::uint64_t countLargeAllocations = 0;
+    AR::ImageBufferPool::Statistics imageBuffersBefore = AR::ImageBufferPool::statistics();
+    for (std::size_t i = 0; i < countFrames; ++i) {
+        renderFrame(frame, texture, i);
+        if (i == countWarmupFrames)
+            imageBuffersBefore = AR::ImageBufferPool::statistics();
+        std::uint64_t countFrameAllocations = AllocationCounter::countLargeAllocations();
+        {
+            std::vector<AR::Image<uchar>> imagePyramid(countImageLevels);
+            AR::ImageProcessing::buildImagePyramid(imagePyramid, frame);
+            AR::Image<uchar> blurred(imagePyramid[0].size());
+            AR::ImageProcessing::gaussianBlur(blurred, imagePyramid[0], 2, 1.0f);
+            std::vector<AR::Image<uchar>> copyOfPyramid(countImageLevels);
+            for (int level = 0; level < countImageLevels; ++level)
+                copyOfPyramid[level] = imagePyramid[level].copy();
+            keptPyramids.push_back(std::move(copyOfPyramid));
+            if (keptPyramids.size() > countKeptPyramids)
+                keptPyramids.pop_front();
+        }
+        countFrameAllocations = AllocationCounter::countLargeAllocations() - countFrameAllocations;
+        if (i < countWarmupFrames)
+            continue;
+        ++countSteadyStateFrames;
+        if (countFrameAllocations > 0) {
+            std::cout << "Frame " << i << ": " << countFrameAllocations << " large allocations" << std::endl;
+            ++countFramesWithLargeAllocations;
+            countLargeAllocations += countFrameAllocations;
+        }
+    }
+    AR::ImageBufferPool::Statistics imageBuffers = AR::ImageBufferPool::statistics();
+
+    std::cout << "ImageBufferPool:" << std::endl;
+    std::cout << "Steady-state frames: " << countSteadyStateFrames << ", with large allocations: "
+              << countFramesWithLargeAllocations << " (" << countLargeAllocations << " allocations)" << std::endl;
+    std::uint64_t countHeapAllocations = imageBuffers.countHeapAllocations - imageBuffersBefore.countHeapAllocations;
+    std::uint64_t countReuses = imageBuffers.countReuses - imageBuffersBefore.countReuses;
+    std::cout << "Image buffers in steady-state frames: " << countHeapAllocations << " allocated, "
+              << countReuses << " reused" << std::endl;
+    // buffers must be taken from free lists, otherwise the pool isn't checked
+    return (countLargeAllocations == 0) && (countHeapAllocations == 0) && (countReuses > 0);
+}
+
+static bool checkTracking(const std::vector<float> & texture, std::size_t countFrames, std::size_t countWarmupFrames)
+{
+    AR::Image<AR::Rgba> frame(frameSize);
+    AR::ARSystem arSystem;
+    arSystem.setCameraParameters(AR::Camera::defaultCameraParameters);
+
+    std::size_t countTrackedFrames = 0;
+    std::size_t countSteadyStateFrames = 0;
+    std::size_t countFramesWithLargeAllocations = 0;
+    std::uint64_t countLargeAllocations = 0;
+    for (std::size_t i = 0; i < countFrames; ++i) {
+        renderFrame(frame, texture, i);
+        if (i == 0) {
+            arSystem.nextTrackingState();
+        } else if ((i == secondFrame) && (arSystem.trackingState() == AR::TrackingState::CaptureSecondFrame)) {
+            arSystem.nextTrackingState();
+        }
+        bool wasTracking = (arSystem.trackingState() == AR::TrackingState::Tracking);
+        std::size_t countKeyFrames = arSystem.map()->countKeyFrames();
+        std::uint64_t countFrameAllocations = AllocationCounter::countLargeAllocations();
+        arSystem.process(frame);
+        countFrameAllocations = AllocationCounter::countLargeAllocations() - countFrameAllocations;
+        if (arSystem.trackingState() != AR::TrackingState::Tracking)
+            continue;
+        ++countTrackedFrames;
+        if (!wasTracking || (countTrackedFrames <= countWarmupFrames) ||
+                (arSystem.map()->countKeyFrames() != countKeyFrames))
+            continue;
+        ++countSteadyStateFrames;
+        if (countFrameAllocations > 0) {
+            std::cout << "Frame " << i << ": " << countFrameAllocations << " large allocations" << std::endl;
+            ++countFramesWithLargeAllocations;
+            countLargeAllocations += countFrameAllocations;
+        }
+    }
+
+    std::cout << "ARSystem:" << std::endl;
+    std::cout << "Tracked frames: " << countTrackedFrames << " of " << countFrames << std::endl;
+    std::cout << "Steady-state frames: " << countSteadyStateFrames << ", with large allocations: "
+              << countFramesWithLargeAllocations << " (" << countLargeAllocations << " allocations)" << std::endl;
+    if (countSteadyStateFrames < minCountSteadyStateFrames) {
+        std::cout << "Not enough steady-state frames, at least " << minCountSteadyStateFrames << " are needed" << std::endl;
+        return false;
+    }
+    return (countLargeAllocations == 0);
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t countFrames = 200;
+    std::size_t countWarmupFrames = 10;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::string(argv[i]) == "--frames") && ((i + 1) < argc)) {
+            countFrames = (std::size_t)std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::string(argv[i]) == "--warmup") && ((i + 1) < argc)) {
+            countWarmupFrames = (std::size_t)std::max(std::atoi(argv[++i]), 0);
+        } else {
+            std::cout << "Usage: AllocationCheck [--frames N] [--warmup N]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<float> texture = createTexture();
+    bool poolPassed = checkImageBufferPool(texture, countFrames, countWarmupFrames);
+    bool trackingPassed = checkTracking(texture, countFrames, countWarmupFrames);
+    bool passed = (poolPassed && trackingPassed);
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
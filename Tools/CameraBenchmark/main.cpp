@@ -0,0 +1,107 @@
+#include "AR/Camera.h"
+#include "AR/Point2.h"
+#include "TMath/TMath.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+// Time and accuracy of batched projection functions of AR::Camera (lookup tables) versus the exact path.
+// Usage:
+//     CameraBenchmark [--camera fx fy cx cy d] [--size width height] [--points N] [--repeats N]
+// Random points of the image (with a margin of 10% outside of the image) are unprojected by unproject()
+// and unprojectMany(), points on z=1 plane are projected by project() and projectMany().
+// Max errors of batched functions must not be greater than errors reported by Camera::lookupTablesErrors()
+// plus 1e-4 pixel (precision of floats of the undistortion map and of points between measured cells).
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv)
+{
+    TMath::TVectord cameraParameters = TMath::TVectord::create(0.95, 1.27, 0.5, 0.5, 0.9);
+    AR::Point2d imageSize(640.0, 480.0);
+    int countPoints = 10000;
+    int countRepeats = 100;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "--camera") == 0) && ((i + 5) < argc)) {
+            for (int j = 0; j < 5; ++j)
+                cameraParameters(j) = std::atof(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--size") == 0) && ((i + 2) < argc)) {
+            imageSize.x = std::atof(argv[++i]);
+            imageSize.y = std::atof(argv[++i]);
+        } else if ((std::strcmp(argv[i], "--points") == 0) && ((i + 1) < argc)) {
+            countPoints = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::strcmp(argv[i], "--repeats") == 0) && ((i + 1) < argc)) {
+            countRepeats = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::cout << "Usage: CameraBenchmark [--camera fx fy cx cy d] [--size width height]"
+                      << " [--points N] [--repeats N]" << std::endl;
+            return 1;
+        }
+    }
+
+    AR::Camera camera(cameraParameters, imageSize);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    AR::Camera::LookupTablesErrors bounds = camera.lookupTablesErrors();
+    double buildTime = seconds(start);
+
+    std::srand(1);
+    std::vector<AR::Point2d> imagePoints(countPoints), camPoints(countPoints), camPointsExact(countPoints);
+    std::vector<AR::Point2d> projections(countPoints), projectionsExact(countPoints);
+    for (int i = 0; i < countPoints; ++i) {
+        imagePoints[i].set((std::rand() / (double)RAND_MAX * 1.2 - 0.1) * imageSize.x,
+                           (std::rand() / (double)RAND_MAX * 1.2 - 0.1) * imageSize.y);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < countRepeats; ++r) {
+        for (int i = 0; i < countPoints; ++i)
+            camPointsExact[i] = camera.unproject(imagePoints[i]);
+    }
+    double unprojectTime = seconds(start);
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < countRepeats; ++r)
+        camera.unprojectMany(imagePoints.data(), camPoints.data(), countPoints);
+    double unprojectManyTime = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < countRepeats; ++r) {
+        for (int i = 0; i < countPoints; ++i)
+            projectionsExact[i] = camera.project(camPointsExact[i]);
+    }
+    double projectTime = seconds(start);
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < countRepeats; ++r)
+        camera.projectMany(camPointsExact.data(), projections.data(), countPoints);
+    double projectManyTime = seconds(start);
+
+    AR::Point2d focal = camera.pixelFocalLength();
+    double maxUnprojectionError = 0.0, maxProjectionError = 0.0;
+    for (int i = 0; i < countPoints; ++i) {
+        AR::Point2d d = camPoints[i] - camPointsExact[i];
+        d.set(d.x * focal.x, d.y * focal.y);
+        maxUnprojectionError = std::max(maxUnprojectionError, d.length());
+        maxProjectionError = std::max(maxProjectionError, (projections[i] - projectionsExact[i]).length());
+    }
+
+    double countCalls = (double)countPoints * countRepeats;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Build of lookup tables: " << buildTime * 1e3 << " ms" << std::endl;
+    std::cout << "unproject:     " << unprojectTime / countCalls * 1e9 << " ns/point" << std::endl;
+    std::cout << "unprojectMany: " << unprojectManyTime / countCalls * 1e9 << " ns/point" << std::endl;
+    std::cout << "project:       " << projectTime / countCalls * 1e9 << " ns/point" << std::endl;
+    std::cout << "projectMany:   " << projectManyTime / countCalls * 1e9 << " ns/point" << std::endl;
+    std::cout << std::scientific << std::setprecision(3);
+    std::cout << "Unprojection error: " << maxUnprojectionError << " px (bound " << bounds.unprojection << " px)" << std::endl;
+    std::cout << "Projection error:   " << maxProjectionError << " px (bound " << bounds.projection << " px)" << std::endl;
+    bool passed = (maxUnprojectionError <= (bounds.unprojection + 1e-4)) &&
+            (maxProjectionError <= (bounds.projection + 1e-4));
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+QT -= core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle qt
+
+TARGET = ImageProcessingBenchmark
+TEMPLATE = app
+
+INCLUDEPATH += .
+INCLUDEPATH += $$PWD/../../AddedSource
+
+include ($$PWD/../../AddedSource/AR/AR_lite.pri)
+include ($$PWD/../../AddedSource/TMath/TMath.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,657 @@
+#include "AR/Image.h"
+#include "AR/ImageProcessing.h"
+#include "AR/PatchComparison.h"
+#include "AR/PatchJacobian.h"
+#include "AR/FastCorner.h"
+#include "AR/FeatureDetector.h"
+#include "AR/TukeyRobustCost.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cmath>
+
+// Microbenchmark of conversion of frame to black-white image, creation of image pyramid and patch comparison.
+// Usage:
+//     ImageProcessingBenchmark [--levels N] [--iterations N]
+// The reference is the scalar code that was used before vectorized kernels:
+// (r + g + b) / 3 per pixel and the template ImageProcessing::halfSample.
+// Patch comparison is measured for batches of patches 8x8 and 11x11 in a frame and for small images 32x32,
+// the reference is the plain loop over pixels.
+// Normal equations of the tracker are measured for patches 5x5 with 6 parameters, the reference is the loop
+// over double jacobians which was used in AR::Tracker before float kernels.
+// FAST-10 detection, FAST scores and Shi-Tomasi scores of corners are compared with the scalar tree
+// (the instruction set Scalar) for noise, smooth and blocky images with several barriers, corners and scores
+// must be exactly equal.
+// Features of AR::FeatureDetector are detected on the same images with several counts of threads,
+// they must be equal to features of one thread.
+// Batched KLT (AR::OpticalFlow::tracking2dLK for vectors of points) is compared with tracking of every point
+// by AR::OpticalFlowCalculator on a shifted image. Patches of the batch aren't rounded to bytes, so positions differ,
+// the mean error of positions (relative to the known shift) must be not greater than the error of the calculator
+// and results of tracking must be the same for almost all points.
+// Results of all instruction sets are compared with the reference.
+
+static const int countSizes = 3;
+static const AR::Point2i frameSizes[countSizes] = {
+    AR::Point2i(640, 480), AR::Point2i(1280, 720), AR::Point2i(1920, 1080)
+};
+
+static void buildReferencePyramid(std::vector<AR::Image<uchar>>& imagePyramid, const AR::ImageRef<AR::Rgba>& frame)
+{
+    if (imagePyramid[0].size() != frame.size())
+        imagePyramid[0] = AR::Image<uchar>(frame.size());
+    const int area = frame.area();
+    uchar* bwPtr = imagePyramid[0].data();
+    const AR::Rgba* rgbaPtr = frame.data();
+    for (int i = 0; i < area; ++i, ++bwPtr, ++rgbaPtr)
+        *bwPtr = (rgbaPtr->red + rgbaPtr->green + rgbaPtr->blue) / 3;
+    AR::Point2i imageSize = frame.size();
+    for (std::size_t i = 1; i < imagePyramid.size(); ++i) {
+        imageSize /= 2;
+        if (imagePyramid[i].size() != imageSize)
+            imagePyramid[i] = AR::Image<uchar>(imageSize);
+        AR::ImageProcessing::halfSample<unsigned int, uchar>(imagePyramid[i], imagePyramid[i - 1]);
+    }
+}
+
+static bool equalPyramids(const std::vector<AR::Image<uchar>>& a, const std::vector<AR::Image<uchar>>& b)
+{
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if ((a[i].size() != b[i].size()) || !std::equal(a[i].data(), a[i].data() + a[i].area(), b[i].data()))
+            return false;
+    }
+    return true;
+}
+
+// Returns the median time of iterations in milliseconds.
+template <typename Function>
+static double measure(Function function, int countIterations)
+{
+    std::vector<double> times;
+    function(); // warming of caches and allocation of images
+    for (int i = 0; i < countIterations; ++i) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        function();
+        times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start).count() * 1e-6);
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+static const char* instructionSetName(AR::ImageProcessing::InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+    case AR::ImageProcessing::InstructionSet::Scalar:
+        return "Scalar";
+    case AR::ImageProcessing::InstructionSet::SSE2:
+        return "SSE2";
+    case AR::ImageProcessing::InstructionSet::AVX2:
+        return "AVX2";
+    case AR::ImageProcessing::InstructionSet::NEON:
+        return "NEON";
+    }
+    return "";
+}
+
+struct PatchCase
+{
+    const char* name;
+    AR::Point2i patchSize;
+    bool intImages;
+};
+
+static const int countPatchCases = 3;
+static const PatchCase patchCases[countPatchCases] = {
+    { "8x8", AR::Point2i(8, 8), false },
+    { "11x11", AR::Point2i(11, 11), false },
+    { "32x32 int", AR::Point2i(32, 32), true }
+};
+static const int countPatchPoints = 256;
+
+template <typename Type>
+static void referencePatchScores(int* ssd, int* zmssd, float* ncc, const AR::ImageRef<Type>& patch,
+                                 const AR::ImageRef<Type>& image, const std::vector<AR::Point2i>& points)
+{
+    const int area = patch.area();
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        long long sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0, sumD = 0;
+        for (int y = 0; y < patch.height(); ++y) {
+            for (int x = 0; x < patch.width(); ++x) {
+                long long a = patch(x, y), b = image(points[i].x + x, points[i].y + y);
+                sumA += a;
+                sumB += b;
+                sumAA += a * a;
+                sumBB += b * b;
+                sumAB += a * b;
+                sumD += (a - b) * (a - b);
+            }
+        }
+        ssd[i] = (int)sumD;
+        zmssd[i] = (int)(sumD - ((sumA - sumB) * (sumA - sumB)) / area);
+        double denominator = (double)(area * sumAA - sumA * sumA) * (double)(area * sumBB - sumB * sumB);
+        ncc[i] = (denominator > 0.0) ? (float)((area * sumAB - sumA * sumB) / std::sqrt(denominator)) : 0.0f;
+    }
+}
+
+template <typename Type>
+static void patchScores(int* ssd, int* zmssd, float* ncc, const AR::ImageRef<Type>& patch,
+                        const AR::ImageRef<Type>& image, const std::vector<AR::Point2i>& points)
+{
+    AR::SSD::compare(ssd, patch, image, points.data(), points.size());
+    AR::ZMSSD::compare(zmssd, patch, image, points.data(), points.size());
+    AR::NCC::compare(ncc, patch, image, points.data(), points.size());
+}
+
+template <typename Type>
+static bool benchmarkPatchCase(const PatchCase& patchCase,
+                               const std::vector<AR::ImageProcessing::InstructionSet>& instructionSets,
+                               int countIterations)
+{
+    const int range = std::is_same<Type, int>::value ? 511 : 256;
+    const int offset = std::is_same<Type, int>::value ? -255 : 0;
+    AR::Image<Type> patch(patchCase.patchSize);
+    for (int i = 0; i < patch.area(); ++i)
+        patch.data()[i] = (Type)(std::rand() % range + offset);
+    // int images are compared as separate small images, so the image has the same size as the patch
+    AR::Image<Type> image(std::is_same<Type, int>::value ? patchCase.patchSize : AR::Point2i(640, 480));
+    for (int i = 0; i < image.area(); ++i)
+        image.data()[i] = (Type)(std::rand() % range + offset);
+    std::vector<AR::Point2i> points(countPatchPoints);
+    for (AR::Point2i& point : points)
+        point.set(std::rand() % (image.width() - patch.width() + 1), std::rand() % (image.height() - patch.height() + 1));
+    // a few areas are equal to the patch
+    for (int y = 0; y < patch.height(); ++y)
+        for (int x = 0; x < patch.width(); ++x)
+            image(points[0].x + x, points[0].y + y) = patch(x, y);
+
+    std::vector<int> referenceSsd(points.size()), referenceZmssd(points.size());
+    std::vector<float> referenceNcc(points.size());
+    double referenceTime = measure([&] () {
+        referencePatchScores(referenceSsd.data(), referenceZmssd.data(), referenceNcc.data(), patch, image, points);
+    }, countIterations);
+    std::cout << std::left << std::setw(12) << patchCase.name << std::setw(22) << "Reference" << std::right
+              << std::setw(14) << referenceTime << std::setw(12) << 1.0 << std::endl;
+
+    bool allEqual = true;
+    for (AR::ImageProcessing::InstructionSet instructionSet : instructionSets) {
+        AR::ImageProcessing::setInstructionSet(instructionSet);
+        std::vector<int> ssd(points.size()), zmssd(points.size());
+        std::vector<float> ncc(points.size());
+        double time = measure([&] () { patchScores(ssd.data(), zmssd.data(), ncc.data(), patch, image, points); },
+                              countIterations);
+        bool equal = (ssd == referenceSsd) && (zmssd == referenceZmssd);
+        for (std::size_t i = 0; equal && (i < ncc.size()); ++i)
+            equal = (std::fabs(ncc[i] - referenceNcc[i]) < 1e-5f);
+        allEqual = allEqual && equal;
+        std::cout << std::left << std::setw(12) << patchCase.name << std::setw(22) << instructionSetName(instructionSet)
+                  << std::right << std::setw(14) << time << std::setw(12) << (referenceTime / time)
+                  << (equal ? "" : "  MISMATCH") << std::endl;
+    }
+    return allEqual;
+}
+
+struct FastImageCase
+{
+    const char* name;
+    AR::Image<uchar> image;
+};
+
+static std::vector<FastImageCase> createFastImages()
+{
+    std::vector<FastImageCase> images;
+    AR::Image<uchar> noise(AR::Point2i(640, 480));
+    for (int i = 0; i < noise.area(); ++i)
+        noise.data()[i] = (uchar)(std::rand() % 256);
+    images.push_back({ "noise", noise });
+    // bilinear interpolation of random values of a coarse grid with a bit of noise
+    AR::Image<uchar> smooth(AR::Point2i(1920, 1080));
+    const int cell = 24;
+    std::vector<int> grid((smooth.width() / cell + 2) * (smooth.height() / cell + 2));
+    const int gridWidth = smooth.width() / cell + 2;
+    for (int& v : grid)
+        v = std::rand() % 256;
+    for (int y = 0; y < smooth.height(); ++y) {
+        for (int x = 0; x < smooth.width(); ++x) {
+            int gx = x / cell, gy = y / cell, fx = x % cell, fy = y % cell;
+            int v = ((grid[gy * gridWidth + gx] * (cell - fx) + grid[gy * gridWidth + gx + 1] * fx) * (cell - fy) +
+                     (grid[(gy + 1) * gridWidth + gx] * (cell - fx) + grid[(gy + 1) * gridWidth + gx + 1] * fx) * fy) /
+                    (cell * cell);
+            smooth(x, y) = (uchar)std::max(0, std::min(v + std::rand() % 5 - 2, 255));
+        }
+    }
+    images.push_back({ "smooth", smooth });
+    // rectangles of random colors give corners with long arcs and saturated differences
+    AR::Image<uchar> blocks(AR::Point2i(1280, 720));
+    for (int i = 0; i < blocks.area(); ++i)
+        blocks.data()[i] = 128;
+    for (int i = 0; i < 400; ++i) {
+        int x0 = std::rand() % blocks.width(), y0 = std::rand() % blocks.height();
+        int x1 = std::min(x0 + 5 + std::rand() % 60, blocks.width()), y1 = std::min(y0 + 5 + std::rand() % 60, blocks.height());
+        uchar color = (uchar)((std::rand() % 2) ? 255 : std::rand() % 256);
+        for (int y = y0; y < y1; ++y)
+            for (int x = x0; x < x1; ++x)
+                blocks(x, y) = color;
+    }
+    images.push_back({ "blocks", blocks });
+    return images;
+}
+
+struct FastResult
+{
+    std::vector<AR::FastCorner::Corner> corners;
+    std::vector<float> shiTomasiScores;
+};
+
+static void detectFast(FastResult& result, const AR::ImageRef<uchar>& image, int barrier)
+{
+    result.corners.resize(0);
+    AR::FastCorner::fast_corner_detect_10(image, AR::Point2i(0, 0), image.size(), result.corners, barrier);
+}
+
+static void scoreFast(FastResult& result, const AR::ImageRef<uchar>& image, int barrier)
+{
+    AR::FastCorner::fast_corner_score_10(image, result.corners, barrier);
+    result.shiTomasiScores.resize(result.corners.size());
+    for (std::size_t i = 0; i < result.corners.size(); ++i) {
+        const AR::Point2i& pos = result.corners[i].pos;
+        // the window of the score needs one more pixel around it
+        if ((pos.x > 3) && (pos.y > 3) && (pos.x < image.width() - 4) && (pos.y < image.height() - 4))
+            result.shiTomasiScores[i] = AR::FastCorner::shiTomasiScore_10(image, pos);
+        else
+            result.shiTomasiScores[i] = 0.0f;
+    }
+}
+
+static bool equalFastResults(const FastResult& a, const FastResult& b)
+{
+    if ((a.corners.size() != b.corners.size()) || (a.shiTomasiScores != b.shiTomasiScores))
+        return false;
+    for (std::size_t i = 0; i < a.corners.size(); ++i) {
+        if ((a.corners[i].pos != b.corners[i].pos) || (a.corners[i].score != b.corners[i].score))
+            return false;
+    }
+    return true;
+}
+
+static bool benchmarkFast(const std::vector<AR::ImageProcessing::InstructionSet>& instructionSets,
+                          int countIterations)
+{
+    const int barriers[] = { 3, 10, 20, 40 };
+    std::vector<FastImageCase> images = createFastImages();
+    bool allEqual = true;
+    for (const FastImageCase& imageCase : images) {
+        for (int barrier : barriers) {
+            std::string name = std::string(imageCase.name) + " " + std::to_string(barrier);
+            AR::ImageProcessing::setInstructionSet(AR::ImageProcessing::InstructionSet::Scalar);
+            FastResult reference;
+            double referenceTime = measure([&] () { detectFast(reference, imageCase.image, barrier); },
+                                           countIterations);
+            scoreFast(reference, imageCase.image, barrier);
+            std::cout << std::left << std::setw(12) << name << std::setw(22) << "Tree" << std::right
+                      << std::setw(14) << referenceTime << std::setw(12) << 1.0
+                      << "  " << reference.corners.size() << " corners" << std::endl;
+            for (AR::ImageProcessing::InstructionSet instructionSet : instructionSets) {
+                if (instructionSet == AR::ImageProcessing::InstructionSet::Scalar)
+                    continue;
+                AR::ImageProcessing::setInstructionSet(instructionSet);
+                FastResult result;
+                double time = measure([&] () { detectFast(result, imageCase.image, barrier); }, countIterations);
+                scoreFast(result, imageCase.image, barrier);
+                bool equal = equalFastResults(reference, result);
+                allEqual = allEqual && equal;
+                std::cout << std::left << std::setw(12) << name << std::setw(22) << instructionSetName(instructionSet)
+                          << std::right << std::setw(14) << time << std::setw(12) << (referenceTime / time)
+                          << (equal ? "" : "  MISMATCH") << std::endl;
+            }
+        }
+    }
+    return allEqual;
+}
+
+static void detectFeatures(std::vector<AR::FeatureDetector::FeatureCorner>& features, AR::FeatureDetector& detector)
+{
+    features.resize(0);
+    // cells are shuffled by std::random_shuffle
+    std::srand(1);
+    detector.detectFeaturesOnFirstImage(features);
+}
+
+static bool equalFeatures(const std::vector<AR::FeatureDetector::FeatureCorner>& a,
+                          const std::vector<AR::FeatureDetector::FeatureCorner>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if ((a[i].pos != b[i].pos) || (a[i].level != b[i].level))
+            return false;
+    }
+    return true;
+}
+
+static bool benchmarkFeatureDetector(int countIterations)
+{
+    const int countThreads[] = { 2, 4, 8 };
+    std::vector<FastImageCase> images = createFastImages();
+    bool allEqual = true;
+    for (const FastImageCase& imageCase : images) {
+        AR::FeatureDetector detector;
+        detector.setCountLevels(3);
+        detector.setMaxCountFeatures(1000);
+        detector.setFirstImage(imageCase.image);
+        std::vector<AR::FeatureDetector::FeatureCorner> reference;
+        double referenceTime = measure([&] () { detectFeatures(reference, detector); }, countIterations);
+        std::cout << std::left << std::setw(12) << imageCase.name << std::setw(22) << "1 thread" << std::right
+                  << std::setw(14) << referenceTime << std::setw(12) << 1.0
+                  << "  " << reference.size() << " features" << std::endl;
+        for (int count : countThreads) {
+            detector.setCountThreads(count);
+            std::vector<AR::FeatureDetector::FeatureCorner> features;
+            double time = measure([&] () { detectFeatures(features, detector); }, countIterations);
+            bool equal = equalFeatures(reference, features);
+            allEqual = allEqual && equal;
+            std::cout << std::left << std::setw(12) << imageCase.name
+                      << std::setw(22) << (std::to_string(count) + " threads")
+                      << std::right << std::setw(14) << time << std::setw(12) << (referenceTime / time)
+                      << (equal ? "" : "  MISMATCH") << std::endl;
+        }
+    }
+    return allEqual;
+}
+
+// Second image is the first image shifted by a subpixel offset with a bit of noise.
+static AR::Image<uchar> shiftImage(const AR::ImageRef<uchar>& image, const AR::Point2f& shift)
+{
+    AR::Image<uchar> result(image.size());
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            float sx = std::max(0.0f, std::min(x - shift.x, image.width() - 1.001f));
+            float sy = std::max(0.0f, std::min(y - shift.y, image.height() - 1.001f));
+            int ix = (int)sx, iy = (int)sy;
+            float fx = sx - ix, fy = sy - iy;
+            float v = (1.0f - fx) * (1.0f - fy) * image(ix, iy) + fx * (1.0f - fy) * image(ix + 1, iy) +
+                      (1.0f - fx) * fy * image(ix, iy + 1) + fx * fy * image(ix + 1, iy + 1);
+            result(x, y) = (uchar)std::max(0, std::min((int)(v + 0.5f) + std::rand() % 3 - 1, 255));
+        }
+    }
+    return result;
+}
+
+struct KltResult
+{
+    std::vector<AR::TrackingResult> success;
+    std::vector<AR::Point2f> points;
+};
+
+// Templates of AR::OpticalFlowCalculator are shifted by half of pixel, so tracked positions are shifted too.
+static float meanKltError(const KltResult& result, const std::vector<AR::Point2f>& firstPoints,
+                          const AR::Point2f& shift)
+{
+    float sum = 0.0f;
+    int count = 0;
+    for (std::size_t i = 0; i < firstPoints.size(); ++i) {
+        if (result.success[i] == AR::TrackingResult::Fail)
+            continue;
+        sum += (result.points[i] - (firstPoints[i] + shift - AR::Point2f(0.5f, 0.5f))).length();
+        ++count;
+    }
+    return (count > 0) ? (sum / count) : 0.0f;
+}
+
+static bool benchmarkKlt(const std::vector<AR::ImageProcessing::InstructionSet>& instructionSets,
+                         int countIterations)
+{
+    const AR::Point2f shift(2.3f, -1.6f);
+    std::vector<FastImageCase> images = createFastImages();
+    bool allEqual = true;
+    for (const FastImageCase& imageCase : images) {
+        AR::Image<uchar> secondImage = shiftImage(imageCase.image, shift);
+        AR::FeatureDetector detector;
+        detector.setCountLevels(3);
+        detector.setCursorSize(AR::Point2i(10, 10));
+        detector.setMaxNumberIterations(20);
+        detector.setPixelEps(1e-3f);
+        detector.setMaxCountFeatures(1000);
+        detector.setFirstImage(imageCase.image);
+        detector.setSecondImage(secondImage);
+        std::vector<AR::FeatureDetector::FeatureCorner> features;
+        detectFeatures(features, detector);
+        std::vector<AR::Point2f> firstPoints(features.size());
+        for (std::size_t i = 0; i < features.size(); ++i)
+            firstPoints[i] = AR::Point2f((float)features[i].pos.x, (float)features[i].pos.y);
+
+        KltResult reference;
+        double referenceTime = measure([&] () {
+            reference.points = firstPoints;
+            reference.success.resize(firstPoints.size());
+            for (std::size_t i = 0; i < firstPoints.size(); ++i)
+                reference.success[i] = detector.tracking2dLK(reference.points[i], firstPoints[i]);
+        }, countIterations);
+        float referenceError = meanKltError(reference, firstPoints, shift);
+        std::cout << std::left << std::setw(12) << imageCase.name << std::setw(22) << "Calculator" << std::right
+                  << std::setw(14) << referenceTime << std::setw(12) << 1.0
+                  << "  " << firstPoints.size() << " points, error " << referenceError << std::endl;
+        for (AR::ImageProcessing::InstructionSet instructionSet : instructionSets) {
+            AR::ImageProcessing::setInstructionSet(instructionSet);
+            KltResult result;
+            double time = measure([&] () {
+                result.points = firstPoints;
+                detector.tracking2dLK(result.success, result.points, firstPoints);
+            }, countIterations);
+            int countMismatches = 0;
+            for (std::size_t i = 0; i < firstPoints.size(); ++i) {
+                if ((reference.success[i] == AR::TrackingResult::Fail) !=
+                        (result.success[i] == AR::TrackingResult::Fail))
+                    ++countMismatches;
+            }
+            float error = meanKltError(result, firstPoints, shift);
+            bool equal = (countMismatches * 50 <= (int)firstPoints.size()) && (error <= referenceError + 0.01f);
+            allEqual = allEqual && equal;
+            std::cout << std::left << std::setw(12) << imageCase.name << std::setw(22) << instructionSetName(instructionSet)
+                      << std::right << std::setw(14) << time << std::setw(12) << (referenceTime / time)
+                      << "  " << countMismatches << " mismatches, error " << error
+                      << (equal ? "" : "  MISMATCH") << std::endl;
+        }
+    }
+    return allEqual;
+}
+
+static const int countJacobianPatches = 300;
+static const int jacobianPatchArea = 25;
+static const float jacobianSquareSigma = 400.0f;
+
+struct NormalEquations
+{
+    double A_raw[21];
+    double B[6];
+    double error;
+};
+
+static void referenceNormalEquations(NormalEquations& equations, const std::vector<double>& jacobians,
+                                     const std::vector<float>& residuals, const std::vector<float>& gaussian)
+{
+    std::fill(equations.A_raw, equations.A_raw + 21, 0.0);
+    std::fill(equations.B, equations.B + 6, 0.0);
+    equations.error = 0.0;
+    const double* jacobian = jacobians.data();
+    for (int f = 0; f < countJacobianPatches; ++f) {
+        for (int k = 0; k < jacobianPatchArea; ++k, jacobian += 6) {
+            float dt = residuals[f * jacobianPatchArea + k];
+            float weight = gaussian[k] * TMath::TukeyRobustCost::weight(dt * dt, jacobianSquareSigma);
+            float wdt = dt * weight;
+            equations.error += wdt * dt;
+            int t = 0;
+            for (int i = 0; i < 6; ++i) {
+                for (int j = 0; j <= i; ++j, ++t)
+                    equations.A_raw[t] += jacobian[i] * jacobian[j] * weight;
+                equations.B[i] += jacobian[i] * wdt;
+            }
+        }
+    }
+}
+
+static void kernelNormalEquations(NormalEquations& equations, const std::vector<float>& jacobians,
+                                  const std::vector<float>& residuals, const std::vector<float>& gaussian, int stride)
+{
+    std::fill(equations.A_raw, equations.A_raw + 21, 0.0);
+    std::fill(equations.B, equations.B + 6, 0.0);
+    equations.error = 0.0;
+    for (int f = 0; f < countJacobianPatches; ++f)
+        AR::PatchJacobian::accumulate(equations.A_raw, equations.B, equations.error, 6, &jacobians[f * stride * 6],
+                                      &residuals[f * stride], gaussian.data(), stride, jacobianSquareSigma);
+}
+
+// Returns the maximal difference relative to the maximal absolute value of the reference.
+static double relativeDifference(const NormalEquations& a, const NormalEquations& b)
+{
+    double maxValue = std::fabs(a.error), maxDifference = 0.0;
+    for (int i = 0; i < 21; ++i) {
+        maxValue = std::max(maxValue, std::fabs(a.A_raw[i]));
+        maxDifference = std::max(maxDifference, std::fabs(a.A_raw[i] - b.A_raw[i]));
+    }
+    for (int i = 0; i < 6; ++i) {
+        maxValue = std::max(maxValue, std::fabs(a.B[i]));
+        maxDifference = std::max(maxDifference, std::fabs(a.B[i] - b.B[i]));
+    }
+    maxDifference = std::max(maxDifference, std::fabs(a.error - b.error));
+    return (maxValue > 0.0) ? (maxDifference / maxValue) : maxDifference;
+}
+
+static bool benchmarkNormalEquations(const std::vector<AR::ImageProcessing::InstructionSet>& instructionSets,
+                                     int countIterations)
+{
+    const int stride = AR::PatchJacobian::stride(jacobianPatchArea);
+    std::vector<double> referenceJacobians(countJacobianPatches * jacobianPatchArea * 6);
+    std::vector<float> jacobians(countJacobianPatches * stride * 6, 0.0f);
+    std::vector<float> referenceResiduals(countJacobianPatches * jacobianPatchArea);
+    std::vector<float> residuals(countJacobianPatches * stride, 0.0f);
+    std::vector<float> gaussian(stride, 0.0f);
+    for (int k = 0; k < jacobianPatchArea; ++k)
+        gaussian[k] = std::exp(- ((k % 5 - 2) * (k % 5 - 2) + (k / 5 - 2) * (k / 5 - 2)) / 2.0f) * 0.1f;
+    for (int f = 0; f < countJacobianPatches; ++f) {
+        for (int k = 0; k < jacobianPatchArea; ++k) {
+            for (int i = 0; i < 6; ++i) {
+                float value = (std::rand() % 2001 - 1000) * 0.05f;
+                referenceJacobians[(f * jacobianPatchArea + k) * 6 + i] = value;
+                jacobians[(f * 6 + i) * stride + k] = value;
+            }
+            float residual = (std::rand() % 601 - 300) * 0.1f;
+            referenceResiduals[f * jacobianPatchArea + k] = residual;
+            residuals[f * stride + k] = residual;
+        }
+    }
+
+    NormalEquations reference;
+    double referenceTime = measure([&] () {
+        referenceNormalEquations(reference, referenceJacobians, referenceResiduals, gaussian);
+    }, countIterations);
+    std::cout << std::left << std::setw(12) << "5x5x6" << std::setw(22) << "Reference double" << std::right
+              << std::setw(14) << referenceTime << std::setw(12) << 1.0 << std::endl;
+
+    bool allEqual = true;
+    for (AR::ImageProcessing::InstructionSet instructionSet : instructionSets) {
+        AR::ImageProcessing::setInstructionSet(instructionSet);
+        NormalEquations equations;
+        double time = measure([&] () { kernelNormalEquations(equations, jacobians, residuals, gaussian, stride); },
+                              countIterations);
+        bool equal = (relativeDifference(reference, equations) < 1e-5);
+        allEqual = allEqual && equal;
+        std::cout << std::left << std::setw(12) << "5x5x6" << std::setw(22) << instructionSetName(instructionSet)
+                  << std::right << std::setw(14) << time << std::setw(12) << (referenceTime / time)
+                  << (equal ? "" : "  MISMATCH") << std::endl;
+    }
+    return allEqual;
+}
+
+int main(int argc, char* argv[])
+{
+    int countLevels = 4;
+    int countIterations = 200;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::string(argv[i]) == "--levels") && ((i + 1) < argc)) {
+            countLevels = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::string(argv[i]) == "--iterations") && ((i + 1) < argc)) {
+            countIterations = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::cout << "Usage: ImageProcessingBenchmark [--levels N] [--iterations N]" << std::endl;
+            return 1;
+        }
+    }
+
+    const AR::ImageProcessing::InstructionSet bestInstructionSet = AR::ImageProcessing::instructionSet();
+    std::vector<AR::ImageProcessing::InstructionSet> instructionSets;
+    const AR::ImageProcessing::InstructionSet allInstructionSets[] = {
+        AR::ImageProcessing::InstructionSet::Scalar, AR::ImageProcessing::InstructionSet::SSE2,
+        AR::ImageProcessing::InstructionSet::AVX2, AR::ImageProcessing::InstructionSet::NEON
+    };
+    for (AR::ImageProcessing::InstructionSet instructionSet : allInstructionSets) {
+        if (AR::ImageProcessing::setInstructionSet(instructionSet))
+            instructionSets.push_back(instructionSet);
+    }
+
+    bool allEqual = true;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::left << std::setw(12) << "Size" << std::setw(22) << "Variant" << std::right
+              << std::setw(14) << "pyramid, ms" << std::setw(12) << "speedup" << std::endl;
+    for (int k = 0; k < countSizes; ++k) {
+        AR::Image<AR::Rgba> frame(frameSizes[k]);
+        std::srand(k + 1);
+        for (int i = 0; i < frame.area(); ++i)
+            frame.data()[i].set(std::rand() % 256, std::rand() % 256, std::rand() % 256);
+        std::string sizeName = std::to_string(frame.width()) + "x" + std::to_string(frame.height());
+
+        std::vector<AR::Image<uchar>> referencePyramid(countLevels);
+        double referenceTime = measure([&] () { buildReferencePyramid(referencePyramid, frame); }, countIterations);
+        std::cout << std::left << std::setw(12) << sizeName << std::setw(22) << "Reference" << std::right
+                  << std::setw(14) << referenceTime << std::setw(12) << 1.0 << std::endl;
+
+        for (AR::ImageProcessing::InstructionSet instructionSet : instructionSets) {
+            AR::ImageProcessing::setInstructionSet(instructionSet);
+            std::vector<AR::Image<uchar>> imagePyramid(countLevels);
+            double time = measure([&] () { AR::ImageProcessing::buildImagePyramid(imagePyramid, frame); },
+                                  countIterations);
+            bool equal = equalPyramids(referencePyramid, imagePyramid);
+            allEqual = allEqual && equal;
+            std::cout << std::left << std::setw(12) << sizeName << std::setw(22) << instructionSetName(instructionSet)
+                      << std::right << std::setw(14) << time << std::setw(12) << (referenceTime / time)
+                      << (equal ? "" : "  MISMATCH") << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(12) << "Patch" << std::setw(22) << "Variant" << std::right
+              << std::setw(14) << "batch, ms" << std::setw(12) << "speedup" << std::endl;
+    std::srand(countSizes + 1);
+    for (int k = 0; k < countPatchCases; ++k) {
+        bool equal = patchCases[k].intImages ?
+                    benchmarkPatchCase<int>(patchCases[k], instructionSets, countIterations) :
+                    benchmarkPatchCase<uchar>(patchCases[k], instructionSets, countIterations);
+        allEqual = allEqual && equal;
+    }
+
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(12) << "Jacobian" << std::setw(22) << "Variant" << std::right
+              << std::setw(14) << "batch, ms" << std::setw(12) << "speedup" << std::endl;
+    allEqual = benchmarkNormalEquations(instructionSets, countIterations) && allEqual;
+
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(12) << "FAST-10" << std::setw(22) << "Variant" << std::right
+              << std::setw(14) << "detection, ms" << std::setw(12) << "speedup" << std::endl;
+    allEqual = benchmarkFast(instructionSets, countIterations) && allEqual;
+    AR::ImageProcessing::setInstructionSet(bestInstructionSet);
+
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(12) << "Features" << std::setw(22) << "Variant" << std::right
+              << std::setw(14) << "detection, ms" << std::setw(12) << "speedup" << std::endl;
+    allEqual = benchmarkFeatureDetector(countIterations) && allEqual;
+
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(12) << "KLT" << std::setw(22) << "Variant" << std::right
+              << std::setw(14) << "tracking, ms" << std::setw(12) << "speedup" << std::endl;
+    allEqual = benchmarkKlt(instructionSets, countIterations) && allEqual;
+    AR::ImageProcessing::setInstructionSet(bestInstructionSet);
+    return allEqual ? 0 : 1;
+}
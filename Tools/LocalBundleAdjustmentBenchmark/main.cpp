@@ -0,0 +1,235 @@
+#include "AR/Map.h"
+#include "AR/KeyFrame.h"
+#include "AR/MapPoint.h"
+#include "AR/Feature.h"
+#include "AR/Camera.h"
+#include "AR/LocationOptimizer.h"
+#include "AR/LocalBundleAdjustment.h"
+#include "AR/MapResourcesManager.h"
+#include "AR/PerformanceMonitor.h"
+#include "TMath/TMath.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+// Accuracy and time of AR::LocalBundleAdjustment on a synthetic scene.
+// Usage:
+//     LocalBundleAdjustmentBenchmark [--key-frames N] [--points N] [--window N] [--iterations N] [--repeats N]
+// Key frames look at random map points from a line, features are exact projections with noise of 0.5 pixel.
+// Poses of key frames of the window (the last key frames) and positions of map points are perturbed, then
+// the window of the last key frame is adjusted. The mean reprojection error has to become less than 1 pixel.
+// The second part runs the thread of adjustment while other thread transforms the map and adds key frames,
+// adjustments started before transformation are dropped, rotations of key frames must stay orthonormal.
+// Then the last key frame is adjusted without changes of the map, the error has to become less than 1 pixel again.
+
+static const int countImageLevels = 3;
+static const AR::Point2i imageSize(640, 480);
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool isOrthonormal(const TMath::TMatrixd & rotation)
+{
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            double d = 0.0;
+            for (int k = 0; k < 3; ++k)
+                d += rotation(i, k) * rotation(j, k);
+            if (std::fabs(d - ((i == j) ? 1.0 : 0.0)) > 1e-6)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void createScene(AR::Map & map, int countKeyFrames, int countPoints, int countWindowKeyFrames,
+                        TMath::Random_mt19937 & rnd)
+{
+    std::shared_ptr<const AR::Camera> camera = std::make_shared<AR::Camera>(AR::Camera::defaultCameraParameters,
+                                                                            imageSize.cast<double>());
+    std::vector<AR::Image<uchar>> imagePyramid(countImageLevels);
+    for (int i = 0; i < countImageLevels; ++i) {
+        imagePyramid[i] = AR::Image<uchar>(imageSize / (1 << i));
+        std::fill(imagePyramid[i].data(), imagePyramid[i].data() + imagePyramid[i].area(), (uchar)128);
+    }
+    std::vector<TMath::TVectord> positions;
+    for (int i = 0; i < countPoints; ++i) {
+        positions.push_back(TMath::TVectord::create(rnd.uniform(-1.5, 1.5), rnd.uniform(-1.0, 1.0),
+                                                    rnd.uniform(3.0, 5.0)));
+        map.createMapPoint(positions.back());
+    }
+    for (int k = 0; k < countKeyFrames; ++k) {
+        double x = 0.1 * (k - countKeyFrames * 0.5);
+        TMath::TMatrixd rotation = TMath::TTools::exp_rotationMatrix(TMath::TVectord::create(0.0, 0.02 * k, 0.0));
+        TMath::TVectord translation = - (rotation * TMath::TVectord::create(x, 0.0, 0.0));
+        std::shared_ptr<AR::KeyFrame> keyFrame = map.createKeyFrame(camera, imagePyramid, rotation, translation);
+        for (int i = 0; i < countPoints; ++i) {
+            TMath::TVectord v = rotation * positions[i] + translation;
+            AR::Point2d projection = camera->project(AR::LocationOptimizer::project2d(v));
+            AR::Point2f position((float)(projection.x + rnd.uniform(-0.5, 0.5)),
+                                 (float)(projection.y + rnd.uniform(-0.5, 0.5)));
+            if ((position.x < 0.0f) || (position.y < 0.0f) ||
+                    (position.x >= (float)imageSize.x) || (position.y >= (float)imageSize.y))
+                continue;
+            map.createFeature(keyFrame, position, 0, map.mapPoint(i));
+        }
+    }
+    // the window is perturbed, other key frames are fixed by adjustment
+    for (int k = countKeyFrames - countWindowKeyFrames; k < countKeyFrames; ++k) {
+        std::shared_ptr<AR::KeyFrame> keyFrame = map.keyFrame(k);
+        keyFrame->transform(TMath::TTools::exp_rotationMatrix(TMath::TVectord::create(rnd.uniform(-0.01, 0.01),
+                                                                                      rnd.uniform(-0.01, 0.01),
+                                                                                      rnd.uniform(-0.01, 0.01))),
+                            TMath::TVectord::create(rnd.uniform(-0.02, 0.02), rnd.uniform(-0.02, 0.02),
+                                                    rnd.uniform(-0.02, 0.02)));
+    }
+    for (int i = 0; i < countPoints; ++i) {
+        map.mapPoint(i)->setPosition(positions[i] + TMath::TVectord::create(rnd.uniform(-0.03, 0.03),
+                                                                            rnd.uniform(-0.03, 0.03),
+                                                                            rnd.uniform(-0.03, 0.03)));
+    }
+}
+
+// Mean distance between features of key frames and projections of their map points in pixels.
+static double meanReprojectionError(AR::Map & map)
+{
+    double sumErrors = 0.0;
+    std::size_t countErrors = 0;
+    for (std::size_t i = 0; i < map.countKeyFrames(); ++i) {
+        std::shared_ptr<const AR::KeyFrame> keyFrame = map.keyFrame(i);
+        TMath::TMatrixd rotation = keyFrame->rotation();
+        TMath::TVectord translation = keyFrame->translation();
+        for (int j = 0; j < keyFrame->countFeatures(); ++j) {
+            std::shared_ptr<const AR::Feature> feature = keyFrame->feature(j);
+            std::shared_ptr<const AR::MapPoint> mapPoint = feature->mapPoint();
+            if (!mapPoint || mapPoint->isDeleted())
+                continue;
+            TMath::TVectord v = rotation * mapPoint->position() + translation;
+            if (v(2) <= 0.0)
+                continue;
+            AR::Point2d projection = keyFrame->camera()->project(AR::LocationOptimizer::project2d(v));
+            AR::Point2f position = feature->positionOnFrame();
+            sumErrors += (projection - AR::Point2d(position.x, position.y)).length();
+            ++countErrors;
+        }
+    }
+    return (countErrors > 0) ? (sumErrors / countErrors) : 0.0;
+}
+
+int main(int argc, char ** argv)
+{
+    int countKeyFrames = 8;
+    int countPoints = 300;
+    int countWindowKeyFrames = 5;
+    int numberIterations = 10;
+    int countRepeats = 20;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "--key-frames") == 0) && ((i + 1) < argc)) {
+            countKeyFrames = std::max(std::atoi(argv[++i]), 2);
+        } else if ((std::strcmp(argv[i], "--points") == 0) && ((i + 1) < argc)) {
+            countPoints = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::strcmp(argv[i], "--window") == 0) && ((i + 1) < argc)) {
+            countWindowKeyFrames = std::max(std::atoi(argv[++i]), 2);
+        } else if ((std::strcmp(argv[i], "--iterations") == 0) && ((i + 1) < argc)) {
+            numberIterations = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::strcmp(argv[i], "--repeats") == 0) && ((i + 1) < argc)) {
+            countRepeats = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::cout << "Usage: LocalBundleAdjustmentBenchmark [--key-frames N] [--points N] [--window N]"
+                      << " [--iterations N] [--repeats N]" << std::endl;
+            return 1;
+        }
+    }
+    countWindowKeyFrames = std::min(countWindowKeyFrames, countKeyFrames);
+
+    bool passed = true;
+    double sumErrorsBefore = 0.0, sumErrorsAfter = 0.0, duration = 0.0;
+    TMath::Random_mt19937 rnd(1);
+    for (int repeat = 0; repeat < countRepeats; ++repeat) {
+        AR::Map map(countImageLevels, 32);
+        AR::MapResourcesManager manager;
+        createScene(map, countKeyFrames, countPoints, countWindowKeyFrames, rnd);
+        AR::LocalBundleAdjustment localBundleAdjustment(&map);
+        localBundleAdjustment.setCountKeyFrames(countWindowKeyFrames);
+        localBundleAdjustment.setNumberIterations(numberIterations);
+        double errorBefore = meanReprojectionError(map);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        map.lock();
+        bool adjusted = localBundleAdjustment.adjust(&manager, map.keyFrame(map.countKeyFrames() - 1));
+        map.unlock();
+        duration += seconds(start);
+        double errorAfter = meanReprojectionError(map);
+        sumErrorsBefore += errorBefore;
+        sumErrorsAfter += errorAfter;
+        if (!adjusted || (errorAfter > 1.0))
+            passed = false;
+    }
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Key frames " << countKeyFrames << ", window " << countWindowKeyFrames
+              << ", map points " << countPoints << std::endl;
+    std::cout << "Mean reprojection error: " << (sumErrorsBefore / countRepeats) << " px before, "
+              << (sumErrorsAfter / countRepeats) << " px after" << std::endl;
+    std::cout << "Adjustment: " << (duration * 1e3 / countRepeats) << " ms" << std::endl;
+
+    // the thread of adjustment with concurrent changes of the map
+    {
+        AR::Map map(countImageLevels, 32);
+        AR::MapResourcesManager manager;
+        createScene(map, countKeyFrames, countPoints, countWindowKeyFrames, rnd);
+        AR::PerformanceMonitor performanceMonitor;
+        AR::LocalBundleAdjustment localBundleAdjustment(&map);
+        localBundleAdjustment.setCountKeyFrames(countWindowKeyFrames);
+        localBundleAdjustment.setNumberIterations(numberIterations);
+        localBundleAdjustment.setPerformanceMonitor(&performanceMonitor);
+        localBundleAdjustment.startThread();
+        for (int i = 0; i < 200; ++i) {
+            map.lock();
+            if ((i % 7) == 3)
+                map.transform(&manager, TMath::TTools::exp_rotationMatrix(TMath::TVectord::create(0.0, 0.001, 0.0)),
+                              TMath::TVectord::create(0.0, 0.0, 0.0001));
+            std::shared_ptr<AR::KeyFrame> keyFrame = map.keyFrame(map.countKeyFrames() - 1 - (i % 3));
+            map.unlock();
+            localBundleAdjustment.addKeyFrame(keyFrame);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // the last adjustment isn't disturbed
+        std::size_t countAdjustments = localBundleAdjustment.countAdjustments();
+        map.lock();
+        std::shared_ptr<AR::KeyFrame> lastKeyFrame = map.keyFrame(map.countKeyFrames() - 1);
+        map.unlock();
+        localBundleAdjustment.addKeyFrame(lastKeyFrame);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while ((localBundleAdjustment.countAdjustments() == countAdjustments) && (seconds(start) < 10.0))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        localBundleAdjustment.stopThread();
+        map.lock();
+        for (std::size_t i = 0; i < map.countKeyFrames(); ++i) {
+            if (!isOrthonormal(map.keyFrame(i)->rotation()))
+                passed = false;
+        }
+        double error = meanReprojectionError(map);
+        map.unlock();
+        std::size_t countDropped = 0;
+        for (std::size_t i = 0; i < performanceMonitor.countCounters(); ++i) {
+            AR::PerformanceMonitor::Counter counter = performanceMonitor.counter((int)i);
+            if (counter.name == "Dropped local bundle adjustments")
+                countDropped = (std::size_t)counter.value;
+        }
+        std::cout << "Thread: adjustments " << localBundleAdjustment.countAdjustments()
+                  << ", dropped " << countDropped << ", mean reprojection error " << error << " px" << std::endl;
+        if ((localBundleAdjustment.countAdjustments() == 0) || (error > 1.0))
+            passed = false;
+    }
+
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+QT -= core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle qt
+
+TARGET = MapConcurrencyStress
+TEMPLATE = app
+
+INCLUDEPATH += .
+INCLUDEPATH += $$PWD/../../AddedSource
+
+include ($$PWD/../../AddedSource/AR/AR.pri)
+include ($$PWD/../../AddedSource/TMath/TMath.pri)
+
+SOURCES += main.cpp
+
+# qmake CONFIG+=tsan - build with ThreadSanitizer
+tsan {
+    QMAKE_CXXFLAGS += -fsanitize=thread -g
+    QMAKE_LFLAGS += -fsanitize=thread
+}
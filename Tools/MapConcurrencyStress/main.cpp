@@ -0,0 +1,294 @@
+#include "AR/Map.h"
+#include "AR/KeyFrame.h"
+#include "AR/MapPoint.h"
+#include "AR/Camera.h"
+#include "AR/MapResourcesManager.h"
+#include "AR/MapResourceLocker.h"
+#include "TMath/TMath.h"
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <string>
+
+// Stress test of locks of map objects (AR::MapResourcesManager) for ThreadSanitizer.
+// Usage:
+//     MapConcurrencyStress [--iterations N] [--threads N]
+// Build with ThreadSanitizer: qmake CONFIG+=tsan (-fsanitize=thread for compiler and linker).
+// The first part locks random sets of map points by several threads in random order and with random access
+// (nested locks and upgrades of shared locks to exclusive locks are included) and checks that an exclusive owner
+// of an object is alone and shared owners don't see exclusive owners.
+// The second part runs threads like ARSystem and MapPointsDetector: the tracking thread holds the map lock,
+// transforms key frames and the map, deletes and creates key frames; the mapping thread reads poses of its key frames
+// with shared locks without the map lock (like updating of seeds) and takes the map lock sometimes (like seeds
+// initialization). Rotations of key frames must be orthonormal when they are read.
+
+static const int countImageLevels = 3;
+static const int sizeOfSmallImage = 32;
+static const AR::Point2i imageSize(160, 120);
+static const int countMapPoints = 200;
+static const int countKeyFrames = 8;
+static const int countFeaturesOnKeyFrame = 20;
+
+struct LockCounters
+{
+    std::atomic<int> countReaders;
+    std::atomic<int> countWriters;
+};
+
+static bool testLocks(int countThreads, int countIterations)
+{
+    AR::Map map(countImageLevels, sizeOfSmallImage);
+    std::vector<std::shared_ptr<AR::MapPoint>> objects;
+    for (int i = 0; i < 16; ++i)
+        objects.push_back(map.createMapPoint(TMath::TVectord::create(0.0, 0.0, 1.0)));
+    std::vector<LockCounters> counters(objects.size());
+    for (LockCounters & c : counters) {
+        c.countReaders = 0;
+        c.countWriters = 0;
+    }
+    std::atomic<int> countViolations(0);
+    std::atomic<long long> countLocks(0);
+
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < countThreads; ++thread) {
+        threads.emplace_back([&, thread] () {
+            AR::MapResourcesManager manager;
+            TMath::Random_mt19937 rnd((unsigned int)(thread + 1));
+            std::vector<std::pair<int, AR::MapResourceAccess>> sequence;
+            std::vector<std::pair<int, bool>> used; // index and if access is exclusive
+            for (int iteration = 0; iteration < countIterations; ++iteration) {
+                sequence.clear();
+                int count = 1 + (int)rnd(4U);
+                for (int k = 0; k < count; ++k) {
+                    int index = (int)rnd((unsigned int)objects.size());
+                    AR::MapResourceAccess access = (rnd(2U) == 0) ? AR::MapResourceAccess::Exclusive :
+                                                                     AR::MapResourceAccess::Shared;
+                    sequence.emplace_back(index, access);
+                    if (rnd(4U) == 0) // nested lock or upgrade
+                        sequence.emplace_back(index, AR::MapResourceAccess::Exclusive);
+                }
+                for (const auto & s : sequence)
+                    manager.lock(objects[s.first].get(), s.second);
+                used.clear();
+                for (const auto & s : sequence) {
+                    bool exclusive = (s.second == AR::MapResourceAccess::Exclusive);
+                    auto it = std::find_if(used.begin(), used.end(), [&] (const std::pair<int, bool> & u) {
+                        return u.first == s.first;
+                    });
+                    if (it == used.end())
+                        used.emplace_back(s.first, exclusive);
+                    else
+                        it->second = it->second || exclusive;
+                }
+                for (const auto & u : used) {
+                    LockCounters & c = counters[u.first];
+                    if (u.second) {
+                        if ((++c.countWriters != 1) || (c.countReaders.load() != 0))
+                            ++countViolations;
+                    } else {
+                        ++c.countReaders;
+                        if (c.countWriters.load() != 0)
+                            ++countViolations;
+                    }
+                }
+                std::this_thread::yield();
+                for (const auto & u : used) {
+                    if (u.second)
+                        --counters[u.first].countWriters;
+                    else
+                        --counters[u.first].countReaders;
+                }
+                for (auto it = sequence.rbegin(); it != sequence.rend(); ++it)
+                    manager.unlock(objects[it->first].get(), it->second);
+                if (manager.countLockedObjects() != 0)
+                    ++countViolations;
+                countLocks += (long long)sequence.size();
+            }
+        });
+    }
+    for (std::thread & t : threads)
+        t.join();
+    std::cout << "Locks: threads " << countThreads << ", locks " << countLocks.load()
+              << ", violations " << countViolations.load() << std::endl;
+    return countViolations.load() == 0;
+}
+
+static bool isOrthonormal(const TMath::TMatrixd & rotation)
+{
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            double d = 0.0;
+            for (int k = 0; k < 3; ++k)
+                d += rotation(i, k) * rotation(j, k);
+            if (std::fabs(d - ((i == j) ? 1.0 : 0.0)) > 1e-6)
+                return false;
+        }
+    }
+    return true;
+}
+
+static std::shared_ptr<AR::KeyFrame> createKeyFrame(AR::Map & map,
+                                                    const std::shared_ptr<const AR::Camera> & camera,
+                                                    const std::vector<AR::Image<uchar>> & imagePyramid,
+                                                    TMath::Random_mt19937 & rnd)
+{
+    std::shared_ptr<AR::KeyFrame> keyFrame = map.createKeyFrame(camera, imagePyramid,
+                        TMath::TMatrixd::Identity(3),
+                        TMath::TVectord::create(rnd.uniform(-1.0, 1.0), rnd.uniform(-1.0, 1.0), 0.0));
+    for (int i = 0; i < countFeaturesOnKeyFrame; ++i) {
+        std::shared_ptr<AR::MapPoint> mapPoint = map.mapPoint(rnd((unsigned int)map.countMapPoints()));
+        AR::Point2f position((float)rnd.uniform(0.0, (double)imageSize.x), (float)rnd.uniform(0.0, (double)imageSize.y));
+        map.createFeature(keyFrame, position, 0, mapPoint);
+    }
+    return keyFrame;
+}
+
+static bool testMap(int countIterations)
+{
+    std::shared_ptr<const AR::Camera> camera = std::make_shared<AR::Camera>(AR::Camera::defaultCameraParameters,
+                                                                            imageSize.cast<double>());
+    std::vector<AR::Image<uchar>> imagePyramid(countImageLevels);
+    for (int i = 0; i < countImageLevels; ++i) {
+        imagePyramid[i] = AR::Image<uchar>(imageSize / (1 << i));
+        std::fill(imagePyramid[i].data(), imagePyramid[i].data() + imagePyramid[i].area(), (uchar)128);
+    }
+    AR::Map map(countImageLevels, sizeOfSmallImage);
+    TMath::Random_mt19937 rnd(1);
+    for (int i = 0; i < countMapPoints; ++i)
+        map.createMapPoint(TMath::TVectord::create(rnd.uniform(-1.0, 1.0), rnd.uniform(-1.0, 1.0),
+                                                   rnd.uniform(3.0, 5.0)));
+
+    std::mutex queueMutex;
+    std::vector<std::weak_ptr<AR::KeyFrame>> queue;
+    for (int i = 0; i < countKeyFrames; ++i)
+        queue.push_back(createKeyFrame(map, camera, imagePyramid, rnd));
+
+    std::atomic<bool> finished(false);
+    std::atomic<int> countViolations(0);
+    int countTransforms = 0, countReplacements = 0;
+    long long countReads = 0, countDropped = 0;
+
+    std::thread tracking([&] () {
+        AR::MapResourcesManager manager;
+        TMath::Random_mt19937 rnd(2);
+        for (int iteration = 0; iteration < countIterations; ++iteration) {
+            map.lock();
+            unsigned int operation = rnd(8U);
+            if (operation == 0) {
+                map.transform(&manager, TMath::TTools::exp_rotationMatrix(TMath::TVectord::create(0.0, 0.01, 0.0)),
+                              TMath::TVectord::create(0.0, 0.0, 0.001));
+                ++countTransforms;
+            } else if (operation <= 2) {
+                std::shared_ptr<AR::KeyFrame> keyFrame = map.keyFrame(rnd((unsigned int)map.countKeyFrames()));
+                map.deleteKeyFrame(&manager, keyFrame);
+                std::shared_ptr<AR::KeyFrame> newKeyFrame = createKeyFrame(map, camera, imagePyramid, rnd);
+                std::lock_guard<std::mutex> lock(queueMutex); (void)lock;
+                queue.push_back(newKeyFrame);
+                ++countReplacements;
+            } else if (operation <= 5) {
+                std::shared_ptr<AR::KeyFrame> keyFrame = map.keyFrame(rnd((unsigned int)map.countKeyFrames()));
+                AR::MapResourceLocker lockerR(&manager, keyFrame.get()); (void)lockerR;
+                keyFrame->transform(TMath::TTools::exp_rotationMatrix(TMath::TVectord::create(0.01, 0.0, 0.02)),
+                                    TMath::TVectord::create(0.001, 0.0, 0.0));
+                ++countTransforms;
+            } else {
+                std::shared_ptr<const AR::KeyFrame> keyFrame = map.keyFrame(rnd((unsigned int)map.countKeyFrames()));
+                AR::MapResourceLocker lockerR(&manager, keyFrame.get(), AR::MapResourceAccess::Shared); (void)lockerR;
+                double depthMean, depthMin;
+                AR::KeyFrame::getDepth(&manager, depthMean, depthMin, keyFrame);
+                if (!isOrthonormal(keyFrame->rotation()))
+                    ++countViolations;
+            }
+            map.unlock();
+            if (manager.countLockedObjects() != 0)
+                ++countViolations;
+        }
+        finished = true;
+    });
+
+    std::thread mapping([&] () {
+        AR::MapResourcesManager manager;
+        std::vector<std::weak_ptr<AR::KeyFrame>> keyFrames;
+        int iteration = 0;
+        while (!finished.load()) {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex); (void)lock;
+                keyFrames.insert(keyFrames.end(), queue.begin(), queue.end());
+                queue.clear();
+            }
+            for (auto it = keyFrames.begin(); it != keyFrames.end(); ) {
+                std::shared_ptr<const AR::KeyFrame> keyFrame = it->lock();
+                if (!keyFrame) {
+                    it = keyFrames.erase(it);
+                    ++countDropped;
+                    continue;
+                }
+                AR::MapResourceLocker lockerR(&manager, keyFrame.get(), AR::MapResourceAccess::Shared); (void)lockerR;
+                if (keyFrame->isDeleted()) {
+                    it = keyFrames.erase(it);
+                    ++countDropped;
+                    continue;
+                }
+                if (!isOrthonormal(keyFrame->rotation()) ||
+                        (keyFrame->imageLevel(0).data()[0] != 128))
+                    ++countViolations;
+                TMath::TVectord translation = keyFrame->translation();
+                (void)translation;
+                ++countReads;
+                ++it;
+            }
+            if (((++iteration % 16) == 0) && !keyFrames.empty()) {
+                map.lock();
+                std::shared_ptr<const AR::KeyFrame> keyFrame = keyFrames.back().lock();
+                if (keyFrame) {
+                    AR::MapResourceLocker lockerR(&manager, keyFrame.get(), AR::MapResourceAccess::Shared); (void)lockerR;
+                    if (!keyFrame->isDeleted()) {
+                        double depthMean, depthMin;
+                        AR::KeyFrame::getDepth(&manager, depthMean, depthMin, keyFrame);
+                    }
+                }
+                map.unlock();
+            }
+            if (manager.countLockedObjects() != 0)
+                ++countViolations;
+            std::this_thread::yield();
+        }
+    });
+
+    tracking.join();
+    mapping.join();
+    std::cout << "Map: transforms " << countTransforms << ", replaced key frames " << countReplacements
+              << ", reads of key frames " << countReads << ", dropped key frames " << countDropped
+              << ", violations " << countViolations.load() << std::endl;
+    return countViolations.load() == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int countIterations = 20000;
+    int countThreads = 4;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::string(argv[i]) == "--iterations") && ((i + 1) < argc)) {
+            countIterations = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::string(argv[i]) == "--threads") && ((i + 1) < argc)) {
+            countThreads = std::max(std::atoi(argv[++i]), 2);
+        } else {
+            std::cout << "Usage: MapConcurrencyStress [--iterations N] [--threads N]" << std::endl;
+            return 1;
+        }
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool locksPassed = testLocks(countThreads, countIterations);
+    bool mapPassed = testMap(countIterations);
+    std::cout << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+    std::cout << ((locksPassed && mapPassed) ? "PASSED" : "FAILED") << std::endl;
+    return (locksPassed && mapPassed) ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#include "AR/Map.h"
+#include "AR/KeyFrame.h"
+#include "AR/MapPoint.h"
+#include "AR/PreviewFrame.h"
+#include "AR/Camera.h"
+#include "AR/MapProjector.h"
+#include "AR/MapResourcesManager.h"
+#include "TMath/TMath.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+// Time of building of the projection grid of AR::MapProjector for maps with different count of map points.
+// Usage:
+//     MapProjectorBenchmark [--frames N] [--keyframes K]
+// Map points are placed in front of the camera, every map point is observed by two key frames.
+// Maximal count of features on frame is 0, so projectMapPoints() only finds visible key frames
+// and projects their map points on the grid without tracking of patches.
+
+static const int countImageLevels = 3;
+static const int sizeOfSmallImage = 32;
+static const AR::Point2i imageSize(640, 480);
+
+static double randomValue(double min, double max)
+{
+    return min + (std::rand() / (double)RAND_MAX) * (max - min);
+}
+
+static double median(std::vector<double> values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[])
+{
+    int countFrames = 50;
+    int countKeyFrames = 10;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::string(argv[i]) == "--frames") && ((i + 1) < argc)) {
+            countFrames = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::string(argv[i]) == "--keyframes") && ((i + 1) < argc)) {
+            countKeyFrames = std::max(std::atoi(argv[++i]), 2);
+        } else {
+            std::cout << "Usage: MapProjectorBenchmark [--frames N] [--keyframes K]" << std::endl;
+            return 1;
+        }
+    }
+
+    const int countsMapPoints[] = { 1000, 10000, 50000 };
+    std::shared_ptr<const AR::Camera> camera = std::make_shared<AR::Camera>(AR::Camera::defaultCameraParameters,
+                                                                            imageSize.cast<double>());
+    std::vector<AR::Image<uchar>> imagePyramid(countImageLevels);
+    for (int i = 0; i < countImageLevels; ++i) {
+        imagePyramid[i] = AR::Image<uchar>(imageSize / (1 << i));
+        std::fill(imagePyramid[i].data(), imagePyramid[i].data() + imagePyramid[i].area(), (uchar)128);
+    }
+    TMath::TMatrixd rotation = TMath::TMatrixd::Identity(3);
+    TMath::TVectord translation = TMath::TVectord::create(0.0, 0.0, 0.0);
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << std::right << std::setw(10) << "MapPoints" << std::setw(14) << "frame, ms" << std::endl;
+    for (int countMapPoints : countsMapPoints) {
+        std::srand(countMapPoints);
+        AR::Map map(countImageLevels, sizeOfSmallImage);
+        AR::MapResourcesManager resourcesManager;
+        AR::BuilderTypePoint builderTypeMapPoint, builderTypeCandidatePoint;
+        AR::MapProjector mapProjector;
+        mapProjector.setMap(&map);
+        mapProjector.setMapResourceManager(&resourcesManager);
+        mapProjector.setBuilderTypeMapPoint(&builderTypeMapPoint);
+        mapProjector.setBuilderTypeCandidatePoint(&builderTypeCandidatePoint);
+        mapProjector.setMaxNumberOfUsedKeyFrames((std::size_t)countKeyFrames);
+        mapProjector.setMaxNumberOfFeaturesOnFrame(0);
+
+        std::vector<std::shared_ptr<AR::KeyFrame>> keyFrames;
+        for (int i = 0; i < countKeyFrames; ++i)
+            keyFrames.push_back(map.createKeyFrame(camera, imagePyramid, rotation, translation));
+        for (int i = 0; i < countMapPoints; ++i) {
+            AR::Point2f imagePoint((float)randomValue(20.0, imageSize.x - 20.0),
+                                   (float)randomValue(20.0, imageSize.y - 20.0));
+            AR::Point2d cameraPoint = camera->unproject(imagePoint);
+            double depth = randomValue(1.0, 5.0);
+            std::shared_ptr<AR::MapPoint> mapPoint = map.createMapPoint(
+                        TMath::TVectord::create(cameraPoint.x * depth, cameraPoint.y * depth, depth));
+            for (int j = 0; j < 2; ++j)
+                map.createFeature(keyFrames[(i + j) % countKeyFrames], imagePoint, 0, mapPoint);
+        }
+
+        std::vector<double> times;
+        for (int f = 0; f < countFrames; ++f) {
+            AR::PreviewFrame previewFrame(camera, imagePyramid, rotation, translation);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            mapProjector.projectMapPoints(previewFrame, previewFrame);
+            times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - start).count() * 1e-6);
+        }
+        std::cout << std::right << std::setw(10) << countMapPoints
+                  << std::setw(14) << median(times) << std::endl;
+    }
+    return 0;
+}
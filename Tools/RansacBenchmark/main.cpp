@@ -0,0 +1,230 @@
+#include "AR/Ransac.h"
+#include "AR/Point2.h"
+#include "TMath/TMath.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <string>
+
+// Count of hypotheses, time and quality of AR::Ransac on synthetic two-view data of a plane with known outliers.
+// Usage:
+//     RansacBenchmark [--points N] [--trials N] [--threads N]
+// Points of a plane are projected to two cameras with noise 0.5 pixel, a part of matches is replaced by random points.
+// Scores of inliers are higher on average (like scores of corners), points are sorted by scores for PROSAC.
+// Homographies are estimated from 4 points like in AR::MapInitializer, max error is 3 pixels,
+// the best homography is recomputed from its inliers, the recall is the part of real inliers found by it.
+// The reference is the fixed count of hypotheses (confidence 1) with uniform sampling.
+// Adaptive termination (confidence 0.99), progressive sampling and threads must find the same part of real inliers
+// (not less than the reference - 0.02).
+
+static const double focalLength = 500.0;
+static const double maxSquarePixelError = 9.0;
+static const int maxCountIterations = 1000;
+
+struct HomographyEstimator
+{
+    typedef TMath::TMatrixd Model;
+    static const int sampleSize = 4;
+    static const int maxCountModels = 1;
+
+    const std::vector<AR::Point2d> & first;
+    const std::vector<AR::Point2d> & second;
+    std::vector<std::unique_ptr<TMath::TSVD<double>>> svds;
+
+    HomographyEstimator(const std::vector<AR::Point2d> & first, const std::vector<AR::Point2d> & second,
+                        int countThreads):
+        first(first), second(second)
+    {
+        for (int i = 0; i < countThreads; ++i)
+            svds.emplace_back(new TMath::TSVD<double>());
+    }
+
+    int computeModels(Model * models, const int * sample, int thread)
+    {
+        models[0] = findHomography(sample, sampleSize, *svds[thread]);
+        return 1;
+    }
+
+    Model findHomography(const int * indices, int countIndices, TMath::TSVD<double> & svd) const
+    {
+        TMath::TMatrixd M(std::max(countIndices * 2, 9), 9);
+        M.setZero();
+        double * dataRow = M.firstDataRow();
+        for (int i = 0; i < countIndices; ++i) {
+            const AR::Point2d & a = first[indices[i]];
+            const AR::Point2d & b = second[indices[i]];
+            const double rows[18] = {
+                a.x, a.y, 1.0, 0.0, 0.0, 0.0, - a.x * b.x, - a.y * b.x, - b.x,
+                0.0, 0.0, 0.0, a.x, a.y, 1.0, - a.x * b.y, - a.y * b.y, - b.y
+            };
+            std::copy(rows, rows + 18, dataRow);
+            dataRow = &dataRow[18];
+        }
+        svd.compute(M, false);
+        return TMath::TMatrixd(3, 3, svd.V_transposed().getDataRow(8));
+    }
+
+    double error(const Model & model, int point) const
+    {
+        const double * h = model.data();
+        const AR::Point2d & a = first[point];
+        const AR::Point2d & b = second[point];
+        const double z = h[6] * a.x + h[7] * a.y + h[8];
+        const double dx = (h[0] * a.x + h[1] * a.y + h[2]) / z - b.x;
+        const double dy = (h[3] * a.x + h[4] * a.y + h[5]) / z - b.y;
+        return (dx * dx + dy * dy) * (focalLength * focalLength);
+    }
+};
+
+struct Scene
+{
+    std::vector<AR::Point2d> first;
+    std::vector<AR::Point2d> second;
+    std::vector<bool> inliers;
+};
+
+static Scene createScene(int countPoints, double outlierRatio, unsigned int seed)
+{
+    TMath::Random_mt19937 rnd(seed);
+    TMath::TMatrixd R = TMath::TTools::exp_rotationMatrix(TMath::TVectord::create(0.02, -0.1, 0.03));
+    TMath::TVectord t = TMath::TVectord::create(0.4, 0.05, 0.1);
+    const double noise = 0.5 / focalLength;
+    std::vector<std::pair<double, int>> scores(countPoints);
+    Scene unsorted;
+    for (int i = 0; i < countPoints; ++i) {
+        double x = rnd.uniform(-1.0, 1.0), y = rnd.uniform(-1.0, 1.0);
+        TMath::TVectord v = TMath::TVectord::create(x, y, 4.0 + 0.3 * x + 0.2 * y);
+        TMath::TVectord u = R * v + t;
+        bool inlier = (rnd.uniform(0.0, 1.0) >= outlierRatio);
+        unsorted.first.push_back(AR::Point2d(v(0) / v(2) + rnd.uniform(-noise, noise),
+                                             v(1) / v(2) + rnd.uniform(-noise, noise)));
+        if (inlier)
+            unsorted.second.push_back(AR::Point2d(u(0) / u(2) + rnd.uniform(-noise, noise),
+                                                  u(1) / u(2) + rnd.uniform(-noise, noise)));
+        else
+            unsorted.second.push_back(AR::Point2d(rnd.uniform(-0.4, 0.4), rnd.uniform(-0.4, 0.4)));
+        unsorted.inliers.push_back(inlier);
+        scores[i] = std::make_pair(inlier ? rnd.uniform(0.3, 1.0) : rnd.uniform(0.0, 1.0), i);
+    }
+    std::sort(scores.begin(), scores.end(), [] (const std::pair<double, int> & a, const std::pair<double, int> & b) {
+        return a.first > b.first;
+    });
+    Scene scene;
+    for (int i = 0; i < countPoints; ++i) {
+        scene.first.push_back(unsorted.first[scores[i].second]);
+        scene.second.push_back(unsorted.second[scores[i].second]);
+        scene.inliers.push_back(unsorted.inliers[scores[i].second]);
+    }
+    return scene;
+}
+
+struct Variant
+{
+    std::string name;
+    double confidence;
+    bool progressive;
+    int countThreads;
+};
+
+struct VariantResult
+{
+    double iterations;
+    double time;
+    double recall;
+};
+
+static VariantResult runVariant(const Variant & variant, const std::vector<Scene> & scenes)
+{
+    AR::Ransac ransac;
+    ransac.setMaxCountIterations(maxCountIterations);
+    ransac.setConfidence(variant.confidence);
+    ransac.setCountThreads(variant.countThreads);
+    VariantResult result = { 0.0, 0.0, 0.0 };
+    for (std::size_t k = 0; k < scenes.size(); ++k) {
+        const Scene & scene = scenes[k];
+        HomographyEstimator estimator(scene.first, scene.second, ransac.countThreads());
+        ransac.setSeed((unsigned int)(k * 7919 + 1));
+        TMath::TMatrixd homography;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool found = ransac.run(homography, estimator, (int)scene.first.size(), maxSquarePixelError, variant.progressive);
+        result.time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start).count() * 1e-6;
+        result.iterations += ransac.countIterations();
+        if (found) {
+            // like AR::MapInitializer the homography is recomputed from all inliers
+            std::vector<int> inliers;
+            for (int i = 0; i < (int)scene.first.size(); ++i) {
+                if (estimator.error(homography, i) <= maxSquarePixelError)
+                    inliers.push_back(i);
+            }
+            homography = estimator.findHomography(inliers.data(), (int)inliers.size(), *estimator.svds[0]);
+        }
+        int countInliers = 0, countFound = 0;
+        for (std::size_t i = 0; i < scene.inliers.size(); ++i) {
+            if (!scene.inliers[i])
+                continue;
+            ++countInliers;
+            if (found && (estimator.error(homography, (int)i) <= maxSquarePixelError))
+                ++countFound;
+        }
+        result.recall += (countInliers > 0) ? (countFound / (double)countInliers) : 1.0;
+    }
+    result.iterations /= scenes.size();
+    result.time /= scenes.size();
+    result.recall /= scenes.size();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int countPoints = 300;
+    int countTrials = 20;
+    int countThreads = 0;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::string(argv[i]) == "--points") && ((i + 1) < argc)) {
+            countPoints = std::max(std::atoi(argv[++i]), 8);
+        } else if ((std::string(argv[i]) == "--trials") && ((i + 1) < argc)) {
+            countTrials = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::string(argv[i]) == "--threads") && ((i + 1) < argc)) {
+            countThreads = std::atoi(argv[++i]);
+        } else {
+            std::cout << "Usage: RansacBenchmark [--points N] [--trials N] [--threads N]" << std::endl;
+            return 1;
+        }
+    }
+
+    const double outlierRatios[] = { 0.1, 0.3, 0.5, 0.7 };
+    const Variant variants[] = {
+        { "Fixed", 1.0, false, 1 },
+        { "Adaptive", 0.99, false, 1 },
+        { "Adaptive+PROSAC", 0.99, true, 1 },
+        { "Adaptive+PROSAC+threads", 0.99, true, countThreads }
+    };
+
+    bool allEqual = true;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::left << std::setw(10) << "Outliers" << std::setw(26) << "Variant" << std::right
+              << std::setw(12) << "iterations" << std::setw(12) << "time, ms" << std::setw(12) << "speedup"
+              << std::setw(12) << "recall" << std::endl;
+    for (double outlierRatio : outlierRatios) {
+        std::vector<Scene> scenes;
+        for (int k = 0; k < countTrials; ++k)
+            scenes.push_back(createScene(countPoints, outlierRatio, (unsigned int)(k + 1)));
+        // the first variant is the reference of speedups and recalls
+        const VariantResult reference = runVariant(variants[0], scenes);
+        for (const Variant & variant : variants) {
+            VariantResult result = (&variant == &variants[0]) ? reference : runVariant(variant, scenes);
+            bool equal = (result.recall >= reference.recall - 0.02);
+            allEqual = allEqual && equal;
+            std::cout << std::left << std::setw(10) << outlierRatio << std::setw(26) << variant.name << std::right
+                      << std::setw(12) << result.iterations << std::setw(12) << result.time
+                      << std::setw(12) << (reference.time / result.time) << std::setw(12) << result.recall
+                      << (equal ? "" : "  MISMATCH") << std::endl;
+        }
+    }
+    return allEqual ? 0 : 1;
+}
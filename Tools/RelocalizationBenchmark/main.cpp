@@ -0,0 +1,256 @@
+#include "AR/Map.h"
+#include "AR/KeyFrame.h"
+#include "AR/Frame.h"
+#include "AR/Camera.h"
+#include "AR/ImageProcessing.h"
+#include "AR/RelocalizationIndex.h"
+#include "AR/MapResourcesManager.h"
+#include "TMath/TMath.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+// Comparison of AR::RelocalizationIndex with the full scan of small images of key frames
+// and of spatial queries of AR::Map with the full scan of world positions of key frames.
+// Usage:
+//     RelocalizationBenchmark [--queries N] [--candidates K]
+// Key frames are made from random smooth images, queries are shifted and noisy images of random key frames.
+// Recall is the part of queries for which the index gives the same scores of K best key frames as the full scan.
+// Key frames of spatial queries have random poses, queries are random positions and directions,
+// recall is the part of queries for which nearest, furthest and K nearest key frames are equal to the full scan.
+
+static const int countImageLevels = 3;
+static const int sizeOfSmallImage = 32;
+static const AR::Point2i imageSize(320, 240);
+static const AR::Point2i gridSize(9, 7);
+
+static AR::Image<uchar> createImage(const std::vector<int> & grid, const AR::Point2i & shift, int noise)
+{
+    AR::Image<uchar> image(imageSize);
+    for (int y = 0; y < imageSize.y; ++y) {
+        for (int x = 0; x < imageSize.x; ++x) {
+            float gx = ((x + shift.x) / (float)imageSize.x) * (gridSize.x - 2);
+            float gy = ((y + shift.y) / (float)imageSize.y) * (gridSize.y - 2);
+            int ix = std::max(0, std::min((int)gx, gridSize.x - 2));
+            int iy = std::max(0, std::min((int)gy, gridSize.y - 2));
+            float fx = std::max(0.0f, std::min(gx - ix, 1.0f)), fy = std::max(0.0f, std::min(gy - iy, 1.0f));
+            float v = (grid[iy * gridSize.x + ix] * (1.0f - fx) + grid[iy * gridSize.x + ix + 1] * fx) * (1.0f - fy) +
+                    (grid[(iy + 1) * gridSize.x + ix] * (1.0f - fx) + grid[(iy + 1) * gridSize.x + ix + 1] * fx) * fy;
+            if (noise > 0)
+                v += (std::rand() % (2 * noise + 1)) - noise;
+            image(x, y) = (uchar)std::max(0, std::min((int)v, 255));
+        }
+    }
+    return image;
+}
+
+static std::vector<AR::Image<uchar>> createImagePyramid(const AR::Image<uchar> & image)
+{
+    std::vector<AR::Image<uchar>> imagePyramid(countImageLevels);
+    imagePyramid[0] = image;
+    for (int i = 1; i < countImageLevels; ++i) {
+        imagePyramid[i] = AR::Image<uchar>(imagePyramid[i - 1].size() / 2);
+        AR::ImageProcessing::halfSample(imagePyramid[i], imagePyramid[i - 1]);
+    }
+    return imagePyramid;
+}
+
+static std::vector<int> fullScan(const AR::Map & map, const AR::ConstImage<int> & smallImage, std::size_t count)
+{
+    std::vector<int> scores;
+    for (std::size_t i = 0; i < map.countKeyFrames(); ++i) {
+        AR::ConstImage<int> keyFrameSmallImage = map.keyFrame(i)->smallImage();
+        int score = 0;
+        for (int j = 0; j < smallImage.area(); ++j) {
+            int d = keyFrameSmallImage.data()[j] - smallImage.data()[j];
+            score += d * d;
+        }
+        scores.push_back(score);
+    }
+    std::sort(scores.begin(), scores.end());
+    scores.resize(std::min(scores.size(), count));
+    return scores;
+}
+
+static double randomValue(double range)
+{
+    return ((std::rand() / (double)RAND_MAX) * 2.0 - 1.0) * range;
+}
+
+static TMath::TVectord randomDir()
+{
+    TMath::TVectord dir = TMath::TVectord::create(randomValue(1.0), randomValue(1.0), randomValue(1.0));
+    return dir / std::max(dir.length(), 1e-6);
+}
+
+struct SpatialResult
+{
+    const AR::KeyFrame * nearest;
+    const AR::KeyFrame * furthest;
+    std::vector<const AR::KeyFrame*> nearestKeyFrames;
+
+    bool operator == (const SpatialResult & b) const
+    {
+        return (nearest == b.nearest) && (furthest == b.furthest) && (nearestKeyFrames == b.nearestKeyFrames);
+    }
+};
+
+static SpatialResult spatialScan(AR::Map & map, const TMath::TVectord & position, const TMath::TVectord & dir,
+                                 std::size_t count)
+{
+    SpatialResult result = { nullptr, nullptr, {} };
+    double minDistance = std::numeric_limits<double>::max(), maxDistance = -1.0;
+    std::vector<std::pair<double, std::size_t>> distances;
+    for (std::size_t i = 0; i < map.countKeyFrames(); ++i) {
+        std::shared_ptr<AR::KeyFrame> keyFrame = map.keyFrame(i);
+        TMath::TVectord worldPosition = keyFrame->worldPosition();
+        double distance = (worldPosition - position).lengthSquared();
+        if ((TMath::dot(keyFrame->rotation().getRow(2, 3), dir) > 0.0) && (distance < minDistance)) {
+            minDistance = distance;
+            result.nearest = keyFrame.get();
+        }
+        if (distance > maxDistance) {
+            maxDistance = distance;
+            result.furthest = keyFrame.get();
+        }
+        distances.push_back(std::make_pair(distance, i));
+    }
+    std::sort(distances.begin(), distances.end());
+    for (std::size_t i = 0; i < std::min(count, distances.size()); ++i)
+        result.nearestKeyFrames.push_back(map.keyFrame(distances[i].second).get());
+    return result;
+}
+
+static SpatialResult spatialQueries(AR::Map & map, const TMath::TVectord & position, const TMath::TVectord & dir,
+                                    std::size_t count)
+{
+    SpatialResult result;
+    result.nearest = map.getNearestKeyFrame(nullptr, position, dir).get();
+    result.furthest = map.getFurthestKeyFrame(nullptr, position).get();
+    std::vector<std::shared_ptr<AR::KeyFrame>> keyFrames = map.getNearestKeyFrames(position, count);
+    for (const std::shared_ptr<AR::KeyFrame> & keyFrame : keyFrames)
+        result.nearestKeyFrames.push_back(keyFrame.get());
+    return result;
+}
+
+template <typename Function>
+static double measure(Function function)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() * 1e-6;
+}
+
+static double median(std::vector<double> values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[])
+{
+    int countQueries = 200;
+    std::size_t countCandidates = 5;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::string(argv[i]) == "--queries") && ((i + 1) < argc)) {
+            countQueries = std::max(std::atoi(argv[++i]), 1);
+        } else if ((std::string(argv[i]) == "--candidates") && ((i + 1) < argc)) {
+            countCandidates = (std::size_t)std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::cout << "Usage: RelocalizationBenchmark [--queries N] [--candidates K]" << std::endl;
+            return 1;
+        }
+    }
+
+    const int countsKeyFrames[] = { 10, 100, 300, 1000 };
+    std::shared_ptr<const AR::Camera> camera = std::make_shared<AR::Camera>(AR::Camera::defaultCameraParameters,
+                                                                            imageSize.cast<double>());
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << std::right << std::setw(10) << "KeyFrames" << std::setw(12) << "scan, ms" << std::setw(12) << "index, ms" << std::setw(14) << "comparisons"
+              << std::setw(10) << "recall" << std::endl;
+    bool allFound = true;
+    for (int countKeyFrames : countsKeyFrames) {
+        std::srand(countKeyFrames);
+        AR::Map map(countImageLevels, sizeOfSmallImage);
+        AR::RelocalizationIndex index;
+        map.addListener(&index);
+        std::vector<std::vector<int>> grids;
+        for (int i = 0; i < countKeyFrames; ++i) {
+            std::vector<int> grid(gridSize.x * gridSize.y);
+            for (int & v : grid)
+                v = std::rand() % 256;
+            grids.push_back(grid);
+            map.createKeyFrame(camera, createImagePyramid(createImage(grid, AR::Point2i(0, 0), 0)));
+        }
+
+        std::vector<double> scanTimes, indexTimes;
+        std::size_t countFound = 0, countComparisons = 0;
+        for (int q = 0; q < countQueries; ++q) {
+            const std::vector<int> & grid = grids[std::rand() % countKeyFrames];
+            AR::Point2i shift(std::rand() % 21 - 10, std::rand() % 21 - 10);
+            AR::Frame frame(camera, createImagePyramid(createImage(grid, shift, 10)));
+            AR::Image<int> smallImage = map.getSmallImage(frame);
+
+            std::vector<int> expected;
+            std::vector<AR::RelocalizationIndex::Candidate> candidates;
+            scanTimes.push_back(measure([&] () { expected = fullScan(map, smallImage, countCandidates); }));
+            indexTimes.push_back(measure([&] () { candidates = index.find(smallImage, countCandidates); }));
+            countComparisons += index.lastCountComparisons();
+            bool found = (candidates.size() == expected.size());
+            for (std::size_t i = 0; found && (i < candidates.size()); ++i)
+                found = (candidates[i].score == expected[i]);
+            if (found)
+                ++countFound;
+        }
+        allFound = allFound && (countFound == (std::size_t)countQueries);
+        std::cout << std::right << std::setw(10) << countKeyFrames
+                  << std::setw(12) << median(scanTimes)
+                  << std::setw(12) << median(indexTimes)
+                  << std::setw(14) << (countComparisons / (double)countQueries)
+                  << std::setw(10) << (countFound / (double)countQueries) << std::endl;
+        map.removeListener(&index);
+    }
+
+    std::cout << std::endl;
+    std::cout << std::right << std::setw(10) << "KeyFrames" << std::setw(12) << "scan, ms" << std::setw(12) << "index, ms"
+              << std::setw(10) << "recall" << std::endl;
+    std::vector<AR::Image<uchar>> imagePyramid = createImagePyramid(AR::Image<uchar>(imageSize));
+    for (int countKeyFrames : countsKeyFrames) {
+        std::srand(countKeyFrames);
+        AR::Map map(countImageLevels, sizeOfSmallImage);
+        AR::MapResourcesManager resourcesManager;
+        for (int i = 0; i < countKeyFrames; ++i) {
+            std::shared_ptr<AR::KeyFrame> keyFrame = map.createKeyFrame(camera, imagePyramid);
+            TMath::TMatrixd rotation = TMath::TTools::exp_rotationMatrix(randomDir() * randomValue(M_PI));
+            keyFrame->setRotation(rotation);
+            keyFrame->setTranslation(- (rotation * TMath::TVectord::create(randomValue(10.0), randomValue(10.0),
+                                                                         randomValue(10.0))));
+        }
+        // deleted key frames move last key frames on their places
+        for (int i = 0; i < countKeyFrames / 10; ++i)
+            map.deleteKeyFrame(&resourcesManager, map.keyFrame(std::rand() % map.countKeyFrames()));
+
+        std::vector<double> scanTimes, indexTimes;
+        std::size_t countFound = 0;
+        for (int q = 0; q < countQueries; ++q) {
+            TMath::TVectord position = TMath::TVectord::create(randomValue(12.0), randomValue(12.0), randomValue(12.0));
+            TMath::TVectord dir = randomDir();
+            SpatialResult expected, result;
+            scanTimes.push_back(measure([&] () { expected = spatialScan(map, position, dir, countCandidates); }));
+            indexTimes.push_back(measure([&] () { result = spatialQueries(map, position, dir, countCandidates); }));
+            if (result == expected)
+                ++countFound;
+        }
+        allFound = allFound && (countFound == (std::size_t)countQueries);
+        std::cout << std::right << std::setw(10) << countKeyFrames
+                  << std::setw(12) << median(scanTimes)
+                  << std::setw(12) << median(indexTimes)
+                  << std::setw(10) << (countFound / (double)countQueries) << std::endl;
+    }
+    return allFound ? 0 : 1;
+}